@@ -0,0 +1,160 @@
+// Heap allocations and time per text command through the whole session
+// path: read into the ring, parse, dispatch, format, queue, flush. The
+// Connection sits on one end of a socket pair and is driven by hand, as
+// in ConnectionTest. The WebSocket rows send each command as a masked text
+// message, as browsers do, to compare with raw TCP; the stats row counts
+// every command for the stats endpoint. Run with `make bench`.
+#include "Connection.h"
+#include "UserManager.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+namespace {
+std::atomic<size_t> allocations{0};
+}
+
+// Every allocation in the process goes through here
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+constexpr int PIPELINE = 64;   // Commands per read
+constexpr int WARMUP = 100;    // Rounds before measuring: buffers reach their working size
+constexpr int ROUNDS = 20000;
+
+void measure(const char* name, const std::string& command, Connection& connection, int client)
+{
+    std::string batch;
+    for (int i = 0; i < PIPELINE; ++i) {
+        batch += command;
+    }
+    char sink[64 * 1024];
+
+    auto round = [&]() {
+        if (write(client, batch.data(), batch.size()) != static_cast<ssize_t>(batch.size())) {
+            std::cerr << "short write" << std::endl;
+            std::exit(1);
+        }
+        connection.onReady(EPOLLIN);
+        while (read(client, sink, sizeof(sink)) > 0) {
+        }
+    };
+
+    for (int i = 0; i < WARMUP; ++i) {
+        round();
+    }
+
+    size_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; ++i) {
+        round();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t allocated = allocations.load() - before;
+
+    double commands = double(ROUNDS) * PIPELINE;
+    std::cout << name << ": " << allocated / commands << " allocations/command, "
+              << seconds / commands * 1e9 << " ns/command (incl. socket I/O)" << std::endl;
+}
+
+// @p command as one masked client text message
+std::string webSocketMessage(const std::string& command)
+{
+    const char key[4] = {'\x12', '\x34', '\x56', '\x78'};
+    std::string frame = {'\x81', static_cast<char>(0x80 | command.size())};
+    frame.append(key, 4);
+    for (size_t i = 0; i < command.size(); ++i) {
+        frame.push_back(static_cast<char>(command[i] ^ key[i % 4]));
+    }
+    return frame;
+}
+
+// A started Connection on one end of a new socket pair; returns the other end
+std::shared_ptr<Connection> openSession(UserManager& userManager, bool webSocket, int& client,
+                                        ServerStats* stats = nullptr)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cerr << "socketpair failed" << std::endl;
+        std::exit(1);
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+
+    sockaddr_in addr = {};
+    auto connection = std::make_shared<Connection>(fds[0], addr, userManager);
+    if (webSocket) {
+        connection->setWebSocket();
+    }
+    connection->setStats(stats);
+    connection->start([](uint32_t) { return Connection::ArmResult::Armed; }, []() {});
+    client = fds[1];
+
+    if (webSocket) {
+        std::string request = "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        if (write(client, request.data(), request.size()) != static_cast<ssize_t>(request.size())) {
+            std::cerr << "short write" << std::endl;
+            std::exit(1);
+        }
+        connection->onReady(EPOLLIN);
+        char sink[1024];
+        while (read(client, sink, sizeof(sink)) > 0) {
+        }
+    }
+    return connection;
+}
+}
+
+int main()
+{
+    UserManager userManager;
+    userManager.registerUser("alice", "secret");
+    userManager.loginUser("alice", "secret", "10.0.0.2", 6000);
+
+    int client;
+    auto connection = openSession(userManager, false, client);
+    measure("GETINFO alice            ", "GETINFO alice\n", *connection, client);
+    measure("GETINFO nobody           ", "GETINFO nobody\n", *connection, client);
+    measure("PING                     ", "PING\n", *connection, client);
+    connection.reset();
+    close(client);
+
+    ServerStats stats;
+    connection = openSession(userManager, false, client, &stats);
+    measure("GETINFO alice (stats)    ", "GETINFO alice\n", *connection, client);
+    connection.reset();
+    close(client);
+
+    connection = openSession(userManager, true, client);
+    measure("GETINFO alice (WebSocket)", webSocketMessage("GETINFO alice"), *connection, client);
+    measure("PING (WebSocket)         ", webSocketMessage("PING"), *connection, client);
+    connection.reset();
+    close(client);
+    return 0;
+}
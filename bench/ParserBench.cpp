@@ -0,0 +1,104 @@
+// Throughput of the input path: socket-sized chunks copied into a
+// RingBuffer, then every complete command parsed out of it. Run with
+// `make bench`.
+#include "RingBuffer.h"
+#include "LineParser.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+constexpr size_t COMMANDS = 200000;
+constexpr int ROUNDS = 20;
+
+std::string textStream()
+{
+    const char* commands[] = {"GETINFO alice\n", "PING\n", "LOGIN bob secret 10.0.0.2 5000\n",
+                              "REGISTER carol hunter2\n", "LOGOUT bob\r\n"};
+    std::string stream;
+    for (size_t i = 0; i < COMMANDS; ++i) {
+        stream += commands[i % 5];
+    }
+    return stream;
+}
+
+std::string frameStream()
+{
+    std::string stream;
+    FrameWriter writer(stream);
+    for (size_t i = 0; i < COMMANDS; ++i) {
+        writer.start(Opcode::GetInfo, static_cast<uint32_t>(i));
+        writer.writeString("alice");
+        writer.finish();
+    }
+    return stream;
+}
+
+// Feeds @p stream in @p chunk byte reads; returns commands parsed
+template <typename Parse>
+size_t run(const std::string& stream, size_t chunk, Parse parse)
+{
+    RingBuffer ring;
+    size_t commands = 0;
+    size_t offset = 0;
+    while (offset < stream.size()) {
+        ring.reserve(chunk);
+        size_t size = std::min({chunk, ring.writable(), stream.size() - offset});
+        std::memcpy(ring.writeData(), stream.data() + offset, size);
+        ring.commit(size);
+        offset += size;
+        commands += parse(ring);
+    }
+    return commands;
+}
+
+template <typename Parse>
+void report(const char* name, const std::string& stream, size_t chunk, Parse parse)
+{
+    size_t commands = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        commands += run(stream, chunk, parse);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ", " << chunk << " byte reads: "
+              << (stream.size() * ROUNDS / seconds) / (1024 * 1024) << " MiB/s, "
+              << (commands / seconds) / 1e6 << " M commands/s" << std::endl;
+}
+}
+
+int main()
+{
+    std::string text = textStream();
+    std::string frames = frameStream();
+
+    LineParser lineParser;
+    auto parseLines = [&lineParser](RingBuffer& ring) {
+        size_t count = 0;
+        std::string_view line;
+        while (lineParser.next(ring, line) == LineParser::Result::Line) {
+            ++count;
+        }
+        return count;
+    };
+
+    FrameParser frameParser;
+    auto parseFrames = [&frameParser](RingBuffer& ring) {
+        size_t count = 0;
+        Frame frame;
+        while (frameParser.next(ring, frame) == FrameParser::Result::Frame) {
+            ++count;
+        }
+        return count;
+    };
+
+    for (size_t chunk : {size_t(1024), size_t(16 * 1024)}) {
+        report("text lines", text, chunk, parseLines);
+        report("v2 frames ", frames, chunk, parseFrames);
+    }
+    return 0;
+}
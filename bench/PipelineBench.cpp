@@ -0,0 +1,70 @@
+// Bulk GETINFO over loopback: one round trip per lookup with
+// Client::getClientInfo(), against tagged pipelining with
+// Client::getClientInfos() and MGETINFO batches with
+// Client::getClientInfoBatch(). Run with `make bench`.
+#include "Server.h"
+#include "Client.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr int PORT = 9190;
+constexpr uint16_t LISTEN_PORT = 9191;
+constexpr size_t LOOKUPS = 20000;
+
+template <typename Run>
+void report(const char* name, Run run)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t found = run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << LOOKUPS / seconds << " lookups/s (" << found << " found)" << std::endl;
+}
+}
+
+int main()
+{
+    ServerOptions options;
+    options.ipCommandRate = 0; // Measure the protocol, not the limiter
+    options.userCommandRate = 0;
+    Server server(PORT, 4, options);
+    std::thread serverThread([&server]() { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    {
+        Client client(LISTEN_PORT, "127.0.0.1", PORT);
+        client.registerWithServer("alice", "secret");
+        client.loginToServer("alice", "secret");
+        std::vector<std::string> usernames(LOOKUPS, "alice");
+
+        std::cout << LOOKUPS << " lookups:" << std::endl;
+        report("one per round trip", [&]() {
+            size_t found = 0;
+            for (const std::string& username : usernames) {
+                found += client.getClientInfo(username).second != 0;
+            }
+            return found;
+        });
+        report("pipelined, tagged ", [&]() {
+            size_t found = 0;
+            for (const auto& address : client.getClientInfos(usernames)) {
+                found += address.second != 0;
+            }
+            return found;
+        });
+        report("MGETINFO batches  ", [&]() {
+            size_t found = 0;
+            for (const auto& address : client.getClientInfoBatch(usernames)) {
+                found += address.second != 0;
+            }
+            return found;
+        });
+    }
+
+    server.stop();
+    serverThread.join();
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Command framing and tokenizing at each DelimiterScan level, against the
+// istringstream path the server used before. Run with `make bench`.
+#include "RingBuffer.h"
+#include "LineParser.h"
+#include "CommandTable.h"
+#include "DelimiterScan.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+constexpr int ROUNDS = 20;
+
+const char* levelName(ScanLevel level)
+{
+    switch (level) {
+    case ScanLevel::Scalar:
+        return "scalar";
+    case ScanLevel::Sse2:
+        return "sse2  ";
+    case ScanLevel::Avx2:
+        return "avx2  ";
+    }
+    return "?";
+}
+
+// Pipelined commands with a padding argument of @p padding bytes, so
+// delimiters are that far apart
+std::string commandStream(size_t padding)
+{
+    std::string stream;
+    std::string pad(padding, 'p');
+    while (stream.size() < 8 * 1024 * 1024) {
+        stream += "GETINFO alice " + pad + "\n";
+        stream += "LOGIN bob secret 10.0.0.2 5000 " + pad + "\n";
+    }
+    return stream;
+}
+
+template <typename Run>
+void report(const char* name, const std::string& stream, Run run)
+{
+    size_t tokens = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        tokens += run(stream);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << (stream.size() * ROUNDS / seconds) / (1024 * 1024) << " MiB/s ("
+              << tokens / ROUNDS << " tokens)" << std::endl;
+}
+
+// The old path: one std::string and one istringstream per command
+size_t istringstreamPath(const std::string& stream)
+{
+    size_t tokens = 0;
+    std::istringstream lines(stream);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream iss(line);
+        std::string token;
+        while (iss >> token) {
+            ++tokens;
+        }
+    }
+    return tokens;
+}
+
+// The new path: 16 KiB reads into the ring, LineParser, nextToken()
+size_t ringPath(const std::string& stream)
+{
+    RingBuffer ring;
+    LineParser parser;
+    size_t tokens = 0;
+    for (size_t offset = 0; offset < stream.size();) {
+        size_t size = std::min<size_t>(16 * 1024, stream.size() - offset);
+        ring.append(stream.data() + offset, size);
+        offset += size;
+
+        std::string_view line;
+        while (parser.next(ring, line) == LineParser::Result::Line) {
+            while (!nextToken(line).empty()) {
+                ++tokens;
+            }
+        }
+    }
+    return tokens;
+}
+}
+
+int main()
+{
+    for (size_t padding : {size_t(0), size_t(64), size_t(1000)}) {
+        std::string stream = commandStream(padding);
+        std::cout << "commands padded by " << padding << " bytes:" << std::endl;
+        report("istringstream", stream, istringstreamPath);
+
+        for (ScanLevel level : {ScanLevel::Scalar, ScanLevel::Sse2, ScanLevel::Avx2}) {
+            if (setScanLevel(level) != level) {
+                continue; // Not supported by this CPU
+            }
+            std::string name = std::string("ring + ") + levelName(level);
+            report(name.c_str(), stream, ringPath);
+        }
+        setScanLevel(detectScanLevel());
+    }
+    return 0;
+}
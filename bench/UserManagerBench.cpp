@@ -0,0 +1,126 @@
+// UserManager under contention: 1, 2, 4, ... threads each running a
+// login-peak mix (LOGIN, GETINFO of someone else, LOGOUT) on their own
+// users, with the whole table behind one lock (1 shard) against the
+// default sharding, and then GETINFO alone, which takes no lock at all.
+// Last, listing the online users of a large table: the whole-list copy
+// against paging through a listing. Run with `make bench`.
+#include "UserManager.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr size_t USERS = 4096;
+constexpr size_t OPS_PER_THREAD = 600000; // Each op is one LOGIN, GETINFO or LOGOUT
+constexpr size_t LISTING_USERS = 200000;   // Registered, one in ten online
+constexpr size_t PAGE_SIZE = 100;
+
+std::vector<std::string> userNames()
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < USERS; ++i) {
+        names.push_back("user" + std::to_string(i));
+    }
+    return names;
+}
+
+// Operations per second over all threads
+double run(size_t shards, size_t threadCount, const std::vector<std::string>& names, bool lookupsOnly)
+{
+    UserManager userManager(shards);
+    for (const std::string& name : names) {
+        userManager.registerUser(name, "secret");
+        userManager.loginUser(name, "secret", "10.0.0.1", 6000);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            std::string ipAddress;
+            uint16_t port;
+            size_t user = t; // Thread t owns users t, t + threadCount, ...
+            if (lookupsOnly) {
+                for (size_t op = 0; op < OPS_PER_THREAD; ++op) {
+                    userManager.getUserAddress(names[user], ipAddress, port);
+                    user = (user + threadCount) % USERS;
+                }
+                return;
+            }
+            for (size_t op = 0; op < OPS_PER_THREAD; op += 3) {
+                const std::string& name = names[user];
+                UserHandle session = userManager.openSession(name, "secret", "10.0.0.1", 6000);
+                userManager.getUserAddress(names[(user * 7 + 1) % USERS], ipAddress, port);
+                userManager.closeSession(session);
+                user = (user + threadCount) % USERS;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(threadCount * OPS_PER_THREAD) / seconds;
+}
+
+template <typename List>
+void timeListing(const char* name, List list)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t listed = list();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << ms << " ms (" << listed << " users)" << std::endl;
+}
+
+void listOnlineUsers()
+{
+    UserManager userManager;
+    for (size_t i = 0; i < LISTING_USERS; ++i) {
+        std::string name = "user" + std::to_string(i);
+        userManager.registerUser(name, "secret");
+        if (i % 10 == 0) {
+            userManager.loginUser(name, "secret", "10.0.0.1", 6000);
+        }
+    }
+
+    std::cout << "Online users, " << LISTING_USERS / 10 << " of " << LISTING_USERS << " registered:" << std::endl;
+    timeListing("getActiveUsers()          ", [&]() { return userManager.getActiveUsers().size(); });
+    timeListing("onlineUsers()             ", [&]() { return userManager.onlineUsers().size(); });
+    OnlineUsers listing = userManager.onlineUsers();
+    timeListing("first page                ", [&]() {
+        std::vector<OnlineUser> page;
+        listing.page(0, PAGE_SIZE, page);
+        return page.size();
+    });
+    timeListing("onlineUsers() + all pages ", [&]() {
+        OnlineUsers all = userManager.onlineUsers();
+        std::vector<OnlineUser> page;
+        size_t listed = 0;
+        for (size_t cursor = 0; cursor < all.size();) {
+            cursor = all.page(cursor, PAGE_SIZE, page);
+            listed += page.size();
+        }
+        return listed;
+    });
+}
+}
+
+int main()
+{
+    std::vector<std::string> names = userNames();
+    size_t maxThreads = std::max(8u, std::thread::hardware_concurrency());
+    std::cout << "UserManager, " << std::thread::hardware_concurrency() << " CPUs (ops/s):" << std::endl;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        double single = run(1, threads, names, false);
+        double sharded = run(USER_SHARDS, threads, names, false);
+        double lookups = run(USER_SHARDS, threads, names, true);
+        std::cout << "  " << threads << " threads: login mix 1 shard " << static_cast<uint64_t>(single) << ", "
+                  << USER_SHARDS << " shards " << static_cast<uint64_t>(sharded) << " (x" << sharded / single
+                  << "); GETINFO only " << static_cast<uint64_t>(lookups) << std::endl;
+    }
+    listOnlineUsers();
+    return 0;
+}
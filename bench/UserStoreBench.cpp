@@ -0,0 +1,141 @@
+// Restart time of a durable user registry: a table of N users (1M, or the
+// first argument) is snapshotted, then loaded back by a fresh UserManager,
+// first from the snapshot alone and then from a log of as many
+// registrations with no snapshot at all. Then the cost of making each
+// registration durable: 1 to 64 threads registering at once, with each
+// log batch synced as soon as the previous one is done or held open for
+// a while, giving registrations/s against the latency one caller sees.
+// Run with `make bench`, or `./bench_store 10000000` for the
+// ten-million-user case.
+#include "UserManager.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr size_t DEFAULT_USERS = 1000000;
+constexpr double GROUP_COMMIT_SECONDS = 0.5; // Per thread count and delay
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t directoryBytes(const std::filesystem::path& directory)
+{
+    uint64_t bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        bytes += entry.file_size();
+    }
+    return bytes;
+}
+
+// Opens the store in a fresh table and reports how long loading took
+void timeLoad(const char* name, const std::filesystem::path& directory, size_t users)
+{
+    UserManager userManager;
+    auto start = std::chrono::steady_clock::now();
+    if (!userManager.openStore(directory)) {
+        std::cerr << "Load failed" << std::endl;
+        std::exit(1);
+    }
+    double seconds = secondsSince(start);
+    std::cout << "  " << name << ": " << seconds * 1000 << " ms (" << userManager.userCount() << " of " << users
+              << " users, " << directoryBytes(directory) / (1024 * 1024) << " MiB on disk, "
+              << static_cast<uint64_t>(userManager.userCount() / seconds) << " users/s)" << std::endl;
+}
+
+// Registers from @p threadCount threads for a while, every registration
+// synced, and reports throughput and per-call latency
+void timeGroupCommit(const std::filesystem::path& directory, size_t threadCount, uint64_t delayUs)
+{
+    std::filesystem::remove_all(directory);
+    UserLogOptions options;
+    options.maxBatchDelayUs = delayUs;
+    UserManager userManager;
+    if (!userManager.openStore(directory, true, options)) {
+        std::cerr << "Open failed" << std::endl;
+        std::exit(1);
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<std::vector<double>> latencies(threadCount); // Microseconds
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            std::string prefix = "user" + std::to_string(t) + "-";
+            for (size_t i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                userManager.registerUser(prefix + std::to_string(i), "secret");
+                latencies[t].push_back(
+                    std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(GROUP_COMMIT_SECONDS));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = secondsSince(start);
+
+    std::vector<double> all;
+    for (const auto& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all.empty() ? 0.0 : all[static_cast<size_t>(p * (all.size() - 1))]; };
+    std::cout << "  " << threadCount << " threads, delay " << delayUs << " us: "
+              << static_cast<uint64_t>(all.size() / seconds) << " registrations/s, latency p50 "
+              << static_cast<uint64_t>(percentile(0.5)) << " us, p99 " << static_cast<uint64_t>(percentile(0.99))
+              << " us" << std::endl;
+}
+}
+
+int main(int argc, char** argv)
+{
+    size_t users = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : DEFAULT_USERS;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bench_store";
+    std::filesystem::remove_all(directory);
+
+    std::cout << "UserStore, " << users << " users:" << std::endl;
+    {
+        // Logged one registration at a time, as a live server would, but
+        // not synced: one thread waiting on every sync would take minutes
+        UserLogOptions options;
+        options.sync = false;
+        UserManager userManager;
+        userManager.openStore(directory, true, options);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < users; ++i) {
+            userManager.registerUser("user" + std::to_string(i), "secret" + std::to_string(i % 1000));
+        }
+        std::cout << "  register (logged):  " << secondsSince(start) * 1000 << " ms" << std::endl;
+    }
+    timeLoad("load, log only     ", directory, users);
+    {
+        UserManager userManager;
+        userManager.openStore(directory);
+        auto start = std::chrono::steady_clock::now();
+        userManager.writeSnapshot();
+        std::cout << "  write snapshot:     " << secondsSince(start) * 1000 << " ms" << std::endl;
+    }
+    timeLoad("load, snapshot     ", directory, users);
+
+    std::cout << "Group commit, every registration synced:" << std::endl;
+    for (uint64_t delayUs : {0, 200, 1000}) {
+        for (size_t threads : {1, 4, 16, 64}) {
+            timeGroupCommit(directory, threads, delayUs);
+        }
+    }
+
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define CLIENT_H
 
 #include <string>
+#include <vector>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <atomic>
@@ -35,6 +36,33 @@ public:
     bool logoutFromServer();
     std::pair<std::string, uint16_t> getClientInfo(const std::string& username);
 
+    /**
+     * @brief Looks up many users in about one round trip instead of one
+     *        each: the GETINFOs go out tagged "#<n>", up to PIPELINE_WINDOW
+     *        in flight, and the replies are matched back by tag, since the
+     *        server may answer them in any order. Lookups refused with
+     *        ERR RATE_LIMITED are sent again once the client has backed
+     *        off; if the server keeps refusing them, that is an error.
+     * @param usernames The users to look up.
+     * @return One {ip, port} per username, in the same order; {"", 0} for
+     *         a user that is not found, or for all of them on error.
+     */
+    std::vector<std::pair<std::string, uint16_t>> getClientInfos(const std::vector<std::string>& usernames);
+
+    /**
+     * @brief Looks up many users with MGETINFO: as many names per command
+     *        as a line takes, so the server takes its user lock once per
+     *        command, and the commands pipelined. Same result, and same
+     *        retries when rate limited, as getClientInfos().
+     */
+    std::vector<std::pair<std::string, uint16_t>> getClientInfoBatch(const std::vector<std::string>& usernames);
+
+    /**
+     * @brief Requests sent ahead of their replies by getClientInfos(); keeps
+     *        both sides from blocking on full socket buffers.
+     */
+    static constexpr size_t PIPELINE_WINDOW = 256;
+
     // P2P Communication
     bool connectToClient(const std::string& ipAddress, uint16_t port);
     bool chatWithClient(const std::string& username);
@@ -49,6 +77,7 @@ private:
     sockaddr_in listenerAddr_;
     pthread_t listenerThread_;  // Listener thread handle
     std::atomic<bool> running_; // Control flag for the listener thread
+    std::string inbox_;         // Received from the server, not yet a full line
 
     // Listener Management
     static void* listenerLoop(void* arg);
@@ -57,6 +86,11 @@ private:
     // Initialization Helpers
     bool initializeListener(uint16_t listenPort);
     bool connectToServer(const std::string& serverIP, uint16_t serverPort);
+
+    // Server I/O Helpers
+    bool sendAll(const std::string& data);
+    bool readLine(std::string& line);
+    bool roundTrip(const std::string& command, std::string& response);
 };
 
 #endif // CLIENT_H
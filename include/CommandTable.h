@@ -0,0 +1,121 @@
+#ifndef COMMANDTABLE_H
+#define COMMANDTABLE_H
+
+#include "DelimiterScan.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief The text protocol's commands.
+ */
+enum class Command : uint8_t {
+    Unknown,
+    Register,
+    Login,
+    Logout,
+    GetInfo,
+    MGetInfo,
+    Ping,
+    Pong,
+    Hello
+};
+
+struct CommandName {
+    std::string_view name;
+    Command command = Command::Unknown;
+};
+
+inline constexpr CommandName COMMAND_NAMES[] = {
+    {"REGISTER", Command::Register},
+    {"LOGIN",    Command::Login},
+    {"LOGOUT",   Command::Logout},
+    {"GETINFO",  Command::GetInfo},
+    {"MGETINFO", Command::MGetInfo},
+    {"PING",     Command::Ping},
+    {"PONG",     Command::Pong},
+    {"HELLO",    Command::Hello},
+};
+
+constexpr size_t COMMAND_TABLE_SIZE = 16; // Power of two, larger than the command count
+
+/**
+ * @brief Seeded FNV-1a; the seed is picked at compile time so that no two
+ *        command names share a slot.
+ */
+constexpr uint32_t commandHash(std::string_view name, uint32_t seed)
+{
+    uint32_t hash = seed;
+    for (char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the first seed that gives every command its own slot, or 0.
+ */
+constexpr uint32_t findCommandSeed()
+{
+    for (uint32_t seed = 1; seed < 100000; ++seed) {
+        bool used[COMMAND_TABLE_SIZE] = {};
+        bool collision = false;
+        for (const CommandName& entry : COMMAND_NAMES) {
+            size_t slot = commandHash(entry.name, seed) & (COMMAND_TABLE_SIZE - 1);
+            collision = collision || used[slot];
+            used[slot] = true;
+        }
+        if (!collision) {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+inline constexpr uint32_t COMMAND_SEED = findCommandSeed();
+static_assert(COMMAND_SEED != 0, "No perfect hash seed: grow COMMAND_TABLE_SIZE");
+
+constexpr std::array<CommandName, COMMAND_TABLE_SIZE> buildCommandTable()
+{
+    std::array<CommandName, COMMAND_TABLE_SIZE> table{};
+    for (const CommandName& entry : COMMAND_NAMES) {
+        table[commandHash(entry.name, COMMAND_SEED) & (COMMAND_TABLE_SIZE - 1)] = entry;
+    }
+    return table;
+}
+
+inline constexpr std::array<CommandName, COMMAND_TABLE_SIZE> COMMAND_TABLE = buildCommandTable();
+
+/**
+ * @brief Maps a command name to its Command with one hash and one compare.
+ *        Case-sensitive, like the protocol.
+ */
+constexpr Command lookupCommand(std::string_view name)
+{
+    const CommandName& entry = COMMAND_TABLE[commandHash(name, COMMAND_SEED) & (COMMAND_TABLE_SIZE - 1)];
+    return entry.name == name ? entry.command : Command::Unknown;
+}
+
+static_assert(lookupCommand("GETINFO") == Command::GetInfo);
+static_assert(lookupCommand("PONG") == Command::Pong);
+static_assert(lookupCommand("MGETINFO") == Command::MGetInfo);
+static_assert(lookupCommand("GETINF") == Command::Unknown);
+static_assert(lookupCommand("") == Command::Unknown);
+
+/**
+ * @brief Splits the next token off @p rest: skips spaces and tabs, returns
+ *        the run up to the next one and advances @p rest past it. Returns
+ *        an empty view once @p rest holds no more tokens. Both scans are
+ *        vectorized (see DelimiterScan.h).
+ */
+inline std::string_view nextToken(std::string_view& rest)
+{
+    const char* end = rest.data() + rest.size();
+    const char* start = skipBlanks(rest.data(), end);
+    const char* stop = scanForBlank(start, end);
+    rest = std::string_view(stop, static_cast<size_t>(end - stop));
+    return std::string_view(start, static_cast<size_t>(stop - start));
+}
+
+#endif // COMMANDTABLE_H
@@ -2,19 +2,43 @@
 #define CONNECTION_H
 
 #include <UserManager.h>
+#include "SessionTask.h"
+#include "OutboundQueue.h"
+#include "TimerWheel.h"
+#include "RateLimiter.h"
+#include "Protocol.h"
+#include "RingBuffer.h"
+#include "LineParser.h"
+#include "CommandTable.h"
+#include "WebSocket.h"
+#include "Stats.h"
 #include <sys/socket.h> // for socket functions/types if needed
 #include <netinet/in.h> // for sockaddr_in, etc.
 #include <unistd.h>     // for close()
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #ifdef USE_OPENSSL
 #include <openssl/ssl.h>
 #endif
 
+#ifdef USE_IO_URING
+class UringSession;
+#endif
+
+class ThreadPool;
+
 using Socket = int;
 
 
-class Connection
+class Connection : public std::enable_shared_from_this<Connection>
 {
 public:
     /**
@@ -31,26 +55,247 @@ public:
     ~Connection();
 
     /**
-     * @brief Handles interaction with this client—reading, writing,
-     *        processing messages, etc.
-     * 
-     * You might call this from a worker thread in the ThreadPool.
+     * @brief Outcome of asking the event loop to wake us for an event.
+     */
+    enum class ArmResult {
+        Armed,   // The loop will call onReady() once the socket is ready
+        Retry,   // Not armed: data may already be there, retry the I/O now
+        Failed   // The socket cannot be watched any more
+    };
+
+    /**
+     * @brief Asks the loop to call onReady() once the socket is ready for
+     *        @p events (EPOLLIN, EPOLLOUT or both). Provided by the Server.
+     *        Always called with the connection's I/O mutex held.
+     */
+    using ArmFunction = std::function<ArmResult(uint32_t events)>;
+
+    /**
+     * @brief Called once the session coroutine has finished. Provided by
+     *        the Server to unregister and close the connection.
+     */
+    using CloseFunction = std::function<void()>;
+
+    /**
+     * @brief Creates the handleClient() coroutine and runs it until it first
+     *        waits for the socket. Call from a ThreadPool worker.
+     *
+     * @param arm     Hook used to park the coroutine on the event loop.
+     * @param onClose Hook run when the session ends.
+     */
+    void start(ArmFunction arm, CloseFunction onClose);
+
+    /**
+     * @brief Called from a ThreadPool worker when the loop reports that the
+     *        socket is ready. Flushes blocked output, completes the I/O the
+     *        coroutine is waiting on and resumes it, or re-arms on a
+     *        spurious wakeup.
+     *
+     * @param events The ready events reported by the loop.
+     */
+    void onReady(uint32_t events);
+
+    /**
+     * @brief Result of send().
+     */
+    enum class SendStatus {
+        Queued,       // Accepted; the queue is below the high watermark
+        Backpressure, // Accepted, but the queue is above the high watermark:
+                      // hold further output until the writable callback runs
+        Closed        // Dropped: the connection is closed or its socket failed
+    };
+
+    /**
+     * @brief Queues @p data for the client from any thread and writes as
+     *        much as the socket takes right away; the rest is flushed when
+     *        the loop reports EPOLLOUT. Never blocks on the socket.
+     *
+     * @param data The data to send.
+     * @param size The number of bytes to send.
+     * @return Whether the data was queued, and whether to back off.
+     */
+    SendStatus send(const char* data, size_t size);
+
+    /**
+     * @brief Sets the outbound queue watermarks (see SendStatus).
+     */
+    void setWatermarks(size_t lowWatermark, size_t highWatermark);
+
+    /**
+     * @brief Sets the limiters every command is checked against before it
+     *        is dispatched: @p perIp keyed by the peer address, @p perUser by
+     *        the user logged in on this connection. Either may be null.
+     *        Set them before start(); the limiters must outlive the connection.
+     */
+    void setRateLimiters(RateLimiter* perIp, RateLimiter* perUser);
+
+    /**
+     * @brief Lets tagged GETINFO requests run in parallel on @p pool: they
+     *        are collected while a read is parsed, shipped to the pool
+     *        LOOKUP_BATCH at a time, and each batch replies as soon as it
+     *        is done, so replies overtake each other. Without a pool (or
+     *        when the Connection is not owned by a shared_ptr) lookups run
+     *        inline. Set it before start(); the pool must outlive the
+     *        connection.
+     */
+    void setLookupPool(ThreadPool* pool);
+
+    /**
+     * @brief Counts every command and its latency in @p stats (null, the
+     *        default, counts nothing). Set it before start(); the stats
+     *        must outlive the connection.
+     */
+    void setStats(ServerStats* stats);
+
+    /**
+     * @brief Serves this client over WebSocket (see WebSocket.h): the
+     *        session starts with the HTTP upgrade, then runs the text
+     *        protocol inside text messages. Call before start().
+     */
+    void setWebSocket() { webSocket_ = true; }
+
+    /**
+     * @brief Tagged lookups per ThreadPool task.
+     */
+    static constexpr size_t LOOKUP_BATCH = 64;
+
+    /**
+     * @brief Sets the callback run once the outbound queue drains below the
+     *        low watermark after send() returned SendStatus::Backpressure.
+     *        It runs on the thread that drained the queue, without locks held.
+     */
+    void setWritableCallback(std::function<void()> callback);
+
+    /**
+     * @brief Returns the number of bytes queued but not yet written.
+     */
+    size_t outboundSize();
+
+    /**
+     * @brief Per-connection timers, linked into the owning shard's
+     *        TimerWheel by the Server. Embedded so arming never allocates.
+     */
+    struct Timers {
+        TimerWheel::Timer idle;      // Closes the connection after too long without input
+        TimerWheel::Timer login;     // Closes it if no LOGIN succeeded in time
+        TimerWheel::Timer heartbeat; // Sends PING while the client is quiet
+    };
+
+    /**
+     * @brief Returns the timers; only touch them under the shard's timer lock.
      */
-    void handleClient();
+    Timers& timers() { return timers_; }
+
+    /**
+     * @brief Returns when the client last sent anything (TimerWheel::monotonicMs()).
+     *        Updated lock-free on every read, so idle timers are checked
+     *        lazily on expiry instead of being rescheduled per read.
+     */
+    uint64_t lastActivityMs() const { return lastActivityMs_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns true once a LOGIN succeeded on this connection.
+     */
+    bool loggedIn() const { return loggedIn_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Ends the session from any thread: queues @p reason for the
+     *        client, then shuts the read side down so the session
+     *        coroutine sees end-of-file, flushes and lets the Server close us.
+     */
+    void expire(const std::string& reason);
+
+    /**
+     * @brief Sends a heartbeat from any thread: a "PING" line on the text
+     *        protocol, a PING frame (requestId 0) on v2.
+     */
+    void sendPing();
+
+    /**
+     * @brief Everything of a session that lives in this process, handed
+     *        over with the socket on a hot upgrade.
+     */
+    struct SessionState {
+        bool loggedIn = false;         // Whether a LOGIN succeeded
+        std::string username;          // Who logged in
+        uint32_t protocolVersion = 1;  // 1 = text, PROTOCOL_VERSION = binary frames
+        std::string pendingInput;      // A partial command received but not parsed yet
+        std::string pendingOutput;     // Responses not yet written
+        bool webSocket = false;        // Served over WebSocket
+        bool webSocketOpen = false;    // ... and the upgrade was answered
+        bool webSocketFragmented = false; // A fragmented message is being reassembled
+        std::string webSocketMessage;  // Its fragments so far
+    };
+
+    /**
+     * @brief Returns the socket file descriptor for this connection.
+     */
+    int socketFd() const { return socketFd_; }
+
+    /**
+     * @brief Returns the client's address.
+     */
+    const sockaddr_in& clientAddress() const { return clientAddr_; }
 
     /**
      * @brief Closes the connection if it is still open.
      */
     void closeConnection();
 
+    /**
+     * @brief Gives the socket up without closing it, for a hot upgrade.
+     *        Only call while the session is quiescent (loop stopped,
+     *        ThreadPool idle); the connection is closed afterwards.
+     *
+     * @param state Receives the session state.
+     * @return The socket fd, now owned by the caller.
+     */
+    int detach(SessionState& state);
+
+    /**
+     * @brief Restores the state a previous server process handed over.
+     *        Call before start().
+     *
+     * @param state The session state detach() produced in the old process.
+     */
+    void restore(const SessionState& state);
+
+#ifdef USE_IO_URING
+    /**
+     * @brief Routes receiveData()/sendData() through an io_uring session
+     *        instead of recv()/send() on the socket.
+     *
+     * @param session The session owned by the UringEngine.
+     */
+    void attachUringSession(UringSession* session) { uringSession_ = session; }
+
+    /**
+     * @brief Returns the io_uring session, or nullptr on the epoll backend.
+     */
+    UringSession* uringSession() const { return uringSession_; }
+#endif
+
 #ifdef USE_OPENSSL
     /**
-     * @brief Set up SSL for this connection. Perform the SSL handshake, etc.
+     * @brief Set up SSL for this connection. Call it before start(): the
+     *        handshake itself runs non-blocking at the start of the session,
+     *        parked on the loop whenever OpenSSL wants more I/O.
      *
      * @param sslContext The server’s SSL context.
-     * @return true on successful SSL handshake, false on error.
+     * @return true if the SSL object was created, false on error.
      */
     bool setupSSL(SSL_CTX* sslContext);
+
+    /**
+     * @brief Returns true if the TLS handshake resumed an earlier session.
+     */
+    bool sessionReused() const;
+
+    /**
+     * @brief Returns true if the kernel encrypts this connection's output
+     *        (kTLS), so responses go out with plain gathered writes.
+     */
+    bool kernelTlsActive() const;
 #endif
 
 private:
@@ -70,35 +315,359 @@ private:
     /**
      * @brief The SSL handle for this connection (nullptr if not using SSL).
      */
-    SSL* sslHandle_;
+    SSL* sslHandle_ = nullptr;
+    bool handshakeDone_ = false;   // Output is held back until then (guarded by ioMutex_)
+    bool kernelTlsSend_ = false;   // kTLS TX: flush with sendmsg, not SSL_write (guarded by ioMutex_)
+#endif
+
+#ifdef USE_IO_URING
+    /**
+     * @brief The io_uring session (nullptr on the epoll backend).
+     */
+    UringSession* uringSession_ = nullptr;
+#endif
+
+    /**
+     * @brief The read or flush a suspended coroutine is waiting to complete.
+     */
+    struct PendingIo {
+        enum class Kind { Read, Flush, Handshake };
+        Kind kind = Kind::Read;        // What completePendingIo() attempts
+        uint32_t events = 0;           // What to wait for: EPOLLIN, EPOLLOUT (TLS may switch)
+        char* readBuffer = nullptr;    // Destination of a read
+        size_t size = 0;               // Bytes requested
+        ssize_t result = 0;            // Value returned by co_await
+        int error = 0;                 // errno to restore when result < 0
+    };
+
+    /**
+     * @brief Awaitable returned by read() and flush().
+     *        Completes immediately if the socket is ready, otherwise parks
+     *        the coroutine on the event loop without blocking the thread.
+     */
+    class IoAwaitable
+    {
+    public:
+        explicit IoAwaitable(Connection& connection) : connection_(connection) {}
+        bool await_ready() { return connection_.tryPendingIo(); }
+        bool await_suspend(std::coroutine_handle<> handle) { return connection_.suspendOnPendingIo(handle); }
+        ssize_t await_resume();
+
+    private:
+        Connection& connection_;
+    };
+
+    /**
+     * @brief A tagged GETINFO: the text tag or v2 requestId, the user to
+     *        look up, and the result once answerLookups() ran.
+     */
+    struct Lookup {
+        uint32_t id = 0;
+        std::string username;
+        Status status = Status::UserNotFound;
+        std::string ipAddress;
+        uint16_t port = 0;
+        uint64_t startNs = 0;   // Its clock start (statsClockNs_), if stats are kept
+    };
+
+    /**
+     * @brief The session coroutine: reads, runs processInput(), flushes the
+     *        responses, until the client disconnects.
+     */
+    SessionTask handleClient();
+
+    /**
+     * @brief Takes a token from the per-IP and, once logged in, the per-user
+     *        limiter. Only called from the session coroutine.
+     * @return false if the command must be refused.
+     */
+    bool withinRateLimits();
+
+    /**
+     * @brief co_await read(buffer, size): bytes read, 0 on close, -1 on error.
+     */
+    IoAwaitable read(char* buffer, size_t size);
+
+#ifdef USE_OPENSSL
+    /**
+     * @brief co_await handshake(): runs the server side of the TLS handshake.
+     *        Returns 0 once it is done, -1 if it failed.
+     */
+    IoAwaitable handshake();
 #endif
 
+    /**
+     * @brief co_await flush(): writes the outbound queue. Returns 0 at once
+     *        while the queue is below the high watermark; otherwise waits
+     *        for it to drain below the low one, so a client that does not
+     *        read its responses stops being read. Returns -1 on error.
+     */
+    IoAwaitable flush();
+
+    /**
+     * @brief await_ready() of IoAwaitable: attempts pending_ once.
+     */
+    bool tryPendingIo();
+
+    /**
+     * @brief await_suspend() of IoAwaitable: records @p handle, then waits.
+     */
+    bool suspendOnPendingIo(std::coroutine_handle<> handle);
+
+    /**
+     * @brief Attempts pending_ once. Requires ioMutex_.
+     * @return true if it completed (pending_.result is set), false on EAGAIN.
+     */
+    bool completePendingIo();
+
+#ifdef USE_OPENSSL
+    /**
+     * @brief completePendingIo() for the TLS handshake. Requires ioMutex_.
+     */
+    bool completeHandshakeLocked();
+#endif
+
+    /**
+     * @brief Arms the loop for everything still wanted: pending_ if the
+     *        coroutine is parked, EPOLLOUT if output is blocked. Retries
+     *        pending_ when told to. Requires ioMutex_.
+     * @return false if pending_ completed and the coroutine should
+     *         continue right away, true otherwise.
+     */
+    bool armLocked();
+
+    /**
+     * @brief Writes as much of outbound_ as the socket takes. Requires ioMutex_.
+     * @return false if the socket failed.
+     */
+    bool flushLocked();
+
+    /**
+     * @brief Returns the writable callback if producers were told to back
+     *        off and the queue has since drained. Requires ioMutex_.
+     */
+    std::function<void()> takeWritableCallbackLocked();
+
+    SessionTask session_;                  // The handleClient() coroutine
+    Timers timers_;                        // Armed by the Server
+    std::atomic<uint64_t> lastActivityMs_; // Time of the last successful read
+    std::atomic_bool loggedIn_;            // Set by a successful LOGIN
+    UserHandle user_;                      // Session of the logged-in user (session coroutine only)
+    uint32_t protocolVersion_ = 1;         // Written by the session under ioMutex_
+    RingBuffer input_;                     // Received, not yet parsed (session coroutine only)
+    LineParser lineParser_;                // Text commands out of input_
+    FrameParser frameParser_;              // v2 frames out of input_
+    std::string response_;                 // Reply being formatted; keeps its capacity (session coroutine only)
+    std::string lookupAddress_;            // GETINFO result, reused the same way
+    std::vector<std::string_view> batchUsernames_; // MGETINFO arguments, views into input_
+    std::vector<UserAddress> batchAddresses_;      // MGETINFO results; both keep their capacity
+    std::string_view tag_;                 // "#<id>" of the text command being handled, or empty
+    std::vector<Lookup> lookups_;          // Tagged lookups of the current read (session coroutine only)
+    bool webSocket_ = false;               // Set before start(): WebSocket framing both ways
+    bool webSocketOpen_ = false;           // The upgrade was answered (written under ioMutex_)
+    WsFrameParser wsFrameParser_;          // WebSocket frames out of input_
+    bool wsFragmented_ = false;            // Between the first and the final frame of a message
+    std::string wsMessage_;                // The fragments so far (session coroutine only)
+    ThreadPool* lookupPool_ = nullptr;     // Runs lookup batches; null runs them inline
+    RateLimiter* ipLimiter_ = nullptr;     // Per source IP, shared by all connections
+    RateLimiter* userLimiter_ = nullptr;   // Per logged-in user, shared by all connections
+    ServerStats* stats_ = nullptr;         // Command counters, null if not kept
+    uint64_t statsClockNs_ = 0;            // Where the next command's latency starts (countCommand())
+    ArmFunction arm_;                      // Parks us on the event loop
+    CloseFunction onClose_;                // Unregisters us when the session ends
+
+    // Everything below is shared between the session coroutine, loop
+    // wakeups and send() from other threads, and guarded by ioMutex_.
+    std::mutex ioMutex_;
+    std::coroutine_handle<> waiting_;      // Set while parked on the event loop
+    PendingIo pending_;                    // The I/O it is parked on
+    uint32_t armedEvents_ = 0;             // Events the loop was last armed for
+    OutboundQueue outbound_;               // Responses not yet written
+    bool writeBlocked_ = false;            // outbound_ hit EAGAIN; wait for EPOLLOUT
+    bool writeFailed_ = false;             // The socket failed; drop further output
+    bool backpressured_ = false;           // send() reported Backpressure
+    std::function<void()> writableCallback_; // Run when backpressure clears
+
     /**
      * @brief Helper function to read data from the socket (or SSL handle).
      *
      * @param buffer The buffer to store received data.
      * @param size   The maximum number of bytes to read.
-     * @return Number of bytes read, or -1 on error.
+     * @return Number of bytes read, 0 if closed, or -1 on error.
+     *         On a would-block condition -1 is returned with errno = EAGAIN.
      */
     ssize_t receiveData(char* buffer, size_t size);
 
+    /**
+     * @brief Queues a response for the client. The session coroutine
+     *        flushes the queue with co_await flush() after processInput(),
+     *        so all responses to one read leave in one gathered write.
+     *        On the io_uring backend the data is handed to the ring at once.
+     *
+     * @param data The data to send.
+     * @param size The number of bytes to send.
+     * @return Number of bytes queued, or -1 on error.
+     */
+    ssize_t sendData(const char* data, size_t size);
+
+    /**
+     * @brief Queues one text protocol response: the tag of the command
+     *        being handled if it had one, @p text and "\n", formatted in
+     *        response_.
+     */
+    void sendLine(std::string_view text);
+
+    /**
+     * @brief Starts a text response in response_: "#<id> " for a tagged
+     *        command, nothing otherwise.
+     */
+    void beginLine();
+
+    /**
+     * @brief Hands @p data to the ring or the outbound queue; on a
+     *        WebSocket as one text message. Output a WebSocket client
+     *        cannot receive yet (before the upgrade) is dropped. Requires
+     *        ioMutex_, except on the io_uring backend.
+     *
+     * @return @p size, or -1 if the ring refused it.
+     */
+    ssize_t queueOutput(const char* data, size_t size);
+
+    /**
+     * @brief queueOutput() without any framing.
+     */
+    ssize_t queueRaw(const char* data, size_t size);
+
+    /**
+     * @brief queueOutput() as one unmasked WebSocket frame of @p opcode,
+     *        header and payload in a single buffer on the ring so a send
+     *        from another thread cannot land in between.
+     */
+    ssize_t queueWsFrame(WsOpcode opcode, const char* data, size_t size);
+
     /**
      * @brief Helper function to write data to the socket (or SSL handle).
      *
      * @param data The data to send.
      * @param size The number of bytes to send.
      * @return Number of bytes written, or -1 on error.
+     *         On a would-block condition -1 is returned with errno = EAGAIN.
      */
-    ssize_t sendData(const char* data, size_t size);
+    ssize_t writeSome(const char* data, size_t size);
 
     /**
-     * @brief Process incoming data (e.g., parse commands, send responses).
-     *        You might define a protocol for how clients communicate.
+     * @brief Runs every complete command in input_ and leaves a partial
+     *        one for the next read. Text lines until the client negotiates
+     *        v2 with "HELLO 2", binary frames (see Protocol.h) from then on.
      *
-     * @param data The incoming data buffer.
-     * @param size The size of the data.
+     * @return false if the stream is corrupt and the session must end.
+     */
+    bool processInput();
+
+    /**
+     * @brief WebSocket: answers the upgrade request once it is complete,
+     *        then decodes every complete frame in input_: text messages
+     *        run through handleWsMessage(), pings are answered, a close
+     *        is echoed.
+     * @return false once the session must end (close, bad request or frame).
+     */
+    bool processWebSocket();
+
+    /**
+     * @brief Runs every command line of a text message, straight from the
+     *        unmasked payload.
+     * @return false on a line longer than MAX_LINE_SIZE.
+     */
+    bool handleWsMessage(std::string_view message);
+
+    /**
+     * @brief Queues a close frame carrying @p code.
+     */
+    void closeWebSocket(WsCloseCode code);
+
+    /**
+     * @brief Queues a control frame (pong, close) from the session coroutine.
+     */
+    void sendWsControl(WsOpcode opcode, std::string_view payload);
+
+    /**
+     * @brief Protocol v1: runs one command line and queues its response line.
+     *        A line may start with a tag, "#<id> COMMAND ...", id a non-zero
+     *        u32; the response then starts with the same "#<id> ". Untagged
+     *        responses keep command order, tagged ones may not.
+     */
+    void handleCommand(std::string_view line);
+
+    /**
+     * @brief Protocol v2: decodes every complete frame in input_ and queues
+     *        all their replies as one write.
+     * @return false on a frame that cannot be resynchronized.
+     */
+    bool processFrames();
+
+    /**
+     * @brief Protocol v2: runs one request frame and appends its REPLY.
+     */
+    void handleFrame(const Frame& frame, FrameWriter& replies);
+
+    /**
+     * @brief The commands, shared by both protocols.
+     */
+    Status registerUser(std::string_view username, std::string_view password);
+    Status login(std::string_view username, std::string_view password, uint16_t port);
+    Status logout(std::string_view username);
+    Status getInfo(std::string_view username, std::string& ipAddress, uint16_t& port);
+
+    /**
+     * @brief MGETINFO: looks batchUsernames_ up into batchAddresses_, taking
+     *        the user lock once for the whole batch.
+     */
+    void getInfoBatch();
+
+    /**
+     * @brief Records @p command in stats_ (which must be set) with the
+     *        time since statsClockNs_, then restarts that clock.
+     */
+    void countCommand(Command command);
+
+    /**
+     * @brief Switches to protocol v2 right after queueing @p reply ("OK
+     *        HELLO 2"), so server-initiated messages are framed from
+     *        exactly that point.
+     */
+    void switchToFrames(std::string_view reply);
+
+    /**
+     * @brief Adds a tagged GETINFO to lookups_ and ships a full batch to
+     *        the lookup pool. Only called with a pool set.
+     */
+    void queueLookup(uint32_t id, std::string_view username);
+
+    /**
+     * @brief Answers what is left in lookups_ inline, at the end of a read
+     *        or before the protocol changes.
+     */
+    void finishLookups();
+
+    /**
+     * @brief Runs @p lookups and sends all their replies in one write,
+     *        formatted in @p replies for the protocol in use at that
+     *        moment: a batch still running when HELLO 2 is answered
+     *        replies with frames, the tag becoming the requestId.
+     *        Runs on the session coroutine or on a lookup pool worker.
+     */
+    void answerLookups(std::vector<Lookup>& lookups, std::string& replies);
+
+    /**
+     * @brief send() with ioMutex_ held.
+     */
+    SendStatus sendLocked(const char* data, size_t size);
+
+    /**
+     * @brief Queues a server-initiated message, text or framed depending
+     *        on the protocol. Requires ioMutex_.
      */
-    void processData(const char* data, size_t size);
+    void sendNoticeLocked(Opcode opcode, const std::string& text);
 
     /**
      * @brief A flag or state variable you might track.
@@ -0,0 +1,55 @@
+#ifndef DELIMITERSCAN_H
+#define DELIMITERSCAN_H
+
+#include <cstddef>
+
+/**
+ * @brief Vectorized searches for the text protocol's delimiters: the "\n"
+ *        that ends a command and the blanks (space, tab) between tokens.
+ *  - AVX2 (32 bytes per step) or SSE2 (16 bytes per step) on x86-64,
+ *    picked once at startup from what the CPU supports.
+ *  - A scalar fallback everywhere else, also used for inputs shorter than
+ *    16 bytes.
+ *
+ * Every function returns a pointer into [begin, end), or end if nothing
+ * matched. Vector loads never read past end.
+ */
+enum class ScanLevel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+/**
+ * @brief Returns the implementation in use.
+ */
+ScanLevel scanLevel();
+
+/**
+ * @brief Forces an implementation, for tests and benchmarks. A level the
+ *        CPU lacks falls back to the best one it has.
+ * @return The level actually selected.
+ */
+ScanLevel setScanLevel(ScanLevel level);
+
+/**
+ * @brief Returns the best level this CPU supports.
+ */
+ScanLevel detectScanLevel();
+
+/**
+ * @brief First occurrence of @p byte.
+ */
+const char* scanForByte(const char* begin, const char* end, char byte);
+
+/**
+ * @brief First space or tab.
+ */
+const char* scanForBlank(const char* begin, const char* end);
+
+/**
+ * @brief First byte that is neither a space nor a tab.
+ */
+const char* skipBlanks(const char* begin, const char* end);
+
+#endif // DELIMITERSCAN_H
@@ -0,0 +1,54 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <cstddef>
+
+/**
+ * @brief Epoch-based reclamation for data read without locks.
+ *
+ * Readers wrap their accesses in an EpochGuard: entering stamps the
+ * thread with the current global epoch, leaving clears the stamp, and
+ * neither ever waits. A writer that unpublishes an object (swaps a
+ * pointer readers follow) hands the old one to epochRetire(), which
+ * deletes it only once every reader that could have loaded it has left
+ * its guard.
+ *
+ * Retired objects wait in a per-thread list and are freed in batches by
+ * the retiring thread; a thread that exits with objects still pending
+ * leaves them to the next thread that reclaims.
+ */
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+/**
+ * @brief Queues @p object to be freed by @p deleter once no EpochGuard
+ *        alive now is left. Call after unpublishing it.
+ */
+void epochRetireObject(void* object, void (*deleter)(void*));
+
+/**
+ * @brief Queues @p object for delete once no EpochGuard alive now is left.
+ */
+template <typename T>
+void epochRetire(T* object)
+{
+    epochRetireObject(const_cast<void*>(static_cast<const void*>(object)),
+                      [](void* retired) { delete static_cast<T*>(retired); });
+}
+
+/**
+ * @brief Frees whatever the calling thread (or an exited one) retired that
+ *        no reader can still see. epochRetire() does this every few
+ *        dozen objects on its own.
+ *
+ * @return How many of the calling thread's objects are still waiting.
+ */
+size_t epochReclaim();
+
+#endif // EPOCH_H
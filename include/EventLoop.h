@@ -0,0 +1,94 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <sys/epoll.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * @brief A thin epoll(7) reactor.
+ *  - Owns the epoll instance and an eventfd used to wake it up.
+ *  - Dispatches readiness events to the handler registered for each fd.
+ *
+ * Handlers run on the thread that called run(). Long-running work should be
+ * pushed to a ThreadPool from inside the handler so the loop stays responsive.
+ */
+class EventLoop
+{
+public:
+    /**
+     * @brief Callback invoked with the epoll event mask (EPOLLIN, EPOLLOUT, ...).
+     */
+    using Handler = std::function<void(uint32_t events)>;
+
+    /**
+     * @brief Creates the epoll instance and the wakeup eventfd.
+     *        Throws std::runtime_error if either cannot be created.
+     */
+    EventLoop();
+
+    /**
+     * @brief Closes the epoll instance and the wakeup eventfd.
+     *        Registered fds are not closed; they belong to their owners.
+     */
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+     * @brief Registers a file descriptor with the loop.
+     *
+     * @param fd      The file descriptor to watch.
+     * @param events  The epoll event mask (e.g. EPOLLIN | EPOLLET).
+     * @param handler The callback to run when the fd becomes ready.
+     * @return true on success, false if epoll_ctl failed.
+     */
+    bool add(int fd, uint32_t events, Handler handler);
+
+    /**
+     * @brief Changes the event mask of an already registered fd.
+     *        Also used to re-arm fds registered with EPOLLONESHOT.
+     *
+     * @return true on success, false if epoll_ctl failed.
+     */
+    bool modify(int fd, uint32_t events);
+
+    /**
+     * @brief Unregisters a file descriptor and drops its handler.
+     *        Must be called before the fd is closed.
+     */
+    void remove(int fd);
+
+    /**
+     * @brief Runs the dispatch loop until stop() is called.
+     */
+    void run();
+
+    /**
+     * @brief Asks the loop to return from run(). Safe to call from any thread.
+     */
+    void stop();
+
+private:
+    /**
+     * @brief Drains the wakeup eventfd after stop() signalled it.
+     */
+    void drainWakeup();
+
+    int epollFd_;                  // The epoll instance
+    int wakeupFd_;                 // eventfd used to interrupt epoll_wait()
+    std::atomic_bool stopped_;     // Set once stop() has been requested
+
+    /**
+     * @brief Handlers keyed by fd. Shared so a handler stays alive while it
+     *        runs even if another thread removes its fd concurrently.
+     */
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+    std::mutex handlersMutex_;     // Protects handlers_
+};
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,84 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "Connection.h"
+#include "UserManager.h"
+#include <netinet/in.h> // For sockaddr_in
+#include <string>
+#include <vector>
+
+/**
+ * @brief One client connection handed from the old server process to the new one.
+ */
+struct HandoffConnection {
+    int fd = -1;                 // The client socket (a fresh descriptor after transfer)
+    sockaddr_in addr = {};       // The peer address
+    Connection::SessionState session; // Login, protocol/WebSocket state and unsent/unparsed bytes
+};
+
+/**
+ * @brief Everything a new server process needs to carry on without
+ *        dropping a client.
+ */
+struct HandoffState {
+    std::vector<int> listeners;                  // One listening socket per shard
+    std::vector<int> webSocketListeners;         // One per shard when serving WebSocket, else none
+    int statsListener = -1;                      // The stats endpoint's listener, -1 if none
+    std::vector<HandoffConnection> connections;  // Live clients
+    std::vector<User> users;                     // The UserManager table
+};
+
+/**
+ * @brief The hot-upgrade channel between two server processes.
+ *  - The old process listens on a Unix socket path; the new one connects.
+ *  - The state is sent as one length-prefixed binary blob, then every fd
+ *    (listeners first, then WebSocket listeners, the stats listener,
+ *    then clients, in blob order) in SCM_RIGHTS batches.
+ *  - The new process acknowledges with one byte once it owns everything;
+ *    only then does the old process close its copies.
+ */
+class Handoff
+{
+public:
+    /**
+     * @brief Creates the old process's listening Unix socket at @p path,
+     *        replacing a stale socket file.
+     * @return The socket, or -1 on error.
+     */
+    static int listen(const std::string& path);
+
+    /**
+     * @brief Connects the new process to the old one listening at @p path.
+     * @return The channel, or -1 on error.
+     */
+    static int connect(const std::string& path);
+
+    /**
+     * @brief Sends @p state over @p channel and waits for the acknowledgement.
+     *        The fds in @p state are still open in the caller afterwards.
+     *
+     * @return true once the peer confirmed it took everything over.
+     */
+    static bool send(int channel, const HandoffState& state);
+
+    /**
+     * @brief Receives the state sent by send(). On success the caller owns
+     *        every fd in @p state and must call acknowledge().
+     *
+     * @return true if the whole state and all fds arrived.
+     */
+    static bool receive(int channel, HandoffState& state);
+
+    /**
+     * @brief Tells the old process that the new one took over.
+     */
+    static bool acknowledge(int channel);
+
+private:
+    static bool writeAll(int fd, const char* data, size_t size);
+    static bool readAll(int fd, char* data, size_t size);
+    static bool sendFds(int channel, const std::vector<int>& fds);
+    static bool receiveFds(int channel, size_t count, std::vector<int>& fds);
+};
+
+#endif // HANDOFF_H
@@ -0,0 +1,43 @@
+#ifndef LINEPARSER_H
+#define LINEPARSER_H
+
+#include "RingBuffer.h"
+#include <cstddef>
+#include <string_view>
+
+constexpr size_t MAX_LINE_SIZE = 4096; // Longest text command accepted, without "\n"
+
+/**
+ * @brief Incremental decoder for the text protocol: commands are lines
+ *        ending in "\n" (a "\r" before it is dropped). Takes every
+ *        complete line off the front of a RingBuffer and leaves a partial
+ *        one for the next read. Resumable: bytes already searched for the
+ *        delimiter are not searched again, so each byte is scanned once
+ *        however the command is split.
+ */
+class LineParser
+{
+public:
+    enum class Result {
+        Line,     // @p line was filled in and consumed from the buffer
+        NeedMore, // No complete line buffered
+        Error     // A line longer than MAX_LINE_SIZE: the session must end
+    };
+
+    /**
+     * @brief Takes the next line (without its delimiter) off @p input.
+     *        Empty lines are skipped. The view stays valid until @p input
+     *        is written or linearized again.
+     */
+    Result next(RingBuffer& input, std::string_view& line);
+
+    /**
+     * @brief Forgets the scan position, e.g. when the buffer changed hands.
+     */
+    void reset() { scanned_ = 0; }
+
+private:
+    size_t scanned_ = 0; // Bytes at the front of the buffer known to hold no "\n"
+};
+
+#endif // LINEPARSER_H
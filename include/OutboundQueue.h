@@ -0,0 +1,102 @@
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <sys/types.h>  // For ssize_t
+#include <deque>
+#include <functional>
+#include <string>
+
+/**
+ * @brief A chain of pending output buffers for one connection.
+ *  - Small appends are coalesced into the tail buffer.
+ *  - flush() hands up to 64 buffers to one gathered write (writev-style).
+ *  - Partial writes keep the unsent tail for the next flush.
+ *  - Once everything is written the last buffer is kept, empty, for the
+ *    next append, so a connection that keeps up with its responses does
+ *    not allocate per write.
+ *  - High/low watermarks let producers see backpressure.
+ *
+ * Not thread-safe: the owning Connection serializes access.
+ */
+class OutboundQueue
+{
+public:
+    /**
+     * @brief Result of a flush attempt.
+     */
+    enum class FlushResult {
+        Drained,     // Everything was written
+        WouldBlock,  // The socket is full; wait for EPOLLOUT
+        Error        // The socket failed; errno is set
+    };
+
+    /**
+     * @brief Writes one buffer; returns bytes written or -1 with errno set.
+     *        Used when the socket cannot be written directly (SSL_write).
+     */
+    using Writer = std::function<ssize_t(const char* data, size_t size)>;
+
+    /**
+     * @brief Constructs an empty queue.
+     *
+     * @param lowWatermark  Producers are told to resume below this size.
+     * @param highWatermark Producers are told to back off above this size.
+     */
+    OutboundQueue(size_t lowWatermark = 64 * 1024, size_t highWatermark = 1024 * 1024);
+
+    /**
+     * @brief Changes the watermarks (low is clamped to at most high).
+     */
+    void setWatermarks(size_t lowWatermark, size_t highWatermark);
+
+    /**
+     * @brief Appends a copy of @p data, coalescing it into the tail buffer
+     *        when that stays below the coalescing limit.
+     */
+    void append(const char* data, size_t size);
+
+    /**
+     * @brief Appends @p data without copying it.
+     */
+    void append(std::string&& data);
+
+    /**
+     * @brief Writes as much as possible to socket @p fd, gathering the
+     *        chain into sendmsg() calls (writev() with MSG_NOSIGNAL).
+     */
+    FlushResult flush(int fd);
+
+    /**
+     * @brief Writes as much as possible buffer by buffer through @p writer.
+     */
+    FlushResult flush(const Writer& writer);
+
+    /**
+     * @brief Removes and returns everything still queued, in order.
+     */
+    std::string takeAll();
+
+    /**
+     * @brief Drops everything still queued.
+     */
+    void clear();
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool aboveHighWatermark() const { return size_ > highWatermark_; }
+    bool belowLowWatermark() const { return size_ <= lowWatermark_; }
+
+private:
+    /**
+     * @brief Drops @p bytes written bytes from the front of the chain.
+     */
+    void consume(size_t bytes);
+
+    std::deque<std::string> buffers_;  // Pending output, oldest first; only a sole buffer may be empty
+    size_t frontOffset_;               // Bytes of buffers_.front() already written
+    size_t size_;                      // Unsent bytes across the chain
+    size_t lowWatermark_;
+    size_t highWatermark_;
+};
+
+#endif // OUTBOUNDQUEUE_H
@@ -0,0 +1,146 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "RingBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Binary protocol v2.
+ *
+ * A connection starts in the text protocol (v1), one command per line. A
+ * client that sends the line "HELLO 2" is answered "OK HELLO 2" in text;
+ * every byte after that, in both directions, is a v2 frame. Frames may be
+ * coalesced or split by TCP arbitrarily.
+ *
+ * Frame layout (integers big-endian):
+ *
+ *     | length u32 | opcode u8 | requestId u32 | payload ...        |
+ *
+ * length counts everything after itself (1 + 4 + payload size) and is at
+ * most MAX_FRAME_SIZE. A reply carries the requestId of its request, so
+ * clients may pipeline requests. Payload fields are u16 integers and
+ * strings encoded as a u16 length followed by the bytes.
+ *
+ * Requests (payload):
+ *     REGISTER  username, password
+ *     LOGIN     username, password, port u16
+ *     LOGOUT    username (the session's own, or empty)
+ *     GETINFO   username
+ *     MGETINFO  count u16, then count usernames (at most MAX_BATCH_LOOKUP)
+ *     PING / PONG  (empty)
+ * Every request but PONG gets exactly one reply: opcode REPLY, payload
+ * status u8, then for a successful GETINFO ip, port u16, and for a
+ * successful MGETINFO count u16 and one record per username, in request
+ * order: status u8 (Ok or UserNotFound), then if Ok ip, port u16. Replies come in
+ * request order, except GETINFO replies: the server may run lookups in
+ * parallel and answer them as they complete, so match them by requestId.
+ * Server-initiated frames use requestId 0: PING (heartbeat, answer with
+ * PONG) and GOODBYE (payload: reason string) before the server closes.
+ */
+enum class Opcode : uint8_t {
+    Register = 0x01,
+    Login    = 0x02,
+    Logout   = 0x03,
+    GetInfo  = 0x04,
+    Ping     = 0x05,
+    Pong     = 0x06,
+    MGetInfo = 0x07,
+    Reply    = 0x80,
+    Goodbye  = 0x81
+};
+
+/**
+ * @brief Outcome carried by a REPLY frame.
+ */
+enum class Status : uint8_t {
+    Ok                 = 0,
+    UserExists         = 1,
+    InvalidCredentials = 2,
+    NotLoggedIn        = 3,
+    UserNotFound       = 4,
+    UnknownCommand     = 5,
+    RateLimited        = 6,
+    Malformed          = 7,
+    StorageError       = 8  // The server could not make the change durable
+};
+
+constexpr uint32_t PROTOCOL_VERSION = 2;
+constexpr size_t FRAME_HEADER_SIZE = 9;           // length + opcode + requestId
+constexpr size_t MAX_FRAME_SIZE = 64 * 1024;      // Largest length field accepted
+constexpr size_t MAX_BATCH_LOOKUP = 1024;         // Usernames per MGETINFO, both protocols
+
+/**
+ * @brief One decoded frame. The payload points into the input buffer and
+ *        stays valid until that is written or linearized again.
+ */
+struct Frame {
+    Opcode opcode = Opcode::Ping;
+    uint32_t requestId = 0;
+    std::string_view payload;
+};
+
+/**
+ * @brief Incremental frame decoder: takes every complete frame off the
+ *        front of a RingBuffer and leaves a partial one for the next read.
+ *        Each attempt costs O(1); a frame that wraps around the end of the
+ *        buffer is made contiguous once.
+ */
+class FrameParser
+{
+public:
+    enum class Result {
+        Frame,    // @p frame was filled in
+        NeedMore, // No complete frame buffered
+        Error     // Length out of range: the stream cannot be resynchronized
+    };
+
+    /**
+     * @brief Takes the next complete frame off @p input.
+     */
+    Result next(RingBuffer& input, Frame& frame);
+};
+
+/**
+ * @brief Reads payload fields; every getter fails past the end.
+ */
+class PayloadReader
+{
+public:
+    explicit PayloadReader(std::string_view payload) : payload_(payload) {}
+
+    bool readU16(uint16_t& value);
+    bool readString(std::string_view& value);
+
+    /**
+     * @brief Returns true once every byte was consumed.
+     */
+    bool atEnd() const { return payload_.empty(); }
+
+private:
+    std::string_view payload_;
+};
+
+/**
+ * @brief Builds one frame in place: start(), fields, then finish().
+ *        Several frames may be built back to back in the same string.
+ */
+class FrameWriter
+{
+public:
+    explicit FrameWriter(std::string& out) : out_(out) {}
+
+    void start(Opcode opcode, uint32_t requestId);
+    void writeU8(uint8_t value);
+    void writeU16(uint16_t value);
+    void writeString(std::string_view value); // Truncated to 65535 bytes
+    void finish();
+
+private:
+    std::string& out_;
+    size_t frameStart_ = 0;
+};
+
+#endif // PROTOCOL_H
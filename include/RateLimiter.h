@@ -0,0 +1,63 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief A lock-free token-bucket rate limiter over many keys (source IPs,
+ *        usernames).
+ *  - Each bucket is a single atomic: the GCRA "theoretical arrival time",
+ *    which is equivalent to a token bucket of @p burst tokens refilled at
+ *    @p ratePerSecond. allow() is one clock read and one CAS, no lock.
+ *  - Keys are hashed into a fixed table of buckets, so memory is bounded
+ *    no matter how many keys show up. Colliding keys share a bucket; that
+ *    only ever makes the limit stricter, and is rare with enough slots.
+ *
+ * Thread-safe.
+ */
+class RateLimiter
+{
+public:
+    /**
+     * @brief Constructs the limiter.
+     *
+     * @param ratePerSecond Sustained requests per second allowed per key.
+     * @param burst         Requests a key may make at once after being quiet.
+     * @param slots         Number of buckets (rounded up to a power of two).
+     */
+    RateLimiter(uint32_t ratePerSecond, uint32_t burst, size_t slots = 4096);
+
+    /**
+     * @brief Takes one token from @p key's bucket.
+     *
+     * @param key   The key, e.g. an IPv4 address or a hashed username.
+     * @param nowNs The current time in nanoseconds (monotonic); defaults
+     *              to monotonicNs().
+     * @return true if the request is within the limit.
+     */
+    bool allow(uint64_t key, uint64_t nowNs = monotonicNs());
+
+    /**
+     * @brief Same for a string key (e.g. a username).
+     */
+    bool allow(const std::string& key, uint64_t nowNs = monotonicNs());
+
+    /**
+     * @brief CLOCK_MONOTONIC in nanoseconds (vDSO, no syscall).
+     */
+    static uint64_t monotonicNs();
+
+private:
+    std::atomic<uint64_t>& bucketFor(uint64_t key);
+
+    uint64_t intervalNs_;   // Time one token takes to refill
+    uint64_t toleranceNs_;  // How far ahead of now a bucket may run: (burst - 1) intervals
+    size_t mask_;           // slots - 1
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_; // Theoretical arrival times
+};
+
+#endif // RATELIMITER_H
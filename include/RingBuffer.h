@@ -0,0 +1,120 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Per-connection input buffer: the socket reads straight into its
+ *        free space and the parsers take commands off the front.
+ *  - The capacity is a power of two and positions wrap with a mask.
+ *  - It grows (doubling) when a command is larger than the free space,
+ *    and shrink() gives the memory back once it is empty again.
+ *  - A command that wraps around the end is made contiguous on demand
+ *    (linearize()), so parsers can hand out string_views.
+ *
+ * Not thread-safe: only the session coroutine touches it.
+ */
+class RingBuffer
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * @brief Constructs an empty buffer; no memory is allocated until the
+     *        first write.
+     *
+     * @param initialCapacity Capacity allocated first and kept by shrink()
+     *                        (rounded up to a power of two).
+     */
+    explicit RingBuffer(size_t initialCapacity = 4096);
+
+    /**
+     * @brief Bytes buffered and not yet consumed.
+     */
+    size_t size() const { return tail_ - head_; }
+
+    bool empty() const { return head_ == tail_; }
+
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * @brief Makes at least @p size contiguous bytes writable at writeData(),
+     *        moving or growing the storage if needed.
+     */
+    void reserve(size_t size);
+
+    /**
+     * @brief Start of the contiguous free space, for read()/recv().
+     */
+    char* writeData() { return storage_.get() + (tail_ & (capacity_ - 1)); }
+
+    /**
+     * @brief Bytes writable at writeData() without wrapping.
+     */
+    size_t writable() const;
+
+    /**
+     * @brief Marks @p size bytes written at writeData() as buffered.
+     */
+    void commit(size_t size) { tail_ += size; }
+
+    /**
+     * @brief Copies @p data in, growing as needed.
+     */
+    void append(const char* data, size_t size);
+
+    /**
+     * @brief Returns the byte at @p offset from the front (offset < size()).
+     */
+    char at(size_t offset) const { return storage_[(head_ + offset) & (capacity_ - 1)]; }
+
+    /**
+     * @brief Returns the offset of the first @p byte at or after @p from,
+     *        or npos. Scans both segments with scanForByte() (SIMD).
+     */
+    size_t find(char byte, size_t from = 0) const;
+
+    /**
+     * @brief Copies @p size bytes from the front into @p out without consuming them.
+     */
+    void copyOut(char* out, size_t size) const;
+
+    /**
+     * @brief Makes the first @p size bytes contiguous and returns them.
+     *        The pointer stays valid until the buffer is written or
+     *        linearized again. Writable, so a parser may decode in place.
+     */
+    char* linearize(size_t size);
+
+    /**
+     * @brief Drops @p size bytes from the front. Consumed bytes stay
+     *        readable until the buffer is written again.
+     */
+    void consume(size_t size);
+
+    /**
+     * @brief Removes and returns everything buffered (hot upgrade).
+     */
+    std::string takeAll();
+
+    /**
+     * @brief Frees storage grown past the initial capacity once empty.
+     */
+    void shrink();
+
+private:
+    /**
+     * @brief Moves the contents to the start of a new @p capacity storage.
+     */
+    void relocate(size_t capacity);
+
+    std::unique_ptr<char[]> storage_;
+    size_t capacity_ = 0;        // Power of two, or 0 before the first write
+    size_t initialCapacity_;
+    size_t head_ = 0;            // Position of the first buffered byte (unwrapped)
+    size_t tail_ = 0;            // Position one past the last buffered byte (unwrapped)
+};
+
+#endif // RINGBUFFER_H
@@ -4,16 +4,92 @@
 #include "ThreadPool.h"
 #include "Connection.h"
 #include "UserManager.h"
+#include "EventLoop.h"
+#include "UringEngine.h"
+#include "TimerWheel.h"
+#include "RateLimiter.h"
+#include "TlsContext.h"
+#include "Stats.h"
 #include <netinet/in.h>  // For sockaddr_in
 #include <atomic>
 #include <memory>        // For std::unique_ptr
-#include <vector>        // For managing connected clients
+#include <mutex>
+#include <unordered_map> // For managing connected clients
+#include <vector>
 #include <string>
 
+/**
+ * @brief Which I/O engine drives the client sockets.
+ */
+enum class IoBackend {
+    Epoll,   // Readiness-based EventLoop, always available
+    IoUring  // Completion-based UringEngine, needs a USE_IO_URING build
+};
+
+/**
+ * @brief Tunables for the server. The defaults give the plain epoll server.
+ */
+struct ServerOptions {
+    IoBackend ioBackend = IoBackend::Epoll; // Falls back to epoll if io_uring is unavailable
+    size_t acceptorCount = 1;               // SO_REUSEPORT listeners, one event loop thread each
+    bool pinAcceptors = true;               // Pin each acceptor thread to its own CPU
+    size_t outboundLowWatermark = 64 * 1024;    // Per-connection output queue: resume below this
+    size_t outboundHighWatermark = 1024 * 1024; // Per-connection output queue: back off above this
+    uint64_t idleTimeoutMs = 0;             // Close clients silent for this long (0 disables)
+    uint64_t loginTimeoutMs = 0;            // Close clients not logged in by then (0 disables)
+    uint64_t heartbeatIntervalMs = 0;       // PING clients quiet for this long (0 disables)
+    std::string upgradeSocketPath;          // Unix socket a new binary connects to for a hot upgrade (empty disables)
+    std::string takeoverPath;               // Take listeners, clients and users over from the server listening here
+    size_t maxConnections = 65536;          // Reject new clients with ERR BUSY beyond this many (0 disables)
+    size_t maxQueueDepth = 8192;            // ... or while this many tasks wait for a worker (0 disables)
+    uint64_t maxQueueDelayMs = 500;         // ... or while the oldest waiting task is this old (0 disables)
+    uint32_t ipCommandRate = 200;           // Commands per second per source IP (0 disables)
+    uint32_t ipCommandBurst = 400;          // Commands an IP may send at once
+    uint32_t userCommandRate = 100;         // Commands per second per logged-in user (0 disables)
+    uint32_t userCommandBurst = 200;        // Commands a user may send at once
+    std::string tlsCertificatePath;         // PEM certificate chain; set with the key to serve TLS (USE_OPENSSL)
+    std::string tlsPrivateKeyPath;          // PEM private key
+    size_t tlsSessionCacheSize = 20480;     // Server-side TLS session cache entries
+    long tlsSessionTimeoutSec = 300;        // How long TLS sessions and tickets can be resumed
+    bool tlsKernelOffload = false;          // Let the kernel encrypt (kTLS) when it can
+    int webSocketPort = 0;                  // Also serve WebSocket clients (see WebSocket.h) on this port (0 disables)
+    int statsPort = 0;                      // Serve stats over HTTP (/stats JSON, /metrics Prometheus) on this port (0 disables)
+    std::string dataDirectory;              // Keep registered users here across restarts (empty: in memory only)
+    uint64_t snapshotLogBytes = 64 << 20;   // Compact the user log into a new snapshot once it grows past this
+    bool syncUserLog = true;                // Answer REGISTER only once its log record is fdatasync'ed
+    uint64_t userLogBatchDelayUs = 0;       // Hold each user log batch open this long for more records
+};
+
+struct HandoffState;
+
 /**
  * @brief A class to manage the server:
- *  - Accepting connections.
- *  - Handling incoming sockets using a ThreadPool.
+ *  - Accepting connections on one or more epoll event loops (shards).
+ *  - Watching every client socket on the loop of the shard that accepted it.
+ *  - Resuming each client's session coroutine on a ThreadPool once its
+ *    socket is ready.
+ *
+ * Idle clients cost only an epoll registration and a suspended coroutine;
+ * a worker thread is only busy while a client actually has bytes to process.
+ *
+ * With webSocketPort set, every shard also listens there for WebSocket
+ * clients, whose sessions run the same command engine inside WebSocket
+ * messages.
+ *
+ * With statsPort set, a separate thread serves live counters over HTTP
+ * (see Stats.h). It only reads atomics, so scrapes never wait on, or hold
+ * up, a shard or a worker.
+ *
+ * With dataDirectory set, registrations survive restarts (see UserStore):
+ * a REGISTER is answered once it is on disk, synced together with the
+ * others arriving meanwhile; the users are loaded at startup, a snapshot thread compacts the log
+ * in the background once it grows past snapshotLogBytes, and a normal
+ * shutdown writes a last snapshot so the next start reads no log at all.
+ *
+ * Hot upgrade: with upgradeSocketPath set, a new binary started with
+ * takeoverPath pointing at the same path receives the listening sockets,
+ * every client socket and the user table; the old server's start() then
+ * returns and no client is disconnected.
  */
 class Server
 {
@@ -21,10 +97,15 @@ public:
     /**
      * @brief Constructs the server.
      *
-     * @param port The port number on which the server listens.
+     * @param port The port number on which the server listens
+     *             (unused when taking over, the inherited sockets are bound).
      * @param threadCount The number of threads in the ThreadPool.
+     * @param options Optional tunables (I/O backend, ...).
+     *
+     * Throws std::runtime_error if the socket cannot be set up or the
+     * takeover from a running server fails.
      */
-    Server(int port, size_t threadCount);
+    Server(int port, size_t threadCount, const ServerOptions& options = ServerOptions());
 
     /**
      * @brief Destroys the server, cleaning up resources.
@@ -32,7 +113,8 @@ public:
     ~Server();
 
     /**
-     * @brief Starts the server and enters the accept loop.
+     * @brief Starts the server and runs the event loop until stop() or
+     *        until a hot upgrade handed every client to a new process.
      */
     void start();
 
@@ -43,18 +125,199 @@ public:
 
 private:
     /**
-     * @brief Initializes the server socket.
+     * @brief One acceptor shard: a listening socket, the event loop thread
+     *        that accepts on it, and the connections that loop owns.
+     *        With acceptorCount > 1 every shard binds the same port with
+     *        SO_REUSEPORT and the kernel spreads incoming connections.
+     */
+    struct Shard {
+        Server* server = nullptr;           // Back-pointer for the thread entry point
+        size_t index = 0;                   // Shard number, also the CPU it is pinned to
+        int listenSocket = -1;              // This shard's listening socket
+        int webSocketListenSocket = -1;     // Its WebSocket listener, -1 unless webSocketPort is set
+        EventLoop loop;                     // Watches the listener and this shard's clients
+        TimerWheel timers;                  // Idle, login and heartbeat timers of the clients
+        std::mutex timersMutex;             // Protects timers and every Connection::Timers
+        int timerFd = -1;                   // Periodic timerfd ticking the wheel (epoll backend)
+        int reserveFd = -1;                 // Spare descriptor given up to shed a client on EMFILE
+        std::unordered_map<int, std::shared_ptr<Connection>> connections; // Live clients by fd
+        std::mutex connectionsMutex;        // Protects connections
+        pthread_t thread = 0;               // Loop thread (only when sharded)
+#ifdef USE_IO_URING
+        std::unique_ptr<UringEngine> uring; // Set when the io_uring backend is active
+#endif
+    };
+
+    /**
+     * @brief Creates, binds and listens on one of a shard's sockets.
      *
-     * @param port The port to bind the server.
+     * @param listenSocket Receives the socket (set even on failure, for cleanup()).
+     * @param port         The port to bind the server.
+     * @param reusePort    Whether to set SO_REUSEPORT (needed for several shards).
      * @return true if successful, false otherwise.
      */
-    bool initializeSocket(int port);
+    bool initializeSocket(int& listenSocket, int port, bool reusePort);
+
+    /**
+     * @brief Runs one shard's loop until stop(). Blocks the calling thread.
+     */
+    void runShard(Shard& shard);
+
+    /**
+     * @brief pthread entry point for sharded mode; pins itself, then runs the shard.
+     *
+     * @param arg Pointer to the Shard (cast back to `Shard*`).
+     */
+    static void* shardThreadFunc(void* arg);
+
+    /**
+     * @brief Accepts every pending connection on one of the shard's
+     *        listening sockets. Runs on the shard's loop whenever it is readable.
+     *
+     * @param webSocket Whether @p listenSocket is the WebSocket listener.
+     */
+    void acceptLoop(Shard& shard, int listenSocket, bool webSocket);
+
+    /**
+     * @brief Admission control: whether a new client may be served, given
+     *        the client count and how far the ThreadPool is behind.
+     */
+    bool admitClient();
+
+    /**
+     * @brief Load shedding: answers ERR BUSY and closes, without ever
+     *        creating a Connection. Never blocks; if the reply does not fit
+     *        in the socket buffer the client just sees the close.
+     */
+    void rejectClient(int clientSocket);
+
+    /**
+     * @brief Out of descriptors: accepts one pending client with the
+     *        shard's reserve descriptor and rejects it, so the level-triggered
+     *        listener does not spin on a backlog it can never drain.
+     */
+    void shedWithReserveFd(Shard& shard, int listenSocket);
+
+    /**
+     * @brief Receives the state of the server listening at @p path.
+     *        Throws std::runtime_error on failure.
+     *
+     * @return The channel to acknowledge on once everything is adopted.
+     */
+    int takeOver(const std::string& path, HandoffState& state);
+
+    /**
+     * @brief Installs inherited users and starts the inherited clients,
+     *        spread over the shards.
+     */
+    void adoptConnections(HandoffState& state);
+
+    /**
+     * @brief Upgrade thread: waits for a new process on upgradeSocket_, then
+     *        records the channel and stops the loops so start() can hand off.
+     */
+    static void* upgradeThreadFunc(void* arg);
+    void waitForUpgrade();
 
     /**
-     * @brief The main loop for accepting connections.
-     *        Each accepted socket is pushed to the ThreadPool.
+     * @brief Wakes and joins the upgrade thread, closing its socket.
      */
-    void acceptLoop();
+    void stopUpgradeListener();
+
+    /**
+     * @brief Stats thread: answers one HTTP request per connection on
+     *        statsSocket_ and samples the command rates once a second,
+     *        until stopStatsListener().
+     */
+    static void* statsThreadFunc(void* arg);
+    void serveStats();
+
+    /**
+     * @brief Reads one request from @p client, answers it and closes it.
+     *        The socket has short timeouts, so a stalled client cannot
+     *        hold the stats thread for long.
+     */
+    void answerStatsRequest(int client);
+
+    /**
+     * @brief Wakes and joins the stats thread. Leaves statsSocket_ open:
+     *        it may still be handed to a new process.
+     */
+    void stopStatsListener();
+
+    /**
+     * @brief Snapshot thread: checks the user log once a second and writes
+     *        a snapshot once it is past snapshotLogBytes, until stopSnapshots().
+     */
+    static void* snapshotThreadFunc(void* arg);
+    void runSnapshots();
+
+    /**
+     * @brief Wakes and joins the snapshot thread.
+     */
+    void stopSnapshots();
+
+    /**
+     * @brief Sends every listener, client and user to the new process once
+     *        the loops stopped and the ThreadPool is idle, then drops them.
+     */
+    void handOff();
+
+    /**
+     * @brief Advances the shard's timer wheel, firing expired timers.
+     *        Runs on the shard's loop every tick.
+     */
+    void tickTimers(Shard& shard);
+
+    /**
+     * @brief Arms a new connection's idle, login and heartbeat timers.
+     */
+    void armTimers(Shard& shard, const std::shared_ptr<Connection>& connection);
+
+    /**
+     * @brief Timer callbacks; they run inside tickTimers() with the timer
+     *        lock held. closeClient() cancels the timers under the same lock,
+     *        so the connection is always alive while one of these runs.
+     */
+    void onIdleTimer(Shard& shard, Connection& connection);
+    void onLoginTimer(Shard& shard, Connection& connection);
+    void onHeartbeatTimer(Shard& shard, Connection& connection);
+
+    /**
+     * @brief Creates the Connection for a client socket and records it:
+     *        watermarks, timers, shard map.
+     */
+    std::shared_ptr<Connection> registerClient(Shard& shard, int clientSocket, const sockaddr_in& clientAddr);
+
+    /**
+     * @brief Logs an accepted connection, then registers it and, when
+     *        serving TLS, prepares its SSL object.
+     *
+     * @param shard        The shard that accepted the socket.
+     * @param clientSocket The accepted, non-blocking client socket.
+     * @param clientAddr   The peer address.
+     * @param webSocket    Whether it came in on the WebSocket listener.
+     * @return The connection, or nullptr if it was dropped again.
+     */
+    std::shared_ptr<Connection> addClient(Shard& shard, int clientSocket, const sockaddr_in& clientAddr,
+                                          bool webSocket);
+
+    /**
+     * @brief Starts a connection's session coroutine on the ThreadPool.
+     *        The coroutine parks itself on the shard's loop whenever its
+     *        socket is not ready, and is resumed on a worker once it is.
+     *
+     * @param shard      The shard owning the connection.
+     * @param connection The connection to start.
+     */
+    void startClient(Shard& shard, const std::shared_ptr<Connection>& connection);
+
+    /**
+     * @brief Unregisters a connection from its shard's loop and closes it.
+     *        The fd is only closed after it left the loop, so a new client
+     *        reusing the same fd number cannot be confused with this one.
+     */
+    void closeClient(Shard& shard, const std::shared_ptr<Connection>& connection);
 
     /**
      * @brief Safely shuts down and cleans up resources.
@@ -62,11 +325,30 @@ private:
     void cleanup();
 
 private:
-    int serverSocket_;                     // The listening socket
+    // Declaration order matters: the ThreadPool is destroyed first so no
+    // worker can still touch a shard or the UserManager.
+    UserManager userManager_; // Manage users
+    ServerStats stats_;                    // Command and accept counters, read by the stats thread
     sockaddr_in serverAddr_;               // Server address structure
     std::atomic_bool running_;             // Server running state
+    ServerOptions options_;                // Tunables given at construction
+    std::vector<std::unique_ptr<Shard>> shards_; // One per SO_REUSEPORT listener
+    int upgradeSocket_;                    // Hot-upgrade listener, -1 if disabled
+    pthread_t upgradeThread_;              // Waits on upgradeSocket_
+    int handoffChannel_;                   // Channel to the new process once one asked
+    int statsSocket_;                      // Stats endpoint listener, -1 if disabled
+    int statsWakeFd_;                      // eventfd that tells the stats thread to exit
+    pthread_t statsThread_;                // Serves statsSocket_
+    int snapshotWakeFd_;                   // eventfd that tells the snapshot thread to exit
+    pthread_t snapshotThread_;             // Compacts the user store, 0 without one
+    std::atomic<size_t> clientCount_;      // Registered clients over all shards
+    std::atomic<uint64_t> rejectedClients_; // Clients shed with ERR BUSY
+    std::unique_ptr<RateLimiter> ipLimiter_;   // Per source IP, null if disabled
+    std::unique_ptr<RateLimiter> userLimiter_; // Per logged-in user, null if disabled
+#ifdef USE_OPENSSL
+    std::unique_ptr<TlsContext> tlsContext_;   // Set when serving TLS
+#endif
     std::unique_ptr<ThreadPool> threadPool_; // ThreadPool for handling client sockets
-    UserManager userManager_; // Manage users
 };
 
 #endif // SERVER_H
@@ -0,0 +1,95 @@
+#ifndef SESSIONTASK_H
+#define SESSIONTASK_H
+
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+/**
+ * @brief Owning handle to a per-connection coroutine (Connection::handleClient).
+ *  - Starts suspended; the owner decides on which thread it first runs.
+ *  - Stays suspended at the end so the owner controls when the frame dies.
+ *
+ * The frame is destroyed with the SessionTask, which must only happen while
+ * the coroutine is suspended (never from inside the coroutine itself).
+ */
+class SessionTask
+{
+public:
+    struct promise_type {
+        SessionTask get_return_object()
+        {
+            return SessionTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            // A throwing command handler ends the session, not the server
+            try {
+                std::rethrow_exception(std::current_exception());
+            } catch (const std::exception& ex) {
+                std::cerr << "Session terminated by exception: " << ex.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Session terminated by unknown exception." << std::endl;
+            }
+        }
+    };
+
+    SessionTask() = default;
+
+    explicit SessionTask(std::coroutine_handle<promise_type> handle)
+        : handle_(handle)
+    {
+    }
+
+    SessionTask(SessionTask&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {
+    }
+
+    SessionTask& operator=(SessionTask&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    SessionTask(const SessionTask&) = delete;
+    SessionTask& operator=(const SessionTask&) = delete;
+
+    ~SessionTask()
+    {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    /**
+     * @brief Runs the coroutine until its next suspension point.
+     */
+    void resume()
+    {
+        if (handle_ && !handle_.done()) {
+            handle_.resume();
+        }
+    }
+
+    /**
+     * @brief Returns true once the coroutine ran to completion.
+     */
+    bool done() const { return !handle_ || handle_.done(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+#endif // SESSIONTASK_H
@@ -0,0 +1,146 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "CommandTable.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+constexpr size_t COMMAND_COUNT = static_cast<size_t>(Command::Hello) + 1; // Unknown included
+constexpr size_t LATENCY_BUCKETS = 20; // Bucket i: under 2^i microseconds; the last one is unbounded
+constexpr size_t STATS_STRIPES = 16;   // Counter copies; threads pick one each
+
+/**
+ * @brief Totals of one command, summed over the stripes.
+ */
+struct CommandStats {
+    uint64_t count = 0;
+    uint64_t latencyNs = 0;                          // Sum, for the mean
+    std::array<uint64_t, LATENCY_BUCKETS> buckets{}; // Not cumulative
+    double ratePerSecond = 0;                        // Over the last sampling interval
+};
+
+/**
+ * @brief Everything the stats endpoint reports, read at one point in time.
+ */
+struct StatsSnapshot {
+    double uptimeSeconds = 0;
+    size_t connections = 0;             // Open client connections
+    uint64_t acceptedTotal = 0;         // On the text/binary listener
+    uint64_t webSocketAcceptedTotal = 0; // On the WebSocket listener
+    uint64_t rejectedTotal = 0;         // Shed with ERR BUSY
+    size_t workers = 0;                 // ThreadPool threads
+    size_t busyWorkers = 0;             // ... running a task
+    size_t queueDepth = 0;              // Tasks waiting for one
+    size_t registeredUsers = 0;
+    size_t onlineUsers = 0;
+    std::array<CommandStats, COMMAND_COUNT> commands{}; // Indexed by Command
+};
+
+/**
+ * @brief Live server counters for the stats endpoint.
+ *  - Per-command counts and latency histograms (log2 buckets in
+ *    microseconds) are striped: each thread bumps its own cache-line
+ *    aligned copy with relaxed atomics, so workers never share a line and
+ *    a scrape only loads them. Nothing takes a lock.
+ *  - Rates come from sample(), which the stats thread calls about once a
+ *    second.
+ *
+ * recordCommand() and recordAccept() are thread-safe; sample() and
+ * collect() belong to the one stats thread.
+ */
+class ServerStats
+{
+public:
+    ServerStats();
+
+    /**
+     * @brief Counts one command that took @p latencyNs to parse, run and
+     *        queue its reply.
+     */
+    void recordCommand(Command command, uint64_t latencyNs);
+
+    /**
+     * @brief Counts an accepted client.
+     */
+    void recordAccept(bool webSocket);
+
+    /**
+     * @brief Updates the per-command rates from the counts since the
+     *        previous sample. Stats thread only.
+     */
+    void sample(uint64_t nowNs = monotonicNs());
+
+    /**
+     * @brief Fills in uptime, accept totals and the commands of @p snapshot;
+     *        the caller adds the gauges it owns. Stats thread only.
+     */
+    void collect(StatsSnapshot& snapshot);
+
+    /**
+     * @brief CLOCK_MONOTONIC in nanoseconds (vDSO, no syscall).
+     */
+    static uint64_t monotonicNs();
+
+private:
+    struct CommandCounters {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> latencyNs{0};
+        std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> buckets{};
+    };
+
+    struct alignas(64) Stripe {
+        std::array<CommandCounters, COMMAND_COUNT> commands;
+    };
+
+    Stripe& stripe();
+
+    std::unique_ptr<Stripe[]> stripes_;
+    std::atomic<uint64_t> accepted_{0};
+    std::atomic<uint64_t> webSocketAccepted_{0};
+    uint64_t startNs_;
+
+    // Stats thread only
+    uint64_t sampledNs_;                                 // When sample() last ran
+    std::array<uint64_t, COMMAND_COUNT> sampledCounts_{}; // Counts it saw then
+    std::array<double, COMMAND_COUNT> rates_{};
+};
+
+/**
+ * @brief The protocol name of @p command ("UNKNOWN" for Command::Unknown).
+ */
+std::string_view commandName(Command command);
+
+/**
+ * @brief Upper latency bound of histogram bucket @p bucket in microseconds
+ *        (0 for the unbounded last bucket).
+ */
+uint64_t latencyBucketBoundUs(size_t bucket);
+
+/**
+ * @brief Renders @p snapshot as one JSON object.
+ */
+std::string formatStatsJson(const StatsSnapshot& snapshot);
+
+/**
+ * @brief Renders @p snapshot in the Prometheus text exposition format
+ *        (version 0.0.4). Rates are left to PromQL's rate().
+ */
+std::string formatStatsPrometheus(const StatsSnapshot& snapshot);
+
+/**
+ * @brief Answers one HTTP request for the stats endpoint: GET /stats gives
+ *        JSON, GET /metrics Prometheus text, anything else 404 (400 if it
+ *        is not an HTTP request at all). The connection is always closed.
+ *
+ * @param request  The request head, up to the blank line.
+ * @param snapshot The stats to report.
+ * @return The whole response, headers included.
+ */
+std::string statsHttpResponse(std::string_view request, const StatsSnapshot& snapshot);
+
+#endif // STATS_H
@@ -5,6 +5,9 @@
 #include <queue>
 #include <mutex>
 #include <atomic>
+#include <functional>
+#include <vector>
+#include <cstdint>
 
 /**
  * @brief Define the type of socket we're handling (e.g., a file descriptor).
@@ -38,6 +41,35 @@ public:
      */
     void enqueue(Task task);
 
+    /**
+     * @brief Blocks until the queue is empty and no task is running.
+     *        Tasks enqueued meanwhile (even by running tasks) are waited for.
+     */
+    void waitIdle();
+
+    /**
+     * @brief Number of tasks waiting for a worker. Lock-free, so admission
+     *        checks and stats scrapes never queue behind enqueue().
+     */
+    size_t queueDepth() const;
+
+    /**
+     * @brief Number of workers running a task right now. Lock-free.
+     */
+    size_t busyWorkers() const;
+
+    /**
+     * @brief Number of worker threads.
+     */
+    size_t threadCount() const { return numThreads_; }
+
+    /**
+     * @brief How long the oldest waiting task has been queued, in
+     *        milliseconds (0 if the queue is empty). Rises as soon as the
+     *        workers fall behind, before the depth gets large. Lock-free,
+     *        like queueDepth().
+     */
+    uint64_t queueDelayMs() const;
 
 private:
     /**
@@ -60,9 +92,21 @@ private:
     size_t numThreads_;
     std::vector<pthread_t> threads_;
     std::atomic_bool stop_;
-    std::queue<Task> taskQueue_;        // Task queue
+    /**
+     * @brief A task and when it was enqueued, for queueDelayMs().
+     */
+    struct QueuedTask {
+        Task task;
+        uint64_t enqueuedMs;
+    };
+
+    std::queue<QueuedTask> taskQueue_;  // Task queue
+    std::atomic<size_t> queuedTasks_;   // taskQueue_.size(), readable without the lock
+    std::atomic<uint64_t> headEnqueuedMs_; // enqueuedMs of taskQueue_.front() (0 if empty), likewise
+    std::atomic<size_t> activeTasks_;   // Tasks currently running; changed under the lock
     pthread_mutex_t queueMutex_;
     pthread_cond_t condition_;
+    pthread_cond_t idleCondition_;      // Signalled when the pool goes idle
 };
 
 #endif // THREADPOOL_H
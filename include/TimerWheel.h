@@ -0,0 +1,151 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief A hierarchical timing wheel (Varghese & Lauck, as in the classic
+ *        Linux timer base) for very large numbers of coarse timers.
+ *  - schedule() and cancel() are O(1): a timer is an intrusive list node
+ *    that is linked into one slot, so arming one never allocates.
+ *  - advance() is O(1) per tick plus the timers it fires; timers far in the
+ *    future are cascaded towards the inner wheel as time passes.
+ *  - Level 0 has 256 slots of one tick; levels 1..3 have 64 slots each,
+ *    covering 2^26 ticks (about 77 days with 100 ms ticks). Longer delays
+ *    are clamped.
+ *
+ * Not thread-safe: the owner serializes access (e.g. with a mutex per loop).
+ * Callbacks run inside advance() and may schedule or cancel any timer,
+ * including the one that fired.
+ */
+class TimerWheel
+{
+public:
+    /**
+     * @brief Intrusive list links shared by timers and the wheel's slots.
+     */
+    struct Node {
+        Node* prev = nullptr;
+        Node* next = nullptr;
+    };
+
+    /**
+     * @brief A timer embedded in its owner (e.g. a Connection).
+     *        Unlinks itself from the wheel when destroyed.
+     */
+    class Timer : private Node
+    {
+    public:
+        using Callback = std::function<void()>;
+
+        Timer() = default;
+        explicit Timer(Callback callback) : callback_(std::move(callback)) {}
+        ~Timer() { cancel(); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        /**
+         * @brief Sets what to run on expiry. Set it before scheduling.
+         */
+        void setCallback(Callback callback) { callback_ = std::move(callback); }
+
+        /**
+         * @brief Returns true while the timer is scheduled.
+         */
+        bool armed() const { return wheel_ != nullptr; }
+
+        /**
+         * @brief Unschedules the timer if it is armed.
+         */
+        void cancel();
+
+    private:
+        friend class TimerWheel;
+
+        TimerWheel* wheel_ = nullptr; // Set while linked into a slot
+        uint64_t expiry_ = 0;         // Absolute expiry, in ticks
+        Callback callback_;
+    };
+
+    /**
+     * @brief Creates an empty wheel.
+     *
+     * @param tickMs Resolution of the wheel in milliseconds.
+     * @param nowMs  The current time, in the clock later passed to advance().
+     */
+    explicit TimerWheel(uint64_t tickMs = 100, uint64_t nowMs = monotonicMs());
+
+    /**
+     * @brief Disarms every timer still scheduled.
+     */
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * @brief Arms @p timer to fire after @p delayMs (rounded up to a tick,
+     *        at least one). An armed timer is rescheduled.
+     */
+    void schedule(Timer& timer, uint64_t delayMs);
+
+    /**
+     * @brief Moves the wheel to @p nowMs, firing every timer that expired.
+     *
+     * @return The number of timers fired.
+     */
+    size_t advance(uint64_t nowMs);
+
+    /**
+     * @brief Returns the number of armed timers.
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Returns the resolution given at construction.
+     */
+    uint64_t tickMs() const { return tickMs_; }
+
+    /**
+     * @brief Returns CLOCK_MONOTONIC_COARSE in milliseconds, cheap enough
+     *        to call on every read.
+     */
+    static uint64_t monotonicMs();
+
+private:
+    static constexpr unsigned ROOT_BITS = 8;
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr size_t ROOT_SLOTS = size_t(1) << ROOT_BITS;
+    static constexpr size_t LEVEL_SLOTS = size_t(1) << LEVEL_BITS;
+    static constexpr uint64_t MAX_TICKS = uint64_t(1) << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);
+
+    /**
+     * @brief Links @p timer into the slot matching its expiry.
+     */
+    void insert(Timer& timer);
+
+    /**
+     * @brief Re-inserts every timer of one outer slot relative to now_.
+     * @return The slot index, so the caller knows whether to go one level up.
+     */
+    size_t cascade(unsigned level);
+
+    /**
+     * @brief Unlinks @p timer and disarms it.
+     */
+    void unlink(Timer& timer);
+
+    Node& slot(unsigned level, size_t index);
+
+    uint64_t tickMs_;
+    uint64_t now_;    // Current time, in ticks
+    size_t size_;     // Armed timers
+    Node root_[ROOT_SLOTS];
+    Node levels_[LEVELS - 1][LEVEL_SLOTS];
+};
+
+#endif // TIMERWHEEL_H
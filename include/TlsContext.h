@@ -0,0 +1,74 @@
+#ifndef TLSCONTEXT_H
+#define TLSCONTEXT_H
+
+#ifdef USE_OPENSSL
+
+#include <openssl/ssl.h>
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief The server's SSL_CTX, set up for cheap reconnects.
+ *  - A server-side session cache, so TLS 1.2 clients presenting a session
+ *    id resume with an abbreviated handshake.
+ *  - Session tickets (TLS 1.2 and 1.3), so clients resume without the
+ *    server keeping any state. The ticket keys live as long as this
+ *    context, which is shared by every shard.
+ *  - Modes that let the non-blocking handshake and the outbound queue
+ *    drive SSL_write: partial writes, and retries from a moved buffer.
+ *  - Optionally kernel TLS: after the handshake OpenSSL installs the
+ *    session keys into the socket (TLS_TX, and TLS_RX where it supports
+ *    it), so the kernel encrypts and writes need no SSL_write at all.
+ *    Falls back to userspace TLS when the kernel lacks the "tls" module
+ *    or the cipher is not offloadable.
+ *
+ * Only used with the epoll backend: SSL reads and writes the socket itself.
+ */
+class TlsContext
+{
+public:
+    /**
+     * @brief Loads the certificate chain and private key (PEM files).
+     *
+     * @param certificatePath  Certificate chain file.
+     * @param privateKeyPath   Private key file.
+     * @param sessionCacheSize Sessions kept in the server-side cache.
+     * @param sessionTimeoutSec How long a session (or ticket) can be resumed.
+     * @param kernelOffload    Hand the record layer to the kernel (kTLS) when possible.
+     *
+     * Throws std::runtime_error if the context cannot be set up.
+     */
+    TlsContext(const std::string& certificatePath, const std::string& privateKeyPath,
+               size_t sessionCacheSize = 20480, long sessionTimeoutSec = 300,
+               bool kernelOffload = false);
+
+    /**
+     * @brief Frees the SSL_CTX; every SSL created from it must be gone.
+     */
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    /**
+     * @brief Returns the context, for Connection::setupSSL().
+     */
+    SSL_CTX* get() const { return context_; }
+
+    /**
+     * @brief Handshakes that resumed a session (cache or ticket).
+     */
+    long resumedHandshakes() const;
+
+    /**
+     * @brief Handshakes that completed, resumed or not.
+     */
+    long completedHandshakes() const;
+
+private:
+    SSL_CTX* context_;
+};
+
+#endif // USE_OPENSSL
+
+#endif // TLSCONTEXT_H
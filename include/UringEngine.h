@@ -0,0 +1,265 @@
+#ifndef URINGENGINE_H
+#define URINGENGINE_H
+
+#ifdef USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>  // For sockaddr_in
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Connection;
+class UringEngine;
+
+/**
+ * @brief Per-connection io_uring state.
+ *  - Inbox of bytes completed by the multishot recv, consumed by
+ *    Connection::receiveData().
+ *  - Outbound queue submitted as chains of linked send SQEs by
+ *    Connection::sendData().
+ */
+class UringSession
+{
+public:
+    UringSession(UringEngine& engine, uint64_t id, std::shared_ptr<Connection> connection);
+
+    /**
+     * @brief Copies buffered inbound bytes into @p buffer.
+     *
+     * @return Number of bytes copied, 0 if the peer closed the connection,
+     *         or -1 with errno set (EAGAIN when the inbox is empty).
+     */
+    ssize_t receive(char* buffer, size_t size);
+
+    /**
+     * @brief Queues @p data for sending. Never blocks.
+     *
+     * @return size on success, or -1 if the session is closed.
+     */
+    ssize_t send(const char* data, size_t size);
+
+    /**
+     * @brief send() for a buffer the caller built anyway: queued as is,
+     *        without another copy.
+     */
+    ssize_t send(std::string&& data);
+
+    /**
+     * @brief Called when the session coroutine found the inbox empty and
+     *        is about to wait for more bytes.
+     *
+     * @return true if more bytes (or the close) arrived meanwhile and the
+     *         coroutine must read again, false if it may now wait: the next
+     *         completion will trigger the ReadableHandler.
+     */
+    bool finishDrain();
+
+    const std::shared_ptr<Connection>& connection() const { return connection_; }
+    uint64_t id() const { return id_; }
+
+private:
+    friend class UringEngine;
+
+    /**
+     * @brief Appends a completed recv to the inbox (loop thread).
+     * @return true if a drain must be scheduled on the ThreadPool.
+     */
+    bool deliver(const char* data, size_t size);
+
+    /**
+     * @brief Records end-of-stream or a recv error (loop thread).
+     * @return true if a drain must be scheduled on the ThreadPool.
+     */
+    bool deliverClose(int error);
+
+    /**
+     * @brief Handles the completion of one linked send (loop thread).
+     * @return true if the session was released and its last send finished,
+     *         so the engine can finally drop it.
+     */
+    bool onSendComplete(int result);
+
+    /**
+     * @brief Moves the queued buffers into a new linked chain and submits it.
+     *        Caller must hold mutex_ and no chain may be in flight.
+     */
+    void submitChainLocked();
+
+    UringEngine& engine_;
+    uint64_t id_;                              // Key used in SQE user_data
+    std::shared_ptr<Connection> connection_;
+
+    std::mutex mutex_;                         // Protects everything below
+    std::deque<std::string> inbox_;            // Received, not yet consumed
+    size_t inboxOffset_ = 0;                   // Consumed prefix of inbox_.front()
+    bool draining_ = true;                     // The coroutine owns the inbox (running or about to read)
+    bool peerClosed_ = false;                  // recv returned 0 or failed
+    int recvError_ = 0;                        // errno of a failed recv
+
+    std::deque<std::string> outbox_;           // Waiting for the next chain
+    std::deque<std::string> inFlight_;         // Submitted as one linked chain
+    size_t pendingSends_ = 0;                  // CQEs still expected for inFlight_
+    size_t completedSends_ = 0;                // Fully sent buffers in the chain
+    bool sendFailed_ = false;                  // Hard error, stop sending
+    bool released_ = false;                    // Server closed this session
+};
+
+/**
+ * @brief A completion-based I/O engine on top of the raw io_uring syscalls.
+ *  - Multishot accept on each listening socket.
+ *  - Multishot recv per client, filling kernel-selected provided buffers.
+ *  - Sends submitted as IOSQE_IO_LINK chains, so they complete in order.
+ *
+ * The ring is driven by the thread that calls run(); workers only submit
+ * sends, serialized with the loop's own submissions by an SQ mutex.
+ */
+class UringEngine
+{
+public:
+    /**
+     * @brief Called on the loop thread for each accepted socket. The handler
+     *        takes ownership of the fd and normally calls attach().
+     *        @p listener is the index of the listening socket in run()'s list.
+     */
+    using AcceptHandler = std::function<void(int fd, const sockaddr_in& addr, size_t listener)>;
+
+    /**
+     * @brief Called on the loop thread when a session whose coroutine is
+     *        waiting for bytes (see UringSession::finishDrain()) got some.
+     */
+    using ReadableHandler = std::function<void(const std::shared_ptr<UringSession>& session)>;
+
+    /**
+     * @brief Called on the loop thread every tick interval (see setTicker()).
+     */
+    using TickHandler = std::function<void()>;
+
+    /**
+     * @brief Sets up the ring and registers the provided buffer group.
+     *        Throws std::runtime_error if the kernel refuses (e.g. too old
+     *        or io_uring disabled), so callers can fall back to epoll.
+     *
+     * @param entries Number of SQ entries (the CQ gets four times as many).
+     */
+    explicit UringEngine(unsigned entries = 4096);
+
+    /**
+     * @brief Unmaps the rings and closes the ring fd.
+     */
+    ~UringEngine();
+
+    UringEngine(const UringEngine&) = delete;
+    UringEngine& operator=(const UringEngine&) = delete;
+
+    /**
+     * @brief Runs @p onTick every @p intervalMs on the loop thread, driven
+     *        by an IORING_OP_TIMEOUT. Call before run().
+     */
+    void setTicker(uint64_t intervalMs, TickHandler onTick);
+
+    /**
+     * @brief Accepts on every socket in @p listenFds (one multishot accept
+     *        each) and reaps completions until stop().
+     */
+    void run(const std::vector<int>& listenFds, AcceptHandler onAccept, ReadableHandler onReadable);
+
+    /**
+     * @brief Asks run() to return. Safe to call from any thread.
+     */
+    void stop();
+
+    /**
+     * @brief Creates the session for an accepted connection, routes its I/O
+     *        through the ring and starts its multishot recv (loop thread).
+     */
+    std::shared_ptr<UringSession> attach(const std::shared_ptr<Connection>& connection);
+
+    /**
+     * @brief Unregisters a session. The socket is shut down so that its
+     *        outstanding recv completes; in-flight sends keep the session
+     *        alive until their buffers are no longer referenced by the kernel.
+     */
+    void release(uint64_t id);
+
+private:
+    friend class UringSession;
+
+    // Operation tags stored in the top byte of SQE user_data
+    enum class Op : uint8_t { Accept = 1, Recv, Send, ProvideBuffers, Wakeup, Tick };
+
+    static uint64_t encode(Op op, uint64_t id) { return (static_cast<uint64_t>(op) << 56) | id; }
+    static Op decodeOp(uint64_t data) { return static_cast<Op>(data >> 56); }
+    static uint64_t decodeId(uint64_t data) { return data & ((1ULL << 56) - 1); }
+
+    /**
+     * @brief Returns a zeroed SQE; caller must hold sqMutex_.
+     *        Submits pending entries first if the SQ is full.
+     */
+    io_uring_sqe* getSqeLocked();
+
+    /**
+     * @brief Publishes queued SQEs to the kernel; caller must hold sqMutex_.
+     */
+    void submitLocked();
+
+    void prepareAcceptLocked(size_t listener);
+    void prepareRecvLocked(int fd, uint64_t id);
+    void prepareProvideBufferLocked(uint16_t bid);
+    void prepareTickLocked();
+
+    /**
+     * @brief Dispatches one completion (loop thread).
+     */
+    void handleCompletion(const io_uring_cqe& cqe);
+
+    std::shared_ptr<UringSession> findSession(uint64_t id);
+
+    int ringFd_;
+    io_uring_params params_;
+
+    // Mapped ring memory
+    void* sqRing_;
+    void* cqRing_;
+    size_t sqRingSize_;
+    size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+
+    // Pointers into the mapped SQ/CQ rings
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqArray_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    io_uring_cqe* cqes_;
+
+    unsigned sqeTail_;           // Local tail, published by submitLocked()
+    unsigned sqeSubmitted_;      // Tail value last handed to the kernel
+    std::mutex sqMutex_;         // Serializes SQ access between loop and workers
+
+    // Provided buffer group used by every multishot recv
+    std::vector<char> bufferPool_;
+
+    std::vector<int> listenFds_;  // Accept user_data carries the index
+    std::atomic_bool stopped_;
+    AcceptHandler onAccept_;
+    ReadableHandler onReadable_;
+    TickHandler onTick_;
+    __kernel_timespec tickInterval_;  // Read by the kernel when a tick is submitted
+
+    std::unordered_map<uint64_t, std::shared_ptr<UringSession>> sessions_;
+    std::mutex sessionsMutex_;   // Protects sessions_
+    uint64_t nextSessionId_;
+};
+
+#endif // USE_IO_URING
+
+#endif // URINGENGINE_H
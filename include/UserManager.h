@@ -1,10 +1,14 @@
 #ifndef USER_MANAGER_H
 #define USER_MANAGER_H
 
-#include <unordered_map>
+#include "UserStore.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <vector>
 #include <string>
+#include <string_view>
 
 struct User {
     std::string username;       // Unique identifier for the user
@@ -14,19 +18,245 @@ struct User {
     bool isLoggedIn = false;    // Indicates if the user is currently logged in
 };
 
+/**
+ * @brief One result of UserManager::getUserAddresses().
+ */
+struct UserAddress {
+    bool found = false;         // Registered and logged in
+    std::string ipAddress;      // Valid if found
+    uint16_t port = 0;          // Valid if found
+};
+
+constexpr size_t USER_SHARDS = 16; // Default number of independently locked partitions
+constexpr size_t NOT_ONLINE = SIZE_MAX; // UserRecord::onlineSlot of a user who is not logged in
+
+/**
+ * @brief The login fields of a logged-in user, as lock-free readers see
+ *        them. Never changed once published: a login publishes a new one
+ *        and retires the old one through epochRetire().
+ */
+struct UserSnapshot {
+    std::string ipAddress;
+    uint16_t port = 0;
+};
+
+/**
+ * @brief How UserManager stores a User: the record itself plus what
+ *        sessions and readers bound to it need. Never moved once registered.
+ */
+struct UserRecord {
+    User user;
+    size_t usernameHash = 0; // Hashed once at registration; keys per-user rate limits
+    uint64_t session = 0;    // Bumped by every login and logout; older handles are stale
+    std::mutex mutex;        // Guards user's login fields (isLoggedIn, ipAddress, port), passwordHash and session
+    std::atomic<const UserSnapshot*> snapshot{nullptr}; // Login fields for lock-free readers; null when offline
+    size_t onlineSlot = NOT_ONLINE; // Position in its shard's online list (guarded by the shard's onlineMutex)
+
+    UserRecord() = default;
+    ~UserRecord() { delete snapshot.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief A shard's records, in chunks that never move, so records (and the
+ *        handles pointing at them) stay put as the list grows. Chunks
+ *        double up to a few megabytes; those are mapped with huge pages,
+ *        which makes loading millions of records mostly a matter of
+ *        copying, not of faulting memory in 4 KiB at a time.
+ */
+class RecordList {
+public:
+    class iterator {
+    public:
+        UserRecord& operator*() const { return list_->chunks_[chunk_].records[index_]; }
+        iterator& operator++();
+        bool operator!=(const iterator& other) const { return chunk_ != other.chunk_ || index_ != other.index_; }
+
+    private:
+        friend class RecordList;
+
+        iterator(const RecordList* list, size_t chunk, size_t index) : list_(list), chunk_(chunk), index_(index) {}
+
+        const RecordList* list_;
+        size_t chunk_;
+        size_t index_;
+    };
+
+    RecordList() = default;
+    ~RecordList() { clear(); }
+
+    RecordList(const RecordList&) = delete;
+    RecordList& operator=(const RecordList&) = delete;
+
+    /**
+     * @brief Appends a default-constructed record.
+     */
+    UserRecord& emplace_back();
+
+    /**
+     * @brief Makes room for @p count records in all, in one chunk.
+     */
+    void reserve(size_t count);
+
+    /**
+     * @brief Destroys every record and frees the chunks.
+     */
+    void clear();
+
+    size_t size() const { return size_; }
+
+    iterator begin() const;
+    iterator end() const { return iterator(this, chunks_.size(), 0); }
+
+private:
+    struct Chunk {
+        UserRecord* records;
+        size_t capacity;
+        size_t used;
+        bool mapped; // mmap'ed rather than from operator new
+    };
+
+    void addChunk(size_t capacity);
+
+    std::vector<Chunk> chunks_;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief A connection's handle on its logged-in user, issued at LOGIN by
+ *        UserManager::openSession(). It points straight at the user's
+ *        record, so session commands neither hash the name nor take the
+ *        table lock. Records stay put until restoreUsers(), which only runs
+ *        before any session exists.
+ *
+ *        A handle goes stale once its user logs out or logs in again
+ *        (elsewhere or not): closing a stale handle does nothing, so the
+ *        newer session survives the old connection.
+ */
+class UserHandle {
+public:
+    UserHandle() = default;
+
+    /**
+     * @brief true if the handle was issued for a session (stale or not).
+     */
+    explicit operator bool() const { return record_ != nullptr; }
+
+    /**
+     * @brief The user's name. Immutable once registered: no lock needed.
+     */
+    const std::string& username() const { return record_->user.username; }
+
+    /**
+     * @brief The hash of username(), computed at registration.
+     */
+    size_t key() const { return record_->usernameHash; }
+
+private:
+    friend class UserManager;
+
+    UserHandle(UserRecord* record, uint64_t session) : record_(record), session_(session) {}
+
+    UserRecord* record_ = nullptr;
+    uint64_t session_ = 0;
+};
+
+/**
+ * @brief One entry of an online-user listing.
+ */
+struct OnlineUser {
+    std::string username;
+    std::string ipAddress;
+    uint16_t port = 0;
+};
+
+/**
+ * @brief The users online when UserManager::onlineUsers() was called, for
+ *        paging through.
+ *
+ * The membership is fixed at that point: however many users log in or
+ * out meanwhile, paging never repeats or skips anyone. Addresses are read
+ * when a page is, so a user who has logged out since is left out of their
+ * page and one who logged in again shows the new address. Holds pointers
+ * into the table: valid until UserManager::restoreUsers().
+ */
+class OnlineUsers {
+public:
+    /**
+     * @brief Number of users in the listing.
+     */
+    size_t size() const { return records_.size(); }
+
+    /**
+     * @brief Reads positions [@p cursor, @p cursor + @p count) of the
+     *        listing. Lock-free.
+     *
+     * @param cursor Where to start: 0, then what the previous call returned.
+     * @param count  Positions to read; fewer users come back if some logged out.
+     * @param users  Cleared, then filled with the users still online.
+     * @return The cursor of the next page; size() once the listing is done.
+     */
+    size_t page(size_t cursor, size_t count, std::vector<OnlineUser>& users) const;
+
+private:
+    friend class UserManager;
+
+    std::vector<const UserRecord*> records_;
+};
+
+/**
+ * @brief Outcome of UserManager::registerUser() and changePassword().
+ */
+enum class UserUpdate {
+    Ok,
+    UserExists,   // registerUser(): the name is taken
+    UserNotFound, // changePassword(): no such user
+    StorageError  // The store could not log the change (logged)
+};
+
 /**
  * @brief A class to manage users, including registration, login/logout, and active user tracking.
+ *
+ * The table is split by username hash into shards, each behind its own
+ * mutex, so registrations rarely wait for each other. Listings visit the
+ * shards one at a time and never hold more than one shard lock.
+ *
+ * Lookups by name take no lock at all: each shard keeps an insert-only
+ * open-addressing index of its records, published with release stores,
+ * and GETINFO reads a record's immutable UserSnapshot, both under an
+ * EpochGuard. Login and logout lock only the user's own record.
+ *
+ * With openStore(), registrations and password changes also go to a
+ * UserStore on disk, and the table is loaded back from it at startup.
  */
 class UserManager {
 public:
+    /**
+     * @brief Creates an empty table.
+     *
+     * @param shards Number of partitions (at least 1).
+     */
+    explicit UserManager(size_t shards = USER_SHARDS);
+
     /**
      * @brief Registers a new user.
      * 
      * @param username The username to register.
      * @param password The plaintext password (hashed internally).
-     * @return true if registration is successful, false if the username already exists.
+     * @return Ok, UserExists, or StorageError if the store could not log
+     *         it. With a store, the user is added (and returned for) once
+     *         the registration is durable; the name is taken meanwhile.
+     *         A StorageError leaves the table as it was.
+     */
+    UserUpdate registerUser(const std::string& username, const std::string& password);
+
+    /**
+     * @brief Sets a registered user's password. Sessions already open stay
+     *        open; the next login needs the new password.
+     *
+     * @return Ok, UserNotFound, or StorageError as registerUser(). With a
+     *        store, holds the user's record lock until the change is durable.
      */
-    bool registerUser(const std::string& username, const std::string& password);
+    UserUpdate changePassword(const std::string& username, const std::string& password);
 
     /**
      * @brief Logs a user in, storing their IP and port for P2P connections.
@@ -40,7 +270,33 @@ public:
     bool loginUser(const std::string& username, const std::string& password, const std::string& ipAddress, uint16_t port);
 
     /**
-     * @brief Logs a user out.
+     * @brief loginUser() for a connection: logs the user in and returns a
+     *        handle on the new session. Any older session of the user goes
+     *        stale.
+     *
+     * @return The session's handle, or an empty one for invalid credentials.
+     */
+    UserHandle openSession(std::string_view username, std::string_view password, std::string_view ipAddress,
+                           uint16_t port);
+
+    /**
+     * @brief Logs out the user of @p handle unless the session is stale.
+     *        Takes only the user's own record lock.
+     *
+     * @return true if the user was logged out.
+     */
+    bool closeSession(const UserHandle& handle);
+
+    /**
+     * @brief Issues a handle on the current session of a logged-in user,
+     *        for a connection adopted from the previous server process.
+     *
+     * @return The handle, or an empty one if the user is not logged in.
+     */
+    UserHandle resumeSession(std::string_view username);
+
+    /**
+     * @brief Logs a user out by name, whichever session they are in.
      * 
      * @param username The username to log out.
      * @return true if the user was logged out successfully, false otherwise.
@@ -49,31 +305,211 @@ public:
 
     /**
      * @brief Retrieves a list of active users and their P2P connection info.
+     *        Walks the online index, not the whole table, shard by shard:
+     *        users logging in or out meanwhile may or may not be listed,
+     *        but nobody waits for the whole listing.
      * 
      * @return A vector of active users with IP and port information.
      */
     std::vector<User> getActiveUsers();
 
+    /**
+     * @brief Takes a listing of the online users to page through. Copies
+     *        each shard's online index (pointers only) under that shard's
+     *        online lock: O(online users), no strings copied.
+     */
+    OnlineUsers onlineUsers();
+
+    /**
+     * @brief Retrieves every registered user, logged in or not.
+     *        Used to hand the user table to a new server process.
+     *
+     * @return A copy of all users.
+     */
+    std::vector<User> getAllUsers();
+
+    /**
+     * @brief Replaces the user table, e.g. with one received from the
+     *        server process being upgraded. Frees every record: only call
+     *        it before sessions are opened and lookups run.
+     *
+     * @param users The users to install.
+     */
+    void restoreUsers(const std::vector<User>& users);
+
+    /**
+     * @brief Makes the registry durable in @p directory (see UserStore):
+     *        from now on every registration and password change is logged
+     *        there first. Only call it before sessions are opened and
+     *        lookups run.
+     *
+     * @param directory The data directory, created if missing.
+     * @param load      Replace the table with the users stored there
+     *                  (snapshot, then the log after it). A process taking
+     *                  over from a running one already has them.
+     * @param options   How log records are batched and synced.
+     * @return false (logged) if the store cannot be opened or is corrupt.
+     */
+    bool openStore(const std::string& directory, bool load = true, const UserLogOptions& options = UserLogOptions());
+
+    /**
+     * @brief Stops logging to the store, e.g. before handing the table to
+     *        a new process that will. No registration may run meanwhile.
+     */
+    void closeStore();
+
+    /**
+     * @brief Compacts the store: writes every registered user to a new
+     *        snapshot and drops the log it replaces. Locks one shard at a
+     *        time while copying it out; lookups and logins go on.
+     *
+     * @return false if there is no store or the snapshot failed (logged).
+     */
+    bool writeSnapshot();
+
+    /**
+     * @brief Bytes logged since the last snapshot (0 without a store).
+     */
+    uint64_t storeLogBytes() const { return store_ ? store_->logBytes() : 0; }
+
     /**
      * @brief Finds a user by their username.
+     *        The record stays put, but its login fields change under
+     *        logins and logouts: only read them while no other thread
+     *        does either (tests, setup). Request handling reads snapshots
+     *        through getUserAddress().
      * 
      * @param username The username to search for.
      * @return A pointer to the User object if found, or nullptr otherwise.
      */
     User* findUser(const std::string& username);
 
+    /**
+     * @brief Copies a logged-in user's P2P address out of their snapshot.
+     *        Wait-free: no lock, no retry loop, whatever logins and
+     *        registrations run meanwhile. Allocation-free: the lookup takes
+     *        a string_view, and @p ipAddress keeps its capacity between
+     *        calls.
+     *
+     * @param username  The username to look up.
+     * @param ipAddress Receives the user's IP address.
+     * @param port      Receives the user's P2P port.
+     * @return false if the user does not exist or is not logged in.
+     */
+    bool getUserAddress(std::string_view username, std::string& ipAddress, uint16_t& port);
+
+    /**
+     * @brief getUserAddress() for a whole batch under one EpochGuard.
+     *        Allocation-free once @p addresses has been used for a batch
+     *        as large: its entries keep their capacity.
+     *
+     * @param usernames The usernames to look up.
+     * @param addresses Resized to usernames.size(); entry i answers usernames[i].
+     * @return How many were found.
+     */
+    size_t getUserAddresses(const std::vector<std::string_view>& usernames, std::vector<UserAddress>& addresses);
+
+    /**
+     * @brief Number of registered users. Lock-free, for the stats endpoint.
+     */
+    size_t userCount() const { return userCount_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Number of logged-in users. Lock-free, for the stats endpoint.
+     */
+    size_t onlineCount() const { return onlineCount_.load(std::memory_order_relaxed); }
+
     //bool UserManager::isLoggedIn(const std::string& username);
 
 private:
     /**
-     * @brief Stores all registered users.
+     * @brief Hashes std::string and std::string_view alike, so lookups by
+     *        string_view do not build a temporary std::string.
      */
-    std::unordered_map<std::string, User> userDatabase_;
+    struct UsernameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view username) const { return std::hash<std::string_view>()(username); }
+    };
 
     /**
-     * @brief Mutex to protect access to userDatabase_.
+     * @brief Open-addressing table of a shard's records, probed without a
+     *        lock. Slots are only ever filled; a full table is replaced by
+     *        a copy twice the size and retired.
      */
-    std::mutex userMutex_;
+    struct RecordIndex;
+
+    /**
+     * @brief One partition of the table. The mutex
+     *        serializes registrations and listings; a record's login fields
+     *        are behind the record's own mutex, taken after this one when
+     *        both are needed. Aligned so neighbouring shards' locks do not
+     *        share a cache line.
+     */
+    struct alignas(64) Shard {
+        Shard();
+        ~Shard();
+
+        /**
+         * @brief The record of @p username, or nullptr. Lock-free; call
+         *        under an EpochGuard (the index may be replaced meanwhile).
+         */
+        UserRecord* find(std::string_view username, size_t hash) const;
+
+        /**
+         * @brief Indexes @p record, growing the index if needed. Requires mutex.
+         */
+        void insert(UserRecord* record);
+
+        /**
+         * @brief Sizes the records and the index for @p users records
+         *        without growing again. Requires mutex.
+         */
+        void reserve(size_t users);
+
+        /**
+         * @brief Drops every record. Requires mutex, and no reader anywhere.
+         */
+        void clear();
+
+        /**
+         * @brief Publishes an index of @p capacity slots holding every
+         *        record but @p pending, and retires the old one. Requires mutex.
+         */
+        void reindex(size_t capacity, const UserRecord* pending);
+
+        std::mutex mutex;
+        RecordList records;
+        std::atomic<RecordIndex*> index;
+
+        // Registrations logged but not yet durable: their names are taken,
+        // but they are only added to records once their log record is on
+        // disk. Guarded by mutex; as short as the number of callers waiting.
+        struct PendingUser {
+            std::string username;
+            std::string passwordHash;
+            uint64_t ticket; // From UserStore::appendRegister()
+        };
+        std::vector<PendingUser> registering;
+
+        // Dense list of the shard's logged-in users, each knowing its slot:
+        // login appends, logout moves the last entry into the hole. Taken
+        // after a record's mutex, never before.
+        std::mutex onlineMutex;
+        std::vector<UserRecord*> online;
+    };
+
+    Shard& shardFor(size_t hash) { return shards_[hash % shardCount_]; }
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t shardCount_;
+
+    /**
+     * @brief Sizes of the table, kept up to date so readers need no lock.
+     */
+    std::atomic<size_t> userCount_{0};
+    std::atomic<size_t> onlineCount_{0};
+
+    std::unique_ptr<UserStore> store_; // Null unless openStore() succeeded
 
     /**
      * @brief A helper function to hash passwords.
@@ -81,7 +517,47 @@ private:
      * @param password The plaintext password.
      * @return A hashed version of the password.
      */
-    std::string hashPassword(const std::string& password);
+    std::string hashPassword(std::string_view password);
+
+    /**
+     * @brief The record of @p username, or nullptr. Lock-free.
+     */
+    UserRecord* findRecord(std::string_view username);
+
+    /**
+     * @brief Replaces the table with what @p store holds.
+     */
+    bool loadStore(UserStore& store);
+
+    /**
+     * @brief Registers @p username, or sets the password hash of the
+     *        existing record, without logging it: the store replaying
+     *        itself. Requires @p shard's mutex; no session may exist yet.
+     */
+    void installLocked(Shard& shard, std::string_view username, size_t hash, std::string_view passwordHash);
+
+    /**
+     * @brief Appends and indexes a record for @p username, known not to
+     *        be registered yet. Requires @p shard's mutex.
+     */
+    UserRecord& addLocked(Shard& shard, std::string_view username, size_t hash);
+
+    /**
+     * @brief Logs out the user of @p record; the caller holds its mutex.
+     */
+    bool logoutLocked(UserRecord& record);
+
+    /**
+     * @brief Replaces the snapshot readers see for @p record (nullptr when
+     *        offline) and retires the old one. The caller holds its mutex.
+     */
+    void publishLocked(UserRecord& record);
+
+    /**
+     * @brief Adds @p record to (or removes it from) its shard's online
+     *        index in O(1). The caller holds the record's mutex.
+     */
+    void setOnlineLocked(UserRecord& record, bool online);
 };
 
 #endif // USER_MANAGER_H
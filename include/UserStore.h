@@ -0,0 +1,262 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+constexpr size_t MAX_STORED_FIELD = UINT16_MAX; // Longest username or password hash the store can record
+
+/**
+ * @brief Called with each user read back from the store, in the order
+ *        they were written: a later call for the same name replaces the
+ *        earlier one.
+ */
+using StoredUserVisitor = std::function<void(std::string_view username, std::string_view passwordHash)>;
+
+/**
+ * @brief CRC-32C (Castagnoli) of @p size bytes at @p data, continuing from
+ *        @p crc (0 to start). Uses the SSE4.2 instruction when the CPU has it.
+ */
+uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+/**
+ * @brief How UserStore makes log records durable.
+ */
+struct UserLogOptions {
+    bool sync = true;             // fdatasync each batch; off, each record is written straight to the page cache
+    uint64_t maxBatchDelayUs = 0; // How long a batch waits for more records before it is written
+};
+
+/**
+ * @brief Fills one snapshot for UserStore::writeSnapshot(), segment by
+ *        segment. Buffers its writes; a failed one is reported when the
+ *        snapshot is committed.
+ */
+class SnapshotWriter
+{
+public:
+    /**
+     * @brief Adds a user to the current segment.
+     */
+    void add(std::string_view username, std::string_view passwordHash);
+
+    /**
+     * @brief Whether the record with @p ticket is in a log this snapshot
+     *        replaces: a change logged but not applied yet must then be
+     *        added, or it is lost with that log.
+     */
+    bool covers(uint64_t ticket) const { return ticket <= sealedEnd_; }
+
+private:
+    friend class UserStore;
+
+    SnapshotWriter(int fd, uint64_t offset, uint64_t sealedEnd) : fd_(fd), offset_(offset), sealedEnd_(sealedEnd) {}
+
+    bool flush();
+
+    int fd_;
+    uint64_t offset_;        // File offset buffer_ goes to
+    uint64_t sealedEnd_;     // Tickets up to here are in the sealed logs
+    std::string buffer_;
+    uint32_t crc_ = 0;       // Of the current segment so far
+    uint64_t users_ = 0;     // In the current segment so far
+    bool failed_ = false;
+};
+
+/**
+ * @brief The persistent side of the user registry: the registered names
+ *        and password hashes (never who is logged in) in one directory.
+ *  - users.wal.<N>: the write-ahead log. Every registration and password
+ *    change is appended as one CRC-checked record before it takes effect.
+ *    Appends are group-committed: they queue in memory and one flusher
+ *    thread writes whatever has queued as a batch, with a single
+ *    fdatasync, then wakes every caller waiting on a record in it.
+ *  - users.snapshot: the whole registry at some point, written to a
+ *    temporary file, fsync'ed and renamed over the old one. Users are
+ *    stored in segments (one per UserManager shard), each with its own
+ *    CRC, so a loader can check and install them in parallel.
+ *
+ * Taking a snapshot first seals the current log and starts log N + 1:
+ * every change in logs up to N is in the snapshot, and logs from N + 1 on
+ * are replayed over it at startup; once the snapshot is renamed into
+ * place, the sealed logs are deleted. A crash at any point leaves either
+ * the old snapshot with every log after it, or the new one with its own.
+ *
+ * Appending is thread-safe; writeSnapshot() may run alongside appends.
+ * open() and the reads belong to startup. The destructor writes out what
+ * is still queued.
+ */
+class UserStore
+{
+public:
+    /**
+     * @brief A store in @p directory; nothing is touched before open().
+     */
+    explicit UserStore(std::string directory, const UserLogOptions& options = UserLogOptions());
+    ~UserStore();
+
+    UserStore(const UserStore&) = delete;
+    UserStore& operator=(const UserStore&) = delete;
+
+    /**
+     * @brief Creates the directory if needed, maps and checks the snapshot,
+     *        opens the newest log for appending and starts the flusher
+     *        thread. A corrupt snapshot
+     *        fails the open rather than starting without its users.
+     *
+     * @return false on error (logged).
+     */
+    bool open();
+
+    /**
+     * @brief Number of segments in the mapped snapshot (0 without one).
+     */
+    size_t snapshotSegments() const { return segmentCount_; }
+
+    /**
+     * @brief Number of users in segment @p segment of the snapshot.
+     */
+    uint64_t snapshotUsers(size_t segment) const;
+
+    /**
+     * @brief Checks segment @p segment against its CRC, then visits its
+     *        users. Reads the mapping only: segments may be read from
+     *        several threads at once.
+     *
+     * @return false (logged) if the segment is corrupt.
+     */
+    bool readSnapshot(size_t segment, const StoredUserVisitor& visit) const;
+
+    /**
+     * @brief Visits every record of the logs written after the snapshot,
+     *        oldest first, then unmaps the snapshot. Stops at the first
+     *        torn or corrupt record (a crash mid-append) and truncates the
+     *        newest log there, so appends continue after the last whole one.
+     *
+     * @return false if a log could not be read.
+     */
+    bool replayLog(const StoredUserVisitor& visit);
+
+    /**
+     * @brief Queues a registration for the log. Call under the lock that
+     *        orders changes to the user; make it visible only once
+     *        waitDurable() succeeds.
+     *
+     * @return The record's ticket for waitDurable(), or 0 (logged) if the
+     *         log cannot take it.
+     */
+    uint64_t appendRegister(std::string_view username, std::string_view passwordHash);
+
+    /**
+     * @brief Queues a password change, as appendRegister(). Call before
+     *        the new hash is in place.
+     */
+    uint64_t appendPassword(std::string_view username, std::string_view passwordHash);
+
+    /**
+     * @brief Blocks until the record with @p ticket, and every one queued
+     *        before it, is written (and synced, with UserLogOptions::sync).
+     *
+     * @return false if the batch holding it failed (logged); the log takes
+     *         no more records after that.
+     */
+    bool waitDurable(uint64_t ticket);
+
+    /**
+     * @brief Bytes logged since the last snapshot, to decide when to take
+     *        the next one.
+     */
+    uint64_t logBytes() const { return logBytes_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Seals the current log and writes a new snapshot with what
+     *        @p fill adds, one call per segment in order; deletes the
+     *        sealed logs once it is durable. One snapshot at a time;
+     *        appends go on meanwhile.
+     *
+     * @param segments How many segments to write.
+     * @param fill     Called for segment 0, 1, ... with the writer to add its users to.
+     * @return false (logged) on error; the previous snapshot and the logs
+     *         then still hold everything.
+     */
+    bool writeSnapshot(size_t segments, const std::function<void(size_t segment, SnapshotWriter& writer)>& fill);
+
+private:
+    struct SnapshotHeader;
+    struct SnapshotSegment;
+
+    std::string path(std::string_view name) const;
+    std::string logPath(uint64_t generation) const;
+
+    /**
+     * @brief Maps users.snapshot if there is one and checks its header
+     *        and segment table.
+     */
+    bool mapSnapshot();
+    void unmapSnapshot();
+
+    /**
+     * @brief Replays one log file; truncates it after its last whole
+     *        record if @p newest.
+     */
+    bool replayLogFile(uint64_t generation, bool newest, const StoredUserVisitor& visit);
+
+    /**
+     * @brief Closes the current log and starts log @p generation, with its
+     *        directory entry synced. Requires logMutex_, and the flusher
+     *        not to be writing.
+     */
+    bool startLogLocked(uint64_t generation);
+
+    uint64_t append(uint8_t type, std::string_view username, std::string_view passwordHash);
+
+    /**
+     * @brief The flusher thread: writes out queued batches and rotates
+     *        the log for writeSnapshot().
+     */
+    void flushLoop();
+
+    /**
+     * @brief Writes @p batch to the end of @p fd and syncs it; cuts off
+     *        whatever part of it landed if that fails.
+     */
+    bool writeBatch(int fd, const std::string& batch);
+
+    std::string directory_;
+    UserLogOptions options_;
+
+    // The mapped snapshot, between open() and replayLog()
+    const char* snapshot_ = nullptr;
+    size_t snapshotSize_ = 0;
+    const SnapshotSegment* segments_ = nullptr;
+    size_t segmentCount_ = 0;
+    uint64_t firstLog_ = 0;            // Oldest log not folded into the snapshot
+    uint64_t lastLog_ = 0;             // Newest log on disk at open()
+
+    std::mutex logMutex_;              // Guards everything below up to logBytes_
+    int logFd_ = -1;                   // Log the flusher writes to
+    uint64_t logGeneration_ = 0;       // Its number
+    std::string pending_;              // Records queued for the next batch
+    uint64_t queuedEnd_ = 0;           // Bytes ever queued: the ticket of the newest record
+    uint64_t durableEnd_ = 0;          // Bytes ever written out: tickets up to here are durable
+    bool failed_ = false;              // A batch failed; appends are refused from then on
+    bool rotate_ = false;              // writeSnapshot() waits for the flusher to start a new log
+    bool rotated_ = false;             // Whether the last rotation succeeded
+    uint64_t rotatedAt_ = 0;           // queuedEnd_ at the end of the log it sealed
+    bool stopping_ = false;
+    std::condition_variable flushWake_;   // Wakes the flusher
+    std::condition_variable durableWake_; // Wakes waitDurable() and writeSnapshot()
+    std::thread flusher_;
+    std::atomic<uint64_t> logBytes_{0};
+
+    std::mutex snapshotMutex_;         // One writeSnapshot() at a time
+};
+
+#endif // USER_STORE_H
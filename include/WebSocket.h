@@ -0,0 +1,114 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include "RingBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * WebSocket transport (RFC 6455) for the text protocol, so browsers can
+ * talk to the server without a proxy in front.
+ *
+ * A client of the WebSocket listener opens with an HTTP/1.1 upgrade
+ * request and is answered "101 Switching Protocols". From then on each
+ * text message carries one or more command lines ("\n" between them, the
+ * end of the message ends the last one) and every reply, heartbeat and
+ * notice comes back as a text message holding complete lines. Binary
+ * messages and v2 frames (HELLO 2) are refused. Pings are answered with
+ * pongs, a close is echoed before the server closes.
+ */
+enum class WsOpcode : uint8_t {
+    Continuation = 0x0,
+    Text         = 0x1,
+    Binary       = 0x2,
+    Close        = 0x8,
+    Ping         = 0x9,
+    Pong         = 0xA
+};
+
+/**
+ * @brief Status codes the server closes with.
+ */
+enum class WsCloseCode : uint16_t {
+    Normal          = 1000,
+    ProtocolError   = 1002,
+    UnsupportedData = 1003,
+    MessageTooBig   = 1009
+};
+
+constexpr size_t MAX_HANDSHAKE_SIZE = 8192;          // Longest upgrade request accepted
+constexpr size_t MAX_WS_MESSAGE_SIZE = 1024 * 1024;  // Longest frame or reassembled message
+constexpr size_t MAX_WS_CONTROL_SIZE = 125;          // Payload limit of close, ping and pong
+constexpr size_t MAX_WS_HEADER_SIZE = 14;            // 2 + 8-byte length + 4-byte mask
+
+/**
+ * @brief One decoded client frame. The payload is already unmasked, in
+ *        place in the input buffer, and stays valid until that is written
+ *        or linearized again.
+ */
+struct WsFrame {
+    WsOpcode opcode = WsOpcode::Text;
+    bool fin = true;
+    std::string_view payload;
+};
+
+/**
+ * @brief Incremental decoder for client frames, the WebSocket counterpart
+ *        of FrameParser: takes every complete frame off the front of a
+ *        RingBuffer and leaves a partial one for the next read. The
+ *        payload is unmasked where it lies (see unmaskPayload()), so
+ *        commands are dispatched without being copied.
+ */
+class WsFrameParser
+{
+public:
+    enum class Result {
+        Frame,    // @p frame was filled in
+        NeedMore, // No complete frame buffered
+        TooLarge, // Payload over MAX_WS_MESSAGE_SIZE: close with 1009
+        Error     // Unmasked, reserved bits or opcode, bad control frame: close with 1002
+    };
+
+    /**
+     * @brief Takes the next complete frame off @p input.
+     */
+    Result next(RingBuffer& input, WsFrame& frame);
+};
+
+/**
+ * @brief Checks an HTTP upgrade request (everything up to and including
+ *        the blank line): a GET over HTTP/1.1 with "Upgrade: websocket",
+ *        "Connection: Upgrade", "Sec-WebSocket-Version: 13" and a
+ *        Sec-WebSocket-Key. Header names and tokens are case-insensitive.
+ *
+ * @param request The request.
+ * @param key     Receives the Sec-WebSocket-Key value, a view into @p request.
+ * @return false if the request is not a valid WebSocket upgrade.
+ */
+bool parseUpgradeRequest(std::string_view request, std::string_view& key);
+
+/**
+ * @brief Returns the Sec-WebSocket-Accept value for @p key:
+ *        base64(SHA-1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11")).
+ */
+std::string webSocketAccept(std::string_view key);
+
+/**
+ * @brief Writes the header of an unmasked, final server frame carrying
+ *        @p payloadSize bytes.
+ *
+ * @param out At least MAX_WS_HEADER_SIZE bytes.
+ * @return The header length (2, 4 or 10).
+ */
+size_t writeWsHeader(char* out, WsOpcode opcode, size_t payloadSize);
+
+/**
+ * @brief XORs @p data with the 4-byte masking key @p key, byte i with
+ *        key[i % 4]. Runs 32 (AVX2) or 16 (SSE2) bytes per step, at the
+ *        level DelimiterScan selected (see scanLevel()).
+ */
+void unmaskPayload(char* data, size_t size, const char key[4]);
+
+#endif // WEBSOCKET_H
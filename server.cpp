@@ -1,12 +1,62 @@
 #include "Server.h"
 #include <iostream>
+#include <string>
 
-int main() {
+int main(int argc, char** argv) {
     const int port = 8088;          // Port to listen on
     const size_t threadCount = 10;  // Number of threads in the ThreadPool
 
+    ServerOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--io-uring") {
+            options.ioBackend = IoBackend::IoUring;
+        } else if (arg == "--acceptors" && i + 1 < argc) {
+            options.acceptorCount = std::stoul(argv[++i]);
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            options.maxConnections = std::stoul(argv[++i]);
+        } else if (arg == "--tls-cert" && i + 1 < argc) {
+            options.tlsCertificatePath = argv[++i];
+        } else if (arg == "--tls-key" && i + 1 < argc) {
+            options.tlsPrivateKeyPath = argv[++i];
+        } else if (arg == "--ktls") {
+            options.tlsKernelOffload = true;
+        } else if (arg == "--websocket" && i + 1 < argc) {
+            options.webSocketPort = std::stoi(argv[++i]);
+        } else if (arg == "--stats" && i + 1 < argc) {
+            options.statsPort = std::stoi(argv[++i]);
+        } else if (arg == "--idle-timeout" && i + 1 < argc) {
+            options.idleTimeoutMs = std::stoull(argv[++i]);
+        } else if (arg == "--login-timeout" && i + 1 < argc) {
+            options.loginTimeoutMs = std::stoull(argv[++i]);
+        } else if (arg == "--heartbeat" && i + 1 < argc) {
+            options.heartbeatIntervalMs = std::stoull(argv[++i]);
+        } else if (arg == "--data" && i + 1 < argc) {
+            options.dataDirectory = argv[++i];
+        } else if (arg == "--log-batch-delay" && i + 1 < argc) {
+            options.userLogBatchDelayUs = std::stoull(argv[++i]);
+        } else if (arg == "--upgrade-socket" && i + 1 < argc) {
+            options.upgradeSocketPath = argv[++i];
+        } else if (arg == "--takeover" && i + 1 < argc) {
+            options.takeoverPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--io-uring] [--acceptors N] [--max-connections N]\n"
+                      << "       [--tls-cert PEM --tls-key PEM [--ktls]] [--websocket PORT]\n"
+                      << "       [--stats PORT]  (GET /stats for JSON, /metrics for Prometheus)\n"
+                      << "       [--idle-timeout MS] [--login-timeout MS] [--heartbeat MS]  (all off by default)\n"
+                      << "       [--data DIR [--log-batch-delay US]]  (keep registered users in DIR\n"
+                      << "       across restarts; hold each log sync up to US for more registrations)\n"
+                      << "       [--upgrade-socket PATH] [--takeover PATH]\n"
+                      << "  Hot upgrade: run the new binary with --takeover PATH (plus\n"
+                      << "  --upgrade-socket PATH to allow the next one) while the old one\n"
+                      << "  runs with --upgrade-socket PATH." << std::endl;
+            return 1;
+        }
+    }
+
     try {
-        Server server(port, threadCount);
+        Server server(port, threadCount, options);
         std::cout << "Server is running on port " << port << std::endl;
         server.start();  // Start the server and accept connections
     } catch (const std::exception& ex) {
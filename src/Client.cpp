@@ -1,9 +1,17 @@
 #include "Client.h"
+#include "LineParser.h"
+#include "Protocol.h"
 #include <iostream>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <sstream>
+#include <thread>
 
 
 Client::Client(uint16_t listenPort, const std::string& serverIP, uint16_t serverPort) : running_(true) {
@@ -28,7 +36,8 @@ Client::Client(uint16_t listenPort, const std::string& serverIP, uint16_t server
 Client::~Client() {
     running_ = false;
 
-    // Close the listener socket
+    // Close the listener socket; shutdown() first wakes the blocked accept()
+    shutdown(listenerSocket_, SHUT_RDWR);
     close(listenerSocket_);
 
     // Join the listener thread
@@ -87,23 +96,143 @@ bool Client::connectToServer(const std::string& serverIP, uint16_t serverPort) {
         return false;
     }
 
+    // Pipelined requests go out in several writes; do not let Nagle hold them
+    int noDelay = 1;
+    setsockopt(serverSocket_, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
     std::cout << "Connected to server at " << serverIP << ":" << serverPort << std::endl;
     return true;
 }
 
-bool Client::registerWithServer(const std::string& username, const std::string& password) {
-    std::string command = "REGISTER " + username + " " + password + "\n";
-    send(serverSocket_, command.c_str(), command.size(), 0);
+// Sends all of data, however many send() calls it takes
+bool Client::sendAll(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(serverSocket_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
 
-    char buffer[1024];
-    ssize_t bytesRead = recv(serverSocket_, buffer, sizeof(buffer) - 1, 0);
-    if (bytesRead <= 0) {
-        std::cerr << "Failed to register: " << strerror(errno) << std::endl;
+// Reads one response line (without its "\n"); keeps what follows it in inbox_
+bool Client::readLine(std::string& line) {
+    size_t newline;
+    while ((newline = inbox_.find('\n')) == std::string::npos) {
+        char buffer[4096];
+        ssize_t bytesRead = recv(serverSocket_, buffer, sizeof(buffer), 0);
+        if (bytesRead <= 0) {
+            if (bytesRead < 0 && errno == EINTR) continue;
+            if (bytesRead == 0) errno = ECONNRESET;
+            return false;
+        }
+        inbox_.append(buffer, static_cast<size_t>(bytesRead));
+    }
+
+    line.assign(inbox_, 0, newline);
+    inbox_.erase(0, newline + 1);
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    return true;
+}
+
+// Sends one command and reads its response, answering heartbeats meanwhile
+bool Client::roundTrip(const std::string& command, std::string& response) {
+    if (!sendAll(command)) {
+        return false;
+    }
+    while (readLine(response)) {
+        if (response != "PING") {
+            return true;
+        }
+        sendAll("PONG\n");
+    }
+    return false;
+}
+
+namespace {
+// Parses "OK <ip>:<port>" into address
+bool parseAddress(const std::string& response, std::pair<std::string, uint16_t>& address) {
+    size_t colonPos = response.rfind(':');
+    if (response.compare(0, 3, "OK ") != 0 || colonPos == std::string::npos || colonPos < 3) {
         return false;
     }
+    address.first = response.substr(3, colonPos - 3);
+    address.second = static_cast<uint16_t>(std::atoi(response.c_str() + colonPos + 1));
+    return true;
+}
+
+// The server's rate limiter refused the request without running it, so it
+// can be sent again later; not the same as a user that is not found
+bool isRateLimited(const std::string& response) {
+    return response == "ERR RATE_LIMITED";
+}
+
+// Paces requests the server refused as rate limited: after a refusal
+// nothing more goes out until a delay has passed, and the delay doubles
+// each time until a request gets through again
+class RetryBackoff {
+public:
+    // Holds further requests back, unless they already are
+    void refused() {
+        if (!holding_) {
+            holding_ = true;
+            resumeAt_ = std::chrono::steady_clock::now() + delay_;
+        }
+    }
+
+    // A request got through: the limiter is refilling, start over
+    void succeeded() {
+        delay_ = FIRST_DELAY;
+        rounds_ = 0;
+    }
+
+    // Whether requests may go out now; ends a hold that is over
+    bool ready() {
+        if (holding_ && std::chrono::steady_clock::now() < resumeAt_) {
+            return false;
+        }
+        if (holding_) {
+            holding_ = false;
+            delay_ = std::min(delay_ * 2, MAX_DELAY);
+            ++rounds_;
+        }
+        return true;
+    }
+
+    // Sleeps out the hold; false when refusals have gone on for MAX_ROUNDS
+    // holds with nothing getting through, and the caller should give up
+    bool wait() {
+        if (rounds_ >= MAX_ROUNDS) {
+            return false;
+        }
+        std::this_thread::sleep_until(resumeAt_);
+        return ready();
+    }
+
+private:
+    static constexpr std::chrono::milliseconds FIRST_DELAY{10};
+    static constexpr std::chrono::milliseconds MAX_DELAY{1000};
+    static constexpr unsigned MAX_ROUNDS = 10; // About 6 s of waiting
 
-    buffer[bytesRead] = '\0';
-    return std::string(buffer).substr(0, 2) == "OK";
+    std::chrono::milliseconds delay_ = FIRST_DELAY;
+    std::chrono::steady_clock::time_point resumeAt_;
+    bool holding_ = false;
+    unsigned rounds_ = 0;
+};
+}
+
+bool Client::registerWithServer(const std::string& username, const std::string& password) {
+    std::string response;
+    if (!roundTrip("REGISTER " + username + " " + password + "\n", response)) {
+        std::cerr << "Failed to register: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return response.substr(0, 2) == "OK";
 }
 
 bool Client::loginToServer(const std::string& username, const std::string& password) {
@@ -111,57 +240,200 @@ bool Client::loginToServer(const std::string& username, const std::string& passw
     inet_ntop(AF_INET, &listenerAddr_.sin_addr, localIP, sizeof(localIP));
 
     std::string command = "LOGIN " + username + " " + password + " " + localIP + " " + std::to_string(ntohs(listenerAddr_.sin_port)) + "\n";
-    send(serverSocket_, command.c_str(), command.size(), 0);
-
-    char buffer[1024];
-    ssize_t bytesRead = recv(serverSocket_, buffer, sizeof(buffer) - 1, 0);
-    if (bytesRead <= 0) {
+    std::string response;
+    if (!roundTrip(command, response)) {
         std::cerr << "Failed to login: " << strerror(errno) << std::endl;
         return false;
     }
-
-    buffer[bytesRead] = '\0';
-    return std::string(buffer).substr(0, 2) == "OK";
+    return response.substr(0, 2) == "OK";
 }
 
 bool Client::logoutFromServer() {
-    std::string command = "LOGOUT\n";
-    send(serverSocket_, command.c_str(), command.size(), 0);
-
-    char buffer[1024];
-    ssize_t bytesRead = recv(serverSocket_, buffer, sizeof(buffer) - 1, 0);
-    if (bytesRead <= 0) {
+    std::string response;
+    if (!roundTrip("LOGOUT\n", response)) {
         std::cerr << "Failed to logout: " << strerror(errno) << std::endl;
         return false;
     }
-
-    buffer[bytesRead] = '\0';
-    return std::string(buffer).substr(0, 2) == "OK";
+    return response.substr(0, 2) == "OK";
 }
 
 std::pair<std::string, uint16_t> Client::getClientInfo(const std::string& username) {
-    std::string command = "GETINFO " + username + "\n";
-    send(serverSocket_, command.c_str(), command.size(), 0);
+    std::string response;
+    RetryBackoff backoff;
+    do {
+        if (!roundTrip("GETINFO " + username + "\n", response)) {
+            std::cerr << "Failed to get client info: " << strerror(errno) << std::endl;
+            return {"", 0};
+        }
+        if (!isRateLimited(response)) {
+            break;
+        }
+        backoff.refused();
+    } while (backoff.wait());
 
-    char buffer[1024];
-    ssize_t bytesRead = recv(serverSocket_, buffer, sizeof(buffer) - 1, 0);
-    if (bytesRead <= 0) {
-        std::cerr << "Failed to get client info: " << strerror(errno) << std::endl;
+    std::pair<std::string, uint16_t> address;
+    if (!parseAddress(response, address)) {
+        std::cerr << "Error from server: " << response << std::endl;
         return {"", 0};
     }
+    return address;
+}
+
+std::vector<std::pair<std::string, uint16_t>> Client::getClientInfos(const std::vector<std::string>& usernames) {
+    std::vector<std::pair<std::string, uint16_t>> addresses(usernames.size(), {"", 0});
+    std::vector<bool> waiting(usernames.size(), false);
+    std::deque<size_t> pending; // Not sent yet, or refused and to be sent again
+    for (size_t i = 0; i < usernames.size(); ++i) {
+        pending.push_back(i);
+    }
+    size_t inFlight = 0;
+    size_t received = 0;
+    RetryBackoff backoff;
+    std::string batch;
+    std::string line;
+
+    while (received < usernames.size()) {
+        // Top the window up once half of it is answered, so requests go out
+        // in large writes. Request i is tagged "#<i + 1>", also when resent.
+        batch.clear();
+        if (inFlight <= PIPELINE_WINDOW / 2 && backoff.ready()) {
+            for (; !pending.empty() && inFlight < PIPELINE_WINDOW; ++inFlight) {
+                size_t i = pending.front();
+                pending.pop_front();
+                waiting[i] = true;
+                batch += "#" + std::to_string(i + 1) + " GETINFO " + usernames[i] + "\n";
+            }
+        }
+        if (!batch.empty() && !sendAll(batch)) {
+            std::cerr << "Failed to send lookups: " << strerror(errno) << std::endl;
+            return std::vector<std::pair<std::string, uint16_t>>(usernames.size(), {"", 0});
+        }
+        if (inFlight == 0) {
+            // All that is left was refused; let the server's limiter refill
+            if (!backoff.wait()) {
+                std::cerr << "Failed to get client info: rate limited by server" << std::endl;
+                return std::vector<std::pair<std::string, uint16_t>>(usernames.size(), {"", 0});
+            }
+            continue;
+        }
 
-    buffer[bytesRead] = '\0';
-    std::string response(buffer);
+        if (!readLine(line)) {
+            std::cerr << "Failed to get client info: " << strerror(errno) << std::endl;
+            return std::vector<std::pair<std::string, uint16_t>>(usernames.size(), {"", 0});
+        }
+        if (line == "PING") {
+            sendAll("PONG\n");
+            continue;
+        }
 
-    if (response.substr(0, 3) == "OK ") {
-        size_t colonPos = response.find(':');
-        std::string ip = response.substr(3, colonPos - 3);
-        uint16_t port = static_cast<uint16_t>(std::stoi(response.substr(colonPos + 1)));
-        return {ip, port};
-    } else {
-        std::cerr << "Error from server: " << response << std::endl;
-        return {"", 0};
+        // "#<n> OK <ip>:<port>" or "#<n> ERR ..."; untagged lines are not ours
+        size_t space = line.find(' ');
+        if (line.empty() || line[0] != '#' || space == std::string::npos) {
+            std::cerr << "Unexpected response from server: " << line << std::endl;
+            continue;
+        }
+        size_t index = std::strtoul(line.c_str() + 1, nullptr, 10) - 1;
+        if (index >= usernames.size() || !waiting[index]) {
+            std::cerr << "Unexpected response from server: " << line << std::endl;
+            continue;
+        }
+        waiting[index] = false;
+        --inFlight;
+        std::string response = line.substr(space + 1);
+        if (isRateLimited(response)) {
+            backoff.refused();
+            pending.push_back(index);
+            continue;
+        }
+        backoff.succeeded();
+        ++received;
+        parseAddress(response, addresses[index]);
+    }
+    return addresses;
+}
+
+std::vector<std::pair<std::string, uint16_t>> Client::getClientInfoBatch(const std::vector<std::string>& usernames) {
+    const size_t BATCH_WINDOW = 4; // MGETINFO commands in flight
+    std::vector<std::pair<std::string, uint16_t>> addresses(usernames.size(), {"", 0});
+
+    // Split into commands that fit the server's line and batch limits;
+    // command c covers usernames [starts[c], starts[c + 1])
+    std::vector<std::string> commands;
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < usernames.size(); ++i) {
+        if (commands.empty() || i - starts.back() == MAX_BATCH_LOOKUP ||
+            commands.back().size() + 1 + usernames[i].size() > MAX_LINE_SIZE) {
+            commands.push_back("MGETINFO");
+            starts.push_back(i);
+        }
+        commands.back() += " " + usernames[i];
+    }
+    starts.push_back(usernames.size());
+
+    // Untagged, so replies come in the order the commands went out: one
+    // line per command
+    std::deque<size_t> pending; // Not sent yet, or refused and to be sent again
+    std::deque<size_t> inFlight;
+    for (size_t c = 0; c < commands.size(); ++c) {
+        pending.push_back(c);
+    }
+    size_t received = 0;
+    RetryBackoff backoff;
+    std::string batch;
+    std::string line;
+    while (received < commands.size()) {
+        batch.clear();
+        if (backoff.ready()) {
+            while (!pending.empty() && inFlight.size() < BATCH_WINDOW) {
+                batch += commands[pending.front()] + "\n";
+                inFlight.push_back(pending.front());
+                pending.pop_front();
+            }
+        }
+        if (!batch.empty() && !sendAll(batch)) {
+            std::cerr << "Failed to send lookups: " << strerror(errno) << std::endl;
+            return std::vector<std::pair<std::string, uint16_t>>(usernames.size(), {"", 0});
+        }
+        if (inFlight.empty()) {
+            // All that is left was refused; let the server's limiter refill
+            if (!backoff.wait()) {
+                std::cerr << "Failed to get client info: rate limited by server" << std::endl;
+                return std::vector<std::pair<std::string, uint16_t>>(usernames.size(), {"", 0});
+            }
+            continue;
+        }
+
+        if (!readLine(line)) {
+            std::cerr << "Failed to get client info: " << strerror(errno) << std::endl;
+            return std::vector<std::pair<std::string, uint16_t>>(usernames.size(), {"", 0});
+        }
+        if (line == "PING") {
+            sendAll("PONG\n");
+            continue;
+        }
+        size_t c = inFlight.front();
+        inFlight.pop_front();
+        if (isRateLimited(line)) {
+            backoff.refused();
+            pending.push_back(c);
+            continue;
+        }
+        backoff.succeeded();
+
+        // "OK <count> <ip>:<port>|- ..."
+        std::istringstream records(line);
+        std::string status, record;
+        size_t count = 0;
+        records >> status >> count;
+        if (status != "OK" || count != starts[c + 1] - starts[c]) {
+            std::cerr << "Error from server: " << line << std::endl;
+        }
+        for (size_t i = starts[c]; i < starts[c + 1] && records >> record; ++i) {
+            parseAddress("OK " + record, addresses[i]);
+        }
+        ++received;
     }
+    return addresses;
 }
 
 bool Client::connectToClient(const std::string& ipAddress, uint16_t port) {
@@ -1,16 +1,39 @@
 #include "Connection.h"
 #include "UserManager.h"
+#include "ThreadPool.h"
 
 #include <iostream>    // For std::cerr, std::cout (debugging/logging)
-#include <sstream>
+#include <charconv>    // For std::from_chars, std::to_chars
 #include <cstring>     // For strerror
 #include <cerrno>      // For errno
 #include <arpa/inet.h>
+#include <sys/epoll.h> // For EPOLLIN / EPOLLOUT
 
 #ifdef USE_OPENSSL
 #include <openssl/err.h> // For SSL error strings
 #endif
 
+#ifdef USE_IO_URING
+#include "UringEngine.h"
+#endif
+
+namespace {
+// The text command a request frame stands for, so stats count both protocols alike
+Command frameCommand(Opcode opcode)
+{
+    switch (opcode) {
+    case Opcode::Register: return Command::Register;
+    case Opcode::Login:    return Command::Login;
+    case Opcode::Logout:   return Command::Logout;
+    case Opcode::GetInfo:  return Command::GetInfo;
+    case Opcode::MGetInfo: return Command::MGetInfo;
+    case Opcode::Ping:     return Command::Ping;
+    case Opcode::Pong:     return Command::Pong;
+    default:               return Command::Unknown;
+    }
+}
+}
+
 // -----------------------------------------------------------------------------
 // Constructor: Store the socket FD and client address, set connected_ = true.
 // -----------------------------------------------------------------------------
@@ -18,10 +41,9 @@ Connection::Connection(int socketFd, const sockaddr_in& clientAddr, UserManager&
     : socketFd_(socketFd),
       clientAddr_(clientAddr),
       userManager_(userManager), 
+      lastActivityMs_(TimerWheel::monotonicMs()),
+      loggedIn_(false),
       connected_(true)
-#ifdef USE_OPENSSL
-    , sslHandle_(nullptr)
-#endif
 {
     // Optionally, you can store or print the client's IP/port:
     // char clientIP[INET_ADDRSTRLEN];
@@ -39,34 +61,404 @@ Connection::~Connection()
 }
 
 // -----------------------------------------------------------------------------
-// handleClient(): The main loop for interacting with the client. 
-// Reads data until client disconnects or an error occurs, 
-// then processes the data as needed.
+// start(): Create the session coroutine and run it up to its first wait.
+// -----------------------------------------------------------------------------
+void Connection::start(ArmFunction arm, CloseFunction onClose)
+{
+    {
+        // send() from another thread may already want to arm the loop
+        std::lock_guard<std::mutex> lock(ioMutex_);
+        arm_ = std::move(arm);
+    }
+    onClose_ = std::move(onClose);
+    session_ = handleClient();
+    session_.resume();
+}
+
+// -----------------------------------------------------------------------------
+// handleClient(): The session coroutine. Reads like the old blocking loop,
+// but every co_await parks the coroutine on the event loop instead of
+// blocking a worker, so a few threads can serve thousands of sessions.
 // -----------------------------------------------------------------------------
-void Connection::handleClient()
+SessionTask Connection::handleClient()
 {
-    const size_t BUFFER_SIZE = 1024;
-    char buffer[BUFFER_SIZE];
+    const size_t READ_SIZE = 1024; // Free space guaranteed to each read
+
+#ifdef USE_OPENSSL
+    // The handshake parks on the loop like any read, instead of holding a
+    // worker for the round trips
+    if (sslHandle_ && co_await handshake() < 0) {
+        if (onClose_) {
+            onClose_();
+        }
+        co_return;
+    }
+#endif
 
     // Keep receiving data until an error or disconnect
     while (connected_) {
-        // 1) Receive data
-        ssize_t bytesRead = receiveData(buffer, BUFFER_SIZE);
+        // 1) Receive data straight into the input ring, behind any partial
+        //    command left from the previous read
+        input_.reserve(READ_SIZE);
+        ssize_t bytesRead = co_await read(input_.writeData(), input_.writable());
         if (bytesRead <= 0) {
             // If 0 or negative, the client likely disconnected or an error occurred
             break;
         }
+        input_.commit(static_cast<size_t>(bytesRead));
 
-        // 2) Process the data (application-specific logic)
-        processData(buffer, static_cast<size_t>(bytesRead));
+        // 2) Run every complete command; a partial one waits for more input
+        if (!processInput()) {
+            break; // Corrupt stream; the error is queued, the exit path flushes it
+        }
+        input_.shrink(); // Give back what a large command made us grow
+
+        // 3) Flush the responses processInput() queued; only waits if the
+        //    client let them pile up past the high watermark
+        if (co_await flush() < 0) {
+            break;
+        }
+    }
 
-        // Depending on your protocol, you might send a response via sendData() here
-        // For example:
-        //sendData("OK", 2);
+    // Last chance for queued output, e.g. after a half-close
+    {
+        std::lock_guard<std::mutex> lock(ioMutex_);
+        flushLocked();
     }
 
-    // If we reach here, the loop ended => close the connection
-    closeConnection();
+    // If we reach here, the session is over => let the Server close us
+    if (onClose_) {
+        onClose_();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// onReady(): The loop saw the socket become ready. The fd is one-shot, so
+// it stays disabled until armLocked() runs again.
+// -----------------------------------------------------------------------------
+void Connection::onReady(uint32_t events)
+{
+    std::coroutine_handle<> handle;
+    std::function<void()> writable;
+    {
+        std::lock_guard<std::mutex> lock(ioMutex_);
+        armedEvents_ = 0;
+        if (!connected_) {
+            return;
+        }
+
+        if (writeBlocked_ || (events & EPOLLOUT)) {
+            flushLocked();
+        }
+
+        // A wakeup can be spurious (e.g. only half a TLS record arrived):
+        // then stay parked and re-arm instead of resuming.
+        bool resume = waiting_ && completePendingIo();
+        if (!resume) {
+            resume = !armLocked();
+        }
+        if (resume) {
+            handle = waiting_;
+            waiting_ = nullptr;
+        }
+        writable = takeWritableCallbackLocked();
+    }
+
+    if (writable) {
+        writable();
+    }
+    if (handle) {
+        handle.resume();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// send(): Queue output from any thread. Writes through while the socket has
+// room; once it is full, EPOLLOUT takes over and the caller sees backpressure
+// instead of a blocked worker.
+// -----------------------------------------------------------------------------
+Connection::SendStatus Connection::send(const char* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    return sendLocked(data, size);
+}
+
+Connection::SendStatus Connection::sendLocked(const char* data, size_t size)
+{
+#ifdef USE_IO_URING
+    if (uringSession_) {
+        // The ring queues sends itself; they never block the caller
+        return queueOutput(data, size) < 0 ? SendStatus::Closed : SendStatus::Queued;
+    }
+#endif
+
+    if (!connected_ || writeFailed_) {
+        return SendStatus::Closed;
+    }
+
+    queueOutput(data, size);
+    if (!writeBlocked_) {
+        flushLocked();
+    }
+    if (writeBlocked_ && !(armedEvents_ & EPOLLOUT)) {
+        armLocked();
+    }
+    if (writeFailed_) {
+        return SendStatus::Closed;
+    }
+
+    if (outbound_.aboveHighWatermark()) {
+        backpressured_ = true;
+        return SendStatus::Backpressure;
+    }
+    return SendStatus::Queued;
+}
+
+// -----------------------------------------------------------------------------
+// expire(): Timer-driven close. Shutting down only the read side wakes the
+// parked read with end-of-file, so the session ends through its normal path
+// and the error message can still be flushed.
+// -----------------------------------------------------------------------------
+void Connection::expire(const std::string& reason)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    sendNoticeLocked(Opcode::Goodbye, reason);
+    if (socketFd_ >= 0) {
+        ::shutdown(socketFd_, SHUT_RD);
+    }
+}
+
+void Connection::sendPing()
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    sendNoticeLocked(Opcode::Ping, "PING");
+}
+
+void Connection::sendNoticeLocked(Opcode opcode, const std::string& text)
+{
+    if (protocolVersion_ != PROTOCOL_VERSION) {
+        std::string line = text + "\n";
+        sendLocked(line.data(), line.size());
+        return;
+    }
+
+    std::string frame;
+    FrameWriter writer(frame);
+    writer.start(opcode, 0);
+    if (opcode == Opcode::Goodbye) {
+        writer.writeString(text);
+    }
+    writer.finish();
+    sendLocked(frame.data(), frame.size());
+}
+
+void Connection::setWatermarks(size_t lowWatermark, size_t highWatermark)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    outbound_.setWatermarks(lowWatermark, highWatermark);
+}
+
+void Connection::setRateLimiters(RateLimiter* perIp, RateLimiter* perUser)
+{
+    ipLimiter_ = perIp;
+    userLimiter_ = perUser;
+}
+
+void Connection::setLookupPool(ThreadPool* pool)
+{
+    lookupPool_ = pool;
+}
+
+void Connection::setStats(ServerStats* stats)
+{
+    stats_ = stats;
+}
+
+void Connection::setWritableCallback(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    writableCallback_ = std::move(callback);
+}
+
+size_t Connection::outboundSize()
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    return outbound_.size();
+}
+
+Connection::IoAwaitable Connection::read(char* buffer, size_t size)
+{
+    pending_ = PendingIo();
+    pending_.events = EPOLLIN;
+    pending_.readBuffer = buffer;
+    pending_.size = size;
+    return IoAwaitable(*this);
+}
+
+Connection::IoAwaitable Connection::flush()
+{
+    pending_ = PendingIo();
+    pending_.kind = PendingIo::Kind::Flush;
+    pending_.events = EPOLLOUT;
+    return IoAwaitable(*this);
+}
+
+#ifdef USE_OPENSSL
+Connection::IoAwaitable Connection::handshake()
+{
+    pending_ = PendingIo();
+    pending_.kind = PendingIo::Kind::Handshake;
+    pending_.events = EPOLLIN;
+    return IoAwaitable(*this);
+}
+#endif
+
+ssize_t Connection::IoAwaitable::await_resume()
+{
+    if (connection_.pending_.result < 0) {
+        errno = connection_.pending_.error;
+    }
+    return connection_.pending_.result;
+}
+
+bool Connection::tryPendingIo()
+{
+    bool completed;
+    std::function<void()> writable;
+    {
+        std::lock_guard<std::mutex> lock(ioMutex_);
+        completed = completePendingIo();
+        writable = takeWritableCallbackLocked();
+    }
+    if (writable) {
+        writable();
+    }
+    return completed;
+}
+
+bool Connection::suspendOnPendingIo(std::coroutine_handle<> handle)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    waiting_ = handle;
+    if (armLocked()) {
+        // From here on another worker may resume us: touch nothing
+        return true;
+    }
+    waiting_ = nullptr;
+    return false;
+}
+
+bool Connection::completePendingIo()
+{
+#ifdef USE_OPENSSL
+    if (pending_.kind == PendingIo::Kind::Handshake) {
+        return completeHandshakeLocked();
+    }
+#endif
+
+    if (pending_.kind == PendingIo::Kind::Read) {
+        ssize_t bytesRead = receiveData(pending_.readBuffer, pending_.size);
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+#ifdef USE_OPENSSL
+            // A TLS read may need to write first (e.g. a key update reply)
+            pending_.events = sslHandle_ && SSL_want_write(sslHandle_) ? EPOLLOUT : EPOLLIN;
+#endif
+            return false;
+        }
+        pending_.result = bytesRead;
+        pending_.error = bytesRead < 0 ? errno : 0;
+        if (bytesRead > 0) {
+            lastActivityMs_.store(TimerWheel::monotonicMs(), std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // EPOLLOUT: write what we can, then decide whether the queue is short
+    // enough to go on reading. Parked, we hold out for the low watermark.
+    if (!flushLocked()) {
+        pending_.result = -1;
+        pending_.error = EPIPE;
+        return true;
+    }
+    if (waiting_ ? outbound_.belowLowWatermark() : !outbound_.aboveHighWatermark()) {
+        pending_.result = 0;
+        return true;
+    }
+    return false;
+}
+
+bool Connection::armLocked()
+{
+    while (arm_) {
+        uint32_t events = (waiting_ ? pending_.events : 0u) | (writeBlocked_ ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        if (events == 0) {
+            return true; // Nothing to wait for
+        }
+
+        switch (arm_(events)) {
+        case ArmResult::Armed:
+            armedEvents_ = events;
+            return true;
+        case ArmResult::Retry:
+            if (!waiting_) {
+                return true;
+            }
+            if (completePendingIo()) {
+                return false;
+            }
+            break;
+        case ArmResult::Failed:
+            writeBlocked_ = false;
+            writeFailed_ = true;
+            outbound_.clear();
+            if (waiting_) {
+                pending_.result = -1;
+                pending_.error = EIO;
+                return false;
+            }
+            return true;
+        }
+    }
+    return true; // Not started yet: the first park arms everything
+}
+
+bool Connection::flushLocked()
+{
+    if (writeFailed_ || socketFd_ < 0) {
+        return false;
+    }
+
+    OutboundQueue::FlushResult result;
+#ifdef USE_OPENSSL
+    if (sslHandle_ && !handshakeDone_) {
+        return true; // Output waits for the keys; the handshake flushes it
+    }
+    if (sslHandle_ && !kernelTlsSend_) {
+        result = outbound_.flush([this](const char* data, size_t size) { return writeSome(data, size); });
+    } else
+#endif
+    // Plain TCP, or kTLS: the kernel encrypts, so the gathered write stays
+    result = outbound_.flush(socketFd_);
+
+    writeBlocked_ = (result == OutboundQueue::FlushResult::WouldBlock);
+    if (result == OutboundQueue::FlushResult::Error) {
+        if (errno != EPIPE && errno != ECONNRESET) {
+            std::cerr << "sendmsg() failed: " << strerror(errno) << std::endl;
+        }
+        writeFailed_ = true;
+        outbound_.clear();
+        return false;
+    }
+    return true;
+}
+
+std::function<void()> Connection::takeWritableCallbackLocked()
+{
+    if (!backpressured_ || !outbound_.belowLowWatermark()) {
+        return nullptr;
+    }
+    backpressured_ = false;
+    return writableCallback_;
 }
 
 // -----------------------------------------------------------------------------
@@ -74,6 +466,14 @@ void Connection::handleClient()
 // -----------------------------------------------------------------------------
 void Connection::closeConnection()
 {
+    // A disconnect logs the user out, unless they have logged in again since
+    if (user_) {
+        userManager_.closeSession(user_);
+        user_ = UserHandle();
+    }
+
+    // Keeps send() from other threads off the fd while it is closed
+    std::lock_guard<std::mutex> lock(ioMutex_);
     if (!connected_) {
         return; // Already closed
     }
@@ -92,12 +492,55 @@ void Connection::closeConnection()
         socketFd_ = -1;
     }
 
+    outbound_.clear();
+    connected_ = false;
+}
+
+// -----------------------------------------------------------------------------
+// detach()/restore(): Hot upgrade. The kernel keeps any unread input in the
+// socket, so only what sits in user space (queued output) and the session
+// state travel with the fd.
+// -----------------------------------------------------------------------------
+int Connection::detach(SessionState& state)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    state.loggedIn = loggedIn_;
+    state.username = user_ ? user_.username() : "";
+    user_ = UserHandle(); // The session lives on in the new process: no logout on close
+    state.protocolVersion = protocolVersion_;
+    state.pendingInput = input_.takeAll();
+    state.pendingOutput = outbound_.takeAll();
+    state.webSocket = webSocket_;
+    state.webSocketOpen = webSocketOpen_;
+    state.webSocketFragmented = wsFragmented_;
+    state.webSocketMessage = std::move(wsMessage_);
+    int fd = socketFd_;
+    socketFd_ = -1;
     connected_ = false;
+    return fd;
+}
+
+void Connection::restore(const SessionState& state)
+{
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    loggedIn_ = state.loggedIn;
+    user_ = state.username.empty() ? UserHandle() : userManager_.resumeSession(state.username);
+    protocolVersion_ = state.protocolVersion;
+    input_.append(state.pendingInput.data(), state.pendingInput.size());
+    webSocket_ = state.webSocket;
+    webSocketOpen_ = state.webSocketOpen;
+    wsFragmented_ = state.webSocketFragmented;
+    wsMessage_ = state.webSocketMessage;
+    if (!state.pendingOutput.empty()) {
+        outbound_.append(state.pendingOutput.data(), state.pendingOutput.size());
+        writeBlocked_ = true; // The first park also waits for EPOLLOUT
+    }
 }
 
 // -----------------------------------------------------------------------------
 // Optional: Setup SSL for this connection (if USE_OPENSSL is defined).
-// This method performs the SSL handshake.
+// This method only prepares the SSL object; handleClient() runs the
+// handshake without blocking.
 // -----------------------------------------------------------------------------
 #ifdef USE_OPENSSL
 bool Connection::setupSSL(SSL_CTX* sslContext)
@@ -114,20 +557,58 @@ bool Connection::setupSSL(SSL_CTX* sslContext)
     }
 
     // Bind the SSL object with our socket
-    SSL_set_fd(sslHandle_, socketFd_);
-
-    // Perform SSL handshake
-    int ret = SSL_accept(sslHandle_);
-    if (ret <= 0) {
-        int error = SSL_get_error(sslHandle_, ret);
-        std::cerr << "SSL_accept failed. Error: " << error << std::endl;
-        ERR_print_errors_fp(stderr); // Print detailed error info
+    if (SSL_set_fd(sslHandle_, socketFd_) != 1) {
+        std::cerr << "SSL_set_fd failed.\n";
         SSL_free(sslHandle_);
         sslHandle_ = nullptr;
         return false;
     }
+    SSL_set_accept_state(sslHandle_);
+    return true;
+}
+
+bool Connection::sessionReused() const
+{
+    return sslHandle_ && SSL_session_reused(sslHandle_);
+}
+
+bool Connection::kernelTlsActive() const
+{
+    return sslHandle_ && BIO_get_ktls_send(SSL_get_wbio(sslHandle_));
+}
+
+// -----------------------------------------------------------------------------
+// completeHandshakeLocked(): One step of the handshake. OpenSSL says which
+// direction it is stuck on, so the coroutine parks for exactly that.
+// -----------------------------------------------------------------------------
+bool Connection::completeHandshakeLocked()
+{
+    int ret = SSL_do_handshake(sslHandle_);
+    if (ret == 1) {
+        // With SSL_OP_ENABLE_KTLS OpenSSL installed the keys into the socket
+        // if the kernel and cipher allow it; otherwise it stays in userspace
+        kernelTlsSend_ = BIO_get_ktls_send(SSL_get_wbio(sslHandle_));
+        handshakeDone_ = true;
+        pending_.result = flushLocked() ? 0 : -1; // e.g. a heartbeat queued meanwhile
+        pending_.error = pending_.result < 0 ? EPIPE : 0;
+        return true;
+    }
+
+    int error = SSL_get_error(sslHandle_, ret);
+    if (error == SSL_ERROR_WANT_READ) {
+        pending_.events = EPOLLIN;
+        return false;
+    }
+    if (error == SSL_ERROR_WANT_WRITE) {
+        pending_.events = EPOLLOUT;
+        return false;
+    }
 
-    std::cout << "SSL handshake successful.\n";
+    // Scanners and plain-TCP clients end up here; keep it to one line
+    std::cerr << "SSL handshake failed. Error: " << error << std::endl;
+    ERR_clear_error();
+    pending_.result = -1;
+    pending_.error = EPROTO;
     return true;
 }
 #endif // USE_OPENSSL
@@ -147,6 +628,10 @@ ssize_t Connection::receiveData(char* buffer, size_t size)
             if (error == SSL_ERROR_ZERO_RETURN) {
                 // SSL connection closed
                 return 0;
+            } else if (error == SSL_ERROR_WANT_READ) {
+                // No complete record buffered yet
+                errno = EAGAIN;
+                return -1;
             } else {
                 // Some other SSL read error
                 std::cerr << "SSL_read error: " << error << std::endl;
@@ -157,25 +642,118 @@ ssize_t Connection::receiveData(char* buffer, size_t size)
     }
 #endif
 
+#ifdef USE_IO_URING
+    if (uringSession_) {
+        // Bytes were already received by the ring's multishot recv
+        return uringSession_->receive(buffer, size);
+    }
+#endif
+
     // Non-SSL case: use recv()
     ssize_t bytesRead = ::recv(socketFd_, buffer, size, 0);
-    if (bytesRead < 0) {
+    if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
         std::cerr << "recv() failed: " << strerror(errno) << std::endl;
     }
     return bytesRead;
 }
 
 // -----------------------------------------------------------------------------
-// sendData(): Write data to the socket or SSL.
-// Returns the number of bytes written, or -1 on error.
+// sendData(): Queue a response. handleClient() flushes the queue once
+// processInput() returns, so one read's responses share one gathered write
+// and a full socket parks the coroutine, not a thread.
 // -----------------------------------------------------------------------------
 ssize_t Connection::sendData(const char* data, size_t size)
 {
+#ifdef USE_IO_URING
+    if (uringSession_) {
+        // Queued as a linked send SQE; never blocks the worker
+        return queueOutput(data, size);
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    if (writeFailed_) {
+        errno = EPIPE;
+        return -1;
+    }
+    return queueOutput(data, size);
+}
+
+// -----------------------------------------------------------------------------
+// queueOutput()/queueRaw()/queueWsFrame(): The one place output is framed,
+// so replies, lookup batches, heartbeats and notices all reach a WebSocket
+// client as messages, on either backend.
+// -----------------------------------------------------------------------------
+ssize_t Connection::queueOutput(const char* data, size_t size)
+{
+    if (!webSocket_) {
+        return queueRaw(data, size);
+    }
+    // Before the 101 the client speaks HTTP: a heartbeat that early is dropped
+    return webSocketOpen_ ? queueWsFrame(WsOpcode::Text, data, size) : static_cast<ssize_t>(size);
+}
+
+ssize_t Connection::queueRaw(const char* data, size_t size)
+{
+#ifdef USE_IO_URING
+    if (uringSession_) {
+        return uringSession_->send(data, size);
+    }
+#endif
+    outbound_.append(data, size);
+    return static_cast<ssize_t>(size);
+}
+
+ssize_t Connection::queueWsFrame(WsOpcode opcode, const char* data, size_t size)
+{
+    char header[MAX_WS_HEADER_SIZE];
+    size_t headerSize = writeWsHeader(header, opcode, size);
+#ifdef USE_IO_URING
+    if (uringSession_) {
+        std::string frame;
+        frame.reserve(headerSize + size);
+        frame.append(header, headerSize);
+        frame.append(data, size);
+        return uringSession_->send(std::move(frame)) < 0 ? -1 : static_cast<ssize_t>(size);
+    }
+#endif
+    outbound_.append(header, headerSize);
+    outbound_.append(data, size);
+    return static_cast<ssize_t>(size);
+}
+
+void Connection::sendLine(std::string_view text)
+{
+    beginLine();
+    response_.append(text);
+    response_.push_back('\n');
+    sendData(response_.data(), response_.size());
+}
+
+void Connection::beginLine()
+{
+    response_.assign(tag_);
+    if (!tag_.empty()) {
+        response_.push_back(' ');
+    }
+}
+
+// -----------------------------------------------------------------------------
+// writeSome(): Write data to the socket or SSL; the OutboundQueue writer
+// on TLS connections, where the socket cannot take a gathered write.
+// Returns the number of bytes written, or -1 on error (errno = EAGAIN if full).
+// -----------------------------------------------------------------------------
+ssize_t Connection::writeSome(const char* data, size_t size)
+{
 #ifdef USE_OPENSSL
     if (sslHandle_) {
         int ret = SSL_write(sslHandle_, data, static_cast<int>(size));
         if (ret <= 0) {
             int error = SSL_get_error(sslHandle_, ret);
+            if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+                errno = EAGAIN;
+                return -1;
+            }
             std::cerr << "SSL_write error: " << error << std::endl;
             return -1;
         }
@@ -184,77 +762,643 @@ ssize_t Connection::sendData(const char* data, size_t size)
 #endif
 
     // Non-SSL case
-    ssize_t bytesSent = ::send(socketFd_, data, size, 0);
-    if (bytesSent < 0) {
+    ssize_t bytesSent = ::send(socketFd_, data, size, MSG_NOSIGNAL);
+    if (bytesSent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
         std::cerr << "send() failed: " << strerror(errno) << std::endl;
     }
     return bytesSent;
 }
 
 // -----------------------------------------------------------------------------
-// processData(): A placeholder for application-specific logic.
-// Here, we simply print the data. In a real server, you'd parse commands,
-// handle user requests, etc.
+// withinRateLimits(): Runs before anything touches the UserManager, so a
+// flooding client is turned away without taking its lock. One clock read
+// and one CAS per limiter when the client behaves.
+// -----------------------------------------------------------------------------
+bool Connection::withinRateLimits()
+{
+    if (!ipLimiter_ && !userLimiter_) {
+        return true;
+    }
+    uint64_t now = RateLimiter::monotonicNs();
+    if (ipLimiter_ && !ipLimiter_->allow(clientAddr_.sin_addr.s_addr, now)) {
+        return false;
+    }
+    if (userLimiter_ && user_ && !userLimiter_->allow(user_.key(), now)) {
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// registerUser()/login()/logout()/getInfo(): The commands themselves; the
+// text and binary protocols only differ in how they are spelled.
 // -----------------------------------------------------------------------------
-void Connection::processData(const char* data, size_t size)
+Status Connection::registerUser(std::string_view username, std::string_view password)
 {
-    // For demonstration, print out the received data
-    std::string received(data, size);
-    //std::cout << "[Connection] Received: " << received << std::endl;
+    switch (userManager_.registerUser(std::string(username), std::string(password))) {
+    case UserUpdate::Ok:
+        return Status::Ok;
+    case UserUpdate::StorageError:
+        return Status::StorageError;
+    default:
+        return Status::UserExists;
+    }
+}
+
+Status Connection::login(std::string_view username, std::string_view password, uint16_t port)
+{
+    char clientIP[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &clientAddr_.sin_addr, clientIP, sizeof(clientIP));
+
+    UserHandle user = userManager_.openSession(username, password, clientIP, port);
+    if (!user) {
+        return Status::InvalidCredentials;
+    }
+    // A connection holds one session: logging in as someone else ends the
+    // previous one (logging in again as the same user already made it stale)
+    userManager_.closeSession(user_);
+    user_ = user;
+    loggedIn_ = true;
+    return Status::Ok;
+}
 
-    // In a chat server, you might parse commands here:
-    // 1) Parse "REGISTER <user> <pass>"
-    // 2) Parse "LOGIN <user> <pass>"
-    // 3) Handle "LOGOUT", "SENDMESSAGE", etc.
-    // 4) Possibly send responses via sendData(...).
+Status Connection::logout(std::string_view username)
+{
+    // Only ever this session's own user; naming one is optional
+    if (!user_ || (!username.empty() && username != user_.username())) {
+        return Status::NotLoggedIn;
+    }
+    bool closed = userManager_.closeSession(user_);
+    user_ = UserHandle();
+    return closed ? Status::Ok : Status::NotLoggedIn;
+}
 
-    std::istringstream iss(received);
-    std::string command;
-    iss >> command;
+Status Connection::getInfo(std::string_view username, std::string& ipAddress, uint16_t& port)
+{
+    return userManager_.getUserAddress(username, ipAddress, port) ? Status::Ok : Status::UserNotFound;
+}
 
-    if (command == "REGISTER") {
-        std::string username, password;
-        iss >> username >> password;
+void Connection::getInfoBatch()
+{
+    userManager_.getUserAddresses(batchUsernames_, batchAddresses_);
+}
 
-        if (userManager_.registerUser(username, password)) {
-            sendData("OK REGISTERED", 13);
-        } else {
-            sendData("ERR USER_EXISTS", 16);
+// -----------------------------------------------------------------------------
+// processInput(): Every complete command in the ring runs, in order; a
+// partial one stays there for the next read. HELLO 2 switches the rest of
+// the same input over to frames.
+// -----------------------------------------------------------------------------
+bool Connection::processInput()
+{
+    bool ok = true;
+    if (stats_) {
+        statsClockNs_ = ServerStats::monotonicNs();
+    }
+    if (webSocket_) {
+        ok = processWebSocket();
+        finishLookups();
+        return ok;
+    }
+
+    while (protocolVersion_ != PROTOCOL_VERSION) {
+        std::string_view line;
+        LineParser::Result result = lineParser_.next(input_, line);
+        if (result == LineParser::Result::NeedMore) {
+            break;
+        }
+        if (result == LineParser::Result::Error) {
+            sendLine("ERR LINE_TOO_LONG");
+            ok = false;
+            break;
+        }
+        handleCommand(line);
+        tag_ = {}; // A view into the line
+    }
+    if (ok && protocolVersion_ == PROTOCOL_VERSION) {
+        ok = processFrames();
+    }
+    finishLookups();
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+// processWebSocket(): The upgrade request is answered once it is complete;
+// after that each frame is unmasked in place in the ring and a single-frame
+// text message (the usual case) is dispatched from there without a copy.
+// Only fragmented messages are reassembled in wsMessage_.
+// -----------------------------------------------------------------------------
+bool Connection::processWebSocket()
+{
+    if (!webSocketOpen_) {
+        size_t end = RingBuffer::npos;
+        for (size_t newline = input_.find('\n'); newline != RingBuffer::npos && newline < MAX_HANDSHAKE_SIZE;
+             newline = input_.find('\n', newline + 1)) {
+            if (newline >= 3 && input_.at(newline - 1) == '\r' && input_.at(newline - 2) == '\n' &&
+                input_.at(newline - 3) == '\r') {
+                end = newline + 1;
+                break;
+            }
+        }
+        if (end == RingBuffer::npos && input_.size() < MAX_HANDSHAKE_SIZE) {
+            return true; // The rest of the request is still on its way
         }
-    } else if (command == "LOGIN") {
-        std::string username, password, ip, port;
-        iss >> username >> password >> ip >> port;
 
-        std::string clientIP = inet_ntoa(clientAddr_.sin_addr);
-        uint16_t clientPort = ntohs(clientAddr_.sin_port);
+        std::string_view key;
+        if (end == RingBuffer::npos || !parseUpgradeRequest(std::string_view(input_.linearize(end), end), key)) {
+            static constexpr std::string_view BAD_REQUEST =
+                "HTTP/1.1 400 Bad Request\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\n"
+                "Connection: close\r\n\r\n";
+            std::lock_guard<std::mutex> lock(ioMutex_);
+            queueRaw(BAD_REQUEST.data(), BAD_REQUEST.size());
+            return false;
+        }
 
-        if (userManager_.loginUser(username, password, clientIP, atoi(port.c_str()))) {
-            sendData("OK LOGIN", 8);
-        } else {
-            sendData("ERR INVALID_CREDENTIALS", 24);
+        response_.assign("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                         "Sec-WebSocket-Accept: ");
+        response_.append(webSocketAccept(key));
+        response_.append("\r\n\r\n");
+        input_.consume(end);
+
+        // Under the lock, so a heartbeat is either dropped before the 101
+        // or framed after it, like switchToFrames()
+        std::lock_guard<std::mutex> lock(ioMutex_);
+        queueRaw(response_.data(), response_.size());
+        webSocketOpen_ = true;
+    }
+
+    WsFrame frame;
+    WsFrameParser::Result result;
+    while ((result = wsFrameParser_.next(input_, frame)) == WsFrameParser::Result::Frame) {
+        switch (frame.opcode) {
+        case WsOpcode::Text:
+            if (wsFragmented_) {
+                closeWebSocket(WsCloseCode::ProtocolError); // The previous message never ended
+                return false;
+            }
+            if (frame.fin) {
+                if (!handleWsMessage(frame.payload)) {
+                    return false;
+                }
+                break;
+            }
+            wsFragmented_ = true;
+            wsMessage_.assign(frame.payload);
+            break;
+        case WsOpcode::Continuation:
+            if (!wsFragmented_) {
+                closeWebSocket(WsCloseCode::ProtocolError);
+                return false;
+            }
+            if (wsMessage_.size() + frame.payload.size() > MAX_WS_MESSAGE_SIZE) {
+                closeWebSocket(WsCloseCode::MessageTooBig);
+                return false;
+            }
+            wsMessage_.append(frame.payload);
+            if (frame.fin) {
+                wsFragmented_ = false;
+                bool ok = handleWsMessage(wsMessage_);
+                wsMessage_.clear();
+                if (!ok) {
+                    return false;
+                }
+            }
+            break;
+        case WsOpcode::Binary:
+            closeWebSocket(WsCloseCode::UnsupportedData);
+            return false;
+        case WsOpcode::Ping:
+            sendWsControl(WsOpcode::Pong, frame.payload);
+            break;
+        case WsOpcode::Pong:
+            break; // A keepalive; the read itself reset the idle timer
+        case WsOpcode::Close:
+            // Echo the status code; the exit path flushes it and closes
+            sendWsControl(WsOpcode::Close, frame.payload.substr(0, 2));
+            return false;
+        }
+    }
+
+    if (result == WsFrameParser::Result::TooLarge) {
+        closeWebSocket(WsCloseCode::MessageTooBig);
+        return false;
+    }
+    if (result == WsFrameParser::Result::Error) {
+        closeWebSocket(WsCloseCode::ProtocolError);
+        return false;
+    }
+    return true;
+}
+
+bool Connection::handleWsMessage(std::string_view message)
+{
+    const char* end = message.data() + message.size();
+    for (const char* start = message.data(); start < end;) {
+        const char* newline = scanForByte(start, end, '\n');
+        std::string_view line(start, static_cast<size_t>(newline - start));
+        start = newline + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
         }
-    } else if (command == "LOGOUT") {
-        std::string username;
-        iss >> username;
+        if (line.empty()) {
+            continue;
+        }
+        if (line.size() > MAX_LINE_SIZE) {
+            sendLine("ERR LINE_TOO_LONG");
+            return false;
+        }
+        handleCommand(line);
+        tag_ = {}; // A view into the message
+    }
+    return true;
+}
 
-        if (userManager_.logoutUser(username)) {
-            sendData("OK LOGOUT", 9);
+void Connection::closeWebSocket(WsCloseCode code)
+{
+    char payload[2] = {static_cast<char>(static_cast<uint16_t>(code) >> 8), static_cast<char>(code)};
+    sendWsControl(WsOpcode::Close, std::string_view(payload, sizeof(payload)));
+}
+
+void Connection::sendWsControl(WsOpcode opcode, std::string_view payload)
+{
+#ifdef USE_IO_URING
+    if (uringSession_) {
+        queueWsFrame(opcode, payload.data(), payload.size());
+        return;
+    }
+#endif
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    if (!writeFailed_) {
+        queueWsFrame(opcode, payload.data(), payload.size());
+    }
+}
+
+// -----------------------------------------------------------------------------
+// handleCommand(): Tokens are views into the input ring and the command
+// name is looked up in a compile-time perfect hash table, so the common
+// commands (GETINFO, PING) run without touching the heap.
+// -----------------------------------------------------------------------------
+void Connection::handleCommand(std::string_view line)
+{
+    std::string_view rest = line;
+    std::string_view name = nextToken(rest);
+    uint32_t id = 0;
+    tag_ = {};
+    if (name.starts_with('#')) {
+        const char* end = name.data() + name.size();
+        auto [stop, error] = std::from_chars(name.data() + 1, end, id);
+        if (error != std::errc() || stop != end || id == 0) {
+            sendLine("ERR MALFORMED_TAG");
+            return;
+        }
+        tag_ = name;
+        name = nextToken(rest);
+    }
+
+    // A PONG answers our own heartbeat: charging it would let a throttled
+    // client's reply be refused and the heartbeat then drop the client
+    Command command = lookupCommand(name);
+    if (command != Command::Pong && !withinRateLimits()) {
+        sendLine("ERR RATE_LIMITED");
+        return;
+    }
+
+    switch (command) {
+    case Command::Register: {
+        std::string_view username = nextToken(rest);
+        std::string_view password = nextToken(rest);
+
+        Status status = registerUser(username, password);
+        if (status == Status::Ok) {
+            sendLine("OK REGISTERED");
+        } else if (status == Status::StorageError) {
+            sendLine("ERR STORAGE");
         } else {
-            sendData("ERR NOT_LOGGED_IN", 17);
+            sendLine("ERR USER_EXISTS");
         }
-    } else if (command == "GETINFO") {
-        std::string targetUsername;
-        iss >> targetUsername;
+        break;
+    }
+    case Command::Login: {
+        std::string_view username = nextToken(rest);
+        std::string_view password = nextToken(rest);
+        nextToken(rest); // The client's idea of its IP; the peer address is used instead
+        std::string_view portToken = nextToken(rest);
+        uint16_t port = 0;
+        std::from_chars(portToken.data(), portToken.data() + portToken.size(), port);
 
-        User* user = userManager_.findUser(targetUsername);
-        if (user && user->isLoggedIn) {
-            std::string response = "OK " + user->ipAddress + ":" + std::to_string(user->port);
-            sendData(response.c_str(), response.size());
+        if (login(username, password, port) == Status::Ok) {
+            sendLine("OK LOGIN");
+        } else {
+            sendLine("ERR INVALID_CREDENTIALS");
+        }
+        break;
+    }
+    case Command::Logout:
+        if (logout(nextToken(rest)) == Status::Ok) {
+            sendLine("OK LOGOUT");
         } else {
-            sendData("ERR USER_NOT_FOUND", 18);
+            sendLine("ERR NOT_LOGGED_IN");
+        }
+        break;
+    case Command::GetInfo: {
+        std::string_view username = nextToken(rest);
+        if (!tag_.empty() && lookupPool_) {
+            queueLookup(id, username); // Answered (and counted) later, maybe by another thread
+            return;
+        }
+
+        uint16_t port = 0;
+        if (getInfo(username, lookupAddress_, port) != Status::Ok) {
+            sendLine("ERR USER_NOT_FOUND");
+            break;
+        }
+
+        // "OK <ip>:<port>\n", formatted in place
+        char digits[8];
+        char* end = std::to_chars(digits, digits + sizeof(digits), port).ptr;
+        beginLine();
+        response_.append("OK ");
+        response_.append(lookupAddress_);
+        response_.push_back(':');
+        response_.append(digits, end);
+        response_.push_back('\n');
+        sendData(response_.data(), response_.size());
+        break;
+    }
+    case Command::MGetInfo: {
+        batchUsernames_.clear();
+        for (std::string_view username; !(username = nextToken(rest)).empty();) {
+            batchUsernames_.push_back(username);
+        }
+        if (batchUsernames_.size() > MAX_BATCH_LOOKUP) {
+            sendLine("ERR TOO_MANY_USERS");
+            break;
+        }
+        getInfoBatch();
+
+        // "OK <count> <ip>:<port>|- ...\n", one record per username, in order
+        char digits[8];
+        beginLine();
+        response_.append("OK ");
+        response_.append(digits, std::to_chars(digits, digits + sizeof(digits), batchAddresses_.size()).ptr);
+        for (const UserAddress& address : batchAddresses_) {
+            response_.push_back(' ');
+            if (!address.found) {
+                response_.push_back('-');
+                continue;
+            }
+            response_.append(address.ipAddress);
+            response_.push_back(':');
+            response_.append(digits, std::to_chars(digits, digits + sizeof(digits), address.port).ptr);
         }
+        response_.push_back('\n');
+        sendData(response_.data(), response_.size());
+        break;
+    }
+    case Command::Ping:
+        // Client-side keepalive; any input also resets the idle timer
+        sendLine("PONG");
+        break;
+    case Command::Pong:
+        // Answer to a server heartbeat: the read itself was the point
+        break;
+    case Command::Hello:
+        if (nextToken(rest) != "2" || webSocket_) { // WebSocket clients stay on text messages
+            sendLine("ERR UNSUPPORTED_VERSION");
+            break;
+        }
+        finishLookups(); // Earlier lookups of this read still answer in text
+        beginLine();
+        response_.append("OK HELLO 2\n");
+        switchToFrames(response_);
+        break;
+    case Command::Unknown:
+        sendLine("ERR UNKNOWN_COMMAND");
+        break;
+    }
+
+    if (stats_) {
+        countCommand(command);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// countCommand(): One clock read per command: each is timed from where the
+// previous one of the same read finished, the first from the start of
+// processInput(), so parsing is included and nothing is read twice.
+// -----------------------------------------------------------------------------
+void Connection::countCommand(Command command)
+{
+    uint64_t now = ServerStats::monotonicNs();
+    stats_->recordCommand(command, now - statsClockNs_);
+    statsClockNs_ = now;
+}
+
+void Connection::switchToFrames(std::string_view reply)
+{
+    // Under the lock, so a heartbeat from a timer (or a lookup batch from
+    // the pool) is either text before the reply or a frame after it
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    queueRaw(reply.data(), reply.size());
+    protocolVersion_ = PROTOCOL_VERSION;
+}
+
+// -----------------------------------------------------------------------------
+// queueLookup()/finishLookups()/answerLookups(): Tagged GETINFOs. A client
+// that pipelines many of them gets them spread over the ThreadPool in
+// batches, each answered with one write as soon as it is done; whatever
+// does not fill a batch is answered inline once the read is parsed.
+// -----------------------------------------------------------------------------
+void Connection::queueLookup(uint32_t id, std::string_view username)
+{
+    Lookup& lookup = lookups_.emplace_back();
+    lookup.id = id;
+    lookup.username = username;
+    lookup.startNs = statsClockNs_;
+    if (lookups_.size() < LOOKUP_BATCH) {
+        return;
+    }
 
+    std::shared_ptr<Connection> self = weak_from_this().lock();
+    if (!self) {
+        return; // Not shared, so nothing may outlive this call: finishLookups() answers
+    }
+    std::vector<Lookup> batch;
+    batch.swap(lookups_);
+    lookups_.reserve(LOOKUP_BATCH);
+    lookupPool_->enqueue([self, batch = std::move(batch)]() mutable {
+        std::string replies;
+        self->answerLookups(batch, replies);
+    });
+}
+
+void Connection::finishLookups()
+{
+    if (lookups_.empty()) {
+        return;
+    }
+    answerLookups(lookups_, response_);
+    lookups_.clear();
+}
+
+void Connection::answerLookups(std::vector<Lookup>& lookups, std::string& replies)
+{
+    // The UserManager is only touched outside ioMutex_
+    for (Lookup& lookup : lookups) {
+        lookup.status = getInfo(lookup.username, lookup.ipAddress, lookup.port);
+    }
+
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    replies.clear();
+    if (protocolVersion_ == PROTOCOL_VERSION) {
+        FrameWriter writer(replies);
+        for (const Lookup& lookup : lookups) {
+            writer.start(Opcode::Reply, lookup.id);
+            writer.writeU8(static_cast<uint8_t>(lookup.status));
+            if (lookup.status == Status::Ok) {
+                writer.writeString(lookup.ipAddress);
+                writer.writeU16(lookup.port);
+            }
+            writer.finish();
+        }
     } else {
-        sendData("ERR UNKNOWN_COMMAND", 20);
+        char digits[16];
+        for (const Lookup& lookup : lookups) {
+            replies.push_back('#');
+            replies.append(digits, std::to_chars(digits, digits + sizeof(digits), lookup.id).ptr);
+            if (lookup.status != Status::Ok) {
+                replies.append(" ERR USER_NOT_FOUND\n");
+                continue;
+            }
+            replies.append(" OK ");
+            replies.append(lookup.ipAddress);
+            replies.push_back(':');
+            replies.append(digits, std::to_chars(digits, digits + sizeof(digits), lookup.port).ptr);
+            replies.push_back('\n');
+        }
+    }
+    sendLocked(replies.data(), replies.size());
+
+    if (stats_) {
+        uint64_t now = ServerStats::monotonicNs();
+        for (const Lookup& lookup : lookups) {
+            stats_->recordCommand(Command::GetInfo, now - lookup.startNs);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// processFrames(): Every complete frame is answered, in order, and all the
+// replies leave together; a partial frame waits in the ring for the rest.
+// GETINFOs are the exception once a lookup pool is set (queueLookup()).
+// -----------------------------------------------------------------------------
+bool Connection::processFrames()
+{
+    std::string& replies = response_; // Reused, so replies do not allocate
+    replies.clear();
+    FrameWriter writer(replies);
+    Frame frame;
+    FrameParser::Result result;
+    while ((result = frameParser_.next(input_, frame)) == FrameParser::Result::Frame) {
+        handleFrame(frame, writer);
+    }
+
+    if (result == FrameParser::Result::Error) {
+        writer.start(Opcode::Goodbye, 0);
+        writer.writeString("ERR MALFORMED_FRAME");
+        writer.finish();
+    }
+    if (!replies.empty()) {
+        sendData(replies.data(), replies.size());
+    }
+    return result != FrameParser::Result::Error;
+}
+
+void Connection::handleFrame(const Frame& frame, FrameWriter& replies)
+{
+    if (frame.opcode == Opcode::Pong) {
+        if (stats_) {
+            countCommand(Command::Pong); // Answer to a server heartbeat, nothing to run
+        }
+        return; // Before the rate limits, like a text PONG
+    }
+
+    Status status = Status::Malformed;
+    uint16_t port = 0;
+    PayloadReader reader(frame.payload);
+    std::string_view username, password;
+    uint16_t clientPort = 0;
+
+    if (!withinRateLimits()) {
+        status = Status::RateLimited;
+    } else {
+        switch (frame.opcode) {
+        case Opcode::Register:
+            if (reader.readString(username) && reader.readString(password) && reader.atEnd()) {
+                status = registerUser(username, password);
+            }
+            break;
+        case Opcode::Login:
+            if (reader.readString(username) && reader.readString(password) && reader.readU16(clientPort) &&
+                reader.atEnd()) {
+                status = login(username, password, clientPort);
+            }
+            break;
+        case Opcode::Logout:
+            if (reader.readString(username) && reader.atEnd()) {
+                status = logout(username);
+            }
+            break;
+        case Opcode::GetInfo:
+            if (reader.readString(username) && reader.atEnd()) {
+                if (lookupPool_) {
+                    queueLookup(frame.requestId, username); // Answered (and counted) later, maybe by another thread
+                    return;
+                }
+                status = getInfo(username, lookupAddress_, port);
+            }
+            break;
+        case Opcode::MGetInfo: {
+            uint16_t count = 0;
+            bool valid = reader.readU16(count) && count <= MAX_BATCH_LOOKUP;
+            batchUsernames_.clear();
+            for (uint16_t i = 0; valid && i < count; ++i) {
+                valid = reader.readString(username);
+                batchUsernames_.push_back(username);
+            }
+            if (valid && reader.atEnd()) {
+                getInfoBatch();
+                status = Status::Ok;
+            }
+            break;
+        }
+        case Opcode::Ping:
+            status = Status::Ok;
+            break;
+        default:
+            status = Status::UnknownCommand;
+            break;
+        }
+    }
+
+    replies.start(Opcode::Reply, frame.requestId);
+    replies.writeU8(static_cast<uint8_t>(status));
+    if (frame.opcode == Opcode::GetInfo && status == Status::Ok) {
+        replies.writeString(lookupAddress_);
+        replies.writeU16(port);
+    }
+    if (frame.opcode == Opcode::MGetInfo && status == Status::Ok) {
+        replies.writeU16(static_cast<uint16_t>(batchAddresses_.size()));
+        for (const UserAddress& address : batchAddresses_) {
+            replies.writeU8(static_cast<uint8_t>(address.found ? Status::Ok : Status::UserNotFound));
+            if (address.found) {
+                replies.writeString(address.ipAddress);
+                replies.writeU16(address.port);
+            }
+        }
+    }
+    replies.finish();
+
+    if (stats_ && status != Status::RateLimited) {
+        countCommand(frameCommand(frame.opcode));
     }
 }
@@ -0,0 +1,240 @@
+#include "DelimiterScan.h"
+#include <atomic>
+
+// The SSE2 paths are compiled for the baseline target, so they need the
+// compiler to allow SSE2: always on x86-64, on 32-bit x86 only with
+// -msse2 (or a -march that implies it). Without it, scans stay scalar.
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define DELIMITER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+struct ScanFunctions {
+    ScanLevel level;
+    const char* (*forByte)(const char* begin, const char* end, char byte);
+    const char* (*forBlank)(const char* begin, const char* end);
+    const char* (*pastBlanks)(const char* begin, const char* end);
+};
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// ---- Scalar: the fallback, and inputs shorter than one SSE2 vector ----
+
+const char* scalarForByte(const char* begin, const char* end, char byte)
+{
+    while (begin < end && *begin != byte) {
+        ++begin;
+    }
+    return begin;
+}
+
+const char* scalarForBlank(const char* begin, const char* end)
+{
+    while (begin < end && !isBlank(*begin)) {
+        ++begin;
+    }
+    return begin;
+}
+
+const char* scalarPastBlanks(const char* begin, const char* end)
+{
+    while (begin < end && isBlank(*begin)) {
+        ++begin;
+    }
+    return begin;
+}
+
+constexpr ScanFunctions SCALAR = {ScanLevel::Scalar, scalarForByte, scalarForBlank, scalarPastBlanks};
+
+#ifdef DELIMITER_SCAN_X86
+// ---- SSE2: part of the x86-64 baseline, so always available. Inputs of
+// at least one vector end with a load flush against @p end, overlapping
+// bytes already known not to match, so there is no scalar tail. ----
+
+inline unsigned sse2ByteMask(const char* at, char byte)
+{
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(byte))));
+}
+
+inline unsigned sse2BlankMask(const char* at)
+{
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+    __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+    return static_cast<unsigned>(_mm_movemask_epi8(blanks));
+}
+
+const char* sse2ForByte(const char* begin, const char* end, char byte)
+{
+    if (end - begin < 16) {
+        return scalarForByte(begin, end, byte);
+    }
+    for (; end - begin > 16; begin += 16) {
+        if (unsigned mask = sse2ByteMask(begin, byte)) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    unsigned mask = sse2ByteMask(end - 16, byte);
+    return mask ? end - 16 + __builtin_ctz(mask) : end;
+}
+
+const char* sse2ForBlank(const char* begin, const char* end)
+{
+    if (end - begin < 16) {
+        return scalarForBlank(begin, end);
+    }
+    for (; end - begin > 16; begin += 16) {
+        if (unsigned mask = sse2BlankMask(begin)) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    unsigned mask = sse2BlankMask(end - 16);
+    return mask ? end - 16 + __builtin_ctz(mask) : end;
+}
+
+const char* sse2PastBlanks(const char* begin, const char* end)
+{
+    if (end - begin < 16) {
+        return scalarPastBlanks(begin, end);
+    }
+    for (; end - begin > 16; begin += 16) {
+        if (unsigned mask = ~sse2BlankMask(begin) & 0xffffu) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    unsigned mask = ~sse2BlankMask(end - 16) & 0xffffu;
+    return mask ? end - 16 + __builtin_ctz(mask) : end;
+}
+
+constexpr ScanFunctions SSE2 = {ScanLevel::Sse2, sse2ForByte, sse2ForBlank, sse2PastBlanks};
+
+// ---- AVX2: compiled for AVX2 per function, only called if the CPU has
+// it. Inputs shorter than one vector go to SSE2. ----
+
+__attribute__((target("avx2"))) inline unsigned avx2ByteMask(const char* at, char byte)
+{
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(byte))));
+}
+
+__attribute__((target("avx2"))) inline unsigned avx2BlankMask(const char* at)
+{
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+    __m256i blanks = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                                     _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t')));
+    return static_cast<unsigned>(_mm256_movemask_epi8(blanks));
+}
+
+__attribute__((target("avx2"))) const char* avx2ForByte(const char* begin, const char* end, char byte)
+{
+    if (end - begin < 32) {
+        return sse2ForByte(begin, end, byte);
+    }
+    for (; end - begin > 32; begin += 32) {
+        if (unsigned mask = avx2ByteMask(begin, byte)) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    unsigned mask = avx2ByteMask(end - 32, byte);
+    return mask ? end - 32 + __builtin_ctz(mask) : end;
+}
+
+__attribute__((target("avx2"))) const char* avx2ForBlank(const char* begin, const char* end)
+{
+    if (end - begin < 32) {
+        return sse2ForBlank(begin, end);
+    }
+    for (; end - begin > 32; begin += 32) {
+        if (unsigned mask = avx2BlankMask(begin)) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    unsigned mask = avx2BlankMask(end - 32);
+    return mask ? end - 32 + __builtin_ctz(mask) : end;
+}
+
+__attribute__((target("avx2"))) const char* avx2PastBlanks(const char* begin, const char* end)
+{
+    if (end - begin < 32) {
+        return sse2PastBlanks(begin, end);
+    }
+    for (; end - begin > 32; begin += 32) {
+        if (unsigned mask = ~avx2BlankMask(begin)) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    unsigned mask = ~avx2BlankMask(end - 32);
+    return mask ? end - 32 + __builtin_ctz(mask) : end;
+}
+
+constexpr ScanFunctions AVX2 = {ScanLevel::Avx2, avx2ForByte, avx2ForBlank, avx2PastBlanks};
+#endif
+
+const ScanFunctions* functionsFor(ScanLevel level)
+{
+#ifdef DELIMITER_SCAN_X86
+    switch (level) {
+    case ScanLevel::Avx2:
+        return &AVX2;
+    case ScanLevel::Sse2:
+        return &SSE2;
+    case ScanLevel::Scalar:
+        break;
+    }
+#else
+    (void)level;
+#endif
+    return &SCALAR;
+}
+
+// Chosen once at startup; only setScanLevel() changes it afterwards
+std::atomic<const ScanFunctions*> active{functionsFor(detectScanLevel())};
+}
+
+ScanLevel detectScanLevel()
+{
+#ifdef DELIMITER_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanLevel::Avx2;
+    }
+    return ScanLevel::Sse2;
+#else
+    return ScanLevel::Scalar;
+#endif
+}
+
+ScanLevel scanLevel()
+{
+    return active.load(std::memory_order_relaxed)->level;
+}
+
+ScanLevel setScanLevel(ScanLevel level)
+{
+    ScanLevel best = detectScanLevel();
+    if (static_cast<int>(level) > static_cast<int>(best)) {
+        level = best;
+    }
+    active.store(functionsFor(level), std::memory_order_relaxed);
+    return level;
+}
+
+const char* scanForByte(const char* begin, const char* end, char byte)
+{
+    return active.load(std::memory_order_relaxed)->forByte(begin, end, byte);
+}
+
+const char* scanForBlank(const char* begin, const char* end)
+{
+    return active.load(std::memory_order_relaxed)->forBlank(begin, end);
+}
+
+const char* skipBlanks(const char* begin, const char* end)
+{
+    return active.load(std::memory_order_relaxed)->pastBlanks(begin, end);
+}
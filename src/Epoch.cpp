@@ -0,0 +1,150 @@
+#include "Epoch.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace {
+constexpr size_t RECLAIM_BATCH = 64; // Retired objects per thread between reclaim attempts
+
+// One per thread that ever read; reused by later threads once released
+struct alignas(64) Participant {
+    std::atomic<uint64_t> epoch{0}; // Epoch the thread entered its guard in; 0 when outside
+    std::atomic_bool claimed{false};
+    Participant* next = nullptr;
+};
+
+struct Retired {
+    void* object;
+    void (*deleter)(void*);
+    uint64_t epoch; // Readers stamped with this epoch or an older one may still hold it
+};
+
+std::atomic<uint64_t> globalEpoch{1};
+std::atomic<Participant*> participants{nullptr}; // Only grows, to the peak thread count
+
+std::mutex orphanMutex;
+std::vector<Retired> orphans;            // Left by exited threads
+std::atomic_bool orphansPending{false};
+
+Participant* claimParticipant()
+{
+    for (Participant* p = participants.load(std::memory_order_acquire); p != nullptr; p = p->next) {
+        bool expected = false;
+        if (!p->claimed.load(std::memory_order_relaxed) &&
+            p->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return p;
+        }
+    }
+    Participant* p = new Participant; // Never freed: readers of the list hold no guard
+    p->claimed.store(true, std::memory_order_relaxed);
+    p->next = participants.load(std::memory_order_relaxed);
+    while (!participants.compare_exchange_weak(p->next, p, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return p;
+}
+
+// The oldest epoch a reader is in right now (UINT64_MAX if none reads)
+uint64_t oldestReader()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the fence in EpochGuard()
+    uint64_t oldest = UINT64_MAX;
+    for (Participant* p = participants.load(std::memory_order_acquire); p != nullptr; p = p->next) {
+        uint64_t epoch = p->epoch.load(std::memory_order_relaxed);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+// Frees the objects of @p retired no reader can reach; returns how many remain
+size_t freeUnreachable(std::vector<Retired>& retired)
+{
+    uint64_t oldest = oldestReader();
+    size_t kept = 0;
+    for (const Retired& entry : retired) {
+        if (entry.epoch < oldest) {
+            entry.deleter(entry.object);
+        } else {
+            retired[kept++] = entry;
+        }
+    }
+    retired.resize(kept);
+    return kept;
+}
+
+struct ThreadState {
+    Participant* participant = nullptr;
+    unsigned depth = 0; // Nested guards: only the outermost stamps the epoch
+    std::vector<Retired> retired;
+
+    ~ThreadState()
+    {
+        if (!retired.empty() && freeUnreachable(retired) > 0) {
+            std::lock_guard<std::mutex> lock(orphanMutex);
+            orphans.insert(orphans.end(), retired.begin(), retired.end());
+            orphansPending.store(true, std::memory_order_release);
+        }
+        if (participant != nullptr) {
+            participant->claimed.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadState threadState;
+}
+
+// -----------------------------------------------------------------------------
+// EpochGuard(): One store and a fence, no loop and no lock. The fence
+// orders the stamp before the reads it protects, against the writer's
+// fence between unpublishing an object and scanning the stamps: either the
+// writer sees this stamp, or this reader sees the object already gone.
+// -----------------------------------------------------------------------------
+EpochGuard::EpochGuard()
+{
+    ThreadState& state = threadState;
+    if (state.depth++ > 0) {
+        return;
+    }
+    if (state.participant == nullptr) {
+        state.participant = claimParticipant();
+    }
+    state.participant->epoch.store(globalEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+EpochGuard::~EpochGuard()
+{
+    ThreadState& state = threadState;
+    if (--state.depth == 0) {
+        state.participant->epoch.store(0, std::memory_order_release);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// epochRetireObject(): Stamps the object with the epoch current after it was
+// unpublished and moves the clock on, so readers entering from now on are
+// stamped later and never hold it up.
+// -----------------------------------------------------------------------------
+void epochRetireObject(void* object, void (*deleter)(void*))
+{
+    uint64_t epoch = globalEpoch.fetch_add(1, std::memory_order_seq_cst);
+    ThreadState& state = threadState;
+    state.retired.push_back({object, deleter, epoch});
+    if (state.retired.size() >= RECLAIM_BATCH) {
+        epochReclaim();
+    }
+}
+
+size_t epochReclaim()
+{
+    ThreadState& state = threadState;
+    if (orphansPending.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(orphanMutex);
+        state.retired.insert(state.retired.end(), orphans.begin(), orphans.end());
+        orphans.clear();
+        orphansPending.store(false, std::memory_order_relaxed);
+    }
+    return freeUnreachable(state.retired);
+}
@@ -0,0 +1,143 @@
+#include "EventLoop.h"
+#include <iostream>
+#include <cstring>       // For strerror
+#include <cerrno>        // For errno
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>      // For close()
+
+namespace {
+// Maximum number of events fetched by one epoll_wait() call
+constexpr int MAX_EVENTS = 256;
+}
+
+EventLoop::EventLoop()
+    : epollFd_(-1),
+      wakeupFd_(-1),
+      stopped_(false)
+{
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ < 0) {
+        throw std::runtime_error(std::string("epoll_create1 failed: ") + strerror(errno));
+    }
+
+    wakeupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupFd_ < 0) {
+        int err = errno;
+        close(epollFd_);
+        throw std::runtime_error(std::string("eventfd failed: ") + strerror(err));
+    }
+
+    // The wakeup fd is handled inline in run(), so it has no entry in handlers_
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeupFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeupFd_, &ev) < 0) {
+        int err = errno;
+        close(wakeupFd_);
+        close(epollFd_);
+        throw std::runtime_error(std::string("epoll_ctl(wakeup) failed: ") + strerror(err));
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    close(wakeupFd_);
+    close(epollFd_);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler)
+{
+    {
+        std::lock_guard<std::mutex> lock(handlersMutex_);
+        handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+    }
+
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        std::cerr << "epoll_ctl(ADD) failed: " << strerror(errno) << std::endl;
+        std::lock_guard<std::mutex> lock(handlersMutex_);
+        handlers_.erase(fd);
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events)
+{
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        std::cerr << "epoll_ctl(MOD) failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::remove(int fd)
+{
+    // ENOENT is fine here: the fd may never have been added successfully
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+
+    std::lock_guard<std::mutex> lock(handlersMutex_);
+    handlers_.erase(fd);
+}
+
+void EventLoop::run()
+{
+    epoll_event events[MAX_EVENTS];
+
+    while (!stopped_) {
+        int n = epoll_wait(epollFd_, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeupFd_) {
+                drainWakeup();
+                continue;
+            }
+
+            // Look the handler up per event: an earlier handler in this batch
+            // may have removed the fd.
+            std::shared_ptr<Handler> handler;
+            {
+                std::lock_guard<std::mutex> lock(handlersMutex_);
+                auto it = handlers_.find(fd);
+                if (it == handlers_.end()) {
+                    continue;
+                }
+                handler = it->second;
+            }
+
+            (*handler)(events[i].events);
+        }
+    }
+}
+
+void EventLoop::stop()
+{
+    stopped_ = true;
+
+    uint64_t one = 1;
+    if (write(wakeupFd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        std::cerr << "Failed to wake event loop: " << strerror(errno) << std::endl;
+    }
+}
+
+void EventLoop::drainWakeup()
+{
+    uint64_t value;
+    while (read(wakeupFd_, &value, sizeof(value)) > 0) {
+        // Keep reading until the counter is reset
+    }
+}
@@ -0,0 +1,391 @@
+#include "Handoff.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>     // For strerror, memcpy
+#include <cerrno>      // For errno
+#include <sys/socket.h>
+#include <sys/un.h>    // For sockaddr_un
+#include <unistd.h>    // For close, unlink
+
+namespace {
+// "CHUP" + format version; bump the version when the blob layout changes
+constexpr uint32_t HANDOFF_MAGIC = 0x43485550;
+constexpr uint32_t HANDOFF_VERSION = 4;
+
+// fds per SCM_RIGHTS message (the kernel caps it at SCM_MAX_FD = 253)
+constexpr size_t FDS_PER_MESSAGE = 250;
+
+// Sanity limit so a corrupt length cannot make us allocate gigabytes
+constexpr uint64_t MAX_BLOB_SIZE = uint64_t(1) << 32;
+
+constexpr char ACK = 'A';
+
+bool fillAddress(const std::string& path, sockaddr_un& addr)
+{
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Handoff socket path too long: " << path << std::endl;
+        return false;
+    }
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/**
+ * @brief Appends fixed-size integers and length-prefixed strings.
+ *        Host byte order: both ends are the same machine.
+ */
+class BlobWriter
+{
+public:
+    template <typename T>
+    void put(T value) { blob_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+    void putString(const std::string& value)
+    {
+        put(static_cast<uint32_t>(value.size()));
+        blob_.append(value);
+    }
+
+    const std::string& blob() const { return blob_; }
+
+private:
+    std::string blob_;
+};
+
+/**
+ * @brief Reads what BlobWriter wrote; every getter fails past the end.
+ */
+class BlobReader
+{
+public:
+    explicit BlobReader(const std::string& blob) : blob_(blob), offset_(0) {}
+
+    template <typename T>
+    bool get(T& value)
+    {
+        if (blob_.size() - offset_ < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, blob_.data() + offset_, sizeof(value));
+        offset_ += sizeof(value);
+        return true;
+    }
+
+    bool getString(std::string& value)
+    {
+        uint32_t size;
+        if (!get(size) || blob_.size() - offset_ < size) {
+            return false;
+        }
+        value.assign(blob_.data() + offset_, size);
+        offset_ += size;
+        return true;
+    }
+
+private:
+    const std::string& blob_;
+    size_t offset_;
+};
+}
+
+int Handoff::listen(const std::string& path)
+{
+    sockaddr_un addr;
+    if (!fillAddress(path, addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Handoff socket creation failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // A previous process may have left its socket file behind
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, 1) < 0) {
+        std::cerr << "Handoff socket bind/listen failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int Handoff::connect(const std::string& path)
+{
+    sockaddr_un addr;
+    if (!fillAddress(path, addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Handoff socket creation failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        std::cerr << "Handoff connect to " << path << " failed: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// -----------------------------------------------------------------------------
+// send(): Blob first, then the fds in blob order, then wait for the ack.
+// -----------------------------------------------------------------------------
+bool Handoff::send(int channel, const HandoffState& state)
+{
+    BlobWriter writer;
+    writer.put(HANDOFF_MAGIC);
+    writer.put(HANDOFF_VERSION);
+
+    writer.put(static_cast<uint32_t>(state.listeners.size()));
+    writer.put(static_cast<uint32_t>(state.webSocketListeners.size()));
+    writer.put(static_cast<uint8_t>(state.statsListener >= 0));
+
+    writer.put(static_cast<uint32_t>(state.connections.size()));
+    for (const HandoffConnection& connection : state.connections) {
+        writer.put(static_cast<uint32_t>(connection.addr.sin_addr.s_addr));
+        writer.put(static_cast<uint16_t>(connection.addr.sin_port));
+        writer.put(static_cast<uint8_t>(connection.session.loggedIn));
+        writer.putString(connection.session.username);
+        writer.put(connection.session.protocolVersion);
+        writer.putString(connection.session.pendingInput);
+        writer.putString(connection.session.pendingOutput);
+        writer.put(static_cast<uint8_t>(connection.session.webSocket));
+        writer.put(static_cast<uint8_t>(connection.session.webSocketOpen));
+        writer.put(static_cast<uint8_t>(connection.session.webSocketFragmented));
+        writer.putString(connection.session.webSocketMessage);
+    }
+
+    writer.put(static_cast<uint32_t>(state.users.size()));
+    for (const User& user : state.users) {
+        writer.putString(user.username);
+        writer.putString(user.passwordHash);
+        writer.putString(user.ipAddress);
+        writer.put(static_cast<uint16_t>(user.port));
+        writer.put(static_cast<uint8_t>(user.isLoggedIn));
+    }
+
+    uint64_t size = writer.blob().size();
+    if (!writeAll(channel, reinterpret_cast<const char*>(&size), sizeof(size)) ||
+        !writeAll(channel, writer.blob().data(), writer.blob().size())) {
+        std::cerr << "Handoff: sending the state failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<int> fds = state.listeners;
+    fds.insert(fds.end(), state.webSocketListeners.begin(), state.webSocketListeners.end());
+    if (state.statsListener >= 0) {
+        fds.push_back(state.statsListener);
+    }
+    for (const HandoffConnection& connection : state.connections) {
+        fds.push_back(connection.fd);
+    }
+    if (!sendFds(channel, fds)) {
+        return false;
+    }
+
+    char ack = 0;
+    if (!readAll(channel, &ack, 1) || ack != ACK) {
+        std::cerr << "Handoff: the new process did not acknowledge the takeover." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Handoff::receive(int channel, HandoffState& state)
+{
+    uint64_t size = 0;
+    if (!readAll(channel, reinterpret_cast<char*>(&size), sizeof(size)) || size > MAX_BLOB_SIZE) {
+        std::cerr << "Handoff: no state received." << std::endl;
+        return false;
+    }
+    std::string blob(size, '\0');
+    if (!readAll(channel, blob.data(), blob.size())) {
+        std::cerr << "Handoff: truncated state." << std::endl;
+        return false;
+    }
+
+    BlobReader reader(blob);
+    uint32_t magic = 0, version = 0, listenerCount = 0, webSocketListenerCount = 0, connectionCount = 0, userCount = 0;
+    if (!reader.get(magic) || !reader.get(version) || magic != HANDOFF_MAGIC || version != HANDOFF_VERSION) {
+        std::cerr << "Handoff: incompatible state format." << std::endl;
+        return false;
+    }
+
+    uint8_t hasStatsListener = 0;
+    bool ok = reader.get(listenerCount) && reader.get(webSocketListenerCount) && reader.get(hasStatsListener) &&
+              reader.get(connectionCount);
+    for (uint32_t i = 0; ok && i < connectionCount; ++i) {
+        HandoffConnection connection;
+        uint32_t ip = 0;
+        uint16_t port = 0;
+        uint8_t loggedIn = 0, webSocket = 0, webSocketOpen = 0, webSocketFragmented = 0;
+        ok = reader.get(ip) && reader.get(port) && reader.get(loggedIn) &&
+             reader.getString(connection.session.username) && reader.get(connection.session.protocolVersion) &&
+             reader.getString(connection.session.pendingInput) && reader.getString(connection.session.pendingOutput) &&
+             reader.get(webSocket) && reader.get(webSocketOpen) && reader.get(webSocketFragmented) &&
+             reader.getString(connection.session.webSocketMessage);
+        connection.addr.sin_family = AF_INET;
+        connection.addr.sin_addr.s_addr = ip;
+        connection.addr.sin_port = port;
+        connection.session.loggedIn = loggedIn != 0;
+        connection.session.webSocket = webSocket != 0;
+        connection.session.webSocketOpen = webSocketOpen != 0;
+        connection.session.webSocketFragmented = webSocketFragmented != 0;
+        state.connections.push_back(std::move(connection));
+    }
+
+    ok = ok && reader.get(userCount);
+    for (uint32_t i = 0; ok && i < userCount; ++i) {
+        User user;
+        uint8_t loggedIn = 0;
+        ok = reader.getString(user.username) && reader.getString(user.passwordHash) &&
+             reader.getString(user.ipAddress) && reader.get(user.port) && reader.get(loggedIn);
+        user.isLoggedIn = loggedIn != 0;
+        state.users.push_back(std::move(user));
+    }
+    if (!ok) {
+        std::cerr << "Handoff: corrupt state." << std::endl;
+        return false;
+    }
+
+    std::vector<int> fds;
+    size_t listenerFds = size_t(listenerCount) + webSocketListenerCount + (hasStatsListener != 0);
+    if (!receiveFds(channel, listenerFds + connectionCount, fds)) {
+        for (int fd : fds) {
+            close(fd);
+        }
+        return false;
+    }
+
+    state.listeners.assign(fds.begin(), fds.begin() + listenerCount);
+    state.webSocketListeners.assign(fds.begin() + listenerCount,
+                                    fds.begin() + listenerCount + webSocketListenerCount);
+    if (hasStatsListener) {
+        state.statsListener = fds[listenerFds - 1];
+    }
+    for (size_t i = 0; i < state.connections.size(); ++i) {
+        state.connections[i].fd = fds[listenerFds + i];
+    }
+    return true;
+}
+
+bool Handoff::acknowledge(int channel)
+{
+    return writeAll(channel, &ACK, 1);
+}
+
+bool Handoff::writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool Handoff::readAll(int fd, char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t bytesRead = ::recv(fd, data, size, 0);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            return false;
+        }
+        data += bytesRead;
+        size -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// sendFds()/receiveFds(): Each batch rides on a one-byte message, read one
+// byte at a time on the other side so every batch arrives with its byte.
+// -----------------------------------------------------------------------------
+bool Handoff::sendFds(int channel, const std::vector<int>& fds)
+{
+    for (size_t offset = 0; offset < fds.size(); offset += FDS_PER_MESSAGE) {
+        size_t count = std::min(FDS_PER_MESSAGE, fds.size() - offset);
+
+        char byte = 'F';
+        iovec iov = {&byte, 1};
+        std::vector<char> control(CMSG_SPACE(count * sizeof(int)), 0);
+
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds.data() + offset, count * sizeof(int));
+
+        ssize_t sent;
+        do {
+            sent = sendmsg(channel, &msg, MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+        if (sent != 1) {
+            std::cerr << "Handoff: sending fds failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Handoff::receiveFds(int channel, size_t count, std::vector<int>& fds)
+{
+    while (fds.size() < count) {
+        size_t expected = std::min(FDS_PER_MESSAGE, count - fds.size());
+
+        char byte = 0;
+        iovec iov = {&byte, 1};
+        std::vector<char> control(CMSG_SPACE(FDS_PER_MESSAGE * sizeof(int)), 0);
+
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        ssize_t received;
+        do {
+            received = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+        } while (received < 0 && errno == EINTR);
+        if (received != 1) {
+            std::cerr << "Handoff: receiving fds failed." << std::endl;
+            return false;
+        }
+
+        size_t got = 0;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                fds.insert(fds.end(), data, data + n);
+                got += n;
+            }
+        }
+        if (got != expected || (msg.msg_flags & MSG_CTRUNC)) {
+            std::cerr << "Handoff: fd batch truncated." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#include "LineParser.h"
+
+LineParser::Result LineParser::next(RingBuffer& input, std::string_view& line)
+{
+    while (true) {
+        size_t end = input.find('\n', scanned_);
+        if (end == RingBuffer::npos) {
+            scanned_ = input.size();
+            return scanned_ > MAX_LINE_SIZE ? Result::Error : Result::NeedMore;
+        }
+        scanned_ = 0;
+        if (end > MAX_LINE_SIZE) {
+            return Result::Error;
+        }
+
+        size_t length = end;
+        if (length > 0 && input.at(length - 1) == '\r') {
+            --length;
+        }
+        if (length == 0) {
+            input.consume(end + 1); // Blank line
+            continue;
+        }
+
+        const char* start = input.linearize(end + 1);
+        input.consume(end + 1);
+        line = std::string_view(start, length);
+        return Result::Line;
+    }
+}
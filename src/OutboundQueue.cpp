@@ -0,0 +1,151 @@
+#include "OutboundQueue.h"
+#include <algorithm>
+#include <cerrno>      // For errno
+#include <climits>     // For IOV_MAX
+#include <sys/socket.h> // For sendmsg
+#include <sys/uio.h>    // For iovec
+
+namespace {
+// Appends up to this size are copied into the tail buffer instead of
+// becoming their own iovec
+constexpr size_t COALESCE_LIMIT = 16 * 1024;
+
+// Upper bound on iovecs per gathered write
+constexpr size_t MAX_IOVECS = IOV_MAX < 64 ? IOV_MAX : 64;
+}
+
+OutboundQueue::OutboundQueue(size_t lowWatermark, size_t highWatermark)
+    : frontOffset_(0),
+      size_(0),
+      lowWatermark_(0),
+      highWatermark_(0)
+{
+    setWatermarks(lowWatermark, highWatermark);
+}
+
+void OutboundQueue::setWatermarks(size_t lowWatermark, size_t highWatermark)
+{
+    highWatermark_ = highWatermark;
+    lowWatermark_ = std::min(lowWatermark, highWatermark);
+}
+
+void OutboundQueue::append(const char* data, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    // Appending never moves unsent bytes, so even a partially written
+    // front buffer can grow
+    if (!buffers_.empty() && (buffers_.back().size() + size <= COALESCE_LIMIT || buffers_.back().empty())) {
+        buffers_.back().append(data, size);
+    } else {
+        buffers_.emplace_back(data, size);
+    }
+    size_ += size;
+}
+
+void OutboundQueue::append(std::string&& data)
+{
+    if (data.empty()) {
+        return;
+    }
+    if (data.size() <= COALESCE_LIMIT / 4) {
+        // Small strings are cheaper to copy than to give their own iovec
+        append(data.data(), data.size());
+        return;
+    }
+    size_ += data.size();
+    if (!buffers_.empty() && buffers_.back().empty()) {
+        buffers_.back() = std::move(data);
+    } else {
+        buffers_.push_back(std::move(data));
+    }
+}
+
+OutboundQueue::FlushResult OutboundQueue::flush(int fd)
+{
+    iovec iov[MAX_IOVECS];
+
+    while (size_ > 0) {
+        size_t count = 0;
+        for (auto it = buffers_.begin(); it != buffers_.end() && count < MAX_IOVECS; ++it, ++count) {
+            size_t offset = (count == 0) ? frontOffset_ : 0;
+            iov[count].iov_base = const_cast<char*>(it->data() + offset);
+            iov[count].iov_len = it->size() - offset;
+        }
+
+        // sendmsg() is writev() plus MSG_NOSIGNAL, so a vanished peer is an
+        // EPIPE error instead of a SIGPIPE
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t written = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return FlushResult::WouldBlock;
+            }
+            return FlushResult::Error;
+        }
+        consume(static_cast<size_t>(written));
+    }
+
+    return FlushResult::Drained;
+}
+
+OutboundQueue::FlushResult OutboundQueue::flush(const Writer& writer)
+{
+    while (size_ > 0) {
+        const std::string& front = buffers_.front();
+        ssize_t written = writer(front.data() + frontOffset_, front.size() - frontOffset_);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return FlushResult::WouldBlock;
+            }
+            return FlushResult::Error;
+        }
+        consume(static_cast<size_t>(written));
+    }
+
+    return FlushResult::Drained;
+}
+
+std::string OutboundQueue::takeAll()
+{
+    std::string all;
+    all.reserve(size_);
+    for (const std::string& buffer : buffers_) {
+        all.append(buffer, all.empty() ? frontOffset_ : 0, std::string::npos);
+    }
+    clear();
+    return all;
+}
+
+void OutboundQueue::clear()
+{
+    buffers_.clear();
+    frontOffset_ = 0;
+    size_ = 0;
+}
+
+void OutboundQueue::consume(size_t bytes)
+{
+    size_ -= bytes;
+    while (bytes > 0) {
+        size_t available = buffers_.front().size() - frontOffset_;
+        if (bytes < available) {
+            frontOffset_ += bytes;
+            return;
+        }
+        bytes -= available;
+        frontOffset_ = 0;
+        if (buffers_.size() == 1 && buffers_.front().capacity() <= COALESCE_LIMIT) {
+            buffers_.front().clear(); // Kept for the next append
+            return;
+        }
+        buffers_.pop_front();
+    }
+}
@@ -0,0 +1,95 @@
+#include "Protocol.h"
+#include <algorithm>
+
+namespace {
+uint32_t loadU32(const char* data)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+void storeU32(char* data, uint32_t value)
+{
+    data[0] = static_cast<char>(value >> 24);
+    data[1] = static_cast<char>(value >> 16);
+    data[2] = static_cast<char>(value >> 8);
+    data[3] = static_cast<char>(value);
+}
+}
+
+FrameParser::Result FrameParser::next(RingBuffer& input, Frame& frame)
+{
+    size_t available = input.size();
+    if (available < 4) {
+        return Result::NeedMore;
+    }
+
+    char prefix[4];
+    input.copyOut(prefix, sizeof(prefix));
+    uint32_t length = loadU32(prefix);
+    if (length < FRAME_HEADER_SIZE - 4 || length > MAX_FRAME_SIZE) {
+        return Result::Error;
+    }
+    if (available < 4 + size_t(length)) {
+        return Result::NeedMore;
+    }
+
+    const char* start = input.linearize(4 + size_t(length));
+    frame.opcode = static_cast<Opcode>(static_cast<uint8_t>(start[4]));
+    frame.requestId = loadU32(start + 5);
+    frame.payload = std::string_view(start + FRAME_HEADER_SIZE, length - (FRAME_HEADER_SIZE - 4));
+    input.consume(4 + size_t(length));
+    return Result::Frame;
+}
+
+bool PayloadReader::readU16(uint16_t& value)
+{
+    if (payload_.size() < 2) {
+        return false;
+    }
+    value = static_cast<uint16_t>((uint8_t(payload_[0]) << 8) | uint8_t(payload_[1]));
+    payload_.remove_prefix(2);
+    return true;
+}
+
+bool PayloadReader::readString(std::string_view& value)
+{
+    uint16_t size;
+    if (!readU16(size) || payload_.size() < size) {
+        return false;
+    }
+    value = payload_.substr(0, size);
+    payload_.remove_prefix(size);
+    return true;
+}
+
+void FrameWriter::start(Opcode opcode, uint32_t requestId)
+{
+    frameStart_ = out_.size();
+    out_.append(FRAME_HEADER_SIZE, '\0');
+    out_[frameStart_ + 4] = static_cast<char>(opcode);
+    storeU32(&out_[frameStart_ + 5], requestId);
+}
+
+void FrameWriter::writeU8(uint8_t value)
+{
+    out_.push_back(static_cast<char>(value));
+}
+
+void FrameWriter::writeU16(uint16_t value)
+{
+    out_.push_back(static_cast<char>(value >> 8));
+    out_.push_back(static_cast<char>(value));
+}
+
+void FrameWriter::writeString(std::string_view value)
+{
+    size_t size = std::min<size_t>(value.size(), UINT16_MAX);
+    writeU16(static_cast<uint16_t>(size));
+    out_.append(value.data(), size);
+}
+
+void FrameWriter::finish()
+{
+    storeU32(&out_[frameStart_], static_cast<uint32_t>(out_.size() - frameStart_ - 4));
+}
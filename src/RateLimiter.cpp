@@ -0,0 +1,60 @@
+#include "RateLimiter.h"
+#include <algorithm>
+#include <functional> // For std::hash
+#include <time.h>     // For clock_gettime
+
+RateLimiter::RateLimiter(uint32_t ratePerSecond, uint32_t burst, size_t slots)
+    : intervalNs_(1000000000ull / std::max<uint32_t>(ratePerSecond, 1)),
+      toleranceNs_(intervalNs_ * (std::max<uint32_t>(burst, 1) - 1)),
+      mask_(0)
+{
+    size_t size = 1;
+    while (size < slots) {
+        size <<= 1;
+    }
+    mask_ = size - 1;
+
+    // Zero means "quiet since forever": every bucket starts full
+    buckets_ = std::make_unique<std::atomic<uint64_t>[]>(size);
+    for (size_t i = 0; i < size; ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// allow(): GCRA. The bucket holds the time at which it would be full again
+// if no more tokens were taken; taking one pushes that time one interval
+// further. More than a burst ahead of now means the bucket is empty.
+// -----------------------------------------------------------------------------
+bool RateLimiter::allow(uint64_t key, uint64_t nowNs)
+{
+    std::atomic<uint64_t>& bucket = bucketFor(key);
+    uint64_t arrival = bucket.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        uint64_t base = std::max(arrival, nowNs);
+        if (base - nowNs > toleranceNs_) {
+            return false; // Rejections leave the bucket alone
+        }
+        next = base + intervalNs_;
+    } while (!bucket.compare_exchange_weak(arrival, next, std::memory_order_relaxed));
+    return true;
+}
+
+bool RateLimiter::allow(const std::string& key, uint64_t nowNs)
+{
+    return allow(static_cast<uint64_t>(std::hash<std::string>()(key)), nowNs);
+}
+
+uint64_t RateLimiter::monotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+std::atomic<uint64_t>& RateLimiter::bucketFor(uint64_t key)
+{
+    // Fibonacci hashing spreads sequential IPs over the table
+    return buckets_[((key * 0x9E3779B97F4A7C15ull) >> 32) & mask_];
+}
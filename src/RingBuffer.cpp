@@ -0,0 +1,138 @@
+#include "RingBuffer.h"
+#include "DelimiterScan.h"
+#include <algorithm>
+#include <cstring> // For memcpy
+
+namespace {
+size_t roundUpToPowerOfTwo(size_t size)
+{
+    size_t capacity = 1;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+}
+
+RingBuffer::RingBuffer(size_t initialCapacity)
+    : initialCapacity_(roundUpToPowerOfTwo(std::max<size_t>(initialCapacity, 64)))
+{
+}
+
+size_t RingBuffer::writable() const
+{
+    size_t position = tail_ & (capacity_ - 1);
+    return std::min(capacity_ - position, capacity_ - size());
+}
+
+// -----------------------------------------------------------------------------
+// reserve(): Cheapest first: the free space may already be contiguous, or
+// become so by moving the contents to the front; only then grow.
+// -----------------------------------------------------------------------------
+void RingBuffer::reserve(size_t size)
+{
+    if (capacity_ == 0) {
+        relocate(std::max(initialCapacity_, roundUpToPowerOfTwo(size)));
+        return;
+    }
+    if (writable() >= size) {
+        return;
+    }
+    if (capacity_ - this->size() >= size) {
+        relocate(capacity_);
+        return;
+    }
+    relocate(roundUpToPowerOfTwo(this->size() + size));
+}
+
+void RingBuffer::append(const char* data, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    if (capacity_ - this->size() < size) {
+        relocate(std::max(initialCapacity_, roundUpToPowerOfTwo(this->size() + size)));
+    }
+    // May wrap: the free space is written in up to two pieces
+    size_t position = tail_ & (capacity_ - 1);
+    size_t first = std::min(capacity_ - position, size);
+    std::memcpy(storage_.get() + position, data, first);
+    std::memcpy(storage_.get(), data + first, size - first);
+    tail_ += size;
+}
+
+size_t RingBuffer::find(char byte, size_t from) const
+{
+    size_t length = size();
+    while (from < length) {
+        size_t position = (head_ + from) & (capacity_ - 1);
+        size_t segment = std::min(capacity_ - position, length - from);
+        const char* start = storage_.get() + position;
+        const char* match = scanForByte(start, start + segment, byte);
+        if (match != start + segment) {
+            return from + static_cast<size_t>(match - start);
+        }
+        from += segment;
+    }
+    return npos;
+}
+
+void RingBuffer::copyOut(char* out, size_t size) const
+{
+    size_t position = head_ & (capacity_ - 1);
+    size_t first = std::min(capacity_ - position, size);
+    std::memcpy(out, storage_.get() + position, first);
+    std::memcpy(out + first, storage_.get(), size - first);
+}
+
+char* RingBuffer::linearize(size_t size)
+{
+    size_t position = head_ & (capacity_ - 1);
+    if (capacity_ - position < size) {
+        relocate(capacity_); // Rare: only commands that straddle the end pay for it
+        position = 0;
+    }
+    return storage_.get() + position;
+}
+
+void RingBuffer::consume(size_t size)
+{
+    head_ += size;
+    if (head_ == tail_) {
+        // Restart at the front, so the next read gets the whole buffer
+        head_ = 0;
+        tail_ = 0;
+    }
+}
+
+std::string RingBuffer::takeAll()
+{
+    std::string contents(size(), '\0');
+    if (!contents.empty()) {
+        copyOut(contents.data(), contents.size());
+    }
+    head_ = 0;
+    tail_ = 0;
+    return contents;
+}
+
+void RingBuffer::shrink()
+{
+    if (empty() && capacity_ > initialCapacity_) {
+        storage_.reset();
+        capacity_ = 0;
+    }
+}
+
+void RingBuffer::relocate(size_t capacity)
+{
+    std::unique_ptr<char[]> storage(new char[capacity]);
+    size_t length = size();
+    if (length > 0) {
+        copyOut(storage.get(), length);
+    }
+    storage_ = std::move(storage);
+    capacity_ = capacity;
+    head_ = 0;
+    tail_ = length;
+}
@@ -1,19 +1,218 @@
 #include "Server.h"
+#include "Handoff.h"
 #include <iostream>
 #include <cstring>
 #include <unistd.h> // For close()
 #include <sys/socket.h> // For socket functions
 #include <netinet/in.h> // For sockaddr_in
+#include <netinet/tcp.h> // For TCP_NODELAY
 #include <arpa/inet.h> // For inet_ntoa()
+#include <fcntl.h>      // For O_NONBLOCK
+#include <sched.h>      // For CPU_SET
+#include <sys/timerfd.h> // For timerfd_create
+#include <sys/eventfd.h> // For eventfd
+#include <poll.h>        // For poll
 
-Server::Server(int port, size_t threadCount)
-    : serverSocket_(-1),
-      running_(false),
+namespace {
+// Client sockets are edge-triggered and one-shot: each arm wakes exactly one
+// worker, which resumes the coroutine that asked for it.
+constexpr uint32_t CLIENT_EVENTS = EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+
+// How often the per-shard timer wheels are advanced (matches their default
+// resolution); timeouts are coarse by nature
+constexpr uint64_t TIMER_TICK_MS = 100;
+
+// Sent to clients shed at accept time
+constexpr char BUSY_REPLY[] = "ERR BUSY\n";
+
+// How often the stats thread recomputes command rates
+constexpr uint64_t STATS_SAMPLE_MS = 1000;
+
+// Longest a stats client may take to send its request or take the reply
+constexpr time_t STATS_IO_TIMEOUT_SEC = 1;
+
+// Longest stats request head read; the endpoint only needs the request line
+constexpr size_t MAX_STATS_REQUEST = 8192;
+
+// How often the snapshot thread checks the size of the user log
+constexpr int SNAPSHOT_CHECK_MS = 1000;
+
+std::string peerName(const sockaddr_in& addr)
+{
+    return std::string(inet_ntoa(addr.sin_addr)) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+int boundPort(int socket)
+{
+    sockaddr_in boundAddr = {};
+    socklen_t boundLen = sizeof(boundAddr);
+    getsockname(socket, (struct sockaddr*)&boundAddr, &boundLen);
+    return ntohs(boundAddr.sin_port);
+}
+}
+
+Server::Server(int port, size_t threadCount, const ServerOptions& options)
+    : running_(false),
+      options_(options),
+      upgradeSocket_(-1),
+      upgradeThread_(0),
+      handoffChannel_(-1),
+      statsSocket_(-1),
+      statsWakeFd_(-1),
+      statsThread_(0),
+      snapshotWakeFd_(-1),
+      snapshotThread_(0),
+      clientCount_(0),
+      rejectedClients_(0),
       threadPool_(std::make_unique<ThreadPool>(threadCount))
 {
-    if (!initializeSocket(port)) {
-        throw std::runtime_error("Failed to initialize the server socket.");
+    if (options.ipCommandRate > 0) {
+        ipLimiter_ = std::make_unique<RateLimiter>(options.ipCommandRate, options.ipCommandBurst);
+    }
+    if (options.userCommandRate > 0) {
+        userLimiter_ = std::make_unique<RateLimiter>(options.userCommandRate, options.userCommandBurst);
+    }
+
+    if (!options.tlsCertificatePath.empty()) {
+#ifdef USE_OPENSSL
+        tlsContext_ = std::make_unique<TlsContext>(options.tlsCertificatePath, options.tlsPrivateKeyPath,
+                                                   options.tlsSessionCacheSize, options.tlsSessionTimeoutSec,
+                                                   options.tlsKernelOffload);
+        if (options_.ioBackend == IoBackend::IoUring) {
+            // OpenSSL reads and writes the socket itself, the ring cannot
+            std::cerr << "TLS needs the epoll backend; not using io_uring." << std::endl;
+            options_.ioBackend = IoBackend::Epoll;
+        }
+#else
+        throw std::runtime_error("TLS requested, but built without USE_OPENSSL.");
+#endif
     }
+
+    // Hot upgrade: inherit the old server's sockets instead of binding new ones
+    HandoffState inherited;
+    int takeoverChannel = -1;
+    if (!options.takeoverPath.empty()) {
+        takeoverChannel = takeOver(options.takeoverPath, inherited);
+    }
+
+    // Taking over, the users come with the handoff, and the old process has
+    // stopped logging before sending them
+    if (!options.dataDirectory.empty()) {
+        UserLogOptions logOptions;
+        logOptions.sync = options.syncUserLog;
+        logOptions.maxBatchDelayUs = options.userLogBatchDelayUs;
+        if (!userManager_.openStore(options.dataDirectory, takeoverChannel < 0, logOptions)) {
+            throw std::runtime_error("Failed to open the user store in " + options.dataDirectory + ".");
+        }
+        if (takeoverChannel < 0) {
+            std::cout << "Loaded " << userManager_.userCount() << " users from " << options.dataDirectory << "."
+                      << std::endl;
+        }
+        snapshotWakeFd_ = eventfd(0, EFD_CLOEXEC);
+        if (snapshotWakeFd_ < 0 ||
+            pthread_create(&snapshotThread_, nullptr, &Server::snapshotThreadFunc, this) != 0) {
+            std::cerr << "Background snapshots disabled: " << strerror(errno) << std::endl;
+            snapshotThread_ = 0;
+        }
+    }
+
+    size_t acceptorCount = options.acceptorCount > 0 ? options.acceptorCount : 1;
+    if (takeoverChannel >= 0) {
+        acceptorCount = inherited.listeners.size();
+    }
+    bool reusePort = acceptorCount > 1;
+
+    for (size_t i = 0; i < acceptorCount; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->server = this;
+        shard->index = i;
+        if (takeoverChannel >= 0) {
+            shard->listenSocket = inherited.listeners[i];
+            if (i < inherited.webSocketListeners.size()) {
+                shard->webSocketListenSocket = inherited.webSocketListeners[i];
+            }
+            shards_.push_back(std::move(shard));
+            continue;
+        }
+        if (!initializeSocket(shard->listenSocket, port, reusePort) ||
+            (options.webSocketPort > 0 &&
+             !initializeSocket(shard->webSocketListenSocket, options.webSocketPort, reusePort))) {
+            shards_.push_back(std::move(shard)); // So cleanup() closes what was opened
+            cleanup();
+            throw std::runtime_error("Failed to initialize the server socket.");
+        }
+        shards_.push_back(std::move(shard));
+    }
+
+    // The stats endpoint outlives upgrades like the client listeners do
+    if (inherited.statsListener >= 0) {
+        statsSocket_ = inherited.statsListener;
+    } else if (options.statsPort > 0 && !initializeSocket(statsSocket_, options.statsPort, false)) {
+        cleanup();
+        throw std::runtime_error("Failed to initialize the stats socket.");
+    }
+    if (statsSocket_ >= 0) {
+        statsWakeFd_ = eventfd(0, EFD_CLOEXEC);
+        if (statsWakeFd_ < 0 || pthread_create(&statsThread_, nullptr, &Server::statsThreadFunc, this) != 0) {
+            std::cerr << "Stats endpoint disabled: " << strerror(errno) << std::endl;
+            statsThread_ = 0;
+        }
+    }
+
+    for (auto& shard : shards_) {
+        shard->reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    if (options_.ioBackend == IoBackend::IoUring) {
+#ifdef USE_IO_URING
+        try {
+            for (auto& shard : shards_) {
+                shard->uring = std::make_unique<UringEngine>();
+            }
+            std::cout << "Using the io_uring backend." << std::endl;
+        } catch (const std::exception& ex) {
+            std::cerr << ex.what() << "; falling back to epoll." << std::endl;
+            for (auto& shard : shards_) {
+                shard->uring.reset();
+            }
+        }
+#else
+        std::cerr << "Built without USE_IO_URING; falling back to epoll." << std::endl;
+#endif
+    }
+
+    if (takeoverChannel >= 0) {
+        adoptConnections(inherited);
+        if (!Handoff::acknowledge(takeoverChannel)) {
+            std::cerr << "Failed to acknowledge the takeover: " << strerror(errno) << std::endl;
+        }
+        close(takeoverChannel);
+
+        port = boundPort(shards_[0]->listenSocket);
+        std::cout << "Took over " << inherited.connections.size() << " connections and "
+                  << inherited.users.size() << " users." << std::endl;
+    }
+
+    if (!options.upgradeSocketPath.empty()) {
+        upgradeSocket_ = Handoff::listen(options.upgradeSocketPath);
+        if (upgradeSocket_ < 0 ||
+            pthread_create(&upgradeThread_, nullptr, &Server::upgradeThreadFunc, this) != 0) {
+            std::cerr << "Hot upgrade disabled: cannot listen on " << options.upgradeSocketPath << std::endl;
+            upgradeThread_ = 0;
+        }
+    }
+
+    std::cout << "Server initialized and listening on port " << port;
+    if (shards_[0]->webSocketListenSocket >= 0) {
+        std::cout << " (WebSocket on port " << boundPort(shards_[0]->webSocketListenSocket) << ")";
+    }
+    if (statsSocket_ >= 0) {
+        std::cout << " (stats on port " << boundPort(statsSocket_) << ")";
+    }
+    if (reusePort) {
+        std::cout << " with " << acceptorCount << " SO_REUSEPORT acceptors";
+    }
+    std::cout << std::endl;
 }
 
 Server::~Server()
@@ -22,39 +221,59 @@ Server::~Server()
     cleanup();
 }
 
-bool Server::initializeSocket(int port)
+bool Server::initializeSocket(int& listenSocket, int port, bool reusePort)
 {
     // Create the socket
-    serverSocket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket_ < 0) {
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket < 0) {
         std::cerr << "Socket creation failed: " << strerror(errno) << std::endl;
         return false;
     }
 
     // Set socket options (reuse address)
     int opt = 1;
-    if (setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         std::cerr << "setsockopt failed: " << strerror(errno) << std::endl;
         return false;
     }
 
+    // Every shard binds the same port; the kernel load-balances between them
+    if (reusePort && setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "setsockopt(SO_REUSEPORT) failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Accepted sockets inherit TCP_NODELAY. Replies are already coalesced
+    // into one write per read; Nagle would only hold back the replies of
+    // pipelined requests until the client's delayed ACK.
+    if (setsockopt(listenSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
+        std::cerr << "setsockopt(TCP_NODELAY) failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
     // Bind the socket to the specified port
     serverAddr_.sin_family = AF_INET;
     serverAddr_.sin_addr.s_addr = INADDR_ANY; // Listen on all interfaces
     serverAddr_.sin_port = htons(port);
 
-    if (bind(serverSocket_, (struct sockaddr*)&serverAddr_, sizeof(serverAddr_)) < 0) {
+    if (bind(listenSocket, (struct sockaddr*)&serverAddr_, sizeof(serverAddr_)) < 0) {
         std::cerr << "Socket bind failed: " << strerror(errno) << std::endl;
         return false;
     }
 
     // Start listening on the socket
-    if (listen(serverSocket_, SOMAXCONN) < 0) {
+    if (listen(listenSocket, SOMAXCONN) < 0) {
         std::cerr << "Socket listen failed: " << strerror(errno) << std::endl;
         return false;
     }
 
-    std::cout << "Server initialized and listening on port " << port << std::endl;
+    // The event loop drains accept() until EAGAIN, so it must never block
+    int flags = fcntl(listenSocket, F_GETFL, 0);
+    if (flags < 0 || fcntl(listenSocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        std::cerr << "fcntl(O_NONBLOCK) failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
     return true;
 }
 
@@ -63,62 +282,721 @@ void Server::start()
     running_ = true;
     std::cout << "Server started. Waiting for connections..." << std::endl;
 
-    // Enter the main accept loop
-    acceptLoop();
+    if (shards_.size() == 1) {
+        // Single acceptor: run it on the calling thread, unpinned
+        runShard(*shards_[0]);
+    } else {
+        for (auto& shard : shards_) {
+            int ret = pthread_create(&shard->thread, nullptr, &Server::shardThreadFunc, shard.get());
+            if (ret != 0) {
+                std::cerr << "pthread_create failed for shard " << shard->index << ": "
+                          << strerror(ret) << std::endl;
+                shard->thread = 0;
+            }
+        }
+
+        // start() keeps its blocking contract: return once every shard stopped
+        for (auto& shard : shards_) {
+            if (shard->thread != 0) {
+                pthread_join(shard->thread, nullptr);
+                shard->thread = 0;
+            }
+        }
+    }
+
+    // Every loop is stopped; if a new process asked for it, pass everything on
+    stopUpgradeListener();
+    stopStatsListener();
+    stopSnapshots();
+    if (handoffChannel_ >= 0) {
+        handOff();
+    }
+}
+
+void* Server::shardThreadFunc(void* arg)
+{
+    Shard* shard = static_cast<Shard*>(arg);
+    if (shard == nullptr) {
+        return nullptr;
+    }
+
+    if (shard->server->options_.pinAcceptors) {
+        long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(shard->index % static_cast<size_t>(cpuCount > 0 ? cpuCount : 1), &cpus);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0) {
+            std::cerr << "pthread_setaffinity_np failed: " << strerror(ret) << std::endl;
+        }
+    }
+
+    shard->server->runShard(*shard);
+    return nullptr;
+}
+
+void Server::runShard(Shard& shard)
+{
+#ifdef USE_IO_URING
+    if (shard.uring) {
+        shard.uring->setTicker(TIMER_TICK_MS, [this, &shard]() { tickTimers(shard); });
+        std::vector<int> listeners = {shard.listenSocket};
+        if (shard.webSocketListenSocket >= 0) {
+            listeners.push_back(shard.webSocketListenSocket);
+        }
+        shard.uring->run(listeners,
+                         [this, &shard](int fd, const sockaddr_in& addr, size_t listener) {
+                             if (!admitClient()) {
+                                 rejectClient(fd);
+                                 return;
+                             }
+                             auto connection = addClient(shard, fd, addr, listener == 1);
+                             shard.uring->attach(connection);
+                             startClient(shard, connection);
+                         },
+                         [this](const std::shared_ptr<UringSession>& session) {
+                             std::shared_ptr<Connection> connection = session->connection();
+                             threadPool_->enqueue([connection]() { connection->onReady(EPOLLIN); });
+                         });
+        return;
+    }
+#endif
+
+    if (!shard.loop.add(shard.listenSocket, EPOLLIN,
+                        [this, &shard](uint32_t) { acceptLoop(shard, shard.listenSocket, false); }) ||
+        (shard.webSocketListenSocket >= 0 &&
+         !shard.loop.add(shard.webSocketListenSocket, EPOLLIN,
+                         [this, &shard](uint32_t) { acceptLoop(shard, shard.webSocketListenSocket, true); }))) {
+        std::cerr << "Failed to register the listening socket." << std::endl;
+        return;
+    }
+
+    // The timer wheel ticks from a periodic timerfd on the same loop
+    shard.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    itimerspec interval = {};
+    interval.it_interval.tv_nsec = TIMER_TICK_MS * 1000000;
+    interval.it_value = interval.it_interval;
+    if (shard.timerFd < 0 || timerfd_settime(shard.timerFd, 0, &interval, nullptr) < 0 ||
+        !shard.loop.add(shard.timerFd, EPOLLIN, [this, &shard](uint32_t) {
+            uint64_t expirations;
+            while (read(shard.timerFd, &expirations, sizeof(expirations)) > 0) {
+                // Drained; the wheel catches up on missed ticks by itself
+            }
+            tickTimers(shard);
+        })) {
+        std::cerr << "Failed to set up the timer wheel: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    // Dispatch events until stop() is called
+    shard.loop.run();
 }
 
 void Server::stop()
 {
     if (running_) {
         running_ = false;
+        std::cout << "Stopping server..." << std::endl;
+    }
 
-        // Close the listening socket to break the accept() call
-        if (serverSocket_ >= 0) {
-            close(serverSocket_);
-            serverSocket_ = -1;
+    // Wake every loop; the listening sockets are closed in cleanup()
+    for (auto& shard : shards_) {
+        shard->loop.stop();
+#ifdef USE_IO_URING
+        if (shard->uring) {
+            shard->uring->stop();
         }
-
-        std::cout << "Stopping server..." << std::endl;
+#endif
     }
 }
 
-void Server::acceptLoop()
+void Server::acceptLoop(Shard& shard, int listenSocket, bool webSocket)
 {
     while (running_) {
         sockaddr_in clientAddr;
         socklen_t clientLen = sizeof(clientAddr);
 
         // Accept a new connection
-        int clientSocket = accept(serverSocket_, (struct sockaddr*)&clientAddr, &clientLen);
+        int clientSocket = accept4(listenSocket, (struct sockaddr*)&clientAddr, &clientLen,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (clientSocket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return; // Backlog drained
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if ((errno == EMFILE || errno == ENFILE) && shard.reserveFd >= 0) {
+                shedWithReserveFd(shard, listenSocket);
+                continue;
+            }
             if (running_) {
                 std::cerr << "Accept failed: " << strerror(errno) << std::endl;
             }
+            return;
+        }
+
+        if (!admitClient()) {
+            rejectClient(clientSocket);
             continue;
         }
 
-        // Log the incoming connection
-        std::cout << "Accepted connection from "
-                  << inet_ntoa(clientAddr.sin_addr) << ":"
-                  << ntohs(clientAddr.sin_port) << std::endl;
+        auto connection = addClient(shard, clientSocket, clientAddr, webSocket);
+        if (connection) {
+            startClient(shard, connection);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// admitClient(): Cheap checks only, this runs for every accept under load.
+// Queueing delay reacts first: it rises as soon as workers fall behind,
+// while depth and client count bound memory.
+// -----------------------------------------------------------------------------
+bool Server::admitClient()
+{
+    if (options_.maxConnections > 0 && clientCount_ >= options_.maxConnections) {
+        return false;
+    }
+    if (options_.maxQueueDepth > 0 && threadPool_->queueDepth() >= options_.maxQueueDepth) {
+        return false;
+    }
+    if (options_.maxQueueDelayMs > 0 && threadPool_->queueDelayMs() >= options_.maxQueueDelayMs) {
+        return false;
+    }
+    return true;
+}
+
+void Server::rejectClient(int clientSocket)
+{
+    // No logging per client: under overload that would be a bottleneck of its own
+    send(clientSocket, BUSY_REPLY, sizeof(BUSY_REPLY) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(clientSocket);
+
+    if (rejectedClients_.fetch_add(1) % 1000 == 0) {
+        std::cerr << "Overloaded: " << rejectedClients_ << " clients rejected so far." << std::endl;
+    }
+}
+
+void Server::shedWithReserveFd(Shard& shard, int listenSocket)
+{
+    close(shard.reserveFd);
+    int clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientSocket >= 0) {
+        rejectClient(clientSocket);
+    }
+    shard.reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+int Server::takeOver(const std::string& path, HandoffState& state)
+{
+    std::cout << "Taking over from the server at " << path << "..." << std::endl;
+    int channel = Handoff::connect(path);
+    if (channel < 0 || !Handoff::receive(channel, state) || state.listeners.empty()) {
+        if (channel >= 0) {
+            close(channel);
+        }
+        throw std::runtime_error("Failed to take over from the running server.");
+    }
+    return channel;
+}
+
+void Server::adoptConnections(HandoffState& state)
+{
+    userManager_.restoreUsers(state.users);
 
-        // Enqueue the client socket to the ThreadPool for processing
-        //threadPool_->enqueue(clientSocket);
+    for (size_t i = 0; i < state.connections.size(); ++i) {
+        HandoffConnection& inherited = state.connections[i];
+        Shard& shard = *shards_[i % shards_.size()];
 
-        // Enqueue the task into the ThreadPool
-        threadPool_->enqueue([this, clientSocket, clientAddr]() {
-            Connection connection(clientSocket, clientAddr, userManager_);
-            connection.handleClient();
-        });
+        auto connection = registerClient(shard, inherited.fd, inherited.addr);
+        connection->restore(inherited.session);
+#ifdef USE_IO_URING
+        if (shard.uring) {
+            shard.uring->attach(connection);
+        }
+#endif
+        startClient(shard, connection);
     }
 }
 
+void* Server::upgradeThreadFunc(void* arg)
+{
+    Server* server = static_cast<Server*>(arg);
+    if (server != nullptr) {
+        server->waitForUpgrade();
+    }
+    return nullptr;
+}
+
+void Server::waitForUpgrade()
+{
+    while (true) {
+        int channel = accept4(upgradeSocket_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return; // stopUpgradeListener() shut the socket down
+        }
+
+#ifdef USE_IO_URING
+        // Multishot recvs still armed in our ring would race the new
+        // process for client bytes, so only epoll servers hand off
+        if (shards_[0]->uring) {
+            std::cerr << "Hot upgrade is not supported on the io_uring backend; refusing." << std::endl;
+            close(channel);
+            continue;
+        }
+#endif
+#ifdef USE_OPENSSL
+        // TLS session state lives in this process's memory
+        if (tlsContext_) {
+            std::cerr << "Hot upgrade is not supported for TLS servers; refusing." << std::endl;
+            close(channel);
+            continue;
+        }
+#endif
+
+        std::cout << "Hot upgrade requested; handing off to the new process..." << std::endl;
+        handoffChannel_ = channel;
+        // Free the path so the new process can serve the next upgrade there
+        unlink(options_.upgradeSocketPath.c_str());
+        stop();
+        return;
+    }
+}
+
+void Server::stopUpgradeListener()
+{
+    if (upgradeSocket_ < 0) {
+        return;
+    }
+
+    // Wakes a blocked accept4() with EINVAL
+    shutdown(upgradeSocket_, SHUT_RDWR);
+    if (upgradeThread_ != 0) {
+        pthread_join(upgradeThread_, nullptr);
+        upgradeThread_ = 0;
+    }
+    close(upgradeSocket_);
+    upgradeSocket_ = -1;
+    if (handoffChannel_ < 0) {
+        unlink(options_.upgradeSocketPath.c_str());
+    }
+}
+
+void* Server::statsThreadFunc(void* arg)
+{
+    Server* server = static_cast<Server*>(arg);
+    if (server != nullptr) {
+        server->serveStats();
+    }
+    return nullptr;
+}
+
+void Server::serveStats()
+{
+    pollfd fds[2] = {{statsSocket_, POLLIN, 0}, {statsWakeFd_, POLLIN, 0}};
+    uint64_t sampledNs = ServerStats::monotonicNs();
+    while (true) {
+        if (poll(fds, 2, STATS_SAMPLE_MS) < 0 && errno != EINTR) {
+            std::cerr << "Stats endpoint stopped: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return; // stopStatsListener()
+        }
+
+        uint64_t now = ServerStats::monotonicNs();
+        if (now - sampledNs >= STATS_SAMPLE_MS * 1000000) {
+            stats_.sample(now);
+            sampledNs = now;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept4(statsSocket_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                answerStatsRequest(client);
+            }
+        }
+    }
+}
+
+void Server::answerStatsRequest(int client)
+{
+    timeval timeout = {STATS_IO_TIMEOUT_SEC, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_STATS_REQUEST) {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(received));
+    }
+
+    // Every value below is an atomic load; nothing here takes a lock
+    StatsSnapshot snapshot;
+    stats_.collect(snapshot);
+    snapshot.connections = clientCount_;
+    snapshot.rejectedTotal = rejectedClients_;
+    snapshot.workers = threadPool_->threadCount();
+    snapshot.busyWorkers = threadPool_->busyWorkers();
+    snapshot.queueDepth = threadPool_->queueDepth();
+    snapshot.registeredUsers = userManager_.userCount();
+    snapshot.onlineUsers = userManager_.onlineCount();
+
+    std::string response = statsHttpResponse(request, snapshot);
+    for (size_t sent = 0; sent < response.size();) {
+        ssize_t written = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        sent += static_cast<size_t>(written);
+    }
+    close(client);
+}
+
+void Server::stopStatsListener()
+{
+    if (statsThread_ != 0) {
+        uint64_t wake = 1;
+        if (write(statsWakeFd_, &wake, sizeof(wake)) < 0) {
+            std::cerr << "Failed to wake the stats thread: " << strerror(errno) << std::endl;
+        }
+        pthread_join(statsThread_, nullptr);
+        statsThread_ = 0;
+    }
+    if (statsWakeFd_ >= 0) {
+        close(statsWakeFd_);
+        statsWakeFd_ = -1;
+    }
+}
+
+void* Server::snapshotThreadFunc(void* arg)
+{
+    Server* server = static_cast<Server*>(arg);
+    if (server != nullptr) {
+        server->runSnapshots();
+    }
+    return nullptr;
+}
+
+void Server::runSnapshots()
+{
+    pollfd wake = {snapshotWakeFd_, POLLIN, 0};
+    while (true) {
+        if (poll(&wake, 1, SNAPSHOT_CHECK_MS) < 0 && errno != EINTR) {
+            std::cerr << "Background snapshots stopped: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (wake.revents != 0) {
+            return; // stopSnapshots()
+        }
+        if (userManager_.storeLogBytes() >= options_.snapshotLogBytes) {
+            userManager_.writeSnapshot();
+        }
+    }
+}
+
+void Server::stopSnapshots()
+{
+    if (snapshotThread_ != 0) {
+        uint64_t wake = 1;
+        if (write(snapshotWakeFd_, &wake, sizeof(wake)) < 0) {
+            std::cerr << "Failed to wake the snapshot thread: " << strerror(errno) << std::endl;
+        }
+        pthread_join(snapshotThread_, nullptr);
+        snapshotThread_ = 0;
+    }
+    if (snapshotWakeFd_ >= 0) {
+        close(snapshotWakeFd_);
+        snapshotWakeFd_ = -1;
+    }
+}
+
+void Server::handOff()
+{
+    // Loops are stopped, so nothing new gets queued; let running sessions
+    // park so every coroutine is suspended before its socket leaves
+    threadPool_->waitIdle();
+
+    HandoffState state;
+    std::vector<std::shared_ptr<Connection>> detached;
+    for (auto& shard : shards_) {
+        state.listeners.push_back(shard->listenSocket);
+        if (shard->webSocketListenSocket >= 0) {
+            state.webSocketListeners.push_back(shard->webSocketListenSocket);
+        }
+
+        std::lock_guard<std::mutex> lock(shard->connectionsMutex);
+        for (auto& [fd, connection] : shard->connections) {
+            shard->loop.remove(fd);
+            {
+                std::lock_guard<std::mutex> timersLock(shard->timersMutex);
+                connection->timers().idle.cancel();
+                connection->timers().login.cancel();
+                connection->timers().heartbeat.cancel();
+            }
+
+            HandoffConnection handed;
+            handed.addr = connection->clientAddress();
+            handed.fd = connection->detach(handed.session);
+            state.connections.push_back(std::move(handed));
+            detached.push_back(connection);
+        }
+        clientCount_ -= shard->connections.size();
+        shard->connections.clear();
+    }
+    state.users = userManager_.getAllUsers();
+    state.statsListener = statsSocket_;
+    userManager_.closeStore(); // The new process logs from here on
+
+    bool handedOff = Handoff::send(handoffChannel_, state);
+    close(handoffChannel_);
+
+    // The new process holds its own descriptors now; on failure the clients
+    // are dropped, exactly as on a plain restart
+    for (auto& shard : shards_) {
+        close(shard->listenSocket);
+        shard->listenSocket = -1;
+        if (shard->webSocketListenSocket >= 0) {
+            close(shard->webSocketListenSocket);
+            shard->webSocketListenSocket = -1;
+        }
+    }
+    if (statsSocket_ >= 0) {
+        close(statsSocket_);
+        statsSocket_ = -1;
+    }
+    for (const HandoffConnection& handed : state.connections) {
+        close(handed.fd);
+    }
+
+    if (handedOff) {
+        std::cout << "Handed off " << state.connections.size() << " connections." << std::endl;
+    } else {
+        std::cerr << "Hot upgrade failed; " << state.connections.size() << " connections dropped." << std::endl;
+    }
+}
+
+void Server::tickTimers(Shard& shard)
+{
+    std::lock_guard<std::mutex> lock(shard.timersMutex);
+    shard.timers.advance(TimerWheel::monotonicMs());
+}
+
+void Server::armTimers(Shard& shard, const std::shared_ptr<Connection>& connection)
+{
+    // Callbacks capture raw pointers (small enough for std::function's
+    // inline storage): see onIdleTimer() for why that is safe
+    Connection* client = connection.get();
+    Connection::Timers& timers = connection->timers();
+    std::lock_guard<std::mutex> lock(shard.timersMutex);
+
+    if (options_.idleTimeoutMs > 0) {
+        timers.idle.setCallback([&shard, client]() { shard.server->onIdleTimer(shard, *client); });
+        shard.timers.schedule(timers.idle, options_.idleTimeoutMs);
+    }
+    if (options_.loginTimeoutMs > 0) {
+        timers.login.setCallback([&shard, client]() { shard.server->onLoginTimer(shard, *client); });
+        shard.timers.schedule(timers.login, options_.loginTimeoutMs);
+    }
+    if (options_.heartbeatIntervalMs > 0) {
+        timers.heartbeat.setCallback([&shard, client]() { shard.server->onHeartbeatTimer(shard, *client); });
+        shard.timers.schedule(timers.heartbeat, options_.heartbeatIntervalMs);
+    }
+}
+
+void Server::onIdleTimer(Shard& shard, Connection& connection)
+{
+    // Reads only stamp lastActivityMs(); the timer is pushed back lazily here
+    uint64_t quiet = TimerWheel::monotonicMs() - connection.lastActivityMs();
+    if (quiet < options_.idleTimeoutMs) {
+        shard.timers.schedule(connection.timers().idle, options_.idleTimeoutMs - quiet);
+        return;
+    }
+    connection.expire("ERR IDLE_TIMEOUT");
+}
+
+void Server::onLoginTimer(Shard&, Connection& connection)
+{
+    if (!connection.loggedIn()) {
+        connection.expire("ERR LOGIN_TIMEOUT");
+    }
+}
+
+void Server::onHeartbeatTimer(Shard& shard, Connection& connection)
+{
+    uint64_t quiet = TimerWheel::monotonicMs() - connection.lastActivityMs();
+    if (quiet >= options_.heartbeatIntervalMs) {
+        connection.sendPing();
+    }
+    shard.timers.schedule(connection.timers().heartbeat, options_.heartbeatIntervalMs);
+}
+
+std::shared_ptr<Connection> Server::addClient(Shard& shard, int clientSocket, const sockaddr_in& clientAddr,
+                                              bool webSocket)
+{
+    // Log the incoming connection
+    std::cout << "Accepted " << (webSocket ? "WebSocket " : "") << "connection from " << peerName(clientAddr)
+              << std::endl;
+
+    stats_.recordAccept(webSocket);
+    auto connection = registerClient(shard, clientSocket, clientAddr);
+    if (webSocket) {
+        connection->setWebSocket(); // Over TLS too: the upgrade runs inside it
+    }
+#ifdef USE_OPENSSL
+    if (tlsContext_ && !connection->setupSSL(tlsContext_->get())) {
+        closeClient(shard, connection);
+        return nullptr;
+    }
+#endif
+    return connection;
+}
+
+std::shared_ptr<Connection> Server::registerClient(Shard& shard, int clientSocket, const sockaddr_in& clientAddr)
+{
+    auto connection = std::make_shared<Connection>(clientSocket, clientAddr, userManager_);
+    connection->setWatermarks(options_.outboundLowWatermark, options_.outboundHighWatermark);
+    connection->setRateLimiters(ipLimiter_.get(), userLimiter_.get());
+    connection->setLookupPool(threadPool_.get());
+    connection->setStats(&stats_);
+    {
+        std::lock_guard<std::mutex> lock(shard.connectionsMutex);
+        shard.connections[clientSocket] = connection;
+    }
+    ++clientCount_;
+    armTimers(shard, connection);
+    return connection;
+}
+
+void Server::startClient(Shard& shard, const std::shared_ptr<Connection>& connection)
+{
+    // Hooks hold weak references: shard.connections owns the Connection,
+    // and every task that resumes it holds a strong one while it runs.
+    std::weak_ptr<Connection> weak = connection;
+    Connection::ArmFunction arm;
+    int fd = connection->socketFd();
+
+#ifdef USE_IO_URING
+    if (shard.uring) {
+        // The ring keeps receiving on its own; only wait if nothing is pending.
+        // Output goes straight to the ring, so EPOLLOUT is never wanted.
+        arm = [weak](uint32_t events) {
+            auto connection = weak.lock();
+            if (!connection || (events & EPOLLOUT)) {
+                return Connection::ArmResult::Failed; // Ring sends never block
+            }
+            return connection->uringSession()->finishDrain() ? Connection::ArmResult::Retry
+                                                             : Connection::ArmResult::Armed;
+        };
+    } else
+#endif
+    {
+        // The fd joins the loop on the first wait, so no event can fire
+        // before the coroutine is actually parked.
+        arm = [this, &shard, weak, fd, registered = false](uint32_t events) mutable {
+            uint32_t mask = events | CLIENT_EVENTS;
+            if (registered) {
+                return shard.loop.modify(fd, mask) ? Connection::ArmResult::Armed
+                                                   : Connection::ArmResult::Failed;
+            }
+            registered = shard.loop.add(fd, mask, [this, weak](uint32_t ready) {
+                // Only real work goes to the ThreadPool: the socket is ready
+                if (auto connection = weak.lock()) {
+                    threadPool_->enqueue([connection, ready]() { connection->onReady(ready); });
+                }
+            });
+            return registered ? Connection::ArmResult::Armed : Connection::ArmResult::Failed;
+        };
+    }
+
+    auto onClose = [this, &shard, weak]() {
+        if (auto connection = weak.lock()) {
+            closeClient(shard, connection);
+        }
+    };
+
+    threadPool_->enqueue([connection, arm, onClose]() {
+        connection->start(arm, onClose);
+    });
+}
+
+void Server::closeClient(Shard& shard, const std::shared_ptr<Connection>& connection)
+{
+    int fd = connection->socketFd();
+    if (fd < 0) {
+        return;
+    }
+
+    {
+        // After this no timer callback can reach the connection any more
+        std::lock_guard<std::mutex> lock(shard.timersMutex);
+        Connection::Timers& timers = connection->timers();
+        timers.idle.cancel();
+        timers.login.cancel();
+        timers.heartbeat.cancel();
+    }
+
+#ifdef USE_IO_URING
+    if (connection->uringSession()) {
+        shard.uring->release(connection->uringSession()->id());
+    } else
+#endif
+    shard.loop.remove(fd);
+    {
+        std::lock_guard<std::mutex> lock(shard.connectionsMutex);
+        if (shard.connections.erase(fd) > 0) {
+            --clientCount_;
+        }
+    }
+    connection->closeConnection();
+}
+
 void Server::cleanup()
 {
-    // Close the listening socket
-    if (serverSocket_ >= 0) {
-        close(serverSocket_);
-        serverSocket_ = -1;
+    stopUpgradeListener();
+    stopStatsListener();
+    stopSnapshots();
+    if (userManager_.storeLogBytes() > 0 && userManager_.writeSnapshot()) {
+        std::cout << "Wrote a snapshot of " << userManager_.userCount() << " users." << std::endl;
+    }
+    if (statsSocket_ >= 0) {
+        close(statsSocket_);
+        statsSocket_ = -1;
+    }
+
+    // Close the listening sockets
+    for (auto& shard : shards_) {
+        if (shard->listenSocket >= 0) {
+            close(shard->listenSocket);
+            shard->listenSocket = -1;
+        }
+        if (shard->webSocketListenSocket >= 0) {
+            close(shard->webSocketListenSocket);
+            shard->webSocketListenSocket = -1;
+        }
+        if (shard->reserveFd >= 0) {
+            close(shard->reserveFd);
+            shard->reserveFd = -1;
+        }
+        if (shard->timerFd >= 0) {
+            shard->loop.remove(shard->timerFd);
+            close(shard->timerFd);
+            shard->timerFd = -1;
+        }
     }
 
     std::cout << "Server resources cleaned up." << std::endl;
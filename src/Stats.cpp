@@ -0,0 +1,258 @@
+#include "Stats.h"
+#include <bit>
+#include <cstdio>
+#include <time.h> // For clock_gettime
+
+namespace {
+// Threads are numbered on first use; thread n bumps stripe n % STATS_STRIPES
+std::atomic<size_t> nextThreadIndex{0};
+
+size_t bucketFor(uint64_t latencyNs)
+{
+    size_t bucket = std::bit_width(latencyNs / 1000);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// Upper bound of the bucket holding the @p quantile-th latency, in
+// microseconds (0 if no command ran or it is in the unbounded bucket)
+uint64_t quantileUs(const CommandStats& command, double quantile)
+{
+    if (command.count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(command.count - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += command.buckets[i];
+        if (seen > rank) {
+            return latencyBucketBoundUs(i);
+        }
+    }
+    return 0;
+}
+
+// A bucket bound for JSON: 0 (unbounded or unknown) becomes null
+std::string jsonBound(uint64_t boundUs)
+{
+    return boundUs > 0 ? std::to_string(boundUs) : "null";
+}
+
+std::string number(double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+}
+
+// ---- Prometheus: one metric family per call, HELP and TYPE first ----
+
+void family(std::string& out, const char* name, const char* type, const char* help)
+{
+    out.append("# HELP chatroom_").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE chatroom_").append(name).append(" ").append(type).append("\n");
+}
+
+void metric(std::string& out, const char* name, std::string_view labels, const std::string& value)
+{
+    out.append("chatroom_").append(name);
+    if (!labels.empty()) {
+        out.append("{").append(labels).append("}");
+    }
+    out.append(" ").append(value).append("\n");
+}
+
+void singleMetric(std::string& out, const char* name, const char* type, const char* help, uint64_t value)
+{
+    family(out, name, type, help);
+    metric(out, name, "", std::to_string(value));
+}
+
+std::string httpResponse(const char* status, const char* contentType, const std::string& body)
+{
+    std::string response = "HTTP/1.1 ";
+    response.append(status).append("\r\nContent-Type: ").append(contentType);
+    response.append("\r\nContent-Length: ").append(std::to_string(body.size()));
+    response.append("\r\nConnection: close\r\n\r\n").append(body);
+    return response;
+}
+}
+
+ServerStats::ServerStats()
+    : stripes_(std::make_unique<Stripe[]>(STATS_STRIPES)),
+      startNs_(monotonicNs()),
+      sampledNs_(startNs_)
+{
+}
+
+// -----------------------------------------------------------------------------
+// recordCommand(): Runs for every command, so it touches only the calling
+// thread's stripe: three relaxed increments on lines no other worker writes.
+// -----------------------------------------------------------------------------
+void ServerStats::recordCommand(Command command, uint64_t latencyNs)
+{
+    CommandCounters& counters = stripe().commands[static_cast<size_t>(command)];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.latencyNs.fetch_add(latencyNs, std::memory_order_relaxed);
+    counters.buckets[bucketFor(latencyNs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ServerStats::recordAccept(bool webSocket)
+{
+    (webSocket ? webSocketAccepted_ : accepted_).fetch_add(1, std::memory_order_relaxed);
+}
+
+void ServerStats::sample(uint64_t nowNs)
+{
+    if (nowNs <= sampledNs_) {
+        return;
+    }
+    double seconds = static_cast<double>(nowNs - sampledNs_) / 1e9;
+    for (size_t command = 0; command < COMMAND_COUNT; ++command) {
+        uint64_t count = 0;
+        for (size_t i = 0; i < STATS_STRIPES; ++i) {
+            count += stripes_[i].commands[command].count.load(std::memory_order_relaxed);
+        }
+        rates_[command] = static_cast<double>(count - sampledCounts_[command]) / seconds;
+        sampledCounts_[command] = count;
+    }
+    sampledNs_ = nowNs;
+}
+
+void ServerStats::collect(StatsSnapshot& snapshot)
+{
+    snapshot.uptimeSeconds = static_cast<double>(monotonicNs() - startNs_) / 1e9;
+    snapshot.acceptedTotal = accepted_.load(std::memory_order_relaxed);
+    snapshot.webSocketAcceptedTotal = webSocketAccepted_.load(std::memory_order_relaxed);
+
+    for (size_t command = 0; command < COMMAND_COUNT; ++command) {
+        CommandStats& totals = snapshot.commands[command];
+        totals = CommandStats();
+        for (size_t i = 0; i < STATS_STRIPES; ++i) {
+            const CommandCounters& counters = stripes_[i].commands[command];
+            totals.count += counters.count.load(std::memory_order_relaxed);
+            totals.latencyNs += counters.latencyNs.load(std::memory_order_relaxed);
+            for (size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+                totals.buckets[bucket] += counters.buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+        totals.ratePerSecond = rates_[command];
+    }
+}
+
+uint64_t ServerStats::monotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+ServerStats::Stripe& ServerStats::stripe()
+{
+    thread_local size_t index = nextThreadIndex.fetch_add(1, std::memory_order_relaxed) % STATS_STRIPES;
+    return stripes_[index];
+}
+
+std::string_view commandName(Command command)
+{
+    for (const CommandName& entry : COMMAND_NAMES) {
+        if (entry.command == command) {
+            return entry.name;
+        }
+    }
+    return "UNKNOWN";
+}
+
+uint64_t latencyBucketBoundUs(size_t bucket)
+{
+    return bucket + 1 < LATENCY_BUCKETS ? uint64_t(1) << bucket : 0;
+}
+
+std::string formatStatsJson(const StatsSnapshot& snapshot)
+{
+    std::string out = "{\"uptime_seconds\":" + number(snapshot.uptimeSeconds);
+    out += ",\"connections\":{\"open\":" + std::to_string(snapshot.connections) +
+           ",\"accepted_total\":" + std::to_string(snapshot.acceptedTotal) +
+           ",\"websocket_accepted_total\":" + std::to_string(snapshot.webSocketAcceptedTotal) +
+           ",\"rejected_total\":" + std::to_string(snapshot.rejectedTotal) + "}";
+    out += ",\"thread_pool\":{\"workers\":" + std::to_string(snapshot.workers) +
+           ",\"busy\":" + std::to_string(snapshot.busyWorkers) +
+           ",\"queue_depth\":" + std::to_string(snapshot.queueDepth) + "}";
+    out += ",\"users\":{\"registered\":" + std::to_string(snapshot.registeredUsers) +
+           ",\"online\":" + std::to_string(snapshot.onlineUsers) + "}";
+
+    out += ",\"commands\":{";
+    for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+        const CommandStats& command = snapshot.commands[i];
+        double meanUs = command.count > 0 ? static_cast<double>(command.latencyNs) / 1e3 / command.count : 0;
+        out += (i > 0 ? ",\"" : "\"") + std::string(commandName(static_cast<Command>(i))) + "\":{";
+        out += "\"count\":" + std::to_string(command.count) + ",\"rate_per_second\":" +
+               number(command.ratePerSecond) + ",\"latency_us\":{\"mean\":" + number(meanUs) +
+               ",\"p50\":" + jsonBound(quantileUs(command, 0.5)) +
+               ",\"p99\":" + jsonBound(quantileUs(command, 0.99)) + ",\"histogram\":{";
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+            uint64_t bound = latencyBucketBoundUs(bucket);
+            out += (bucket > 0 ? ",\"" : "\"") + (bound > 0 ? std::to_string(bound) : std::string("+Inf")) +
+                   "\":" + std::to_string(command.buckets[bucket]);
+        }
+        out += "}}}";
+    }
+    out += "}}\n";
+    return out;
+}
+
+std::string formatStatsPrometheus(const StatsSnapshot& snapshot)
+{
+    std::string out;
+    family(out, "uptime_seconds", "gauge", "Seconds since this process started serving.");
+    metric(out, "uptime_seconds", "", number(snapshot.uptimeSeconds));
+    singleMetric(out, "connections", "gauge", "Open client connections.", snapshot.connections);
+    family(out, "connections_accepted_total", "counter", "Clients accepted, by listener.");
+    metric(out, "connections_accepted_total", "listener=\"tcp\"", std::to_string(snapshot.acceptedTotal));
+    metric(out, "connections_accepted_total", "listener=\"websocket\"",
+           std::to_string(snapshot.webSocketAcceptedTotal));
+    singleMetric(out, "connections_rejected_total", "counter", "Clients shed with ERR BUSY.", snapshot.rejectedTotal);
+    singleMetric(out, "threadpool_workers", "gauge", "Worker threads.", snapshot.workers);
+    singleMetric(out, "threadpool_busy_workers", "gauge", "Workers running a task.", snapshot.busyWorkers);
+    singleMetric(out, "threadpool_queue_depth", "gauge", "Tasks waiting for a worker.", snapshot.queueDepth);
+    singleMetric(out, "users_registered", "gauge", "Registered users.", snapshot.registeredUsers);
+    singleMetric(out, "users_online", "gauge", "Logged-in users.", snapshot.onlineUsers);
+
+    family(out, "command_duration_seconds", "histogram",
+           "Time to parse and run a command and queue its reply.");
+    for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+        const CommandStats& command = snapshot.commands[i];
+        std::string label = "command=\"" + std::string(commandName(static_cast<Command>(i))) + "\"";
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+            cumulative += command.buckets[bucket];
+            uint64_t bound = latencyBucketBoundUs(bucket);
+            std::string le = bound > 0 ? number(static_cast<double>(bound) / 1e6) : "+Inf";
+            metric(out, "command_duration_seconds_bucket", label + ",le=\"" + le + "\"", std::to_string(cumulative));
+        }
+        metric(out, "command_duration_seconds_sum", label, number(static_cast<double>(command.latencyNs) / 1e9));
+        metric(out, "command_duration_seconds_count", label, std::to_string(command.count));
+    }
+    return out;
+}
+
+std::string statsHttpResponse(std::string_view request, const StatsSnapshot& snapshot)
+{
+    std::string_view requestLine = request.substr(0, request.find("\r\n"));
+    size_t pathStart = requestLine.find(' ');
+    size_t pathEnd = requestLine.rfind(' ');
+    if (pathStart == std::string_view::npos || pathEnd <= pathStart ||
+        !requestLine.substr(pathEnd + 1).starts_with("HTTP/1.")) {
+        return httpResponse("400 Bad Request", "text/plain", "Bad request\n");
+    }
+    std::string_view method = requestLine.substr(0, pathStart);
+    std::string_view path = requestLine.substr(pathStart + 1, pathEnd - pathStart - 1);
+    path = path.substr(0, path.find('?'));
+
+    if (method == "GET" && path == "/stats") {
+        return httpResponse("200 OK", "application/json", formatStatsJson(snapshot));
+    }
+    if (method == "GET" && path == "/metrics") {
+        return httpResponse("200 OK", "text/plain; version=0.0.4", formatStatsPrometheus(snapshot));
+    }
+    return httpResponse("404 Not Found", "text/plain", "Try /stats or /metrics\n");
+}
@@ -3,12 +3,26 @@
 #include <iostream>       // For std::cerr, etc.
 #include <cstring>        // For strerror
 #include <cerrno>         // For errno
+#include <time.h>         // For clock_gettime
+
+namespace {
+// Coarse is plenty for queueing delays and costs no syscall
+uint64_t nowMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+}
 
 
 ThreadPool::ThreadPool(size_t numThreads)
     : numThreads_(numThreads),
       threads_(),
-      stop_(false)
+      stop_(false),
+      queuedTasks_(0),
+      headEnqueuedMs_(0),
+      activeTasks_(0)
 {
     int ret = pthread_mutex_init(&queueMutex_, nullptr);
     if (ret != 0) {
@@ -23,6 +37,11 @@ ThreadPool::ThreadPool(size_t numThreads)
         // Handle error (throw exception, exit, etc.)
     }
 
+    ret = pthread_cond_init(&idleCondition_, nullptr);
+    if (ret != 0) {
+        std::cerr << "pthread_cond_init failed: " << strerror(ret) << std::endl;
+    }
+
     // Resize the vector to hold numThreads_ pthread_t handles
     threads_.resize(numThreads_);
 
@@ -47,6 +66,7 @@ ThreadPool::~ThreadPool()
         std::cerr << "pthread_cond_broadcast failed: " << strerror(ret) << std::endl;
         // Handle error
     }
+    pthread_cond_broadcast(&idleCondition_);
 
     // Join all worker threads
     for (size_t i = 0; i < numThreads_; ++i) {
@@ -55,6 +75,7 @@ ThreadPool::~ThreadPool()
 
     // Clean up
     pthread_cond_destroy(&condition_);
+    pthread_cond_destroy(&idleCondition_);
     pthread_mutex_destroy(&queueMutex_);
 }
 
@@ -67,7 +88,11 @@ void ThreadPool::enqueue(Task task)
         // Handle error
     }
 
-    taskQueue_.push(task);
+    taskQueue_.push(QueuedTask{std::move(task), nowMs()});
+    queuedTasks_.store(taskQueue_.size(), std::memory_order_relaxed);
+    if (taskQueue_.size() == 1) {
+        headEnqueuedMs_.store(taskQueue_.front().enqueuedMs, std::memory_order_relaxed);
+    }
 
     // Unlock and signal one worker thread
     ret = pthread_mutex_unlock(&queueMutex_);
@@ -84,6 +109,37 @@ void ThreadPool::enqueue(Task task)
     }
 }
 
+void ThreadPool::waitIdle()
+{
+    pthread_mutex_lock(&queueMutex_);
+    while (!stop_ && (!taskQueue_.empty() || activeTasks_ > 0)) {
+        pthread_cond_wait(&idleCondition_, &queueMutex_);
+    }
+    pthread_mutex_unlock(&queueMutex_);
+}
+
+size_t ThreadPool::queueDepth() const
+{
+    return queuedTasks_.load(std::memory_order_relaxed);
+}
+
+size_t ThreadPool::busyWorkers() const
+{
+    return activeTasks_.load(std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// queueDelayMs(): Called on every accept, so it reads the head's enqueue
+// time published by enqueue() and the workers instead of taking the queue
+// lock. The value may be a moment stale, which admission control tolerates.
+// -----------------------------------------------------------------------------
+uint64_t ThreadPool::queueDelayMs() const
+{
+    uint64_t enqueued = headEnqueuedMs_.load(std::memory_order_relaxed);
+    uint64_t now = nowMs();
+    return enqueued != 0 && now > enqueued ? now - enqueued : 0;
+}
+
 void* ThreadPool::workerFunc(void* arg)
 {
     // Cast the arg back to our ThreadPool*
@@ -127,8 +183,11 @@ void ThreadPool::workerLoop()
         //sock = socketQueue_.front();
         //socketQueue_.pop();
         // Get the next task from the queue
-        task = std::move(taskQueue_.front());
+        task = std::move(taskQueue_.front().task);
         taskQueue_.pop();
+        queuedTasks_.store(taskQueue_.size(), std::memory_order_relaxed);
+        headEnqueuedMs_.store(taskQueue_.empty() ? 0 : taskQueue_.front().enqueuedMs, std::memory_order_relaxed);
+        ++activeTasks_;
 
         // Unlock the mutex so other threads can continue
         ret = pthread_mutex_unlock(&queueMutex_);
@@ -148,5 +207,12 @@ void ThreadPool::workerLoop()
         //}
         
         task();
+
+        // Tell waitIdle() once the last running task is done
+        pthread_mutex_lock(&queueMutex_);
+        if (--activeTasks_ == 0 && taskQueue_.empty()) {
+            pthread_cond_broadcast(&idleCondition_);
+        }
+        pthread_mutex_unlock(&queueMutex_);
     }
 }
@@ -0,0 +1,163 @@
+#include "TimerWheel.h"
+#include <time.h> // For clock_gettime
+
+void TimerWheel::Timer::cancel()
+{
+    if (wheel_) {
+        wheel_->unlink(*this);
+    }
+}
+
+TimerWheel::TimerWheel(uint64_t tickMs, uint64_t nowMs)
+    : tickMs_(tickMs > 0 ? tickMs : 1),
+      now_(nowMs / tickMs_),
+      size_(0)
+{
+    // Every slot starts as an empty circular list around its sentinel
+    for (Node& node : root_) {
+        node.prev = node.next = &node;
+    }
+    for (auto& level : levels_) {
+        for (Node& node : level) {
+            node.prev = node.next = &node;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    auto disarm = [](Node& head) {
+        for (Node* node = head.next; node != &head;) {
+            Timer* timer = static_cast<Timer*>(node);
+            node = node->next;
+            timer->prev = timer->next = nullptr;
+            timer->wheel_ = nullptr;
+        }
+    };
+    for (Node& head : root_) {
+        disarm(head);
+    }
+    for (auto& level : levels_) {
+        for (Node& head : level) {
+            disarm(head);
+        }
+    }
+}
+
+uint64_t TimerWheel::monotonicMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+void TimerWheel::schedule(Timer& timer, uint64_t delayMs)
+{
+    if (timer.wheel_) {
+        unlink(timer);
+    }
+
+    uint64_t ticks = (delayMs + tickMs_ - 1) / tickMs_;
+    if (ticks == 0) {
+        ticks = 1; // Never fire from inside the tick that armed it
+    }
+    if (ticks >= MAX_TICKS) {
+        ticks = MAX_TICKS - 1;
+    }
+
+    timer.expiry_ = now_ + ticks;
+    timer.wheel_ = this;
+    ++size_;
+    insert(timer);
+}
+
+size_t TimerWheel::advance(uint64_t nowMs)
+{
+    uint64_t target = nowMs / tickMs_;
+    size_t fired = 0;
+
+    while (now_ < target) {
+        ++now_;
+
+        // Entering a new lap of the root wheel: pull the next outer slot in,
+        // going one level further out each time a level wraps as well
+        size_t index = now_ & (ROOT_SLOTS - 1);
+        for (unsigned level = 1; index == 0 && level < LEVELS; ++level) {
+            index = cascade(level);
+        }
+
+        // Fire one at a time: a callback may cancel the next timer
+        Node& head = root_[now_ & (ROOT_SLOTS - 1)];
+        while (head.next != &head) {
+            Timer* timer = static_cast<Timer*>(head.next);
+            unlink(*timer);
+            ++fired;
+            if (timer->callback_) {
+                timer->callback_();
+            }
+        }
+    }
+
+    return fired;
+}
+
+void TimerWheel::insert(Timer& timer)
+{
+    uint64_t expiry = timer.expiry_;
+    uint64_t delta = expiry - now_;
+
+    Node* head;
+    if (delta < ROOT_SLOTS) {
+        head = &root_[expiry & (ROOT_SLOTS - 1)];
+    } else {
+        // The first outer level whose span covers the delay
+        unsigned level = 1;
+        while (level < LEVELS - 1 && delta >= (uint64_t(1) << (ROOT_BITS + level * LEVEL_BITS))) {
+            ++level;
+        }
+        unsigned shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        head = &slot(level, (expiry >> shift) & (LEVEL_SLOTS - 1));
+    }
+
+    // Append at the tail of the slot's circular list
+    timer.prev = head->prev;
+    timer.next = head;
+    head->prev->next = &timer;
+    head->prev = &timer;
+}
+
+size_t TimerWheel::cascade(unsigned level)
+{
+    unsigned shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    size_t index = (now_ >> shift) & (LEVEL_SLOTS - 1);
+    Node& head = slot(level, index);
+    if (head.next == &head) {
+        return index;
+    }
+
+    // Detach the whole slot first: re-inserting may land in any slot
+    Node* node = head.next;
+    head.prev->next = nullptr;
+    head.prev = head.next = &head;
+
+    while (node) {
+        Timer* timer = static_cast<Timer*>(node);
+        node = node->next;
+        insert(*timer);
+    }
+    return index;
+}
+
+void TimerWheel::unlink(Timer& timer)
+{
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+    timer.wheel_ = nullptr;
+    --size_;
+}
+
+TimerWheel::Node& TimerWheel::slot(unsigned level, size_t index)
+{
+    return levels_[level - 1][index];
+}
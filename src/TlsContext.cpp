@@ -0,0 +1,68 @@
+#ifdef USE_OPENSSL
+
+#include "TlsContext.h"
+#include <openssl/err.h> // For ERR_print_errors_fp
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+// Sessions are only resumed by the server that issued them
+const unsigned char SESSION_ID_CONTEXT[] = "chatserver";
+}
+
+TlsContext::TlsContext(const std::string& certificatePath, const std::string& privateKeyPath,
+                       size_t sessionCacheSize, long sessionTimeoutSec, bool kernelOffload)
+    : context_(SSL_CTX_new(TLS_server_method()))
+{
+    if (!context_) {
+        ERR_print_errors_fp(stderr);
+        throw std::runtime_error("Failed to create the TLS context.");
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(context_, certificatePath.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(context_, privateKeyPath.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(context_) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(context_);
+        throw std::runtime_error("Failed to load the TLS certificate or key.");
+    }
+
+    SSL_CTX_set_min_proto_version(context_, TLS1_2_VERSION);
+
+    // Renegotiation would make a read want to write mid-stream; nobody needs it
+    SSL_CTX_set_options(context_, SSL_OP_NO_RENEGOTIATION);
+
+    // The OutboundQueue hands SSL_write its front buffer, which may have
+    // moved or grown by the time a WANT_WRITE is retried
+    SSL_CTX_set_mode(context_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // Resumption: a stateful cache for session ids, stateless tickets on top
+    SSL_CTX_set_session_id_context(context_, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_set_session_cache_mode(context_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(context_, static_cast<long>(sessionCacheSize));
+    SSL_CTX_set_timeout(context_, sessionTimeoutSec);
+    SSL_CTX_clear_options(context_, SSL_OP_NO_TICKET);
+
+    if (kernelOffload) {
+        // Per connection, OpenSSL enables kTLS only if the kernel accepts
+        // the negotiated cipher (the default AES-GCM suites are offloadable)
+        SSL_CTX_set_options(context_, SSL_OP_ENABLE_KTLS);
+    }
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(context_);
+}
+
+long TlsContext::resumedHandshakes() const
+{
+    return SSL_CTX_sess_hits(context_);
+}
+
+long TlsContext::completedHandshakes() const
+{
+    return SSL_CTX_sess_accept_good(context_);
+}
+
+#endif // USE_OPENSSL
@@ -0,0 +1,613 @@
+#ifdef USE_IO_URING
+
+#include "UringEngine.h"
+#include "Connection.h"
+#include <iostream>
+#include <cstring>        // For strerror, memset
+#include <cerrno>         // For errno
+#include <stdexcept>
+#include <sys/mman.h>     // For mmap
+#include <sys/syscall.h>  // For __NR_io_uring_*
+#include <sys/socket.h>
+#include <unistd.h>       // For close(), syscall()
+
+namespace {
+// Provided buffer group shared by every multishot recv
+constexpr uint16_t BUFFER_GROUP = 1;
+constexpr uint16_t BUFFER_COUNT = 1024;
+constexpr size_t BUFFER_SIZE = 4096;
+
+// Upper bound on one linked send chain, keeps a chain inside one submission
+constexpr size_t MAX_CHAIN = 32;
+
+int ioUringSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* ringPointer(void* base, unsigned offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+}
+
+// -----------------------------------------------------------------------------
+// UringSession
+// -----------------------------------------------------------------------------
+UringSession::UringSession(UringEngine& engine, uint64_t id, std::shared_ptr<Connection> connection)
+    : engine_(engine),
+      id_(id),
+      connection_(std::move(connection))
+{
+}
+
+ssize_t UringSession::receive(char* buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (inbox_.empty()) {
+        if (peerClosed_) {
+            if (recvError_ != 0) {
+                errno = recvError_;
+                return -1;
+            }
+            return 0;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Copy from as many completed recvs as fit into the caller's buffer
+    size_t copied = 0;
+    while (copied < size && !inbox_.empty()) {
+        const std::string& chunk = inbox_.front();
+        size_t n = std::min(size - copied, chunk.size() - inboxOffset_);
+        std::memcpy(buffer + copied, chunk.data() + inboxOffset_, n);
+        copied += n;
+        inboxOffset_ += n;
+        if (inboxOffset_ == chunk.size()) {
+            inbox_.pop_front();
+            inboxOffset_ = 0;
+        }
+    }
+    return static_cast<ssize_t>(copied);
+}
+
+ssize_t UringSession::send(const char* data, size_t size)
+{
+    return send(std::string(data, size));
+}
+
+ssize_t UringSession::send(std::string&& data)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (released_ || sendFailed_) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (data.empty()) {
+        return 0;
+    }
+
+    size_t size = data.size();
+    outbox_.push_back(std::move(data));
+    if (pendingSends_ == 0) {
+        submitChainLocked();
+    }
+    return static_cast<ssize_t>(size);
+}
+
+bool UringSession::finishDrain()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (inbox_.empty() && !peerClosed_) {
+        draining_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool UringSession::deliver(const char* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (released_) {
+        return false;
+    }
+
+    inbox_.emplace_back(data, size);
+    if (draining_) {
+        return false; // The running worker will pick it up
+    }
+    draining_ = true;
+    return true;
+}
+
+bool UringSession::deliverClose(int error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (released_ || peerClosed_) {
+        return false;
+    }
+
+    peerClosed_ = true;
+    recvError_ = error;
+    if (draining_) {
+        return false;
+    }
+    draining_ = true;
+    return true;
+}
+
+void UringSession::submitChainLocked()
+{
+    std::lock_guard<std::mutex> sqLock(engine_.sqMutex_);
+
+    int fd = connection_->socketFd();
+    size_t count = std::min(outbox_.size(), MAX_CHAIN);
+    for (size_t i = 0; i < count; ++i) {
+        inFlight_.push_back(std::move(outbox_.front()));
+        outbox_.pop_front();
+
+        const std::string& buffer = inFlight_.back();
+        io_uring_sqe* sqe = engine_.getSqeLocked();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer.data());
+        sqe->len = static_cast<uint32_t>(buffer.size());
+        // MSG_WAITALL: the kernel keeps sending until the whole buffer is out,
+        // and a send that still ends short fails the link, so the sends
+        // after it are cancelled instead of overtaking its tail
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = UringEngine::encode(UringEngine::Op::Send, id_);
+        if (i + 1 < count) {
+            // Link to the next send so the kernel runs them strictly in order
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+    }
+
+    pendingSends_ = count;
+    completedSends_ = 0;
+    engine_.submitLocked();
+}
+
+bool UringSession::onSendComplete(int result)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pendingSends_ == 0) {
+        return released_;
+    }
+
+    std::string& buffer = inFlight_[completedSends_++];
+    if (result >= 0) {
+        // Short only on an error or a kernel that does not retry partial
+        // sends: either way MSG_WAITALL failed the link, and the sends
+        // after this one come back as -ECANCELED with nothing sent
+        buffer.erase(0, static_cast<size_t>(result));
+    } else if (result != -ECANCELED) {
+        std::cerr << "io_uring send failed: " << strerror(-result) << std::endl;
+        sendFailed_ = true;
+    }
+
+    if (--pendingSends_ > 0) {
+        return false;
+    }
+
+    // Chain finished: put unsent bytes back in front of the outbox, in order
+    for (auto it = inFlight_.rbegin(); it != inFlight_.rend(); ++it) {
+        if (!it->empty()) {
+            outbox_.push_front(std::move(*it));
+        }
+    }
+    inFlight_.clear();
+
+    if (sendFailed_ || released_) {
+        outbox_.clear();
+    } else if (!outbox_.empty()) {
+        submitChainLocked();
+    }
+    return released_;
+}
+
+// -----------------------------------------------------------------------------
+// UringEngine: ring setup and teardown
+// -----------------------------------------------------------------------------
+UringEngine::UringEngine(unsigned entries)
+    : ringFd_(-1),
+      params_(),
+      sqRing_(MAP_FAILED),
+      cqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRingSize_(0),
+      sqes_(nullptr),
+      sqeTail_(0),
+      sqeSubmitted_(0),
+      bufferPool_(static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE),
+      stopped_(false),
+      tickInterval_(),
+      nextSessionId_(1)
+{
+    params_.flags = IORING_SETUP_CQSIZE;
+    params_.cq_entries = entries * 4; // Multishot ops post many CQEs per SQE
+
+    ringFd_ = ioUringSetup(entries, &params_);
+    if (ringFd_ < 0) {
+        throw std::runtime_error(std::string("io_uring_setup failed: ") + strerror(errno));
+    }
+
+    sqRingSize_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        int err = errno;
+        close(ringFd_);
+        throw std::runtime_error(std::string("mmap(SQ ring) failed: ") + strerror(err));
+    }
+
+    if (singleMmap) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            int err = errno;
+            munmap(sqRing_, sqRingSize_);
+            close(ringFd_);
+            throw std::runtime_error(std::string("mmap(CQ ring) failed: ") + strerror(err));
+        }
+    }
+
+    void* sqes = mmap(nullptr, params_.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        int err = errno;
+        if (!singleMmap) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        munmap(sqRing_, sqRingSize_);
+        close(ringFd_);
+        throw std::runtime_error(std::string("mmap(SQEs) failed: ") + strerror(err));
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_ = ringPointer<unsigned>(sqRing_, params_.sq_off.head);
+    sqTail_ = ringPointer<unsigned>(sqRing_, params_.sq_off.tail);
+    sqMask_ = ringPointer<unsigned>(sqRing_, params_.sq_off.ring_mask);
+    sqArray_ = ringPointer<unsigned>(sqRing_, params_.sq_off.array);
+    cqHead_ = ringPointer<unsigned>(cqRing_, params_.cq_off.head);
+    cqTail_ = ringPointer<unsigned>(cqRing_, params_.cq_off.tail);
+    cqMask_ = ringPointer<unsigned>(cqRing_, params_.cq_off.ring_mask);
+    cqes_ = ringPointer<io_uring_cqe>(cqRing_, params_.cq_off.cqes);
+
+    sqeTail_ = sqeSubmitted_ = *sqTail_;
+
+    // Hand the whole buffer pool to the kernel as one provided buffer group
+    std::lock_guard<std::mutex> lock(sqMutex_);
+    io_uring_sqe* sqe = getSqeLocked();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = BUFFER_COUNT;
+    sqe->addr = reinterpret_cast<uint64_t>(bufferPool_.data());
+    sqe->len = BUFFER_SIZE;
+    sqe->off = 0;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = encode(Op::ProvideBuffers, 0);
+    submitLocked();
+}
+
+UringEngine::~UringEngine()
+{
+    munmap(sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+    if (cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    munmap(sqRing_, sqRingSize_);
+    close(ringFd_);
+}
+
+// -----------------------------------------------------------------------------
+// Submission helpers (caller holds sqMutex_)
+// -----------------------------------------------------------------------------
+io_uring_sqe* UringEngine::getSqeLocked()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= params_.sq_entries) {
+        // SQ full: without SQPOLL the kernel consumes everything we submit
+        submitLocked();
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    }
+
+    unsigned index = sqeTail_ & *sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqeTail_;
+    return sqe;
+}
+
+void UringEngine::submitLocked()
+{
+    unsigned toSubmit = sqeTail_ - sqeSubmitted_;
+    if (toSubmit == 0) {
+        return;
+    }
+
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    while (toSubmit > 0) {
+        int ret = ioUringEnter(ringFd_, toSubmit, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                // CQ backlog; the loop thread will reap and we retry next time
+                break;
+            }
+            std::cerr << "io_uring_enter(submit) failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        toSubmit -= static_cast<unsigned>(ret);
+        sqeSubmitted_ += static_cast<unsigned>(ret);
+    }
+}
+
+void UringEngine::prepareAcceptLocked(size_t listener)
+{
+    io_uring_sqe* sqe = getSqeLocked();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFds_[listener];
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = encode(Op::Accept, listener);
+}
+
+void UringEngine::prepareRecvLocked(int fd, uint64_t id)
+{
+    io_uring_sqe* sqe = getSqeLocked();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = encode(Op::Recv, id);
+}
+
+void UringEngine::prepareProvideBufferLocked(uint16_t bid)
+{
+    io_uring_sqe* sqe = getSqeLocked();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = reinterpret_cast<uint64_t>(bufferPool_.data() + static_cast<size_t>(bid) * BUFFER_SIZE);
+    sqe->len = BUFFER_SIZE;
+    sqe->off = bid;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = encode(Op::ProvideBuffers, 0);
+}
+
+void UringEngine::prepareTickLocked()
+{
+    // A pure timeout: completes with -ETIME once the interval has passed
+    io_uring_sqe* sqe = getSqeLocked();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&tickInterval_);
+    sqe->len = 1;
+    sqe->off = 0;
+    sqe->user_data = encode(Op::Tick, 0);
+}
+
+// -----------------------------------------------------------------------------
+// Completion loop
+// -----------------------------------------------------------------------------
+void UringEngine::setTicker(uint64_t intervalMs, TickHandler onTick)
+{
+    tickInterval_.tv_sec = static_cast<long long>(intervalMs / 1000);
+    tickInterval_.tv_nsec = static_cast<long long>(intervalMs % 1000) * 1000000;
+    onTick_ = std::move(onTick);
+}
+
+void UringEngine::run(const std::vector<int>& listenFds, AcceptHandler onAccept, ReadableHandler onReadable)
+{
+    listenFds_ = listenFds;
+    onAccept_ = std::move(onAccept);
+    onReadable_ = std::move(onReadable);
+
+    {
+        std::lock_guard<std::mutex> lock(sqMutex_);
+        for (size_t listener = 0; listener < listenFds_.size(); ++listener) {
+            prepareAcceptLocked(listener);
+        }
+        if (onTick_) {
+            prepareTickLocked();
+        }
+        submitLocked();
+    }
+
+    while (!stopped_) {
+        int ret = ioUringEnter(ringFd_, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            std::cerr << "io_uring_enter(wait) failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            // Copy the CQE and free its slot before running any handler
+            io_uring_cqe cqe = cqes_[head & *cqMask_];
+            __atomic_store_n(cqHead_, ++head, __ATOMIC_RELEASE);
+            handleCompletion(cqe);
+            tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        }
+
+        // Buffer recycles and re-armed recvs are batched per reap
+        std::lock_guard<std::mutex> lock(sqMutex_);
+        submitLocked();
+    }
+}
+
+void UringEngine::stop()
+{
+    stopped_ = true;
+
+    // A NOP completion wakes the loop out of io_uring_enter()
+    std::lock_guard<std::mutex> lock(sqMutex_);
+    io_uring_sqe* sqe = getSqeLocked();
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = encode(Op::Wakeup, 0);
+    submitLocked();
+}
+
+void UringEngine::release(uint64_t id)
+{
+    std::shared_ptr<UringSession> session = findSession(id);
+    if (!session) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(session->mutex_);
+        session->released_ = true;
+        session->outbox_.clear();
+        // Completes the outstanding multishot recv (and fails pending sends)
+        ::shutdown(session->connection_->socketFd(), SHUT_RDWR);
+        if (session->pendingSends_ > 0) {
+            // The kernel still reads from inFlight_; the last send CQE drops us
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(sessionsMutex_);
+    sessions_.erase(id);
+}
+
+std::shared_ptr<UringSession> UringEngine::attach(const std::shared_ptr<Connection>& connection)
+{
+    uint64_t id = nextSessionId_++;
+    auto session = std::make_shared<UringSession>(*this, id, connection);
+    connection->attachUringSession(session.get());
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex_);
+        sessions_[id] = session;
+    }
+
+    std::lock_guard<std::mutex> lock(sqMutex_);
+    prepareRecvLocked(connection->socketFd(), id);
+    return session;
+}
+
+std::shared_ptr<UringSession> UringEngine::findSession(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(sessionsMutex_);
+    auto it = sessions_.find(id);
+    return it != sessions_.end() ? it->second : nullptr;
+}
+
+void UringEngine::handleCompletion(const io_uring_cqe& cqe)
+{
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    switch (decodeOp(cqe.user_data)) {
+    case Op::Accept: {
+        if (cqe.res >= 0) {
+            int fd = cqe.res;
+            sockaddr_in clientAddr = {};
+            socklen_t clientLen = sizeof(clientAddr);
+            getpeername(fd, (struct sockaddr*)&clientAddr, &clientLen);
+
+            onAccept_(fd, clientAddr, decodeId(cqe.user_data));
+        } else if (cqe.res != -ECANCELED && !stopped_) {
+            std::cerr << "io_uring accept failed: " << strerror(-cqe.res) << std::endl;
+            if (cqe.res == -EINVAL) {
+                return; // Multishot accept unsupported: do not spin re-arming it
+            }
+        }
+
+        if (!more && !stopped_) {
+            std::lock_guard<std::mutex> lock(sqMutex_);
+            prepareAcceptLocked(decodeId(cqe.user_data));
+        }
+        return;
+    }
+
+    case Op::Recv: {
+        uint64_t id = decodeId(cqe.user_data);
+        std::shared_ptr<UringSession> session = findSession(id);
+        bool schedule = false;
+
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (session && cqe.res > 0) {
+                // Copy out so the buffer goes straight back to the kernel
+                const char* data = bufferPool_.data() + static_cast<size_t>(bid) * BUFFER_SIZE;
+                schedule = session->deliver(data, static_cast<size_t>(cqe.res));
+            }
+            std::lock_guard<std::mutex> lock(sqMutex_);
+            prepareProvideBufferLocked(bid);
+        }
+
+        if (!session) {
+            return; // Released; this is the final completion of its recv
+        }
+
+        bool rearm = false;
+        if (cqe.res == 0) {
+            schedule = session->deliverClose(0);
+        } else if (cqe.res == -ENOBUFS) {
+            rearm = !more; // Pool momentarily empty; buffers are being recycled
+        } else if (cqe.res < 0) {
+            schedule = session->deliverClose(-cqe.res);
+        } else {
+            rearm = !more;
+        }
+
+        if (rearm && !stopped_) {
+            std::lock_guard<std::mutex> lock(sqMutex_);
+            prepareRecvLocked(session->connection()->socketFd(), id);
+        }
+        if (schedule) {
+            onReadable_(session);
+        }
+        return;
+    }
+
+    case Op::Send: {
+        uint64_t id = decodeId(cqe.user_data);
+        std::shared_ptr<UringSession> session = findSession(id);
+        if (session && session->onSendComplete(cqe.res)) {
+            std::lock_guard<std::mutex> lock(sessionsMutex_);
+            sessions_.erase(id);
+        }
+        return;
+    }
+
+    case Op::ProvideBuffers:
+        if (cqe.res < 0) {
+            std::cerr << "io_uring provide buffers failed: " << strerror(-cqe.res) << std::endl;
+        }
+        return;
+
+    case Op::Wakeup:
+        return;
+
+    case Op::Tick:
+        if (!stopped_) {
+            onTick_();
+            std::lock_guard<std::mutex> lock(sqMutex_);
+            prepareTickLocked();
+        }
+        return;
+    }
+}
+
+#endif // USE_IO_URING
@@ -1,58 +1,613 @@
 #include "UserManager.h"
+#include "Epoch.h"
 #include <iostream> // For debugging/logging
 #include <stdexcept> // For exceptions
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <thread>
+#include <sys/mman.h> // For mmap, madvise
 
+// Slots hold record pointers, filled once and never cleared. A probe starts
+// at the top bits of the Fibonacci-mixed hash: the low bits already chose
+// the shard, so within one they would all be alike.
+struct UserManager::RecordIndex {
+    explicit RecordIndex(size_t capacity)
+        : shift(64 - static_cast<unsigned>(std::countr_zero(capacity))),
+          mask(capacity - 1),
+          slots(std::make_unique<std::atomic<UserRecord*>[]>(capacity))
+    {
+        for (size_t i = 0; i <= mask; ++i) {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    size_t start(size_t hash) const { return static_cast<size_t>((hash * 0x9e3779b97f4a7c15ull) >> shift); }
+
+    unsigned shift;
+    size_t mask;
+    std::unique_ptr<std::atomic<UserRecord*>[]> slots;
+};
+
+namespace {
+constexpr size_t INITIAL_INDEX_SIZE = 16; // Slots per shard; grows to stay at most half full
+constexpr size_t FIRST_CHUNK_RECORDS = 64;     // A shard's first chunk; later ones double...
+constexpr size_t MAX_CHUNK_BYTES = 8 << 20;    // ... up to this much
+constexpr size_t HUGE_PAGE_BYTES = 2 << 20;    // Chunks this large are mapped with huge pages
+}
 
-bool UserManager::registerUser(const std::string& username, const std::string& password) {
-    std::lock_guard<std::mutex> lock(userMutex_);
-    if (userDatabase_.find(username) != userDatabase_.end()) {
-        return false; // User already exists
+RecordList::iterator& RecordList::iterator::operator++()
+{
+    ++index_;
+    while (chunk_ < list_->chunks_.size() && index_ >= list_->chunks_[chunk_].used) {
+        ++chunk_;
+        index_ = 0;
     }
+    return *this;
+}
 
-    User newUser = {username, hashPassword(password), "", 0, false};
-    userDatabase_[username] = newUser;
-    return true;
+RecordList::iterator RecordList::begin() const
+{
+    size_t chunk = 0;
+    while (chunk < chunks_.size() && chunks_[chunk].used == 0) {
+        ++chunk;
+    }
+    return iterator(this, chunk, 0);
+}
+
+UserRecord& RecordList::emplace_back()
+{
+    if (chunks_.empty() || chunks_.back().used == chunks_.back().capacity) {
+        size_t grown = std::max(size_, FIRST_CHUNK_RECORDS);
+        addChunk(std::min(grown, MAX_CHUNK_BYTES / sizeof(UserRecord)));
+    }
+    Chunk& chunk = chunks_.back();
+    UserRecord* record = new (&chunk.records[chunk.used]) UserRecord();
+    ++chunk.used;
+    ++size_;
+    return *record;
+}
+
+void RecordList::reserve(size_t count)
+{
+    size_t room = chunks_.empty() ? 0 : chunks_.back().capacity - chunks_.back().used;
+    if (count > size_ + room) {
+        addChunk(count - size_);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// addChunk(): Large chunks come straight from mmap with MADV_HUGEPAGE: one
+// fault per 2 MiB instead of one per 4 KiB, and fewer TLB misses when
+// lookups chase record pointers.
+// -----------------------------------------------------------------------------
+void RecordList::addChunk(size_t capacity)
+{
+    size_t bytes = capacity * sizeof(UserRecord);
+    Chunk chunk = {nullptr, capacity, 0, bytes >= HUGE_PAGE_BYTES};
+    if (chunk.mapped) {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        madvise(memory, bytes, MADV_HUGEPAGE);
+        chunk.records = static_cast<UserRecord*>(memory);
+    } else {
+        chunk.records = static_cast<UserRecord*>(::operator new(bytes, std::align_val_t(alignof(UserRecord))));
+    }
+    chunks_.push_back(chunk);
+}
+
+void RecordList::clear()
+{
+    for (Chunk& chunk : chunks_) {
+        for (size_t i = 0; i < chunk.used; ++i) {
+            chunk.records[i].~UserRecord();
+        }
+        if (chunk.mapped) {
+            munmap(chunk.records, chunk.capacity * sizeof(UserRecord));
+        } else {
+            ::operator delete(chunk.records, std::align_val_t(alignof(UserRecord)));
+        }
+    }
+    chunks_.clear();
+    size_ = 0;
+}
+
+UserManager::Shard::Shard() : index(new RecordIndex(INITIAL_INDEX_SIZE))
+{
+}
+
+UserManager::Shard::~Shard()
+{
+    delete index.load(std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// Shard::find(): Linear probing over acquire loads. A slot is published
+// after its record is complete, and records never leave the index, so a
+// reader sees either a whole record or an empty slot: no lock, no retry.
+// -----------------------------------------------------------------------------
+UserRecord* UserManager::Shard::find(std::string_view username, size_t hash) const
+{
+    const RecordIndex* table = index.load(std::memory_order_acquire);
+    for (size_t i = table->start(hash);; i = (i + 1) & table->mask) {
+        UserRecord* record = table->slots[i].load(std::memory_order_acquire);
+        if (record == nullptr) {
+            return nullptr;
+        }
+        if (record->usernameHash == hash && record->user.username == username) {
+            return record;
+        }
+    }
+}
+
+void UserManager::Shard::insert(UserRecord* record)
+{
+    RecordIndex* table = index.load(std::memory_order_relaxed);
+    if (records.size() * 2 > table->mask + 1) {
+        reindex((table->mask + 1) * 2, record);
+        table = index.load(std::memory_order_relaxed);
+    }
+
+    size_t i = table->start(record->usernameHash);
+    while (table->slots[i].load(std::memory_order_relaxed) != nullptr) {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].store(record, std::memory_order_release);
+}
+
+void UserManager::Shard::reserve(size_t users)
+{
+    records.reserve(users);
+    size_t capacity = std::bit_ceil(std::max(users * 2, INITIAL_INDEX_SIZE));
+    if (capacity > index.load(std::memory_order_relaxed)->mask + 1) {
+        reindex(capacity, nullptr);
+    }
+}
+
+void UserManager::Shard::reindex(size_t capacity, const UserRecord* pending)
+{
+    // Readers keep probing the old table until they leave their guard
+    RecordIndex* table = new RecordIndex(capacity);
+    for (UserRecord& existing : records) {
+        if (&existing == pending) {
+            continue;
+        }
+        size_t i = table->start(existing.usernameHash);
+        while (table->slots[i].load(std::memory_order_relaxed) != nullptr) {
+            i = (i + 1) & table->mask;
+        }
+        table->slots[i].store(&existing, std::memory_order_relaxed);
+    }
+    epochRetire(index.exchange(table, std::memory_order_release));
+}
+
+void UserManager::Shard::clear()
+{
+    delete index.exchange(new RecordIndex(INITIAL_INDEX_SIZE), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(onlineMutex);
+    online.clear();
+    records.clear();
+}
+
+UserManager::UserManager(size_t shards)
+    : shardCount_(std::max<size_t>(shards, 1))
+{
+    shards_ = std::make_unique<Shard[]>(shardCount_);
+}
+
+// -----------------------------------------------------------------------------
+// registerUser(): With a store, the shard lock is only held to reserve the
+// name and queue the log record; the wait for the sync happens outside it,
+// so registrations in one shard share a sync. The record is added once the
+// sync succeeded, so a failed one leaves nothing behind.
+// -----------------------------------------------------------------------------
+UserUpdate UserManager::registerUser(const std::string& username, const std::string& password) {
+    size_t hash = UsernameHash()(username);
+    Shard& shard = shardFor(hash);
+    std::string passwordHash = hashPassword(password);
+    uint64_t ticket = 0;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.find(username, hash) != nullptr ||
+            std::any_of(shard.registering.begin(), shard.registering.end(),
+                        [&](const Shard::PendingUser& pending) { return pending.username == username; })) {
+            return UserUpdate::UserExists;
+        }
+        if (!store_) {
+            addLocked(shard, username, hash).user.passwordHash = std::move(passwordHash);
+            userCount_.fetch_add(1, std::memory_order_relaxed);
+            return UserUpdate::Ok;
+        }
+        if ((ticket = store_->appendRegister(username, passwordHash)) == 0) {
+            return UserUpdate::StorageError; // Would be lost on restart
+        }
+        shard.registering.push_back({username, std::move(passwordHash), ticket});
+    }
+
+    bool durable = store_->waitDurable(ticket);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto pending = std::find_if(shard.registering.begin(), shard.registering.end(),
+                                [&](const Shard::PendingUser& pending) { return pending.ticket == ticket; });
+    if (durable) {
+        addLocked(shard, username, hash).user.passwordHash = std::move(pending->passwordHash);
+        userCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+    *pending = std::move(shard.registering.back());
+    shard.registering.pop_back();
+    return durable ? UserUpdate::Ok : UserUpdate::StorageError;
+}
+
+UserUpdate UserManager::changePassword(const std::string& username, const std::string& password) {
+    UserRecord* record = findRecord(username);
+    if (record == nullptr) {
+        return UserUpdate::UserNotFound;
+    }
+    std::string passwordHash = hashPassword(password);
+    // The record lock is held through the sync: password changes are rare,
+    // and the old hash stays in place if the sync fails
+    std::lock_guard<std::mutex> lock(record->mutex);
+    if (store_) {
+        uint64_t ticket = store_->appendPassword(username, passwordHash);
+        if (ticket == 0 || !store_->waitDurable(ticket)) {
+            return UserUpdate::StorageError;
+        }
+    }
+    record->user.passwordHash = std::move(passwordHash);
+    return UserUpdate::Ok;
 }
 
 bool UserManager::loginUser(const std::string& username, const std::string& password, const std::string& ipAddress, uint16_t port) {
-    std::lock_guard<std::mutex> lock(userMutex_);
-    auto it = userDatabase_.find(username);
-    if (it == userDatabase_.end() || hashPassword(password) != it->second.passwordHash) {
-        return false; // Invalid credentials
+    return static_cast<bool>(openSession(username, password, ipAddress, port));
+}
+
+UserHandle UserManager::openSession(std::string_view username, std::string_view password, std::string_view ipAddress,
+                                    uint16_t port) {
+    UserRecord* record = findRecord(username);
+    if (record == nullptr) {
+        return {}; // Invalid credentials
     }
+    std::string passwordHash = hashPassword(password);
 
-    it->second.isLoggedIn = true;
-    it->second.ipAddress = ipAddress;
-    it->second.port = port;
-    return true;
+    std::lock_guard<std::mutex> lock(record->mutex);
+    if (passwordHash != record->user.passwordHash) {
+        return {}; // Invalid credentials
+    }
+    if (!record->user.isLoggedIn) {
+        onlineCount_.fetch_add(1, std::memory_order_relaxed);
+        setOnlineLocked(*record, true);
+    }
+    record->user.isLoggedIn = true;
+    record->user.ipAddress.assign(ipAddress);
+    record->user.port = port;
+    publishLocked(*record);
+    return UserHandle(record, ++record->session);
+}
+
+// -----------------------------------------------------------------------------
+// closeSession(): The handle already points at the record, so a LOGOUT or a
+// disconnect neither hashes the name nor waits behind the table lock.
+// -----------------------------------------------------------------------------
+bool UserManager::closeSession(const UserHandle& handle) {
+    if (!handle) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(handle.record_->mutex);
+    if (handle.session_ != handle.record_->session) {
+        return false; // Logged out since, or logged in again
+    }
+    return logoutLocked(*handle.record_);
+}
+
+UserHandle UserManager::resumeSession(std::string_view username) {
+    UserRecord* record = findRecord(username);
+    if (record == nullptr) {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock(record->mutex);
+    return record->user.isLoggedIn ? UserHandle(record, record->session) : UserHandle();
 }
 
 bool UserManager::logoutUser(const std::string& username) {
-    std::lock_guard<std::mutex> lock(userMutex_);
-    auto it = userDatabase_.find(username);
-    if (it == userDatabase_.end() || !it->second.isLoggedIn) {
-        return false; // User not found or not logged in
+    UserRecord* record = findRecord(username);
+    if (record == nullptr) {
+        return false; // User not found
+    }
+    std::lock_guard<std::mutex> lock(record->mutex);
+    return logoutLocked(*record);
+}
+
+bool UserManager::logoutLocked(UserRecord& record) {
+    if (!record.user.isLoggedIn) {
+        return false; // Not logged in
     }
 
-    it->second.isLoggedIn = false;
-    it->second.ipAddress = "";
-    it->second.port = 0;
+    onlineCount_.fetch_sub(1, std::memory_order_relaxed);
+    setOnlineLocked(record, false);
+    record.user.isLoggedIn = false;
+    record.user.ipAddress = "";
+    record.user.port = 0;
+    publishLocked(record);
+    ++record.session;
     return true;
 }
 
+void UserManager::publishLocked(UserRecord& record) {
+    const UserSnapshot* snapshot = nullptr;
+    if (record.user.isLoggedIn) {
+        snapshot = new UserSnapshot{record.user.ipAddress, record.user.port};
+    }
+    if (const UserSnapshot* old = record.snapshot.exchange(snapshot, std::memory_order_acq_rel)) {
+        epochRetire(old);
+    }
+}
+
+void UserManager::setOnlineLocked(UserRecord& record, bool online) {
+    Shard& shard = shardFor(record.usernameHash);
+    std::lock_guard<std::mutex> lock(shard.onlineMutex);
+    if (online) {
+        record.onlineSlot = shard.online.size();
+        shard.online.push_back(&record);
+        return;
+    }
+    UserRecord* last = shard.online.back();
+    shard.online[record.onlineSlot] = last;
+    last->onlineSlot = record.onlineSlot;
+    shard.online.pop_back();
+    record.onlineSlot = NOT_ONLINE;
+}
+
+// -----------------------------------------------------------------------------
+// getActiveUsers(): Logins lock a record and then its shard's online list,
+// so the list is copied first and each record locked after letting go of
+// it; whoever logged out in between is skipped.
+// -----------------------------------------------------------------------------
 std::vector<User> UserManager::getActiveUsers() {
-    std::lock_guard<std::mutex> lock(userMutex_);
     std::vector<User> activeUsers;
+    activeUsers.reserve(onlineCount());
 
-    for (const auto& [username, user] : userDatabase_) {
-        if (user.isLoggedIn) {
-            activeUsers.push_back(user);
+    std::vector<UserRecord*> online;
+    for (size_t i = 0; i < shardCount_; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].onlineMutex);
+            online.assign(shards_[i].online.begin(), shards_[i].online.end());
+        }
+        for (UserRecord* record : online) {
+            std::lock_guard<std::mutex> recordLock(record->mutex);
+            if (record->user.isLoggedIn) {
+                activeUsers.push_back(record->user);
+            }
         }
     }
 
     return activeUsers;
 }
 
+OnlineUsers UserManager::onlineUsers() {
+    OnlineUsers listing;
+    listing.records_.reserve(onlineCount());
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].onlineMutex);
+        listing.records_.insert(listing.records_.end(), shards_[i].online.begin(), shards_[i].online.end());
+    }
+    return listing;
+}
+
+// -----------------------------------------------------------------------------
+// page(): Reads each listed user's published snapshot, as GETINFO does, so
+// paging takes no lock and never waits for a login.
+// -----------------------------------------------------------------------------
+size_t OnlineUsers::page(size_t cursor, size_t count, std::vector<OnlineUser>& users) const {
+    users.clear();
+    cursor = std::min(cursor, records_.size());
+    size_t end = cursor + std::min(count, records_.size() - cursor);
+
+    EpochGuard guard;
+    for (size_t i = cursor; i < end; ++i) {
+        const UserSnapshot* snapshot = records_[i]->snapshot.load(std::memory_order_acquire);
+        if (snapshot != nullptr) {
+            users.push_back({records_[i]->user.username, snapshot->ipAddress, snapshot->port});
+        }
+    }
+    return end;
+}
+
+std::vector<User> UserManager::getAllUsers() {
+    std::vector<User> users;
+    users.reserve(userCount());
+
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        for (UserRecord& record : shards_[i].records) {
+            std::lock_guard<std::mutex> recordLock(record.mutex);
+            users.push_back(record.user);
+        }
+    }
+
+    return users;
+}
+
+void UserManager::restoreUsers(const std::vector<User>& users) {
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        shards_[i].clear();
+    }
+    size_t count = 0;
+    size_t online = 0;
+    for (const User& user : users) {
+        size_t hash = UsernameHash()(user.username);
+        Shard& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        UserRecord* record = shard.find(user.username, hash);
+        if (record != nullptr) {
+            online -= record->user.isLoggedIn; // A repeated name: the last copy wins
+        } else {
+            record = &shard.records.emplace_back();
+            record->user.username = user.username;
+            record->usernameHash = hash;
+            shard.insert(record);
+            ++count;
+        }
+        online += user.isLoggedIn;
+        std::lock_guard<std::mutex> recordLock(record->mutex);
+        if (record->user.isLoggedIn != user.isLoggedIn) {
+            setOnlineLocked(*record, user.isLoggedIn);
+        }
+        record->user = user;
+        publishLocked(*record);
+    }
+    userCount_.store(count, std::memory_order_relaxed);
+    onlineCount_.store(online, std::memory_order_relaxed);
+}
+
+bool UserManager::openStore(const std::string& directory, bool load, const UserLogOptions& options) {
+    auto store = std::make_unique<UserStore>(directory, options);
+    if (!store->open()) {
+        return false;
+    }
+    if (load) {
+        if (!loadStore(*store)) {
+            return false;
+        }
+    } else if (!store->replayLog([](std::string_view, std::string_view) {})) {
+        return false; // Only trims a torn tail: the table came with the handoff
+    }
+    store_ = std::move(store);
+    return true;
+}
+
+void UserManager::closeStore() {
+    store_.reset();
+}
+
+// -----------------------------------------------------------------------------
+// loadStore(): A snapshot written by a table with as many shards has one
+// segment per shard, holding exactly that shard's users: each is installed
+// by its own thread into an index sized up front, with no lock contended
+// and no index ever grown. Users hashed elsewhere (a snapshot from another
+// build) and other shapes go the slow way, one user at a time.
+// -----------------------------------------------------------------------------
+bool UserManager::loadStore(UserStore& store) {
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        shards_[i].clear();
+    }
+    onlineCount_.store(0, std::memory_order_relaxed);
+
+    auto install = [this](std::string_view username, std::string_view passwordHash) {
+        size_t hash = UsernameHash()(username);
+        Shard& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        installLocked(shard, username, hash, passwordHash);
+    };
+
+    size_t segments = store.snapshotSegments();
+    std::atomic_bool intact{true};
+    if (segments == shardCount_) {
+        size_t threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, segments);
+        std::vector<std::vector<std::pair<std::string, std::string>>> strays(threads);
+        auto loadShards = [&](size_t worker) {
+            for (size_t i = worker; i < segments; i += threads) {
+                Shard& shard = shards_[i];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.reserve(store.snapshotUsers(i));
+                bool read = store.readSnapshot(i, [&](std::string_view username, std::string_view passwordHash) {
+                    size_t hash = UsernameHash()(username);
+                    if (hash % shardCount_ == i) {
+                        // Written from a table, so no name repeats: no need to probe for it
+                        addLocked(shard, username, hash).user.passwordHash.assign(passwordHash);
+                    } else {
+                        strays[worker].emplace_back(username, passwordHash);
+                    }
+                });
+                if (!read) {
+                    intact.store(false);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t worker = 1; worker < threads; ++worker) {
+            workers.emplace_back(loadShards, worker);
+        }
+        loadShards(0);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        for (const auto& users : strays) {
+            for (const auto& [username, passwordHash] : users) {
+                install(username, passwordHash);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < segments; ++i) {
+            if (!store.readSnapshot(i, install)) {
+                intact.store(false);
+            }
+        }
+    }
+    if (!intact || !store.replayLog(install)) {
+        return false;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < shardCount_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        count += shards_[i].records.size();
+    }
+    userCount_.store(count, std::memory_order_relaxed);
+    return true;
+}
+
+void UserManager::installLocked(Shard& shard, std::string_view username, size_t hash, std::string_view passwordHash) {
+    UserRecord* record = shard.find(username, hash);
+    if (record == nullptr) {
+        record = &addLocked(shard, username, hash);
+    }
+    record->user.passwordHash.assign(passwordHash);
+}
+
+UserRecord& UserManager::addLocked(Shard& shard, std::string_view username, size_t hash) {
+    UserRecord& record = shard.records.emplace_back();
+    record.user.username.assign(username);
+    record.usernameHash = hash;
+    shard.insert(&record);
+    return record;
+}
+
+// -----------------------------------------------------------------------------
+// writeSnapshot(): Each shard is copied out under its lock, so a
+// registration is either in its segment or waits and lands in the new log.
+// One whose caller has not come back from its sync yet is added if its
+// record went to a sealed log: that log was synced before it was sealed,
+// and is deleted once the snapshot is in place. A password change being synced holds its record's lock, so the
+// copy waits for it.
+// Users go out in index order: probes start at the top bits of the hash, so
+// a loader sizing its index the same (or by any power of two) fills it
+// front to back instead of scattering writes over megabytes of slots.
+// -----------------------------------------------------------------------------
+bool UserManager::writeSnapshot() {
+    if (!store_) {
+        return false;
+    }
+    return store_->writeSnapshot(shardCount_, [this](size_t i, SnapshotWriter& writer) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        const RecordIndex* table = shards_[i].index.load(std::memory_order_relaxed);
+        for (size_t slot = 0; slot <= table->mask; ++slot) {
+            UserRecord* record = table->slots[slot].load(std::memory_order_relaxed);
+            if (record != nullptr) {
+                std::lock_guard<std::mutex> recordLock(record->mutex);
+                writer.add(record->user.username, record->user.passwordHash);
+            }
+        }
+        for (const Shard::PendingUser& pending : shards_[i].registering) {
+            if (writer.covers(pending.ticket)) {
+                writer.add(pending.username, pending.passwordHash);
+            }
+        }
+    });
+}
+
 //bool UserManager::isLoggedIn(const std::string& username) {
  //   std::lock_guard<std::mutex> lock(userMutex_);
  //   auto it = userDatabase_.find(username);
@@ -60,12 +615,55 @@ std::vector<User> UserManager::getActiveUsers() {
 //}
 
 User* UserManager::findUser(const std::string& username) {
-    std::lock_guard<std::mutex> lock(userMutex_);
-    auto it = userDatabase_.find(username);
-    return (it != userDatabase_.end() && it->second.isLoggedIn) ? &it->second : nullptr;
+    UserRecord* record = findRecord(username);
+    return record != nullptr ? &record->user : nullptr;
+}
+
+UserRecord* UserManager::findRecord(std::string_view username) {
+    size_t hash = UsernameHash()(username);
+    EpochGuard guard; // Records stay put; only the index may be retired
+    return shardFor(hash).find(username, hash);
+}
+
+// -----------------------------------------------------------------------------
+// getUserAddress(): GETINFO. The index probe and the snapshot read share one
+// EpochGuard: a login swapping the snapshot out retires it rather than
+// freeing it, so the copy below never reads freed memory.
+// -----------------------------------------------------------------------------
+bool UserManager::getUserAddress(std::string_view username, std::string& ipAddress, uint16_t& port) {
+    size_t hash = UsernameHash()(username);
+    EpochGuard guard;
+    const UserRecord* record = shardFor(hash).find(username, hash);
+    const UserSnapshot* snapshot = record != nullptr ? record->snapshot.load(std::memory_order_acquire) : nullptr;
+    if (snapshot == nullptr) {
+        return false;
+    }
+    ipAddress.assign(snapshot->ipAddress);
+    port = snapshot->port;
+    return true;
+}
+
+size_t UserManager::getUserAddresses(const std::vector<std::string_view>& usernames, std::vector<UserAddress>& addresses) {
+    addresses.resize(usernames.size());
+    size_t found = 0;
+
+    EpochGuard guard;
+    for (size_t i = 0; i < usernames.size(); ++i) {
+        size_t hash = UsernameHash()(usernames[i]);
+        const UserRecord* record = shardFor(hash).find(usernames[i], hash);
+        const UserSnapshot* snapshot = record != nullptr ? record->snapshot.load(std::memory_order_acquire) : nullptr;
+        UserAddress& address = addresses[i];
+        address.found = snapshot != nullptr;
+        if (address.found) {
+            address.ipAddress.assign(snapshot->ipAddress);
+            address.port = snapshot->port;
+            ++found;
+        }
+    }
+    return found;
 }
 
-std::string UserManager::hashPassword(const std::string& password) {
+std::string UserManager::hashPassword(std::string_view password) {
     // Replace this with a real hashing function (e.g., bcrypt, Argon2, or SHA-256).
-    return "hashed_" + password; // Placeholder for demonstration purposes
+    return "hashed_" + std::string(password); // Placeholder for demonstration purposes
 }
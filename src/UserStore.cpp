@@ -0,0 +1,723 @@
+#include "UserStore.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>  // For offsetof
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <dirent.h>   // For opendir, readdir
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat, mkdir
+#include <unistd.h>   // For close, fsync, pwrite
+
+#if defined(__x86_64__)
+#define USER_STORE_X86 1
+#include <immintrin.h>
+#endif
+
+// On disk, host byte order: the files only ever move between processes
+// on one machine, like the handoff blob.
+//
+// users.snapshot: SnapshotHeader, then one SnapshotSegment per segment,
+// then the segments' bodies. A body is a run of entries:
+//   u16 username length, u16 password hash length, username, password hash
+struct UserStore::SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t firstLog;  // Oldest log not folded in: replay it and every later one
+    uint64_t segments;
+    uint32_t tableCrc;  // Of the segment table
+    uint32_t headerCrc; // Of the fields above
+};
+
+struct UserStore::SnapshotSegment {
+    uint64_t offset; // Of the body, from the start of the file
+    uint64_t bytes;
+    uint64_t users;
+    uint32_t crc;    // Of the body
+    uint32_t reserved;
+};
+
+namespace {
+// "CHUS" + format version; bump the version when the layout changes
+constexpr uint32_t SNAPSHOT_MAGIC = 0x43485553;
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+constexpr char SNAPSHOT_FILE[] = "users.snapshot";
+constexpr char SNAPSHOT_TEMP_FILE[] = "users.snapshot.tmp";
+constexpr char LOG_PREFIX[] = "users.wal.";
+
+// A log record: u32 CRC of the rest, u8 type, u16 username length,
+// u16 password hash length, username, password hash
+constexpr size_t LOG_HEADER = 9;
+constexpr uint8_t LOG_REGISTER = 1;
+constexpr uint8_t LOG_PASSWORD = 2;
+
+constexpr size_t ENTRY_HEADER = 4;                 // Snapshot entry: the two lengths
+constexpr size_t SNAPSHOT_WRITE_CHUNK = 1 << 20;   // SnapshotWriter flushes past this
+
+// ---- CRC-32C: table-driven, or the SSE4.2 instruction ----
+
+constexpr uint32_t CRC32C_POLY = 0x82f63b78; // Reflected Castagnoli polynomial
+
+constexpr std::array<uint32_t, 256> crcTable()
+{
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC_TABLE = crcTable();
+
+uint32_t scalarCrc32c(uint32_t crc, const unsigned char* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        crc = CRC_TABLE[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef USER_STORE_X86
+__attribute__((target("sse4.2"))) uint32_t sse42Crc32c(uint32_t crc, const unsigned char* data, size_t size)
+{
+    uint64_t wide = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = static_cast<uint32_t>(wide);
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+using CrcFunction = uint32_t (*)(uint32_t crc, const unsigned char* data, size_t size);
+
+CrcFunction pickCrc32c()
+{
+#ifdef USER_STORE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        return &sse42Crc32c;
+    }
+#endif
+    return &scalarCrc32c;
+}
+
+const CrcFunction activeCrc32c = pickCrc32c();
+
+uint16_t readU16(const char* at)
+{
+    uint16_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+void appendU16(std::string& out, size_t value)
+{
+    uint16_t narrow = static_cast<uint16_t>(value);
+    out.append(reinterpret_cast<const char*>(&narrow), sizeof(narrow));
+}
+
+bool writeAll(int fd, const char* data, size_t size, uint64_t offset)
+{
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+// Makes renames and new files in @p directory durable
+bool syncDirectory(const std::string& directory)
+{
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+}
+
+uint32_t crc32c(const void* data, size_t size, uint32_t crc)
+{
+    return ~activeCrc32c(~crc, static_cast<const unsigned char*>(data), size);
+}
+
+void SnapshotWriter::add(std::string_view username, std::string_view passwordHash)
+{
+    if (username.size() > MAX_STORED_FIELD || passwordHash.size() > MAX_STORED_FIELD) {
+        std::cerr << "User too large for a snapshot: " << username.substr(0, 64) << std::endl;
+        failed_ = true;
+        return;
+    }
+    size_t start = buffer_.size();
+    appendU16(buffer_, username.size());
+    appendU16(buffer_, passwordHash.size());
+    buffer_.append(username);
+    buffer_.append(passwordHash);
+    crc_ = crc32c(buffer_.data() + start, buffer_.size() - start, crc_);
+    ++users_;
+    if (buffer_.size() >= SNAPSHOT_WRITE_CHUNK) {
+        flush();
+    }
+}
+
+bool SnapshotWriter::flush()
+{
+    if (!failed_ && !writeAll(fd_, buffer_.data(), buffer_.size(), offset_)) {
+        std::cerr << "Failed to write the user snapshot: " << strerror(errno) << std::endl;
+        failed_ = true;
+    }
+    offset_ += buffer_.size();
+    buffer_.clear();
+    return !failed_;
+}
+
+UserStore::UserStore(std::string directory, const UserLogOptions& options)
+    : directory_(std::move(directory)), options_(options)
+{
+}
+
+UserStore::~UserStore()
+{
+    if (flusher_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(logMutex_);
+            stopping_ = true;
+        }
+        flushWake_.notify_one();
+        flusher_.join(); // After the last batch is out
+    }
+    unmapSnapshot();
+    if (logFd_ >= 0) {
+        close(logFd_);
+    }
+}
+
+std::string UserStore::path(std::string_view name) const
+{
+    return directory_ + "/" + std::string(name);
+}
+
+std::string UserStore::logPath(uint64_t generation) const
+{
+    return path(LOG_PREFIX + std::to_string(generation));
+}
+
+// -----------------------------------------------------------------------------
+// open(): The snapshot names the oldest log it does not cover; older logs
+// are left over from a crash between renaming a snapshot in and deleting
+// what it folded in, and go now.
+// -----------------------------------------------------------------------------
+bool UserStore::open()
+{
+    if (mkdir(directory_.c_str(), 0755) < 0 && errno != EEXIST) {
+        std::cerr << "Cannot create " << directory_ << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    unlink(path(SNAPSHOT_TEMP_FILE).c_str()); // A snapshot that never made it
+
+    if (!mapSnapshot()) {
+        return false;
+    }
+
+    DIR* dir = opendir(directory_.c_str());
+    if (dir == nullptr) {
+        std::cerr << "Cannot read " << directory_ << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> logs;
+    while (dirent* entry = readdir(dir)) {
+        std::string_view name = entry->d_name;
+        if (name.substr(0, sizeof(LOG_PREFIX) - 1) != LOG_PREFIX) {
+            continue;
+        }
+        std::string_view digits = name.substr(sizeof(LOG_PREFIX) - 1);
+        if (!digits.empty() && std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            logs.push_back(std::stoull(std::string(digits)));
+        }
+    }
+    closedir(dir);
+    std::sort(logs.begin(), logs.end());
+
+    if (snapshot_ == nullptr) {
+        firstLog_ = logs.empty() ? 1 : logs.front();
+    }
+    uint64_t bytes = 0;
+    for (uint64_t generation : logs) {
+        if (generation < firstLog_) {
+            unlink(logPath(generation).c_str());
+            continue;
+        }
+        struct stat info;
+        if (stat(logPath(generation).c_str(), &info) == 0) {
+            bytes += static_cast<uint64_t>(info.st_size);
+        }
+    }
+    lastLog_ = std::max(firstLog_, logs.empty() ? 0 : logs.back());
+    logBytes_.store(bytes, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(logMutex_);
+        if (!startLogLocked(lastLog_)) {
+            return false;
+        }
+    }
+    flusher_ = std::thread(&UserStore::flushLoop, this);
+    return true;
+}
+
+bool UserStore::mapSnapshot()
+{
+    std::string file = path(SNAPSHOT_FILE);
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return true; // First start
+        }
+        std::cerr << "Cannot open " << file << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        std::cerr << "Cannot stat " << file << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    // Populated up front: one pass in the kernel instead of a fault per page
+    void* mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Cannot map " << file << ": " << (size > 0 ? strerror(errno) : "empty file") << std::endl;
+        return false;
+    }
+    snapshot_ = static_cast<const char*>(mapped);
+    snapshotSize_ = size;
+
+    SnapshotHeader header;
+    bool valid = size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, snapshot_, sizeof(header));
+        valid = header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION &&
+                header.headerCrc == crc32c(&header, offsetof(SnapshotHeader, headerCrc)) &&
+                header.segments <= (size - sizeof(header)) / sizeof(SnapshotSegment);
+    }
+    if (valid) {
+        segments_ = reinterpret_cast<const SnapshotSegment*>(snapshot_ + sizeof(header));
+        segmentCount_ = header.segments;
+        valid = header.tableCrc == crc32c(segments_, segmentCount_ * sizeof(SnapshotSegment));
+    }
+    for (size_t i = 0; valid && i < segmentCount_; ++i) {
+        valid = segments_[i].offset <= size && segments_[i].bytes <= size - segments_[i].offset;
+    }
+    if (!valid) {
+        std::cerr << "Corrupt user snapshot " << file << "; move it away to start without it." << std::endl;
+        unmapSnapshot();
+        return false;
+    }
+    firstLog_ = header.firstLog;
+    return true;
+}
+
+void UserStore::unmapSnapshot()
+{
+    if (snapshot_ != nullptr) {
+        munmap(const_cast<char*>(snapshot_), snapshotSize_);
+    }
+    snapshot_ = nullptr;
+    snapshotSize_ = 0;
+    segments_ = nullptr;
+    segmentCount_ = 0;
+}
+
+uint64_t UserStore::snapshotUsers(size_t segment) const
+{
+    return segment < segmentCount_ ? segments_[segment].users : 0;
+}
+
+bool UserStore::readSnapshot(size_t segment, const StoredUserVisitor& visit) const
+{
+    if (segment >= segmentCount_) {
+        return false;
+    }
+    const SnapshotSegment& info = segments_[segment];
+    const char* at = snapshot_ + info.offset;
+    const char* end = at + info.bytes;
+    if (crc32c(at, info.bytes) != info.crc) {
+        std::cerr << "Corrupt user snapshot: segment " << segment << " fails its CRC." << std::endl;
+        return false;
+    }
+
+    uint64_t users = 0;
+    while (end - at >= static_cast<ptrdiff_t>(ENTRY_HEADER)) {
+        size_t nameSize = readU16(at);
+        size_t hashSize = readU16(at + 2);
+        at += ENTRY_HEADER;
+        if (static_cast<size_t>(end - at) < nameSize + hashSize) {
+            break;
+        }
+        visit(std::string_view(at, nameSize), std::string_view(at + nameSize, hashSize));
+        at += nameSize + hashSize;
+        ++users;
+    }
+    if (at != end || users != info.users) {
+        std::cerr << "Corrupt user snapshot: segment " << segment << " is malformed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool UserStore::replayLog(const StoredUserVisitor& visit)
+{
+    unmapSnapshot();
+    for (uint64_t generation = firstLog_; generation <= lastLog_; ++generation) {
+        if (!replayLogFile(generation, generation == lastLog_, visit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// replayLogFile(): A record is only trusted whole and with a matching CRC.
+// Appends are single write()s, so anything else is the tail of one cut
+// short by a crash; nothing valid can follow it.
+// -----------------------------------------------------------------------------
+bool UserStore::replayLogFile(uint64_t generation, bool newest, const StoredUserVisitor& visit)
+{
+    std::string file = logPath(generation);
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return true; // Never written to
+        }
+        std::cerr << "Cannot open " << file << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        std::cerr << "Cannot stat " << file << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Cannot map " << file << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const char* log = static_cast<const char*>(mapped);
+    size_t offset = 0;
+    while (size - offset >= LOG_HEADER) {
+        const char* record = log + offset;
+        uint32_t crc;
+        memcpy(&crc, record, sizeof(crc));
+        uint8_t type = static_cast<uint8_t>(record[4]);
+        size_t nameSize = readU16(record + 5);
+        size_t hashSize = readU16(record + 7);
+        size_t length = LOG_HEADER + nameSize + hashSize;
+        if (size - offset < length || crc != crc32c(record + 4, length - 4) ||
+            (type != LOG_REGISTER && type != LOG_PASSWORD)) {
+            break;
+        }
+        visit(std::string_view(record + LOG_HEADER, nameSize), std::string_view(record + LOG_HEADER + nameSize, hashSize));
+        offset += length;
+    }
+    munmap(mapped, size);
+
+    if (offset < size) {
+        std::cerr << "Dropping " << size - offset << " bytes of torn or corrupt log at the end of " << file
+                  << std::endl;
+        if (newest) {
+            std::lock_guard<std::mutex> lock(logMutex_);
+            if (truncate(file.c_str(), static_cast<off_t>(offset)) < 0) {
+                std::cerr << "Cannot truncate " << file << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+        }
+        logBytes_.fetch_sub(size - offset, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// startLogLocked(): fdatasync() on the log makes its records durable but not
+// its directory entry, so the directory is synced before any record goes
+// in: otherwise a crash could take a new log with every acknowledged
+// registration in it. A failed sync fails the store.
+// -----------------------------------------------------------------------------
+bool UserStore::startLogLocked(uint64_t generation)
+{
+    std::string file = logPath(generation);
+    int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << file << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!syncDirectory(directory_)) {
+        std::cerr << "Cannot sync " << directory_ << " for " << file << ": " << strerror(errno) << std::endl;
+        close(fd);
+        failed_ = true;
+        durableWake_.notify_all();
+        return false;
+    }
+    if (logFd_ >= 0) {
+        close(logFd_);
+    }
+    logFd_ = fd;
+    logGeneration_ = generation;
+    return true;
+}
+
+uint64_t UserStore::appendRegister(std::string_view username, std::string_view passwordHash)
+{
+    return append(LOG_REGISTER, username, passwordHash);
+}
+
+uint64_t UserStore::appendPassword(std::string_view username, std::string_view passwordHash)
+{
+    return append(LOG_PASSWORD, username, passwordHash);
+}
+
+// -----------------------------------------------------------------------------
+// append(): Only queues the record; the caller is still under its shard or
+// record lock here, so one user's records are queued in the order their
+// changes are applied. The flusher is only woken by the first record of a
+// batch: it is either idle then, or about to look at the queue anyway.
+// Without syncs there is nothing to share, and the record is written here.
+// -----------------------------------------------------------------------------
+uint64_t UserStore::append(uint8_t type, std::string_view username, std::string_view passwordHash)
+{
+    if (username.size() > MAX_STORED_FIELD || passwordHash.size() > MAX_STORED_FIELD) {
+        std::cerr << "User too large to log: " << username.substr(0, 64) << std::endl;
+        return 0;
+    }
+    thread_local std::string record;
+    record.assign(4, '\0');
+    record.push_back(static_cast<char>(type));
+    appendU16(record, username.size());
+    appendU16(record, passwordHash.size());
+    record.append(username);
+    record.append(passwordHash);
+    uint32_t crc = crc32c(record.data() + 4, record.size() - 4);
+    memcpy(record.data(), &crc, sizeof(crc));
+
+    std::lock_guard<std::mutex> lock(logMutex_);
+    if (logFd_ < 0 || failed_) {
+        return 0;
+    }
+    if (!options_.sync) {
+        if (!writeBatch(logFd_, record)) {
+            return 0;
+        }
+        queuedEnd_ += record.size();
+        durableEnd_ = queuedEnd_;
+        logBytes_.fetch_add(record.size(), std::memory_order_relaxed);
+        return queuedEnd_;
+    }
+    bool wake = pending_.empty();
+    pending_.append(record);
+    queuedEnd_ += record.size();
+    logBytes_.fetch_add(record.size(), std::memory_order_relaxed);
+    if (wake) {
+        flushWake_.notify_one();
+    }
+    return queuedEnd_;
+}
+
+bool UserStore::waitDurable(uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(logMutex_);
+    durableWake_.wait(lock, [&]() { return durableEnd_ >= ticket || failed_; });
+    return durableEnd_ >= ticket;
+}
+
+// -----------------------------------------------------------------------------
+// flushLoop(): Takes the whole queue as one batch and writes it with the
+// lock released, so appends keep queueing the next batch meanwhile; under
+// load a batch is simply whatever arrived during the previous sync. With
+// a batch delay, a lone record also waits that long for company. A log
+// rotation is done between batches, when no write is in flight.
+// -----------------------------------------------------------------------------
+void UserStore::flushLoop()
+{
+    std::string batch;
+    std::unique_lock<std::mutex> lock(logMutex_);
+    while (true) {
+        flushWake_.wait(lock, [this]() { return stopping_ || rotate_ || !pending_.empty(); });
+        if (options_.maxBatchDelayUs > 0 && !pending_.empty() && !stopping_ && !rotate_) {
+            flushWake_.wait_for(lock, std::chrono::microseconds(options_.maxBatchDelayUs),
+                                [this]() { return stopping_ || rotate_; });
+        }
+
+        if (!pending_.empty()) {
+            batch.swap(pending_);
+            uint64_t end = queuedEnd_;
+            int fd = logFd_;
+            lock.unlock();
+            bool written = writeBatch(fd, batch);
+            batch.clear();
+            lock.lock();
+            if (written) {
+                durableEnd_ = end;
+            } else {
+                failed_ = true;
+                pending_.clear(); // Their waiters fail with the batch
+            }
+            durableWake_.notify_all();
+        }
+
+        if (rotate_) {
+            rotated_ = !failed_ && startLogLocked(logGeneration_ + 1);
+            if (rotated_) {
+                rotatedAt_ = queuedEnd_ - pending_.size();
+                logBytes_.store(pending_.size(), std::memory_order_relaxed); // They go to the new log
+            }
+            rotate_ = false;
+            durableWake_.notify_all();
+        }
+        if (stopping_ && pending_.empty()) {
+            return;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// writeBatch(): A write cut short (disk full) is cut off again, so later
+// batches do not land behind a torn record that replay would stop at. A
+// failed sync is not retried: the kernel may already have dropped the
+// dirty pages, so nothing in the batch can be trusted to be on disk.
+// -----------------------------------------------------------------------------
+bool UserStore::writeBatch(int fd, const std::string& batch)
+{
+    size_t done = 0;
+    while (done < batch.size()) {
+        ssize_t written = write(fd, batch.data() + done, batch.size() - done);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            std::cerr << "Failed to log user changes: " << (written < 0 ? strerror(errno) : "short write")
+                      << std::endl;
+            struct stat info;
+            if (done > 0 && fstat(fd, &info) == 0) {
+                if (ftruncate(fd, info.st_size - static_cast<off_t>(done)) < 0) {
+                    std::cerr << "Cannot cut the torn batch off the log: " << strerror(errno) << std::endl;
+                }
+            }
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+    if (options_.sync && fdatasync(fd) < 0) {
+        std::cerr << "Failed to sync the user log: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// writeSnapshot(): The log is sealed before fill() reads anything, so every
+// change the snapshot may miss is in a later log. The flusher seals it, so
+// a batch in flight is not split across two logs. Changes that land in both
+// are replayed over a snapshot that already has them, which is harmless:
+// each record just sets a user's password hash.
+// -----------------------------------------------------------------------------
+bool UserStore::writeSnapshot(size_t segments, const std::function<void(size_t segment, SnapshotWriter& writer)>& fill)
+{
+    std::lock_guard<std::mutex> snapshotLock(snapshotMutex_);
+    uint64_t sealed;
+    uint64_t sealedEnd;
+    {
+        std::unique_lock<std::mutex> lock(logMutex_);
+        if (logFd_ < 0 || failed_) {
+            return false;
+        }
+        sealed = logGeneration_;
+        rotate_ = true;
+        flushWake_.notify_one();
+        durableWake_.wait(lock, [this]() { return !rotate_; });
+        if (!rotated_) {
+            return false;
+        }
+        sealedEnd = rotatedAt_;
+    }
+
+    std::string temp = path(SNAPSHOT_TEMP_FILE);
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot create " << temp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<SnapshotSegment> table(segments);
+    SnapshotWriter writer(fd, sizeof(SnapshotHeader) + segments * sizeof(SnapshotSegment), sealedEnd);
+    for (size_t i = 0; i < segments; ++i) {
+        table[i] = {writer.offset_ + writer.buffer_.size(), 0, 0, 0, 0};
+        writer.crc_ = 0;
+        writer.users_ = 0;
+        fill(i, writer);
+        table[i].bytes = writer.offset_ + writer.buffer_.size() - table[i].offset;
+        table[i].users = writer.users_;
+        table[i].crc = writer.crc_;
+    }
+
+    SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, sealed + 1, segments, 0, 0};
+    header.tableCrc = crc32c(table.data(), table.size() * sizeof(SnapshotSegment));
+    header.headerCrc = crc32c(&header, offsetof(SnapshotHeader, headerCrc));
+    bool written = writer.flush() &&
+                   writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header), 0) &&
+                   writeAll(fd, reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SnapshotSegment),
+                            sizeof(header)) &&
+                   fdatasync(fd) == 0;
+    if (!written && !writer.failed_) {
+        std::cerr << "Failed to write " << temp << ": " << strerror(errno) << std::endl;
+    }
+    close(fd);
+    if (!written || rename(temp.c_str(), path(SNAPSHOT_FILE).c_str()) < 0) {
+        if (written) {
+            std::cerr << "Cannot rename " << temp << ": " << strerror(errno) << std::endl;
+        }
+        unlink(temp.c_str());
+        return false;
+    }
+    if (!syncDirectory(directory_)) {
+        std::cerr << "Cannot sync " << directory_ << ": " << strerror(errno) << std::endl;
+    }
+
+    for (uint64_t generation = firstLog_; generation <= sealed; ++generation) {
+        unlink(logPath(generation).c_str());
+    }
+    firstLog_ = sealed + 1;
+    return true;
+}
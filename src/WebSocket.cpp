@@ -0,0 +1,337 @@
+#include "WebSocket.h"
+#include "DelimiterScan.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// As in DelimiterScan.cpp: unmasking stays scalar on x86 without SSE2
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define WEBSOCKET_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+constexpr char HANDSHAKE_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+constexpr size_t KEY_SIZE = 24; // base64 of the 16 random bytes RFC 6455 asks for
+
+// ---- SHA-1 (FIPS 180-4): only the handshake needs it, once per client ----
+
+uint32_t rotateLeft(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+void sha1Block(std::array<uint32_t, 5>& state, const unsigned char* block)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+               (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+std::array<unsigned char, 20> sha1(std::string_view data)
+{
+    std::array<uint32_t, 5> state = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // The message, a 0x80 byte, zeros, then the bit length: a multiple of 64 bytes
+    std::string padded(data);
+    padded.push_back(static_cast<char>(0x80));
+    while (padded.size() % 64 != 56) {
+        padded.push_back('\0');
+    }
+    uint64_t bits = uint64_t(data.size()) * 8;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        padded.push_back(static_cast<char>(bits >> shift));
+    }
+
+    for (size_t offset = 0; offset < padded.size(); offset += 64) {
+        sha1Block(state, reinterpret_cast<const unsigned char*>(padded.data() + offset));
+    }
+
+    std::array<unsigned char, 20> digest;
+    for (size_t i = 0; i < 20; ++i) {
+        digest[i] = static_cast<unsigned char>(state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+    return digest;
+}
+
+std::string base64(const unsigned char* data, size_t size)
+{
+    static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t group = uint32_t(data[i]) << 16;
+        if (i + 1 < size) {
+            group |= uint32_t(data[i + 1]) << 8;
+        }
+        if (i + 2 < size) {
+            group |= data[i + 2];
+        }
+        encoded.push_back(ALPHABET[(group >> 18) & 63]);
+        encoded.push_back(ALPHABET[(group >> 12) & 63]);
+        encoded.push_back(i + 1 < size ? ALPHABET[(group >> 6) & 63] : '=');
+        encoded.push_back(i + 2 < size ? ALPHABET[group & 63] : '=');
+    }
+    return encoded;
+}
+
+// ---- Header parsing: names and tokens compare case-insensitively ----
+
+char lowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return lowerAscii(x) == lowerAscii(y);
+           });
+}
+
+std::string_view trim(std::string_view value)
+{
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// Whether the comma-separated list @p value holds @p token
+bool hasToken(std::string_view value, std::string_view token)
+{
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        if (equalsIgnoreCase(trim(value.substr(0, comma)), token)) {
+            return true;
+        }
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+    }
+    return false;
+}
+
+// ---- Unmasking: the key is loaded as one 32-bit word in memory order, so
+// broadcasting it lines its bytes up with every 4-byte group of payload.
+// Each level hands its tail (< one vector, a multiple of 4 bytes in) to the
+// next narrower one. ----
+
+void scalarUnmask(char* data, size_t size, uint32_t mask)
+{
+    uint64_t wide = (uint64_t(mask) << 32) | mask;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        word ^= wide;
+        memcpy(data + i, &word, sizeof(word));
+    }
+    const char* key = reinterpret_cast<const char*>(&mask);
+    for (; i < size; ++i) {
+        data[i] ^= key[i % 4];
+    }
+}
+
+#ifdef WEBSOCKET_X86
+void sse2Unmask(char* data, size_t size, uint32_t mask)
+{
+    __m128i key = _mm_set1_epi32(static_cast<int>(mask));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i* at = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(at, _mm_xor_si128(_mm_loadu_si128(at), key));
+    }
+    scalarUnmask(data + i, size - i, mask);
+}
+
+__attribute__((target("avx2"))) void avx2Unmask(char* data, size_t size, uint32_t mask)
+{
+    __m256i key = _mm256_set1_epi32(static_cast<int>(mask));
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i* at = reinterpret_cast<__m256i*>(data + i);
+        _mm256_storeu_si256(at, _mm256_xor_si256(_mm256_loadu_si256(at), key));
+    }
+    sse2Unmask(data + i, size - i, mask);
+}
+#endif
+}
+
+void unmaskPayload(char* data, size_t size, const char key[4])
+{
+    uint32_t mask;
+    memcpy(&mask, key, sizeof(mask));
+#ifdef WEBSOCKET_X86
+    switch (scanLevel()) {
+    case ScanLevel::Avx2:
+        avx2Unmask(data, size, mask);
+        return;
+    case ScanLevel::Sse2:
+        sse2Unmask(data, size, mask);
+        return;
+    case ScanLevel::Scalar:
+        break;
+    }
+#endif
+    scalarUnmask(data, size, mask);
+}
+
+WsFrameParser::Result WsFrameParser::next(RingBuffer& input, WsFrame& frame)
+{
+    size_t available = input.size();
+    if (available < 2) {
+        return Result::NeedMore;
+    }
+
+    unsigned char header[MAX_WS_HEADER_SIZE];
+    input.copyOut(reinterpret_cast<char*>(header), std::min(available, sizeof(header)));
+    uint8_t opcode = header[0] & 0x0F;
+    bool fin = header[0] & 0x80;
+    bool control = opcode & 0x08;
+    if ((header[0] & 0x70) != 0 || (opcode > 0x2 && opcode < 0x8) || opcode > 0xA) {
+        return Result::Error; // Reserved bits (no extension was negotiated) or opcode
+    }
+    if ((header[1] & 0x80) == 0) {
+        return Result::Error; // Clients must mask
+    }
+
+    uint64_t length = header[1] & 0x7F;
+    size_t headerSize = 2;
+    if (length == 126) {
+        headerSize = 4;
+    } else if (length == 127) {
+        headerSize = 10;
+    }
+    if (available < headerSize) {
+        return Result::NeedMore;
+    }
+    if (headerSize > 2) {
+        length = 0;
+        for (size_t i = 2; i < headerSize; ++i) {
+            length = (length << 8) | header[i];
+        }
+    }
+    if (control && (!fin || length > MAX_WS_CONTROL_SIZE)) {
+        return Result::Error;
+    }
+    if (length > MAX_WS_MESSAGE_SIZE) {
+        return Result::TooLarge;
+    }
+
+    headerSize += 4; // The masking key
+    if (available < headerSize + length) {
+        return Result::NeedMore;
+    }
+
+    char* start = input.linearize(headerSize + length);
+    char* payload = start + headerSize;
+    unmaskPayload(payload, length, start + headerSize - 4);
+    frame.opcode = static_cast<WsOpcode>(opcode);
+    frame.fin = fin;
+    frame.payload = std::string_view(payload, length);
+    input.consume(headerSize + length);
+    return Result::Frame;
+}
+
+bool parseUpgradeRequest(std::string_view request, std::string_view& key)
+{
+    size_t lineEnd = request.find("\r\n");
+    if (lineEnd == std::string_view::npos) {
+        return false;
+    }
+    std::string_view requestLine = request.substr(0, lineEnd);
+    if (!requestLine.starts_with("GET ") || !requestLine.ends_with(" HTTP/1.1")) {
+        return false;
+    }
+
+    bool upgrade = false, connection = false, version = false;
+    key = {};
+    for (size_t position = lineEnd + 2;;) {
+        size_t end = request.find("\r\n", position);
+        if (end == std::string_view::npos || end == position) {
+            break; // The blank line
+        }
+        std::string_view line = request.substr(position, end - position);
+        position = end + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            return false;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trim(line.substr(colon + 1));
+        if (equalsIgnoreCase(name, "Upgrade")) {
+            upgrade = hasToken(value, "websocket");
+        } else if (equalsIgnoreCase(name, "Connection")) {
+            connection = hasToken(value, "Upgrade");
+        } else if (equalsIgnoreCase(name, "Sec-WebSocket-Version")) {
+            version = value == "13";
+        } else if (equalsIgnoreCase(name, "Sec-WebSocket-Key")) {
+            key = value;
+        }
+    }
+    return upgrade && connection && version && key.size() == KEY_SIZE;
+}
+
+std::string webSocketAccept(std::string_view key)
+{
+    std::string input(key);
+    input.append(HANDSHAKE_GUID);
+    std::array<unsigned char, 20> digest = sha1(input);
+    return base64(digest.data(), digest.size());
+}
+
+size_t writeWsHeader(char* out, WsOpcode opcode, size_t payloadSize)
+{
+    out[0] = static_cast<char>(0x80 | static_cast<uint8_t>(opcode));
+    if (payloadSize < 126) {
+        out[1] = static_cast<char>(payloadSize);
+        return 2;
+    }
+    if (payloadSize <= UINT16_MAX) {
+        out[1] = 126;
+        out[2] = static_cast<char>(payloadSize >> 8);
+        out[3] = static_cast<char>(payloadSize);
+        return 4;
+    }
+    out[1] = 127;
+    for (size_t i = 0; i < 8; ++i) {
+        out[2 + i] = static_cast<char>(uint64_t(payloadSize) >> (56 - 8 * i));
+    }
+    return 10;
+}
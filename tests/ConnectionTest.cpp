@@ -0,0 +1,520 @@
+#include <gtest/gtest.h>
+#include "Connection.h"
+#include "Protocol.h"
+#include "UserManager.h"
+#include "ThreadPool.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// Fixture: a Connection on one end of a non-blocking socket pair, driven by
+// hand instead of by an event loop. The arm hook only records what the
+// connection asked to wait for; the test plays the loop by calling onReady().
+// -----------------------------------------------------------------------------
+class ConnectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        startSession(false);
+    }
+
+    // (Re)creates the socket pair and a started Connection on it
+    void startSession(bool webSocket) {
+        if (connection_) {
+            connection_.reset();
+            close(fds_[1]);
+        }
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_), 0);
+        int size = 4096;
+        setsockopt(fds_[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(fds_[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        fcntl(fds_[0], F_SETFL, fcntl(fds_[0], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds_[1], F_SETFL, fcntl(fds_[1], F_GETFL, 0) | O_NONBLOCK);
+
+        sockaddr_in addr = {};
+        connection_ = std::make_shared<Connection>(fds_[0], addr, userManager_);
+        if (webSocket) {
+            connection_->setWebSocket();
+        }
+        connection_->start([this](uint32_t events) {
+                               armedEvents_ = events;
+                               return Connection::ArmResult::Armed;
+                           },
+                           [this]() { closed_ = true; });
+    }
+
+    void TearDown() override {
+        connection_.reset(); // Closes fds_[0]
+        close(fds_[1]);
+    }
+
+    // Reads everything currently available on the client side
+    std::string drainPeer() {
+        std::string received;
+        char buffer[8192];
+        ssize_t n;
+        while ((n = read(fds_[1], buffer, sizeof(buffer))) > 0) {
+            received.append(buffer, static_cast<size_t>(n));
+        }
+        return received;
+    }
+
+    int fds_[2];
+    UserManager userManager_;
+    std::shared_ptr<Connection> connection_;
+    std::atomic<uint32_t> armedEvents_{0};
+    std::atomic_bool closed_{false};
+};
+
+// -----------------------------------------------------------------------------
+// Test that the session answers a command through the outbound queue
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, AnswersThroughOutboundQueue) {
+    EXPECT_EQ(armedEvents_.load(), static_cast<uint32_t>(EPOLLIN));
+
+    ASSERT_EQ(write(fds_[1], "GETINFO nobody\n", 15), 15);
+    connection_->onReady(EPOLLIN);
+
+    EXPECT_EQ(drainPeer(), "ERR USER_NOT_FOUND\n");
+    EXPECT_EQ(connection_->outboundSize(), 0u);
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test a command split across reads waits for its end, and every command
+// of a pipelined read is answered, in order
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, ParsesSplitAndPipelinedCommands) {
+    ASSERT_EQ(write(fds_[1], "GETIN", 5), 5);
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "");
+
+    const std::string rest = "FO nobody\r\nPING\nREGISTER bob pw\nREGISTER bob pw\nGET";
+    ASSERT_EQ(write(fds_[1], rest.data(), rest.size()), static_cast<ssize_t>(rest.size()));
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "ERR USER_NOT_FOUND\nPONG\nOK REGISTERED\nERR USER_EXISTS\n");
+
+    ASSERT_EQ(write(fds_[1], "INFO bob\n", 9), 9);
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "ERR USER_NOT_FOUND\n");
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test tokens around extra blanks, LOGIN's port, and GETINFO's formatted reply
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, DispatchesTokenizedCommands) {
+    const std::string commands = "REGISTER  alice\tsecret\nLOGIN alice secret 10.0.0.9 6000\n"
+                                 "GETINFO alice \nGETINFOX alice\nHELLO 3\nLOGOUT alice\nGETINFO alice\n";
+    ASSERT_EQ(write(fds_[1], commands.data(), commands.size()), static_cast<ssize_t>(commands.size()));
+    connection_->onReady(EPOLLIN);
+
+    // The fixture's peer address is all zeroes; LOGIN records that, not the IP sent
+    EXPECT_EQ(drainPeer(), "OK REGISTERED\nOK LOGIN\nOK 0.0.0.0:6000\nERR UNKNOWN_COMMAND\n"
+                           "ERR UNSUPPORTED_VERSION\nOK LOGOUT\nERR USER_NOT_FOUND\n");
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test LOGOUT only ends this connection's own session, and closing the
+// connection logs its user out
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, LogsOutOnlyItsOwnUser) {
+    userManager_.registerUser("alice", "secret");
+    userManager_.registerUser("bob", "hunter2");
+    ASSERT_TRUE(userManager_.loginUser("bob", "hunter2", "10.0.0.2", 7000)); // On another connection
+
+    const std::string commands = "LOGOUT\nLOGIN alice secret 6000\nLOGOUT bob\nLOGOUT\nLOGOUT alice\n"
+                                 "LOGIN alice secret 6000\n";
+    ASSERT_EQ(write(fds_[1], commands.data(), commands.size()), static_cast<ssize_t>(commands.size()));
+    connection_->onReady(EPOLLIN);
+
+    EXPECT_EQ(drainPeer(), "ERR NOT_LOGGED_IN\nOK LOGIN\nERR NOT_LOGGED_IN\nOK LOGOUT\n"
+                           "ERR NOT_LOGGED_IN\nOK LOGIN\n");
+    EXPECT_TRUE(userManager_.findUser("bob")->isLoggedIn);
+    EXPECT_TRUE(userManager_.findUser("alice")->isLoggedIn);
+
+    connection_->closeConnection();
+    EXPECT_FALSE(userManager_.findUser("alice")->isLoggedIn);
+    EXPECT_TRUE(userManager_.findUser("bob")->isLoggedIn);
+    EXPECT_EQ(userManager_.onlineCount(), 1u);
+}
+
+// -----------------------------------------------------------------------------
+// Test tagged commands get tagged replies, and bad tags are refused
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, AnswersTaggedCommands) {
+    const std::string commands = "#7 REGISTER alice secret\n#8 GETINFO nobody\nPING\n#9 PING\n"
+                                 "#0 PING\n#x GETINFO alice\n#4294967296 PING\n#10 HELLO 3\n";
+    ASSERT_EQ(write(fds_[1], commands.data(), commands.size()), static_cast<ssize_t>(commands.size()));
+    connection_->onReady(EPOLLIN);
+
+    EXPECT_EQ(drainPeer(), "#7 OK REGISTERED\n#8 ERR USER_NOT_FOUND\nPONG\n#9 PONG\n"
+                           "ERR MALFORMED_TAG\nERR MALFORMED_TAG\nERR MALFORMED_TAG\n#10 ERR UNSUPPORTED_VERSION\n");
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test pipelined tagged lookups spread over a lookup pool: every tag is
+// answered exactly once, whatever the order, next to untagged commands
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, SpreadsTaggedLookupsOverPool) {
+    ThreadPool pool(4);
+    connection_->setLookupPool(&pool);
+
+    const int count = 3 * static_cast<int>(Connection::LOOKUP_BATCH) + 10;
+    std::string commands = "REGISTER alice secret\nLOGIN alice secret 0 6000\n";
+    for (int tag = 1; tag <= count; ++tag) {
+        commands += "#" + std::to_string(tag) + (tag % 2 ? " GETINFO alice\n" : " GETINFO nobody\n");
+    }
+    commands += "PING\n";
+    ASSERT_EQ(write(fds_[1], commands.data(), commands.size()), static_cast<ssize_t>(commands.size()));
+    connection_->onReady(EPOLLIN);
+
+    // Play the loop until every reply is out; the socket buffers are small
+    std::string received;
+    for (int i = 0; i < 1000 && std::count(received.begin(), received.end(), '\n') < count + 3; ++i) {
+        pool.waitIdle();
+        received += drainPeer();
+        connection_->onReady(EPOLLOUT);
+    }
+
+    std::istringstream lines(received);
+    std::string line;
+    std::set<int> tags;
+    int untagged = 0;
+    while (std::getline(lines, line)) {
+        if (line[0] != '#') {
+            ++untagged;
+            continue;
+        }
+        int tag = std::stoi(line.substr(1));
+        EXPECT_TRUE(tags.insert(tag).second) << "tag " << tag << " answered twice";
+        std::string reply = line.substr(line.find(' ') + 1);
+        EXPECT_EQ(reply, tag % 2 ? "OK 0.0.0.0:6000" : "ERR USER_NOT_FOUND") << "tag " << tag;
+    }
+    EXPECT_EQ(untagged, 3); // OK REGISTERED, OK LOGIN, PONG
+    EXPECT_EQ(tags.size(), static_cast<size_t>(count));
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test MGETINFO answers every username in order with one record, in text
+// and as a v2 frame
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, AnswersBatchLookups) {
+    std::string tooMany = "MGETINFO";
+    for (size_t i = 0; i <= MAX_BATCH_LOOKUP; ++i) {
+        tooMany += " u";
+    }
+    const std::string commands = "REGISTER alice secret\nLOGIN alice secret 0 6000\n"
+                                 "MGETINFO alice nobody\talice\n#5 MGETINFO\n" + tooMany + "\nHELLO 2\n";
+    std::string request;
+    FrameWriter writer(request);
+    writer.start(Opcode::MGetInfo, 3);
+    writer.writeU16(2);
+    writer.writeString("nobody");
+    writer.writeString("alice");
+    writer.finish();
+    std::string input = commands + request;
+    ASSERT_EQ(write(fds_[1], input.data(), input.size()), static_cast<ssize_t>(input.size()));
+    connection_->onReady(EPOLLIN);
+
+    const std::string text = "OK REGISTERED\nOK LOGIN\nOK 3 0.0.0.0:6000 - 0.0.0.0:6000\n#5 OK 0\n"
+                             "ERR TOO_MANY_USERS\nOK HELLO 2\n";
+    std::string received = drainPeer();
+    ASSERT_EQ(received.substr(0, text.size()), text);
+    received.erase(0, text.size());
+
+    RingBuffer replies;
+    replies.append(received.data(), received.size());
+    Frame frame;
+    ASSERT_EQ(FrameParser().next(replies, frame), FrameParser::Result::Frame);
+    EXPECT_EQ(frame.requestId, 3u);
+    PayloadReader reader(frame.payload.substr(1));
+    EXPECT_EQ(static_cast<Status>(frame.payload[0]), Status::Ok);
+    uint16_t count = 0, port = 0;
+    std::string_view ip;
+    ASSERT_TRUE(reader.readU16(count));
+    EXPECT_EQ(count, 2);
+    EXPECT_EQ(static_cast<Status>(frame.payload[3]), Status::UserNotFound);
+    EXPECT_EQ(static_cast<Status>(frame.payload[4]), Status::Ok);
+    reader = PayloadReader(frame.payload.substr(5));
+    ASSERT_TRUE(reader.readString(ip) && reader.readU16(port) && reader.atEnd());
+    EXPECT_EQ(ip, "0.0.0.0");
+    EXPECT_EQ(port, 6000);
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test HELLO 2 switches to frames, with the first frames in the same write
+// and the last one split across two reads; replies keep their request ids
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, NegotiatesBinaryFrames) {
+    std::string requests;
+    FrameWriter writer(requests);
+    writer.start(Opcode::Register, 7);
+    writer.writeString("alice");
+    writer.writeString("secret");
+    writer.finish();
+    writer.start(Opcode::GetInfo, 8);
+    writer.writeString("alice");
+    writer.finish();
+    size_t splitFrame = requests.size();
+    writer.start(Opcode::Ping, 9);
+    writer.finish();
+
+    std::string first = "HELLO 2\n" + requests.substr(0, splitFrame + 3);
+    ASSERT_EQ(write(fds_[1], first.data(), first.size()), static_cast<ssize_t>(first.size()));
+    connection_->onReady(EPOLLIN);
+
+    std::string received = drainPeer();
+    ASSERT_EQ(received.substr(0, 11), "OK HELLO 2\n");
+    received.erase(0, 11);
+
+    ASSERT_EQ(write(fds_[1], requests.data() + splitFrame + 3, requests.size() - splitFrame - 3),
+              static_cast<ssize_t>(requests.size() - splitFrame - 3));
+    connection_->onReady(EPOLLIN);
+    received += drainPeer();
+
+    RingBuffer input;
+    input.append(received.data(), received.size());
+    FrameParser replies;
+    Frame frame;
+    const uint32_t ids[] = {7, 8, 9};
+    const Status statuses[] = {Status::Ok, Status::UserNotFound, Status::Ok};
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(replies.next(input, frame), FrameParser::Result::Frame) << "reply " << i;
+        EXPECT_EQ(frame.opcode, Opcode::Reply);
+        EXPECT_EQ(frame.requestId, ids[i]);
+        ASSERT_EQ(frame.payload.size(), 1u);
+        EXPECT_EQ(static_cast<Status>(frame.payload[0]), statuses[i]);
+    }
+    EXPECT_EQ(replies.next(input, frame), FrameParser::Result::NeedMore);
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test a registration the user store cannot make durable is answered with
+// a storage error in both protocols, not as a taken name
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, ReportsStorageErrors) {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / ("chatserver-test-connection-store-" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    ASSERT_TRUE(userManager_.openStore(directory.string()));
+
+    // The log is still empty: with no file allowed to grow, its first batch fails
+    signal(SIGXFSZ, SIG_IGN);
+    rlimit saved;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    rlimit limit = {0, saved.rlim_max};
+    setrlimit(RLIMIT_FSIZE, &limit);
+    ASSERT_EQ(write(fds_[1], "REGISTER bob pw\n", 16), 16);
+    connection_->onReady(EPOLLIN);
+    setrlimit(RLIMIT_FSIZE, &saved);
+    EXPECT_EQ(drainPeer(), "ERR STORAGE\n");
+
+    std::string requests = "REGISTER carol pw\nHELLO 2\n";
+    FrameWriter writer(requests);
+    writer.start(Opcode::Register, 7);
+    writer.writeString("dave");
+    writer.writeString("pw");
+    writer.finish();
+    ASSERT_EQ(write(fds_[1], requests.data(), requests.size()), static_cast<ssize_t>(requests.size()));
+    connection_->onReady(EPOLLIN);
+    std::string received = drainPeer();
+    ASSERT_EQ(received.substr(0, 23), "ERR STORAGE\nOK HELLO 2\n");
+
+    RingBuffer input;
+    input.append(received.data() + 23, received.size() - 23);
+    FrameParser replies;
+    Frame frame;
+    ASSERT_EQ(replies.next(input, frame), FrameParser::Result::Frame);
+    EXPECT_EQ(frame.requestId, 7u);
+    ASSERT_EQ(frame.payload.size(), 1u);
+    EXPECT_EQ(static_cast<Status>(frame.payload[0]), Status::StorageError);
+    EXPECT_EQ(userManager_.userCount(), 0u);
+
+    userManager_.closeStore();
+    std::filesystem::remove_all(directory);
+}
+
+// -----------------------------------------------------------------------------
+// Test that commands beyond the per-IP burst are refused before dispatch
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, RefusesCommandsOverRateLimit) {
+    RateLimiter perIp(1, 2);
+    connection_->setRateLimiters(&perIp, nullptr);
+
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(write(fds_[1], "PING\n", 5), 5);
+        connection_->onReady(EPOLLIN);
+        EXPECT_EQ(drainPeer(), "PONG\n");
+    }
+
+    ASSERT_EQ(write(fds_[1], "PING\n", 5), 5);
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "ERR RATE_LIMITED\n");
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test that heartbeat answers are not charged to the rate limits, so a
+// throttled client can still keep its connection alive, in both protocols
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, ExemptsPongFromRateLimit) {
+    RateLimiter perIp(1, 2);
+    connection_->setRateLimiters(&perIp, nullptr);
+
+    ASSERT_EQ(write(fds_[1], "PING\nPONG\nPONG\nPING\n", 20), 20);
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "PONG\nPONG\n");
+    ASSERT_EQ(write(fds_[1], "PONG\nPING\n", 10), 10);
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "ERR RATE_LIMITED\n");
+
+    startSession(false);
+    RateLimiter framedPerIp(1, 2); // HELLO 2 and one PING
+    connection_->setRateLimiters(&framedPerIp, nullptr);
+    std::string requests = "HELLO 2\n";
+    FrameWriter writer(requests);
+    writer.start(Opcode::Pong, 0);
+    writer.finish();
+    writer.start(Opcode::Ping, 7);
+    writer.finish();
+    writer.start(Opcode::Pong, 0);
+    writer.finish();
+    writer.start(Opcode::Ping, 8);
+    writer.finish();
+    ASSERT_EQ(write(fds_[1], requests.data(), requests.size()), static_cast<ssize_t>(requests.size()));
+    connection_->onReady(EPOLLIN);
+    std::string received = drainPeer();
+    ASSERT_EQ(received.substr(0, 11), "OK HELLO 2\n");
+
+    RingBuffer input;
+    input.append(received.data() + 11, received.size() - 11);
+    FrameParser replies;
+    Frame frame;
+    const uint32_t ids[] = {7, 8};
+    const Status statuses[] = {Status::Ok, Status::RateLimited};
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(replies.next(input, frame), FrameParser::Result::Frame) << "reply " << i;
+        EXPECT_EQ(frame.requestId, ids[i]);
+        ASSERT_EQ(frame.payload.size(), 1u);
+        EXPECT_EQ(static_cast<Status>(frame.payload[0]), statuses[i]);
+    }
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test that a producer sees backpressure instead of blocking, and is called
+// back once the client has read enough
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, ReportsBackpressureAndDrains) {
+    connection_->setWatermarks(8 * 1024, 32 * 1024);
+    std::atomic_int writable{0};
+    connection_->setWritableCallback([&writable]() { ++writable; });
+
+    std::string expected;
+    Connection::SendStatus status = Connection::SendStatus::Queued;
+    for (int i = 0; status == Connection::SendStatus::Queued; ++i) {
+        std::string chunk(1000, static_cast<char>('a' + i % 26));
+        expected += chunk;
+        status = connection_->send(chunk.data(), chunk.size());
+        ASSERT_LT(i, 10000) << "The queue never reported backpressure";
+    }
+    EXPECT_EQ(status, Connection::SendStatus::Backpressure);
+    EXPECT_GT(connection_->outboundSize(), 32u * 1024);
+
+    // The session is still parked on its read, and EPOLLOUT was added
+    EXPECT_EQ(armedEvents_.load(), static_cast<uint32_t>(EPOLLIN | EPOLLOUT));
+    EXPECT_EQ(writable.load(), 0);
+
+    // Play the loop: the client reads, the socket becomes writable
+    std::string received;
+    for (int i = 0; i < 1000 && connection_->outboundSize() > 0; ++i) {
+        received += drainPeer();
+        connection_->onReady(EPOLLOUT);
+    }
+    received += drainPeer();
+
+    EXPECT_EQ(received, expected);
+    EXPECT_EQ(writable.load(), 1);
+    EXPECT_EQ(armedEvents_.load(), static_cast<uint32_t>(EPOLLIN));
+    EXPECT_FALSE(closed_);
+}
+
+// -----------------------------------------------------------------------------
+// Test that output to a closed connection is refused
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, RefusesOutputAfterClose) {
+    ASSERT_EQ(close(fds_[1]), 0);
+    fds_[1] = open("/dev/null", O_RDONLY); // So TearDown() has something to close
+    connection_->onReady(EPOLLIN | EPOLLRDHUP);
+
+    EXPECT_TRUE(closed_);
+    connection_->closeConnection();
+    EXPECT_EQ(connection_->send("late", 4), Connection::SendStatus::Closed);
+}
+
+// -----------------------------------------------------------------------------
+// Test a WebSocket session: the upgrade split across reads, commands in
+// masked text messages (one fragmented around a ping), replies and
+// heartbeats as text messages, HELLO 2 refused and the close echoed
+// -----------------------------------------------------------------------------
+TEST_F(ConnectionTest, ServesWebSocketClients) {
+    startSession(true);
+    auto frame = [](uint8_t firstByte, const std::string& payload) {
+        const char key[4] = {'\x37', '\xfa', '\x21', '\x3d'};
+        std::string bytes = {static_cast<char>(firstByte), static_cast<char>(0x80 | payload.size())};
+        bytes.append(key, 4);
+        for (size_t i = 0; i < payload.size(); ++i) {
+            bytes.push_back(static_cast<char>(payload[i] ^ key[i % 4]));
+        }
+        return bytes;
+    };
+
+    std::string request = "GET /chat HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+                          "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                          "Sec-WebSocket-Version: 13\r\n\r\n";
+    ASSERT_EQ(write(fds_[1], request.data(), 40), 40);
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "");
+
+    std::string rest = request.substr(40) + frame(0x81, "REGISTER alice secret\nGETINFO nobody");
+    ASSERT_EQ(write(fds_[1], rest.data(), rest.size()), static_cast<ssize_t>(rest.size()));
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n"
+                           "\x81\x0eOK REGISTERED\n\x81\x13" "ERR USER_NOT_FOUND\n");
+
+    std::string fragmented = frame(0x01, "PI") + frame(0x89, "hi") + frame(0x80, "NG\nHELLO 2");
+    ASSERT_EQ(write(fds_[1], fragmented.data(), fragmented.size()), static_cast<ssize_t>(fragmented.size()));
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "\x8a\x02hi\x81\x05PONG\n\x81\x18" "ERR UNSUPPORTED_VERSION\n");
+
+    connection_->sendPing();
+    EXPECT_EQ(drainPeer(), "\x81\x05PING\n");
+
+    std::string close = frame(0x88, "\x03\xe8");
+    ASSERT_EQ(write(fds_[1], close.data(), close.size()), static_cast<ssize_t>(close.size()));
+    connection_->onReady(EPOLLIN);
+    EXPECT_EQ(drainPeer(), "\x88\x02\x03\xe8");
+    EXPECT_TRUE(closed_);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "DelimiterScan.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// Every level this CPU can run
+std::vector<ScanLevel> supportedLevels()
+{
+    std::vector<ScanLevel> levels = {ScanLevel::Scalar};
+    if (detectScanLevel() != ScanLevel::Scalar) {
+        levels.push_back(ScanLevel::Sse2);
+    }
+    if (detectScanLevel() == ScanLevel::Avx2) {
+        levels.push_back(ScanLevel::Avx2);
+    }
+    return levels;
+}
+
+size_t referenceFind(const std::string& text, size_t from, size_t to, bool (*match)(char))
+{
+    while (from < to && !match(text[from])) {
+        ++from;
+    }
+    return from;
+}
+}
+
+// -----------------------------------------------------------------------------
+// Test each level matches the scalar reference on random text, at every
+// start alignment and length around the 16/32-byte vector widths
+// -----------------------------------------------------------------------------
+TEST(DelimiterScanTest, MatchesReferenceAtEveryOffset) {
+    std::mt19937 random(42);
+    const char alphabet[] = "ab \t\nGETINFO";
+    std::string text(200, '\0');
+
+    for (ScanLevel level : supportedLevels()) {
+        ASSERT_EQ(setScanLevel(level), level);
+        for (int round = 0; round < 50; ++round) {
+            // Sparse delimiters, so matches land deep inside vectors too
+            for (char& c : text) {
+                c = (random() % 8 == 0) ? alphabet[random() % (sizeof(alphabet) - 1)] : 'x';
+            }
+            for (size_t from = 0; from < 40; ++from) {
+                for (size_t to = from; to <= text.size(); to += 7) {
+                    const char* begin = text.data() + from;
+                    const char* end = text.data() + to;
+                    size_t newline = referenceFind(text, from, to, [](char c) { return c == '\n'; });
+                    size_t blank = referenceFind(text, from, to, [](char c) { return c == ' ' || c == '\t'; });
+                    size_t word = referenceFind(text, from, to, [](char c) { return c != ' ' && c != '\t'; });
+
+                    ASSERT_EQ(scanForByte(begin, end, '\n') - text.data(), static_cast<ptrdiff_t>(newline))
+                        << "level " << static_cast<int>(level) << " from " << from << " to " << to;
+                    ASSERT_EQ(scanForBlank(begin, end) - text.data(), static_cast<ptrdiff_t>(blank));
+                    ASSERT_EQ(skipBlanks(begin, end) - text.data(), static_cast<ptrdiff_t>(word));
+                }
+            }
+        }
+    }
+    setScanLevel(detectScanLevel());
+}
+
+// -----------------------------------------------------------------------------
+// Test runs of blanks longer than a vector, and bytes with the high bit set
+// -----------------------------------------------------------------------------
+TEST(DelimiterScanTest, HandlesLongRunsAndHighBytes) {
+    std::string text = std::string(70, ' ') + "\t\t\xff\xe9 word" + std::string(40, '\xa0') + "\n";
+
+    for (ScanLevel level : supportedLevels()) {
+        setScanLevel(level);
+        const char* begin = text.data();
+        const char* end = begin + text.size();
+        EXPECT_EQ(skipBlanks(begin, end) - begin, 72);
+        EXPECT_EQ(scanForBlank(begin + 72, end) - begin, 74);
+        EXPECT_EQ(scanForByte(begin, end, '\n') - begin, static_cast<ptrdiff_t>(text.size() - 1));
+        EXPECT_EQ(scanForByte(begin, end, '\xa0') - begin, 79);
+        EXPECT_EQ(scanForByte(begin, end - 1, '\n'), end - 1);
+    }
+    setScanLevel(detectScanLevel());
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "Epoch.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+// Sets *freed when deleted
+struct Tracked {
+    explicit Tracked(std::atomic_bool* flag) : freed(flag) {}
+    ~Tracked() { freed->store(true); }
+    std::atomic_bool* freed;
+};
+}
+
+// -----------------------------------------------------------------------------
+// Test an object retired inside a guard outlives the guard, nested or not
+// -----------------------------------------------------------------------------
+TEST(EpochTest, WaitsForOwnGuard) {
+    std::atomic_bool freed{false};
+    {
+        EpochGuard outer;
+        {
+            EpochGuard inner;
+            epochRetire(new Tracked(&freed));
+        }
+        EXPECT_EQ(epochReclaim(), 1u); // The outer guard still counts
+        EXPECT_FALSE(freed);
+    }
+    EXPECT_EQ(epochReclaim(), 0u);
+    EXPECT_TRUE(freed);
+}
+
+// -----------------------------------------------------------------------------
+// Test a reader on another thread holds back only what was retired while
+// it read, and readers that enter later hold back nothing
+// -----------------------------------------------------------------------------
+TEST(EpochTest, WaitsForOtherReaders) {
+    std::atomic_bool entered{false};
+    std::atomic_bool leave{false};
+    std::thread reader([&]() {
+        EpochGuard guard;
+        entered = true;
+        while (!leave) {
+            std::this_thread::yield();
+        }
+    });
+    while (!entered) {
+        std::this_thread::yield();
+    }
+
+    std::atomic_bool first{false};
+    epochRetire(new Tracked(&first));
+    EXPECT_EQ(epochReclaim(), 1u);
+    EXPECT_FALSE(first);
+
+    leave = true;
+    reader.join();
+
+    std::atomic_bool second{false};
+    std::thread lateReader([]() { EpochGuard guard; });
+    epochRetire(new Tracked(&second));
+    lateReader.join();
+    EXPECT_EQ(epochReclaim(), 0u);
+    EXPECT_TRUE(first);
+    EXPECT_TRUE(second);
+}
+
+// -----------------------------------------------------------------------------
+// Test what a thread leaves behind at exit is freed by the next reclaim
+// -----------------------------------------------------------------------------
+TEST(EpochTest, AdoptsObjectsOfExitedThreads) {
+    std::atomic_bool freed{false};
+    std::atomic_bool retired{false};
+    std::thread writer;
+    {
+        EpochGuard guard; // Keeps the writer from freeing it before it exits
+        writer = std::thread([&]() {
+            epochRetire(new Tracked(&freed));
+            retired = true;
+        });
+        writer.join();
+    }
+    EXPECT_TRUE(retired);
+    EXPECT_FALSE(freed);
+    EXPECT_EQ(epochReclaim(), 0u);
+    EXPECT_TRUE(freed);
+}
+
+// -----------------------------------------------------------------------------
+// Test readers never see a retired object freed: writers swap a published
+// value as fast as they can while readers check it is intact
+// -----------------------------------------------------------------------------
+TEST(EpochTest, ProtectsConcurrentReaders) {
+    struct Value {
+        explicit Value(uint64_t n) : number(n), check(~n) {}
+        ~Value() { check = 0; } // What a reader of freed memory would likely see
+        uint64_t number;
+        uint64_t check;
+    };
+    std::atomic<Value*> published{new Value(0)};
+    std::atomic_bool stop{false};
+    std::atomic<uint64_t> torn{0};
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&]() {
+            while (!stop) {
+                EpochGuard guard;
+                const Value* value = published.load(std::memory_order_acquire);
+                if (value->check != ~value->number) {
+                    torn.fetch_add(1);
+                }
+            }
+        });
+    }
+    std::thread writer([&]() {
+        for (uint64_t n = 1; n <= 20000; ++n) {
+            epochRetire(published.exchange(new Value(n), std::memory_order_acq_rel));
+        }
+    });
+    writer.join();
+    stop = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_EQ(torn.load(), 0u);
+    EXPECT_EQ(epochReclaim(), 0u);
+    delete published.load();
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
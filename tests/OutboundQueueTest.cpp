@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "OutboundQueue.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <string>
+
+// -----------------------------------------------------------------------------
+// Fixture: a non-blocking socket pair with small buffers, so the writer side
+// fills up quickly.
+// -----------------------------------------------------------------------------
+class OutboundQueueTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_), 0);
+        int size = 4096;
+        setsockopt(fds_[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(fds_[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        fcntl(fds_[0], F_SETFL, fcntl(fds_[0], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds_[1], F_SETFL, fcntl(fds_[1], F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    void TearDown() override {
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+
+    // Reads everything currently available on the peer side
+    std::string drainPeer() {
+        std::string received;
+        char buffer[8192];
+        ssize_t n;
+        while ((n = read(fds_[1], buffer, sizeof(buffer))) > 0) {
+            received.append(buffer, static_cast<size_t>(n));
+        }
+        return received;
+    }
+
+    int fds_[2];
+};
+
+// -----------------------------------------------------------------------------
+// Test that small appends are delivered in order by a single flush
+// -----------------------------------------------------------------------------
+TEST_F(OutboundQueueTest, FlushesAppendsInOrder) {
+    OutboundQueue queue;
+    queue.append("OK LOGIN", 8);
+    queue.append(std::string("OK 127.0.0.1:5000"));
+    queue.append("ERR USER_NOT_FOUND", 18);
+    EXPECT_EQ(queue.size(), 8u + 17u + 18u);
+
+    EXPECT_EQ(queue.flush(fds_[0]), OutboundQueue::FlushResult::Drained);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(drainPeer(), "OK LOGINOK 127.0.0.1:5000ERR USER_NOT_FOUND");
+}
+
+// -----------------------------------------------------------------------------
+// Test that a full socket keeps the unsent tail and resumes where it stopped
+// -----------------------------------------------------------------------------
+TEST_F(OutboundQueueTest, KeepsUnsentBytesOnWouldBlock) {
+    OutboundQueue queue;
+    std::string expected;
+    for (int i = 0; i < 200; ++i) {
+        std::string chunk(1000, static_cast<char>('a' + i % 26));
+        expected += chunk;
+        queue.append(std::move(chunk));
+    }
+
+    std::string received;
+    while (queue.flush(fds_[0]) == OutboundQueue::FlushResult::WouldBlock) {
+        EXPECT_FALSE(queue.empty());
+        received += drainPeer();
+    }
+    received += drainPeer();
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(received, expected);
+}
+
+// -----------------------------------------------------------------------------
+// Test the watermarks
+// -----------------------------------------------------------------------------
+TEST_F(OutboundQueueTest, ReportsWatermarks) {
+    OutboundQueue queue(100, 1000);
+    EXPECT_TRUE(queue.belowLowWatermark());
+    EXPECT_FALSE(queue.aboveHighWatermark());
+
+    queue.append(std::string(500, 'x'));
+    EXPECT_FALSE(queue.belowLowWatermark());
+    EXPECT_FALSE(queue.aboveHighWatermark());
+
+    queue.append(std::string(501, 'x'));
+    EXPECT_TRUE(queue.aboveHighWatermark());
+
+    queue.clear();
+    EXPECT_TRUE(queue.belowLowWatermark());
+}
+
+// -----------------------------------------------------------------------------
+// Test that a writer error and a closed peer are reported
+// -----------------------------------------------------------------------------
+TEST_F(OutboundQueueTest, ReportsErrors) {
+    OutboundQueue queue;
+    queue.append("data", 4);
+
+    int written = 0;
+    auto failing = [&written](const char*, size_t) -> ssize_t {
+        ++written;
+        errno = ECONNRESET;
+        return -1;
+    };
+    EXPECT_EQ(queue.flush(failing), OutboundQueue::FlushResult::Error);
+    EXPECT_EQ(written, 1);
+    EXPECT_EQ(queue.size(), 4u);
+
+    // A vanished peer must not raise SIGPIPE
+    close(fds_[1]);
+    fds_[1] = open("/dev/null", O_RDONLY);
+    EXPECT_EQ(queue.flush(fds_[0]), OutboundQueue::FlushResult::Error);
+    EXPECT_EQ(errno, EPIPE);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "Protocol.h"
+#include <string>
+
+namespace {
+std::string loginFrame(uint32_t requestId)
+{
+    std::string out;
+    FrameWriter writer(out);
+    writer.start(Opcode::Login, requestId);
+    writer.writeString("alice");
+    writer.writeString("secret");
+    writer.writeU16(5000);
+    writer.finish();
+    return out;
+}
+}
+
+// -----------------------------------------------------------------------------
+// Test a frame written by FrameWriter parses back field for field
+// -----------------------------------------------------------------------------
+TEST(ProtocolTest, RoundTripsFrame) {
+    std::string wire = loginFrame(42);
+    ASSERT_EQ(wire.size(), FRAME_HEADER_SIZE + 2 + 5 + 2 + 6 + 2);
+
+    RingBuffer input;
+    input.append(wire.data(), wire.size());
+
+    FrameParser parser;
+    Frame frame;
+    ASSERT_EQ(parser.next(input, frame), FrameParser::Result::Frame);
+    EXPECT_EQ(frame.opcode, Opcode::Login);
+    EXPECT_EQ(frame.requestId, 42u);
+
+    PayloadReader reader(frame.payload);
+    std::string_view username, password;
+    uint16_t port = 0;
+    ASSERT_TRUE(reader.readString(username));
+    ASSERT_TRUE(reader.readString(password));
+    ASSERT_TRUE(reader.readU16(port));
+    EXPECT_TRUE(reader.atEnd());
+    EXPECT_EQ(username, "alice");
+    EXPECT_EQ(password, "secret");
+    EXPECT_EQ(port, 5000);
+
+    // Reading past the end fails instead of running off the payload
+    EXPECT_FALSE(reader.readU16(port));
+    EXPECT_EQ(parser.next(input, frame), FrameParser::Result::NeedMore);
+    EXPECT_TRUE(input.empty());
+}
+
+// -----------------------------------------------------------------------------
+// Test frames split at every byte boundary, and several frames in one
+// read, come out whole and in order
+// -----------------------------------------------------------------------------
+TEST(ProtocolTest, ReassemblesSplitAndCoalescedFrames) {
+    std::string wire = loginFrame(1) + loginFrame(2) + loginFrame(3);
+
+    // A small ring, so frames also wrap around its end
+    RingBuffer input(64);
+    FrameParser parser;
+    Frame frame;
+    uint32_t expected = 1;
+    for (char byte : wire) {
+        input.append(&byte, 1);
+        while (parser.next(input, frame) == FrameParser::Result::Frame) {
+            EXPECT_EQ(frame.requestId, expected++);
+            EXPECT_EQ(frame.payload.substr(2, 5), "alice");
+        }
+    }
+    EXPECT_EQ(expected, 4u);
+
+    input.append(wire.data(), wire.size());
+    for (uint32_t id = 1; id <= 3; ++id) {
+        ASSERT_EQ(parser.next(input, frame), FrameParser::Result::Frame);
+        EXPECT_EQ(frame.requestId, id);
+    }
+    EXPECT_EQ(parser.next(input, frame), FrameParser::Result::NeedMore);
+
+    // A partial frame stays buffered, e.g. for a hot upgrade
+    input.append(wire.data(), 7);
+    EXPECT_EQ(parser.next(input, frame), FrameParser::Result::NeedMore);
+    EXPECT_EQ(input.takeAll(), wire.substr(0, 7));
+}
+
+// -----------------------------------------------------------------------------
+// Test a length outside [5, MAX_FRAME_SIZE] is an error, not a huge buffer
+// -----------------------------------------------------------------------------
+TEST(ProtocolTest, RejectsBadLength) {
+    const char tooLong[] = {0x7f, 0x00, 0x00, 0x00, 0x05};
+    RingBuffer input;
+    input.append(tooLong, sizeof(tooLong));
+    FrameParser parser;
+    Frame frame;
+    EXPECT_EQ(parser.next(input, frame), FrameParser::Result::Error);
+
+    const char tooShort[] = {0x00, 0x00, 0x00, 0x02, 0x05, 0x00};
+    RingBuffer other;
+    other.append(tooShort, sizeof(tooShort));
+    EXPECT_EQ(parser.next(other, frame), FrameParser::Result::Error);
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
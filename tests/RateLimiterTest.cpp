@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "RateLimiter.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr uint64_t SECOND_NS = 1000000000ull;
+constexpr uint64_t START_NS = 1000 * SECOND_NS; // Any realistic monotonic time
+}
+
+// -----------------------------------------------------------------------------
+// Test a quiet key gets its burst, then is held to the sustained rate
+// -----------------------------------------------------------------------------
+TEST(RateLimiterTest, AllowsBurstThenRate) {
+    RateLimiter limiter(10, 5);
+    const uint64_t key = 0x7f000001;
+
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_TRUE(limiter.allow(key, START_NS)) << "request " << i;
+    }
+    EXPECT_FALSE(limiter.allow(key, START_NS));
+
+    // One token refills every 100 ms
+    EXPECT_FALSE(limiter.allow(key, START_NS + SECOND_NS / 20));
+    EXPECT_TRUE(limiter.allow(key, START_NS + SECOND_NS / 10));
+    EXPECT_FALSE(limiter.allow(key, START_NS + SECOND_NS / 10));
+
+    // A long pause refills the whole burst, not more
+    int allowed = 0;
+    while (limiter.allow(key, START_NS + 60 * SECOND_NS)) {
+        ++allowed;
+    }
+    EXPECT_EQ(allowed, 5);
+}
+
+// -----------------------------------------------------------------------------
+// Test keys are limited independently
+// -----------------------------------------------------------------------------
+TEST(RateLimiterTest, KeysAreIndependent) {
+    RateLimiter limiter(1, 1);
+
+    EXPECT_TRUE(limiter.allow(std::string("alice"), START_NS));
+    EXPECT_FALSE(limiter.allow(std::string("alice"), START_NS));
+    EXPECT_TRUE(limiter.allow(std::string("bob"), START_NS));
+    EXPECT_TRUE(limiter.allow(uint64_t(0x0a000001), START_NS));
+    EXPECT_TRUE(limiter.allow(uint64_t(0x0a000002), START_NS));
+}
+
+// -----------------------------------------------------------------------------
+// Test concurrent callers never get more than the burst between them
+// -----------------------------------------------------------------------------
+TEST(RateLimiterTest, ConcurrentCallersShareTheBurst) {
+    const int NUM_THREADS = 8;
+    const int BURST = 1000;
+    RateLimiter limiter(1, BURST);
+    std::atomic<int> allowed{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&limiter, &allowed]() {
+            for (int i = 0; i < BURST; ++i) {
+                if (limiter.allow(uint64_t(42), START_NS)) {
+                    ++allowed;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(allowed.load(), BURST);
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
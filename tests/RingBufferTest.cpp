@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include "RingBuffer.h"
+#include "LineParser.h"
+#include "Protocol.h"
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Test data survives wrapping around the end, and find() looks across it
+// -----------------------------------------------------------------------------
+TEST(RingBufferTest, WrapsAroundAndFinds) {
+    RingBuffer ring(64);
+    std::string filler(48, 'x');
+    ring.append(filler.data(), filler.size());
+    ring.consume(40);
+
+    // 8 bytes buffered at offset 40: the next 30 wrap past the end
+    std::string tail = "0123456789abcdefghij\nklmnopqrs";
+    ring.append(tail.data(), tail.size());
+    EXPECT_EQ(ring.capacity(), 64u);
+    EXPECT_EQ(ring.size(), 38u);
+    EXPECT_EQ(ring.find('\n'), 28u);
+    EXPECT_EQ(ring.find('s'), 37u);
+    EXPECT_EQ(ring.find('\n', 29), RingBuffer::npos);
+
+    const char* contiguous = ring.linearize(ring.size());
+    EXPECT_EQ(std::string(contiguous, ring.size()), std::string(8, 'x') + tail);
+}
+
+// -----------------------------------------------------------------------------
+// Test the buffer grows for a large command and shrinks back once empty
+// -----------------------------------------------------------------------------
+TEST(RingBufferTest, GrowsAndShrinks) {
+    RingBuffer ring(64);
+    ring.reserve(16);
+    EXPECT_EQ(ring.capacity(), 64u);
+
+    std::string large(1000, 'y');
+    ring.append(large.data(), large.size());
+    EXPECT_EQ(ring.capacity(), 1024u);
+    EXPECT_EQ(ring.takeAll(), large);
+
+    ring.shrink();
+    EXPECT_EQ(ring.capacity(), 0u);
+    ring.reserve(1);
+    EXPECT_EQ(ring.capacity(), 64u);
+    EXPECT_GE(ring.writable(), 1u);
+}
+
+// -----------------------------------------------------------------------------
+// Test lines: CRLF is trimmed, blank lines skipped, a partial line kept,
+// and a line past MAX_LINE_SIZE refused without a delimiter ever arriving
+// -----------------------------------------------------------------------------
+TEST(RingBufferTest, ParsesLines) {
+    RingBuffer ring;
+    LineParser parser;
+    std::string_view line;
+
+    std::string input = "PING\r\n\nGETINFO bob\nLOG";
+    ring.append(input.data(), input.size());
+    ASSERT_EQ(parser.next(ring, line), LineParser::Result::Line);
+    EXPECT_EQ(line, "PING");
+    ASSERT_EQ(parser.next(ring, line), LineParser::Result::Line);
+    EXPECT_EQ(line, "GETINFO bob");
+    EXPECT_EQ(parser.next(ring, line), LineParser::Result::NeedMore);
+
+    ring.append("OUT\n", 4);
+    ASSERT_EQ(parser.next(ring, line), LineParser::Result::Line);
+    EXPECT_EQ(line, "LOGOUT");
+    EXPECT_TRUE(ring.empty());
+
+    std::string endless(MAX_LINE_SIZE + 1, 'z');
+    ring.append(endless.data(), endless.size());
+    EXPECT_EQ(parser.next(ring, line), LineParser::Result::Error);
+}
+
+// -----------------------------------------------------------------------------
+// Fuzz: a random stream of commands, lines first and frames after HELLO,
+// is cut into random chunks (1 byte up to several commands) and fed
+// through a small ring. Every command must come out intact, in order.
+// -----------------------------------------------------------------------------
+TEST(RingBufferTest, FuzzRandomSplits) {
+    std::mt19937 random(20261017);
+
+    for (int round = 0; round < 200; ++round) {
+        std::vector<std::string> lines;
+        std::vector<std::string> payloads;
+        std::string stream;
+
+        size_t lineCount = random() % 20;
+        for (size_t i = 0; i < lineCount; ++i) {
+            std::string line(1 + random() % 80, '\0');
+            for (char& c : line) {
+                c = static_cast<char>('!' + random() % 90); // Printable, never "\n"
+            }
+            lines.push_back(line);
+            stream += line + (random() % 2 ? "\r\n" : "\n");
+        }
+        lines.push_back("HELLO 2");
+        stream += "HELLO 2\n";
+
+        size_t frameCount = random() % 20;
+        for (size_t i = 0; i < frameCount; ++i) {
+            std::string payload(random() % 300, '\0');
+            for (char& c : payload) {
+                c = static_cast<char>(random()); // Any byte, "\n" included
+            }
+            payloads.push_back(payload);
+
+            FrameWriter writer(stream);
+            writer.start(Opcode::GetInfo, static_cast<uint32_t>(i));
+            writer.writeString(payload);
+            writer.finish();
+        }
+
+        RingBuffer ring(64);
+        LineParser lineParser;
+        FrameParser frameParser;
+        bool frames = false;
+        size_t nextLine = 0;
+        size_t nextFrame = 0;
+
+        size_t offset = 0;
+        while (offset < stream.size()) {
+            size_t chunk = std::min<size_t>(stream.size() - offset, 1 + random() % 700);
+            ring.reserve(chunk);
+            size_t written = std::min(chunk, ring.writable()); // Short reads, as from a socket
+            std::memcpy(ring.writeData(), stream.data() + offset, written);
+            ring.commit(written);
+            offset += written;
+
+            while (true) {
+                if (!frames) {
+                    std::string_view line;
+                    LineParser::Result result = lineParser.next(ring, line);
+                    ASSERT_NE(result, LineParser::Result::Error);
+                    if (result == LineParser::Result::NeedMore) {
+                        break;
+                    }
+                    ASSERT_LT(nextLine, lines.size());
+                    EXPECT_EQ(line, lines[nextLine]) << "round " << round << " line " << nextLine;
+                    frames = (line == "HELLO 2");
+                    ++nextLine;
+                } else {
+                    Frame frame;
+                    FrameParser::Result result = frameParser.next(ring, frame);
+                    ASSERT_NE(result, FrameParser::Result::Error);
+                    if (result == FrameParser::Result::NeedMore) {
+                        break;
+                    }
+                    ASSERT_LT(nextFrame, payloads.size());
+                    EXPECT_EQ(frame.requestId, nextFrame);
+                    PayloadReader reader(frame.payload);
+                    std::string_view payload;
+                    EXPECT_TRUE(reader.readString(payload) && reader.atEnd());
+                    EXPECT_EQ(payload, payloads[nextFrame]) << "round " << round << " frame " << nextFrame;
+                    ++nextFrame;
+                }
+            }
+            ring.shrink();
+        }
+
+        EXPECT_EQ(nextLine, lines.size()) << "round " << round;
+        EXPECT_EQ(nextFrame, payloads.size()) << "round " << round;
+        EXPECT_TRUE(ring.empty());
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
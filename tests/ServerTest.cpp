@@ -1,13 +1,22 @@
 #include <gtest/gtest.h>
 #include "Server.h"
 #include "ThreadPool.h"
+#include "Client.h"
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
+#include <filesystem>
 #include <thread>
 
+#ifdef USE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#endif
+
 // -----------------------------------------------------------------------------
 // Test that the server initializes the socket correctly
 // -----------------------------------------------------------------------------
@@ -134,6 +143,901 @@ TEST(ServerTest, IntegratesWithThreadPool) {
     SUCCEED() << "Server processed multiple connections with ThreadPool integration.";
 }
 
+// -----------------------------------------------------------------------------
+// Test SO_REUSEPORT sharded acceptors serve clients on the same port
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ShardedAcceptorsServeClients) {
+    const int port = 9094;  // Arbitrary unused port
+    const size_t threadCount = 2;
+
+    ServerOptions options;
+    options.acceptorCount = 4;
+    Server server(port, threadCount, options);
+
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Enough clients that the kernel spreads them over several shards
+    for (int i = 0; i < 16; ++i) {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_GE(clientSocket, 0) << "Failed to create client socket: " << strerror(errno);
+
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        ASSERT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+
+        const char* command = "GETINFO nobody\n";
+        ASSERT_GT(send(clientSocket, command, strlen(command), 0), 0);
+
+        char buffer[64] = {};
+        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        ASSERT_GT(bytesRead, 0);
+        EXPECT_EQ(std::string(buffer).rfind("ERR USER_NOT_FOUND", 0), 0u);
+
+        close(clientSocket);
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test idle/login timeouts and heartbeats driven by the timer wheel
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ExpiresQuietConnections) {
+    const int port = 9095;  // Arbitrary unused port
+    const size_t threadCount = 2;
+
+    ServerOptions options;
+    options.idleTimeoutMs = 600;
+    options.loginTimeoutMs = 1500;
+    options.heartbeatIntervalMs = 200;
+    Server server(port, threadCount, options);
+
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto connectClient = [port]() {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+        return clientSocket;
+    };
+    auto receiveAll = [](int clientSocket) {
+        std::string received;
+        char buffer[256];
+        ssize_t bytesRead;
+        while ((bytesRead = recv(clientSocket, buffer, sizeof(buffer), 0)) > 0) {
+            received.append(buffer, static_cast<size_t>(bytesRead));
+        }
+        return received;
+    };
+
+    // A silent client is pinged, then dropped once the idle timeout passes
+    int silent = connectClient();
+    std::string received = receiveAll(silent);
+    EXPECT_EQ(received.rfind("PING", 0), 0u) << received;
+    EXPECT_NE(received.find("ERR IDLE_TIMEOUT"), std::string::npos) << received;
+    close(silent);
+
+    // A client that keeps talking outlives the idle timeout, but not the
+    // login deadline
+    int chatty = connectClient();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_GT(send(chatty, "PING\n", 5, 0), 0);
+        char buffer[64] = {};
+        ASSERT_GT(recv(chatty, buffer, sizeof(buffer) - 1, 0), 0);
+        EXPECT_EQ(std::string(buffer), "PONG\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    }
+    received = receiveAll(chatty);
+    EXPECT_NE(received.find("ERR LOGIN_TIMEOUT"), std::string::npos) << received;
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1400));
+    close(chatty);
+
+    server.stop();
+    serverThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test a hot upgrade hands a logged-in client over without disconnecting it
+// -----------------------------------------------------------------------------
+TEST(ServerTest, HotUpgradeKeepsClients) {
+    const int port = 9096;  // Arbitrary unused port
+    const size_t threadCount = 2;
+    const std::string upgradePath = "/tmp/chatserver-test-upgrade.sock";
+
+    ServerOptions oldOptions;
+    oldOptions.upgradeSocketPath = upgradePath;
+    Server oldServer(port, threadCount, oldOptions);
+    std::thread oldThread([&oldServer]() {
+        oldServer.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto connectClient = [port]() {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+        return clientSocket;
+    };
+    auto request = [](int clientSocket, const std::string& command) {
+        EXPECT_GT(send(clientSocket, command.data(), command.size(), 0), 0);
+        char buffer[128] = {};
+        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        return bytesRead > 0 ? std::string(buffer, static_cast<size_t>(bytesRead)) : std::string();
+    };
+
+    int client = connectClient();
+    EXPECT_EQ(request(client, "REGISTER alice secret\n"), "OK REGISTERED\n");
+    EXPECT_EQ(request(client, "LOGIN alice secret 0 6000\n"), "OK LOGIN\n");
+
+    // The new server takes over in its constructor; the old start() returns
+    ServerOptions newOptions;
+    newOptions.takeoverPath = upgradePath;
+    Server newServer(0, threadCount, newOptions);
+    oldThread.join();
+
+    std::thread newThread([&newServer]() {
+        newServer.start();
+    });
+
+    // Same socket, now served by the new server, which knows alice
+    EXPECT_EQ(request(client, "GETINFO alice\n"), "OK 127.0.0.1:6000\n");
+
+    // And it accepts on the inherited listener
+    int another = connectClient();
+    EXPECT_EQ(request(another, "GETINFO alice\n"), "OK 127.0.0.1:6000\n");
+
+    close(client);
+    close(another);
+    newServer.stop();
+    newThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test clients beyond maxConnections are shed with ERR BUSY
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ShedsClientsOverLimit) {
+    const int port = 9097;  // Arbitrary unused port
+    const size_t threadCount = 2;
+
+    ServerOptions options;
+    options.maxConnections = 2;
+    Server server(port, threadCount, options);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto connectClient = [port]() {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+        return clientSocket;
+    };
+    auto request = [](int clientSocket, const std::string& command) {
+        send(clientSocket, command.data(), command.size(), MSG_NOSIGNAL);
+        char buffer[128] = {};
+        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        return bytesRead > 0 ? std::string(buffer, static_cast<size_t>(bytesRead)) : std::string();
+    };
+
+    int first = connectClient();
+    int second = connectClient();
+    EXPECT_EQ(request(first, "PING\n"), "PONG\n");
+    EXPECT_EQ(request(second, "PING\n"), "PONG\n");
+
+    // The third is turned away at accept time, then closed
+    int third = connectClient();
+    char buffer[64] = {};
+    EXPECT_GT(recv(third, buffer, sizeof(buffer) - 1, 0), 0);
+    EXPECT_EQ(std::string(buffer), "ERR BUSY\n");
+    EXPECT_EQ(recv(third, buffer, sizeof(buffer), 0), 0);
+    close(third);
+
+    // Once a slot frees up, new clients are served again
+    close(first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    int fourth = connectClient();
+    EXPECT_EQ(request(fourth, "PING\n"), "PONG\n");
+
+    close(second);
+    close(fourth);
+    server.stop();
+    serverThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test that the Client pipelines a bulk lookup as tagged requests and gets
+// every answer back in request order, though the server may reorder them
+// -----------------------------------------------------------------------------
+TEST(ServerTest, PipelinesTaggedLookups) {
+    const int port = 9100;  // Arbitrary unused port
+    const uint16_t listenPort = 9101;
+    const size_t threadCount = 4;
+
+    // Every lookup counts against the rate limits; this test is about order
+    ServerOptions options;
+    options.ipCommandRate = 0;
+    options.userCommandRate = 0;
+    Server server(port, threadCount, options);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    {
+        Client client(listenPort, "127.0.0.1", port);
+        ASSERT_TRUE(client.registerWithServer("alice", "secret"));
+        ASSERT_TRUE(client.loginToServer("alice", "secret"));
+
+        // More than a window, so the client has to top it up as replies arrive
+        std::vector<std::string> usernames;
+        for (size_t i = 0; i < 2 * Client::PIPELINE_WINDOW + 7; ++i) {
+            usernames.push_back(i % 3 ? "alice" : "nobody");
+        }
+        auto addresses = client.getClientInfos(usernames);
+        ASSERT_EQ(addresses.size(), usernames.size());
+        for (size_t i = 0; i < usernames.size(); ++i) {
+            if (i % 3) {
+                EXPECT_EQ(addresses[i], std::make_pair(std::string("127.0.0.1"), listenPort)) << "lookup " << i;
+            } else {
+                EXPECT_EQ(addresses[i].second, 0) << "lookup " << i;
+            }
+        }
+
+        // Untagged requests still work on the same connection afterwards
+        EXPECT_EQ(client.getClientInfo("alice"), std::make_pair(std::string("127.0.0.1"), listenPort));
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test that the Client resolves a roster larger than one line with MGETINFO
+// commands, every record landing on its username
+// -----------------------------------------------------------------------------
+TEST(ServerTest, BatchesLookups) {
+    const int port = 9102;  // Arbitrary unused port
+    const uint16_t listenPort = 9103;
+    const size_t threadCount = 2;
+
+    Server server(port, threadCount);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    {
+        Client client(listenPort, "127.0.0.1", port);
+        ASSERT_TRUE(client.registerWithServer("alice", "secret"));
+        ASSERT_TRUE(client.loginToServer("alice", "secret"));
+
+        std::vector<std::string> usernames;
+        for (size_t i = 0; i < 3000; ++i) {
+            usernames.push_back(i % 3 ? "alice" : "user" + std::to_string(i));
+        }
+        auto addresses = client.getClientInfoBatch(usernames);
+        ASSERT_EQ(addresses.size(), usernames.size());
+        for (size_t i = 0; i < usernames.size(); ++i) {
+            if (i % 3) {
+                EXPECT_EQ(addresses[i], std::make_pair(std::string("127.0.0.1"), listenPort)) << "lookup " << i;
+            } else {
+                EXPECT_EQ(addresses[i].second, 0) << "lookup " << i;
+            }
+        }
+        EXPECT_TRUE(client.getClientInfoBatch({}).empty());
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test that lookups the rate limiter refuses are sent again, not reported as
+// users that are not found
+// -----------------------------------------------------------------------------
+TEST(ServerTest, RetriesRateLimitedLookups) {
+    const int port = 9111;  // Arbitrary unused port
+    const uint16_t listenPort = 9112;
+    const size_t threadCount = 2;
+
+    // A small burst, so most lookups are refused at first, and a rate
+    // that lets them all through within a second
+    ServerOptions options;
+    options.ipCommandRate = 1000;
+    options.ipCommandBurst = 50;
+    options.userCommandRate = 0;
+    Server server(port, threadCount, options);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    {
+        Client client(listenPort, "127.0.0.1", port);
+        ASSERT_TRUE(client.registerWithServer("alice", "secret"));
+        ASSERT_TRUE(client.loginToServer("alice", "secret"));
+
+        std::vector<std::string> usernames(2 * Client::PIPELINE_WINDOW, "alice");
+        auto addresses = client.getClientInfos(usernames);
+        ASSERT_EQ(addresses.size(), usernames.size());
+        for (size_t i = 0; i < usernames.size(); ++i) {
+            EXPECT_EQ(addresses[i], std::make_pair(std::string("127.0.0.1"), listenPort)) << "lookup " << i;
+        }
+
+        // MGETINFO costs one token per command; this takes about 90 of them
+        std::vector<std::string> roster(60000, "alice");
+        auto records = client.getClientInfoBatch(roster);
+        ASSERT_EQ(records.size(), roster.size());
+        for (size_t i = 0; i < roster.size(); ++i) {
+            EXPECT_EQ(records[i], std::make_pair(std::string("127.0.0.1"), listenPort)) << "record " << i;
+        }
+
+        for (size_t i = 0; i < 100; ++i) {
+            EXPECT_EQ(client.getClientInfo("alice"), std::make_pair(std::string("127.0.0.1"), listenPort));
+        }
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test replies too large for the socket buffer reach a slow reader whole
+// and in order, on every I/O backend built in: each MGETINFO reply is
+// distinct, so a tail sent after later data shows as a mismatch
+// -----------------------------------------------------------------------------
+TEST(ServerTest, KeepsRepliesInOrderUnderBackpressure) {
+    std::vector<std::pair<IoBackend, int>> backends = {{IoBackend::Epoll, 9109}};
+#ifdef USE_IO_URING
+    backends.push_back({IoBackend::IoUring, 9110});
+#endif
+    const size_t lines = 300;
+    const size_t namesPerLine = 1000;
+
+    for (auto [backend, port] : backends) {
+        ServerOptions options;
+        options.ioBackend = backend;
+        options.ipCommandRate = 0;
+        options.userCommandRate = 0;
+        Server server(port, 2, options);
+        std::thread serverThread([&server]() {
+            server.start();
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto connectClient = [port](int receiveBuffer) {
+            int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+            if (receiveBuffer > 0) {
+                setsockopt(clientSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+            }
+            sockaddr_in serverAddr = {};
+            serverAddr.sin_family = AF_INET;
+            serverAddr.sin_port = htons(port);
+            serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+            timeval timeout = {5, 0};
+            setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+                << "Client failed to connect: " << strerror(errno);
+            return clientSocket;
+        };
+
+        int user = connectClient(0);
+        const std::string login = "REGISTER a pw\nLOGIN a pw 127.0.0.1 4242\n";
+        send(user, login.data(), login.size(), MSG_NOSIGNAL);
+        const std::string loggedIn = "OK REGISTERED\nOK LOGIN\n";
+        std::string loginReplies;
+        char buffer[4096];
+        ssize_t n = 1;
+        while (loginReplies.size() < loggedIn.size() && (n = recv(user, buffer, sizeof(buffer), 0)) > 0) {
+            loginReplies.append(buffer, static_cast<size_t>(n));
+        }
+        EXPECT_EQ(loginReplies, loggedIn);
+
+        // Line i looks up "z" (unknown) where (j + i) % 7 == 0 and "a" elsewhere:
+        // one-letter names fit 1000 in a line, and the replies are ~13 KB each
+        std::string requests, expected;
+        for (size_t i = 0; i < lines; ++i) {
+            requests += "MGETINFO";
+            expected += "OK " + std::to_string(namesPerLine);
+            for (size_t j = 0; j < namesPerLine; ++j) {
+                bool missing = (j + i) % 7 == 0;
+                requests += missing ? " z" : " a";
+                expected += missing ? " -" : " 127.0.0.1:4242";
+            }
+            requests += '\n';
+            expected += '\n';
+        }
+
+        int reader = connectClient(4096);
+        std::thread sender([&]() {
+            send(reader, requests.data(), requests.size(), MSG_NOSIGNAL);
+        });
+        std::string received;
+        for (size_t reads = 0; received.size() < expected.size(); ++reads) {
+            n = recv(reader, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            received.append(buffer, static_cast<size_t>(n));
+            if (reads % 2 == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Keep the server's sends backed up
+            }
+        }
+        sender.join();
+        EXPECT_EQ(received.size(), expected.size()) << "backend " << static_cast<int>(backend);
+        EXPECT_TRUE(received == expected) << "backend " << static_cast<int>(backend) << ": replies differ from byte "
+                                          << std::mismatch(received.begin(), received.end(), expected.begin(),
+                                                           expected.end()).first - received.begin();
+
+        close(reader);
+        close(user);
+        server.stop();
+        serverThread.join();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Test WebSocket clients on their own listener run the same commands, and
+// survive a hot upgrade together with the listener
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ServesWebSocketClients) {
+    const int port = 9104;  // Arbitrary unused port
+    const int webSocketPort = 9105;
+    const size_t threadCount = 2;
+    const std::string upgradePath = "/tmp/chatserver-test-websocket.sock";
+
+    ServerOptions oldOptions;
+    oldOptions.webSocketPort = webSocketPort;
+    oldOptions.upgradeSocketPath = upgradePath;
+    Server oldServer(port, threadCount, oldOptions);
+    std::thread oldThread([&oldServer]() {
+        oldServer.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto connectClient = [](int clientPort) {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(clientPort);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+        return clientSocket;
+    };
+    auto receive = [](int clientSocket, size_t size) {
+        std::string received;
+        char buffer[256];
+        while (received.size() < size) {
+            ssize_t bytesRead = recv(clientSocket, buffer, std::min(sizeof(buffer), size - received.size()), 0);
+            if (bytesRead <= 0) {
+                break;
+            }
+            received.append(buffer, static_cast<size_t>(bytesRead));
+        }
+        return received;
+    };
+    // Opens a WebSocket session, as a browser would
+    auto upgrade = [&](int clientSocket) {
+        std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        EXPECT_GT(send(clientSocket, request.data(), request.size(), 0), 0);
+        std::string expected = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                               "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+        EXPECT_EQ(receive(clientSocket, expected.size()), expected);
+    };
+    // Sends @p command as one masked text message, returns the reply message's payload
+    auto request = [&](int clientSocket, const std::string& command) {
+        const char key[4] = {'\x01', '\x02', '\x03', '\x04'};
+        std::string frame = {'\x81', static_cast<char>(0x80 | command.size())};
+        frame.append(key, 4);
+        for (size_t i = 0; i < command.size(); ++i) {
+            frame.push_back(static_cast<char>(command[i] ^ key[i % 4]));
+        }
+        EXPECT_GT(send(clientSocket, frame.data(), frame.size(), 0), 0);
+        std::string header = receive(clientSocket, 2);
+        if (header.size() != 2 || header[0] != '\x81') {
+            return std::string();
+        }
+        return receive(clientSocket, static_cast<uint8_t>(header[1]));
+    };
+
+    int client = connectClient(webSocketPort);
+    upgrade(client);
+    EXPECT_EQ(request(client, "REGISTER alice secret"), "OK REGISTERED\n");
+    EXPECT_EQ(request(client, "LOGIN alice secret 0 6000"), "OK LOGIN\n");
+
+    // Plain TCP clients share the users
+    int plain = connectClient(port);
+    ASSERT_GT(send(plain, "GETINFO alice\n", 14, 0), 0);
+    EXPECT_EQ(receive(plain, 18), "OK 127.0.0.1:6000\n");
+    close(plain);
+
+    ServerOptions newOptions;
+    newOptions.takeoverPath = upgradePath;
+    Server newServer(0, threadCount, newOptions);
+    oldThread.join();
+    std::thread newThread([&newServer]() {
+        newServer.start();
+    });
+
+    // The session is still a WebSocket one, and so is the inherited listener
+    EXPECT_EQ(request(client, "GETINFO alice"), "OK 127.0.0.1:6000\n");
+    int another = connectClient(webSocketPort);
+    upgrade(another);
+    EXPECT_EQ(request(another, "PING"), "PONG\n");
+
+    close(client);
+    close(another);
+    newServer.stop();
+    newThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test the stats endpoint reports users and per-command counts in both
+// formats, and keeps serving across a hot upgrade
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ServesStatsOverHttp) {
+    const int port = 9106;  // Arbitrary unused port
+    const int statsPort = 9107;
+    const size_t threadCount = 2;
+    const std::string upgradePath = "/tmp/chatserver-test-stats.sock";
+
+    ServerOptions oldOptions;
+    oldOptions.statsPort = statsPort;
+    oldOptions.upgradeSocketPath = upgradePath;
+    Server oldServer(port, threadCount, oldOptions);
+    std::thread oldThread([&oldServer]() {
+        oldServer.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto connectTo = [](int to) {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(to);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+        return clientSocket;
+    };
+    auto request = [](int clientSocket, const std::string& command) {
+        EXPECT_GT(send(clientSocket, command.data(), command.size(), 0), 0);
+        char buffer[128] = {};
+        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        return bytesRead > 0 ? std::string(buffer, static_cast<size_t>(bytesRead)) : std::string();
+    };
+    auto httpGet = [&](const std::string& path) {
+        int statsSocket = connectTo(statsPort);
+        std::string get = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        EXPECT_GT(send(statsSocket, get.data(), get.size(), 0), 0);
+        std::string response;
+        char buffer[4096];
+        ssize_t bytesRead;
+        while ((bytesRead = recv(statsSocket, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, static_cast<size_t>(bytesRead));
+        }
+        close(statsSocket);
+        return response;
+    };
+
+    int client = connectTo(port);
+    EXPECT_EQ(request(client, "REGISTER alice secret\n"), "OK REGISTERED\n");
+    EXPECT_EQ(request(client, "LOGIN alice secret 0 6000\n"), "OK LOGIN\n");
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(request(client, "GETINFO alice\n"), "OK 127.0.0.1:6000\n");
+    }
+
+    std::string metrics = httpGet("/metrics");
+    EXPECT_TRUE(metrics.starts_with("HTTP/1.1 200 OK\r\n")) << metrics;
+    EXPECT_NE(metrics.find("Content-Type: text/plain; version=0.0.4"), std::string::npos);
+    EXPECT_NE(metrics.find("\nchatroom_connections 1\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("\nchatroom_connections_accepted_total{listener=\"tcp\"} 1\n"), std::string::npos);
+    EXPECT_NE(metrics.find("\nchatroom_users_registered 1\n"), std::string::npos);
+    EXPECT_NE(metrics.find("\nchatroom_users_online 1\n"), std::string::npos);
+    EXPECT_NE(metrics.find("\nchatroom_threadpool_workers 2\n"), std::string::npos);
+    EXPECT_NE(metrics.find("\nchatroom_command_duration_seconds_count{command=\"GETINFO\"} 3\n"),
+              std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("\nchatroom_command_duration_seconds_count{command=\"LOGIN\"} 1\n"),
+              std::string::npos);
+
+    std::string json = httpGet("/stats");
+    EXPECT_TRUE(json.starts_with("HTTP/1.1 200 OK\r\n")) << json;
+    EXPECT_NE(json.find("Content-Type: application/json"), std::string::npos);
+    EXPECT_NE(json.find("\"users\":{\"registered\":1,\"online\":1}"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"GETINFO\":{\"count\":3,"), std::string::npos) << json;
+
+    EXPECT_TRUE(httpGet("/nothing").starts_with("HTTP/1.1 404 Not Found\r\n"));
+
+    // The new server inherits the stats listener along with the clients
+    ServerOptions newOptions;
+    newOptions.takeoverPath = upgradePath;
+    Server newServer(0, threadCount, newOptions);
+    oldThread.join();
+    std::thread newThread([&newServer]() {
+        newServer.start();
+    });
+
+    EXPECT_EQ(request(client, "GETINFO alice\n"), "OK 127.0.0.1:6000\n");
+    metrics = httpGet("/metrics");
+    EXPECT_NE(metrics.find("\nchatroom_users_registered 1\n"), std::string::npos) << metrics;
+    EXPECT_NE(metrics.find("\nchatroom_connections 1\n"), std::string::npos);
+    EXPECT_NE(metrics.find("\nchatroom_command_duration_seconds_count{command=\"GETINFO\"} 1\n"),
+              std::string::npos);
+
+    close(client);
+    newServer.stop();
+    newThread.join();
+}
+
+// -----------------------------------------------------------------------------
+// Test registrations survive a hot upgrade and then a plain restart when
+// the server keeps a data directory
+// -----------------------------------------------------------------------------
+TEST(ServerTest, KeepsUsersAcrossRestarts) {
+    const int port = 9108;  // Arbitrary unused port
+    const size_t threadCount = 2;
+    const std::string upgradePath = "/tmp/chatserver-test-store.sock";
+    const std::string dataDirectory = "/tmp/chatserver-test-data-" + std::to_string(getpid());
+    std::filesystem::remove_all(dataDirectory);
+
+    auto connectClient = [port]() {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+        return clientSocket;
+    };
+    auto request = [](int clientSocket, const std::string& command) {
+        EXPECT_GT(send(clientSocket, command.data(), command.size(), 0), 0);
+        char buffer[128] = {};
+        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        return bytesRead > 0 ? std::string(buffer, static_cast<size_t>(bytesRead)) : std::string();
+    };
+
+    {
+        ServerOptions oldOptions;
+        oldOptions.dataDirectory = dataDirectory;
+        oldOptions.upgradeSocketPath = upgradePath;
+        Server oldServer(port, threadCount, oldOptions);
+        std::thread oldThread([&oldServer]() {
+            oldServer.start();
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        int client = connectClient();
+        EXPECT_EQ(request(client, "REGISTER alice secret\n"), "OK REGISTERED\n");
+
+        // The new process logs to the same directory once it took over
+        ServerOptions newOptions;
+        newOptions.dataDirectory = dataDirectory;
+        newOptions.takeoverPath = upgradePath;
+        Server newServer(0, threadCount, newOptions);
+        oldThread.join();
+        std::thread newThread([&newServer]() {
+            newServer.start();
+        });
+
+        EXPECT_EQ(request(client, "REGISTER bob hunter2\n"), "OK REGISTERED\n");
+        close(client);
+        newServer.stop();
+        newThread.join();
+    }
+
+    // A fresh start loads both from the directory
+    ServerOptions options;
+    options.dataDirectory = dataDirectory;
+    Server server(port, threadCount, options);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    int client = connectClient();
+    EXPECT_EQ(request(client, "REGISTER alice other\n"), "ERR USER_EXISTS\n");
+    EXPECT_EQ(request(client, "LOGIN bob hunter2 0 6000\n"), "OK LOGIN\n");
+
+    close(client);
+    server.stop();
+    serverThread.join();
+    std::filesystem::remove_all(dataDirectory);
+}
+
+#ifdef USE_OPENSSL
+// -----------------------------------------------------------------------------
+// Writes a self-signed certificate and its key for the TLS tests
+// -----------------------------------------------------------------------------
+static void writeTestCertificate(const std::string& certificatePath, const std::string& keyPath) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    ASSERT_NE(key, nullptr);
+    X509* certificate = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+    X509_set_pubkey(certificate, key);
+    X509_NAME_add_entry_by_txt(X509_get_subject_name(certificate), "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(certificate, X509_get_subject_name(certificate));
+    ASSERT_GT(X509_sign(certificate, key, EVP_sha256()), 0);
+    FILE* file = fopen(certificatePath.c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    PEM_write_X509(file, certificate);
+    fclose(file);
+    file = fopen(keyPath.c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    fclose(file);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+}
+
+// -----------------------------------------------------------------------------
+// Test the non-blocking TLS handshake, and that a reconnecting client
+// resumes its session instead of paying for a full handshake
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ResumesTlsSessions) {
+    const int port = 9098;  // Arbitrary unused port
+    const size_t threadCount = 2;
+    const std::string certificatePath = "/tmp/chatserver-test-cert.pem";
+    const std::string keyPath = "/tmp/chatserver-test-key.pem";
+
+    writeTestCertificate(certificatePath, keyPath);
+
+    ServerOptions options;
+    options.tlsCertificatePath = certificatePath;
+    options.tlsPrivateKeyPath = keyPath;
+    Server server(port, threadCount, options);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    SSL_CTX* clientContext = SSL_CTX_new(TLS_client_method());
+    ASSERT_NE(clientContext, nullptr);
+
+    // One TLS client session: PING/PONG, then hand back the session to resume
+    auto pingOverTls = [port, clientContext](SSL_SESSION* resume, bool& reused) -> SSL_SESSION* {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in serverAddr = {};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        timeval timeout = {3, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+            << "Client failed to connect: " << strerror(errno);
+
+        SSL* ssl = SSL_new(clientContext);
+        SSL_set_fd(ssl, clientSocket);
+        if (resume) {
+            SSL_set_session(ssl, resume);
+        }
+        EXPECT_EQ(SSL_connect(ssl), 1);
+        EXPECT_EQ(SSL_write(ssl, "PING\n", 5), 5);
+        char buffer[64] = {};
+        EXPECT_EQ(SSL_read(ssl, buffer, sizeof(buffer) - 1), 5);
+        EXPECT_EQ(std::string(buffer), "PONG\n");
+
+        // TLS 1.3 tickets arrive after the handshake, read along with PONG
+        reused = SSL_session_reused(ssl);
+        SSL_SESSION* session = SSL_get1_session(ssl);
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(clientSocket);
+        return session;
+    };
+
+    bool reused = true;
+    SSL_SESSION* session = pingOverTls(nullptr, reused);
+    ASSERT_NE(session, nullptr);
+    EXPECT_FALSE(reused);
+
+    SSL_SESSION* resumed = pingOverTls(session, reused);
+    EXPECT_TRUE(reused) << "the second handshake was a full one";
+
+    SSL_SESSION_free(resumed);
+    SSL_SESSION_free(session);
+    SSL_CTX_free(clientContext);
+    server.stop();
+    serverThread.join();
+    unlink(certificatePath.c_str());
+    unlink(keyPath.c_str());
+}
+// -----------------------------------------------------------------------------
+// Test a kTLS server answers a burst of commands correctly; with the "tls"
+// kernel module the writes are encrypted by the kernel, without it the
+// server falls back to userspace TLS and must behave the same
+// -----------------------------------------------------------------------------
+TEST(ServerTest, ServesTlsWithKernelOffload) {
+    const int port = 9099;  // Arbitrary unused port
+    const size_t threadCount = 2;
+    const std::string certificatePath = "/tmp/chatserver-test-ktls-cert.pem";
+    const std::string keyPath = "/tmp/chatserver-test-ktls-key.pem";
+    writeTestCertificate(certificatePath, keyPath);
+
+    ServerOptions options;
+    options.tlsCertificatePath = certificatePath;
+    options.tlsPrivateKeyPath = keyPath;
+    options.tlsKernelOffload = true;
+    Server server(port, threadCount, options);
+    std::thread serverThread([&server]() {
+        server.start();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    timeval timeout = {3, 0};
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ASSERT_EQ(connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)), 0)
+        << "Client failed to connect: " << strerror(errno);
+
+    SSL_CTX* clientContext = SSL_CTX_new(TLS_client_method());
+    SSL* ssl = SSL_new(clientContext);
+    SSL_set_fd(ssl, clientSocket);
+    ASSERT_EQ(SSL_connect(ssl), 1);
+
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_EQ(SSL_write(ssl, "PING\n", 5), 5);
+        char buffer[64] = {};
+        ASSERT_EQ(SSL_read(ssl, buffer, sizeof(buffer) - 1), 5) << "response " << i;
+        EXPECT_EQ(std::string(buffer), "PONG\n");
+    }
+
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    SSL_CTX_free(clientContext);
+    close(clientSocket);
+    server.stop();
+    serverThread.join();
+    unlink(certificatePath.c_str());
+    unlink(keyPath.c_str());
+}
+#endif // USE_OPENSSL
+
 // -----------------------------------------------------------------------------
 // Main entry point for Google Test
 // -----------------------------------------------------------------------------
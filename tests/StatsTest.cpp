@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include "Stats.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Test counts from many threads add up over the stripes, each latency
+// landing in its log2 microsecond bucket
+// -----------------------------------------------------------------------------
+TEST(StatsTest, RecordsCommandsFromManyThreads) {
+    ServerStats stats;
+    const size_t threadCount = STATS_STRIPES + 4; // Some threads share a stripe
+    const size_t perThread = 1000;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&stats]() {
+            for (size_t i = 0; i < perThread; ++i) {
+                stats.recordCommand(Command::GetInfo, 3000); // 3 us: bucket "under 4 us"
+            }
+            stats.recordCommand(Command::Ping, 500);          // Under 1 us
+            stats.recordCommand(Command::Login, 10000000000); // 10 s: unbounded
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    stats.recordAccept(false);
+    stats.recordAccept(true);
+    stats.recordAccept(true);
+
+    StatsSnapshot snapshot;
+    stats.collect(snapshot);
+    const CommandStats& getInfo = snapshot.commands[static_cast<size_t>(Command::GetInfo)];
+    EXPECT_EQ(getInfo.count, threadCount * perThread);
+    EXPECT_EQ(getInfo.latencyNs, threadCount * perThread * 3000);
+    EXPECT_EQ(getInfo.buckets[2], threadCount * perThread);
+    EXPECT_EQ(latencyBucketBoundUs(2), 4u);
+    EXPECT_EQ(snapshot.commands[static_cast<size_t>(Command::Ping)].buckets[0], threadCount);
+    EXPECT_EQ(snapshot.commands[static_cast<size_t>(Command::Login)].buckets[LATENCY_BUCKETS - 1], threadCount);
+    EXPECT_EQ(latencyBucketBoundUs(LATENCY_BUCKETS - 1), 0u);
+    EXPECT_EQ(snapshot.commands[static_cast<size_t>(Command::Register)].count, 0u);
+    EXPECT_EQ(snapshot.acceptedTotal, 1u);
+    EXPECT_EQ(snapshot.webSocketAcceptedTotal, 2u);
+}
+
+// -----------------------------------------------------------------------------
+// Test rates cover the commands since the previous sample only
+// -----------------------------------------------------------------------------
+TEST(StatsTest, SamplesRates) {
+    ServerStats stats;
+    uint64_t now = ServerStats::monotonicNs();
+    for (int i = 0; i < 50; ++i) {
+        stats.recordCommand(Command::Ping, 1000);
+    }
+    stats.sample(now + 500000000); // Half a second after construction, at the latest
+
+    for (int i = 0; i < 20; ++i) {
+        stats.recordCommand(Command::Ping, 1000);
+    }
+    stats.sample(now + 2500000000); // Two seconds later
+
+    StatsSnapshot snapshot;
+    stats.collect(snapshot);
+    EXPECT_EQ(snapshot.commands[static_cast<size_t>(Command::Ping)].count, 70u);
+    EXPECT_DOUBLE_EQ(snapshot.commands[static_cast<size_t>(Command::Ping)].ratePerSecond, 10.0);
+    EXPECT_DOUBLE_EQ(snapshot.commands[static_cast<size_t>(Command::GetInfo)].ratePerSecond, 0.0);
+}
+
+// -----------------------------------------------------------------------------
+// Test the Prometheus text: gauges, counters, and cumulative histogram
+// buckets ending in +Inf == _count
+// -----------------------------------------------------------------------------
+TEST(StatsTest, FormatsPrometheus) {
+    StatsSnapshot snapshot;
+    snapshot.connections = 7;
+    snapshot.acceptedTotal = 9;
+    snapshot.webSocketAcceptedTotal = 2;
+    snapshot.queueDepth = 3;
+    snapshot.registeredUsers = 5;
+    CommandStats& getInfo = snapshot.commands[static_cast<size_t>(Command::GetInfo)];
+    getInfo.count = 4;
+    getInfo.latencyNs = 6000;
+    getInfo.buckets[1] = 3;
+    getInfo.buckets[LATENCY_BUCKETS - 1] = 1;
+
+    std::string text = formatStatsPrometheus(snapshot);
+    EXPECT_NE(text.find("# TYPE chatroom_connections gauge\nchatroom_connections 7\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_connections_accepted_total{listener=\"tcp\"} 9\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_connections_accepted_total{listener=\"websocket\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_threadpool_queue_depth 3\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_users_registered 5\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE chatroom_command_duration_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_bucket{command=\"GETINFO\",le=\"1e-06\"} 0\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_bucket{command=\"GETINFO\",le=\"2e-06\"} 3\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_bucket{command=\"GETINFO\",le=\"0.262144\"} 3\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_bucket{command=\"GETINFO\",le=\"+Inf\"} 4\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_sum{command=\"GETINFO\"} 6e-06\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_count{command=\"GETINFO\"} 4\n"), std::string::npos);
+    EXPECT_NE(text.find("chatroom_command_duration_seconds_count{command=\"UNKNOWN\"} 0\n"), std::string::npos);
+}
+
+// -----------------------------------------------------------------------------
+// Test the JSON document carries every section and the estimated quantiles
+// -----------------------------------------------------------------------------
+TEST(StatsTest, FormatsJson) {
+    StatsSnapshot snapshot;
+    snapshot.workers = 4;
+    snapshot.busyWorkers = 1;
+    snapshot.onlineUsers = 2;
+    CommandStats& ping = snapshot.commands[static_cast<size_t>(Command::Ping)];
+    ping.count = 100;
+    ping.latencyNs = 150000;
+    ping.buckets[1] = 98;
+    ping.buckets[5] = 2;
+    ping.ratePerSecond = 12.5;
+
+    std::string json = formatStatsJson(snapshot);
+    EXPECT_EQ(json.front(), '{');
+    EXPECT_NE(json.find("\"thread_pool\":{\"workers\":4,\"busy\":1,\"queue_depth\":0}"), std::string::npos);
+    EXPECT_NE(json.find("\"users\":{\"registered\":0,\"online\":2}"), std::string::npos);
+    EXPECT_NE(json.find("\"PING\":{\"count\":100,\"rate_per_second\":12.5,"
+                        "\"latency_us\":{\"mean\":1.5,\"p50\":2,\"p99\":32,"),
+              std::string::npos) << json;
+    EXPECT_NE(json.find("\"HELLO\":{\"count\":0,\"rate_per_second\":0,"
+                        "\"latency_us\":{\"mean\":0,\"p50\":null,\"p99\":null,"),
+              std::string::npos) << json;
+    EXPECT_NE(json.find("\"+Inf\":0}"), std::string::npos);
+}
+
+// -----------------------------------------------------------------------------
+// Test request routing: both formats, 404 for other paths, 400 for garbage
+// -----------------------------------------------------------------------------
+TEST(StatsTest, AnswersHttpRequests) {
+    StatsSnapshot snapshot;
+
+    std::string json = statsHttpResponse("GET /stats HTTP/1.1\r\nHost: x\r\n\r\n", snapshot);
+    EXPECT_TRUE(json.starts_with("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"));
+    size_t body = json.find("\r\n\r\n") + 4;
+    EXPECT_NE(json.find("Content-Length: " + std::to_string(json.size() - body) + "\r\n"), std::string::npos);
+    EXPECT_NE(json.find("Connection: close\r\n"), std::string::npos);
+
+    std::string metrics = statsHttpResponse("GET /metrics?x=1 HTTP/1.0\r\n\r\n", snapshot);
+    EXPECT_TRUE(metrics.starts_with("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"));
+
+    EXPECT_TRUE(statsHttpResponse("GET / HTTP/1.1\r\n\r\n", snapshot).starts_with("HTTP/1.1 404"));
+    EXPECT_TRUE(statsHttpResponse("POST /stats HTTP/1.1\r\n\r\n", snapshot).starts_with("HTTP/1.1 404"));
+    EXPECT_TRUE(statsHttpResponse("GETINFO alice\n", snapshot).starts_with("HTTP/1.1 400"));
+    EXPECT_TRUE(statsHttpResponse("", snapshot).starts_with("HTTP/1.1 400"));
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -42,8 +42,9 @@ TEST(ThreadPoolTest, HandlesConcurrentEnqueues) {
     // Simulate multiple threads enqueueing tasks
     std::vector<std::thread> enqueueThreads;
     for (size_t i = 0; i < NUM_THREADS; ++i) {
-        enqueueThreads.emplace_back([&pool, &taskCounter, NUM_TASKS]() {
-            for (size_t j = 0; j < NUM_TASKS / NUM_THREADS; ++j) {
+        enqueueThreads.emplace_back([&pool, &taskCounter, i, NUM_TASKS]() {
+            // Stride over the task ids so the remainder is enqueued too
+            for (size_t j = i; j < NUM_TASKS; j += NUM_THREADS) {
                 pool.enqueue([&taskCounter]() {
                     std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Simulate work
                     ++taskCounter;
@@ -90,6 +91,59 @@ TEST(ThreadPoolTest, StopsGracefully) {
     // but new tasks will not start
 }
 
+// -----------------------------------------------------------------------------
+// Test 4: waitIdle() Returns Only After Every Task, Including Nested Ones
+// -----------------------------------------------------------------------------
+TEST(ThreadPoolTest, WaitIdleWaitsForAllTasks) {
+    const size_t NUM_THREADS = 4;
+    const size_t NUM_TASKS = 20;
+
+    ThreadPool pool(NUM_THREADS);
+    std::atomic<int> taskCounter{0};
+
+    for (size_t i = 0; i < NUM_TASKS; ++i) {
+        pool.enqueue([&pool, &taskCounter]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Simulate work
+            // A task that enqueues a follow-up, like a resumed session would
+            pool.enqueue([&taskCounter]() { ++taskCounter; });
+            ++taskCounter;
+        });
+    }
+
+    pool.waitIdle();
+    EXPECT_EQ(taskCounter.load(), 2 * NUM_TASKS);
+}
+
+// -----------------------------------------------------------------------------
+// Test 5: Queue Depth, Delay and Busy Workers Report a Backlog, Then Drop Back to Zero
+// -----------------------------------------------------------------------------
+TEST(ThreadPoolTest, ReportsQueueDepthAndDelay) {
+    ThreadPool pool(1);
+    std::atomic<bool> release{false};
+
+    // Keep the only worker busy so everything else queues up
+    pool.enqueue([&release]() {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 0; i < 5; ++i) {
+        pool.enqueue([]() {});
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(pool.queueDepth(), 5u);
+    EXPECT_GE(pool.queueDelayMs(), 150u);
+    EXPECT_EQ(pool.busyWorkers(), 1u);
+
+    release = true;
+    pool.waitIdle();
+    EXPECT_EQ(pool.queueDepth(), 0u);
+    EXPECT_EQ(pool.queueDelayMs(), 0u);
+    EXPECT_EQ(pool.busyWorkers(), 0u);
+}
+
 // -----------------------------------------------------------------------------
 // Main Function for Google Test
 // -----------------------------------------------------------------------------
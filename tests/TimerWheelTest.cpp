@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include "TimerWheel.h"
+#include <memory>
+#include <random>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Test that a timer fires at its expiry tick, not before
+// -----------------------------------------------------------------------------
+TEST(TimerWheelTest, FiresOnExpiry) {
+    TimerWheel wheel(10, 0);
+    int fired = 0;
+    TimerWheel::Timer timer([&fired]() { ++fired; });
+
+    wheel.schedule(timer, 50);
+    EXPECT_TRUE(timer.armed());
+    EXPECT_EQ(wheel.size(), 1u);
+
+    wheel.advance(49);
+    EXPECT_EQ(fired, 0);
+    wheel.advance(50);
+    EXPECT_EQ(fired, 1);
+    EXPECT_FALSE(timer.armed());
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// -----------------------------------------------------------------------------
+// Test cancel, reschedule and the destructor unlinking armed timers
+// -----------------------------------------------------------------------------
+TEST(TimerWheelTest, CancelsAndReschedules) {
+    TimerWheel wheel(1, 0);
+    int fired = 0;
+    TimerWheel::Timer timer([&fired]() { ++fired; });
+
+    wheel.schedule(timer, 10);
+    timer.cancel();
+    wheel.advance(20);
+    EXPECT_EQ(fired, 0);
+
+    wheel.schedule(timer, 10);
+    wheel.schedule(timer, 100); // Pushes the expiry back
+    wheel.advance(50);
+    EXPECT_EQ(fired, 0);
+    wheel.advance(130);
+    EXPECT_EQ(fired, 1);
+
+    {
+        TimerWheel::Timer scoped([&fired]() { ++fired; });
+        wheel.schedule(scoped, 5);
+    }
+    EXPECT_EQ(wheel.size(), 0u);
+    wheel.advance(200);
+    EXPECT_EQ(fired, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Test that timers on every level fire at the right tick after cascading
+// -----------------------------------------------------------------------------
+TEST(TimerWheelTest, CascadesOuterLevels) {
+    TimerWheel wheel(1, 12345);
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<uint64_t> delays(1, 3000000);
+
+    const size_t COUNT = 20000;
+    std::vector<uint64_t> expected(COUNT);
+    std::vector<uint64_t> actual(COUNT, 0);
+    std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+    uint64_t now = 12345;
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        expected[i] = now + delays(rng);
+        timers.push_back(std::make_unique<TimerWheel::Timer>([&actual, &now, i]() { actual[i] = now; }));
+        wheel.schedule(*timers.back(), expected[i] - now);
+    }
+
+    // Advance in uneven steps, one tick at a time near each step's end
+    while (wheel.size() > 0) {
+        now += (now % 7 == 0) ? 997 : 1;
+        wheel.advance(now);
+    }
+
+    // Big steps fire late by at most the step; single ticks are exact
+    for (size_t i = 0; i < COUNT; ++i) {
+        ASSERT_GE(actual[i], expected[i]) << "timer " << i << " fired early";
+        ASSERT_LT(actual[i] - expected[i], 997u) << "timer " << i << " fired late";
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Test that a callback can re-arm its own timer (periodic timers)
+// -----------------------------------------------------------------------------
+TEST(TimerWheelTest, CallbackCanRearm) {
+    TimerWheel wheel(100, 0);
+    int fired = 0;
+    TimerWheel::Timer timer;
+    timer.setCallback([&]() {
+        if (++fired < 5) {
+            wheel.schedule(timer, 100);
+        }
+    });
+
+    wheel.schedule(timer, 100);
+    EXPECT_EQ(wheel.advance(10000), 5u);
+    EXPECT_EQ(fired, 5);
+    EXPECT_FALSE(timer.armed());
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 #include "UserManager.h"
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 // -----------------------------------------------------------------------------
 // Test User Registration
@@ -8,11 +13,11 @@ TEST(UserManagerTest, RegisterUser) {
     UserManager userManager;
 
     // Register a new user
-    EXPECT_TRUE(userManager.registerUser("alice", "password123"));
+    EXPECT_EQ(userManager.registerUser("alice", "password123"), UserUpdate::Ok);
     // Attempt to register the same user again
-    EXPECT_FALSE(userManager.registerUser("alice", "password123"));
+    EXPECT_EQ(userManager.registerUser("alice", "password123"), UserUpdate::UserExists);
     // Register another user
-    EXPECT_TRUE(userManager.registerUser("bob", "securepass"));
+    EXPECT_EQ(userManager.registerUser("bob", "securepass"), UserUpdate::Ok);
 
     // Check the state of the UserManager
     User* alice = userManager.findUser("alice");
@@ -110,6 +115,289 @@ TEST(UserManagerTest, GetActiveUsers) {
     }));
 }
 
+// -----------------------------------------------------------------------------
+// Test Looking Up a Logged-In User's Address
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, GetUserAddress) {
+    UserManager userManager;
+    userManager.registerUser("alice", "password123");
+    userManager.registerUser("bob", "securepass");
+    userManager.loginUser("alice", "password123", "192.168.1.2", 5001);
+
+    std::string ipAddress = "stale";
+    uint16_t port = 0;
+    EXPECT_TRUE(userManager.getUserAddress(std::string_view("alice-and-more").substr(0, 5), ipAddress, port));
+    EXPECT_EQ(ipAddress, "192.168.1.2");
+    EXPECT_EQ(port, 5001);
+
+    // Registered but not logged in, and unknown, look the same
+    EXPECT_FALSE(userManager.getUserAddress("bob", ipAddress, port));
+    EXPECT_FALSE(userManager.getUserAddress("charlie", ipAddress, port));
+}
+
+// -----------------------------------------------------------------------------
+// Test a batch lookup answers each name in order, reusing its result slots
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, GetUserAddresses) {
+    UserManager userManager;
+    userManager.registerUser("alice", "password123");
+    userManager.registerUser("bob", "securepass");
+    userManager.loginUser("alice", "password123", "192.168.1.2", 5001);
+    userManager.loginUser("bob", "securepass", "10.0.0.3", 6002);
+
+    std::vector<UserAddress> addresses(5);
+    addresses[1].found = true; // Stale results are overwritten
+    std::vector<std::string_view> usernames = {"bob", "charlie", "alice", "bob"};
+    EXPECT_EQ(userManager.getUserAddresses(usernames, addresses), 3u);
+    ASSERT_EQ(addresses.size(), 4u);
+    EXPECT_TRUE(addresses[0].found);
+    EXPECT_EQ(addresses[0].ipAddress, "10.0.0.3");
+    EXPECT_EQ(addresses[0].port, 6002);
+    EXPECT_FALSE(addresses[1].found);
+    EXPECT_EQ(addresses[2].ipAddress, "192.168.1.2");
+    EXPECT_EQ(addresses[2].port, 5001);
+    EXPECT_EQ(addresses[3].port, 6002);
+
+    userManager.logoutUser("bob");
+    EXPECT_EQ(userManager.getUserAddresses(usernames, addresses), 1u);
+    EXPECT_FALSE(addresses[0].found);
+    EXPECT_TRUE(addresses[2].found);
+}
+
+// -----------------------------------------------------------------------------
+// Test the lock-free table sizes follow registration, login, logout and restore
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, CountsUsers) {
+    UserManager userManager;
+    userManager.registerUser("alice", "password123");
+    userManager.registerUser("bob", "securepass");
+    userManager.registerUser("alice", "again");
+    EXPECT_EQ(userManager.userCount(), 2u);
+    EXPECT_EQ(userManager.onlineCount(), 0u);
+
+    userManager.loginUser("alice", "password123", "192.168.1.2", 5001);
+    userManager.loginUser("alice", "password123", "192.168.1.2", 5002); // Already online
+    userManager.loginUser("bob", "wrong", "10.0.0.3", 6002);
+    EXPECT_EQ(userManager.onlineCount(), 1u);
+
+    userManager.logoutUser("alice");
+    userManager.logoutUser("alice");
+    EXPECT_EQ(userManager.onlineCount(), 0u);
+
+    User carol = {"carol", "hashed_x", "10.0.0.4", 7000, true};
+    userManager.restoreUsers({carol, User{"dave", "hashed_y", "", 0, false}});
+    EXPECT_EQ(userManager.userCount(), 2u);
+    EXPECT_EQ(userManager.onlineCount(), 1u);
+    ASSERT_EQ(userManager.getActiveUsers().size(), 1u);
+    EXPECT_EQ(userManager.getActiveUsers()[0].username, "carol");
+}
+
+// -----------------------------------------------------------------------------
+// Test session handles: closing one logs its user out exactly once, and a
+// newer login (or a logout by name) leaves older handles stale
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, BindsSessionsToHandles) {
+    UserManager userManager;
+    userManager.registerUser("alice", "password123");
+
+    EXPECT_FALSE(userManager.openSession("alice", "wrong", "192.168.1.2", 5001));
+    EXPECT_FALSE(userManager.openSession("charlie", "password123", "192.168.1.2", 5001));
+    EXPECT_FALSE(userManager.closeSession(UserHandle()));
+
+    UserHandle first = userManager.openSession("alice", "password123", "192.168.1.2", 5001);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first.username(), "alice");
+    EXPECT_EQ(first.key(), std::hash<std::string>()("alice"));
+    EXPECT_TRUE(userManager.findUser("alice")->isLoggedIn);
+
+    // Logged in again elsewhere: the old connection's close must not log the new one out
+    UserHandle second = userManager.openSession("alice", "password123", "10.0.0.7", 6001);
+    EXPECT_FALSE(userManager.closeSession(first));
+    EXPECT_EQ(userManager.findUser("alice")->port, 6001);
+    EXPECT_EQ(userManager.onlineCount(), 1u);
+
+    EXPECT_TRUE(userManager.closeSession(second));
+    EXPECT_FALSE(userManager.closeSession(second));
+    EXPECT_FALSE(userManager.findUser("alice")->isLoggedIn);
+    EXPECT_EQ(userManager.onlineCount(), 0u);
+
+    // After a hot upgrade the adopted connection resumes the current session
+    EXPECT_FALSE(userManager.resumeSession("alice"));
+    userManager.loginUser("alice", "password123", "192.168.1.2", 5001);
+    UserHandle resumed = userManager.resumeSession("alice");
+    ASSERT_TRUE(resumed);
+    EXPECT_TRUE(userManager.logoutUser("alice"));
+    EXPECT_FALSE(userManager.closeSession(resumed));
+}
+
+// -----------------------------------------------------------------------------
+// Test any shard count holds the same table: threads registering and
+// logging in disjoint users concurrently, then a batch lookup and the
+// listings spanning every shard
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, ShardsTheTable) {
+    for (size_t shards : {size_t(0), size_t(1), size_t(7), USER_SHARDS, size_t(1000)}) {
+        UserManager userManager(shards);
+        const size_t threadCount = 8;
+        const size_t perThread = 100;
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&userManager, t]() {
+                for (size_t i = 0; i < perThread; ++i) {
+                    std::string name = "user" + std::to_string(t * perThread + i);
+                    userManager.registerUser(name, "pw");
+                    if (i % 2 == 0) {
+                        userManager.loginUser(name, "pw", "10.0.0.1", static_cast<uint16_t>(i));
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        EXPECT_EQ(userManager.userCount(), threadCount * perThread);
+        EXPECT_EQ(userManager.onlineCount(), threadCount * perThread / 2);
+        EXPECT_EQ(userManager.getAllUsers().size(), threadCount * perThread);
+        EXPECT_EQ(userManager.getActiveUsers().size(), threadCount * perThread / 2);
+
+        std::vector<std::string> names;
+        for (size_t i = 0; i < 40; ++i) {
+            names.push_back("user" + std::to_string(i * 13));
+        }
+        names.push_back("nobody");
+        std::vector<std::string_view> views(names.begin(), names.end());
+        std::vector<UserAddress> addresses;
+        size_t expected = 0;
+        for (size_t i = 0; i < names.size(); ++i) {
+            expected += (i * 13) % perThread % 2 == 0 && i < 40;
+        }
+        EXPECT_EQ(userManager.getUserAddresses(views, addresses), expected);
+        for (size_t i = 0; i < 40; ++i) {
+            bool online = (i * 13) % perThread % 2 == 0;
+            EXPECT_EQ(addresses[i].found, online) << names[i];
+            if (online) {
+                EXPECT_EQ(addresses[i].port, (i * 13) % perThread);
+            }
+        }
+        EXPECT_FALSE(addresses.back().found);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Test the online index follows logins and logouts, and a listing pages
+// through exactly the users online when it was taken, whatever happens
+// meanwhile
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, PagesThroughOnlineUsers) {
+    UserManager userManager(3);
+    for (int i = 0; i < 100; ++i) {
+        std::string name = "user" + std::to_string(i);
+        userManager.registerUser(name, "pw");
+        if (i % 2 == 0) {
+            userManager.loginUser(name, "pw", "10.0.0.1", static_cast<uint16_t>(i));
+        }
+    }
+    userManager.loginUser("user0", "pw", "10.0.0.2", 1000); // Again: listed once
+    userManager.logoutUser("user10");
+    EXPECT_EQ(userManager.getActiveUsers().size(), 49u);
+
+    OnlineUsers listing = userManager.onlineUsers();
+    ASSERT_EQ(listing.size(), 49u);
+    userManager.logoutUser("user20");                      // Left out of its page
+    userManager.loginUser("user1", "pw", "10.0.0.3", 1);  // Not in the listing
+    userManager.loginUser("user30", "pw", "10.0.0.4", 30); // Listed with the new address
+
+    std::set<std::string> seen;
+    std::vector<OnlineUser> page;
+    size_t pages = 0;
+    for (size_t cursor = 0; cursor < listing.size(); ++pages) {
+        cursor = listing.page(cursor, 10, page);
+        EXPECT_LE(page.size(), 10u);
+        for (const OnlineUser& user : page) {
+            EXPECT_TRUE(seen.insert(user.username).second) << user.username;
+            if (user.username == "user30") {
+                EXPECT_EQ(user.ipAddress, "10.0.0.4");
+            }
+        }
+    }
+    EXPECT_EQ(pages, 5u);
+    EXPECT_EQ(seen.size(), 48u);
+    EXPECT_EQ(seen.count("user0"), 1u);
+    EXPECT_EQ(seen.count("user10"), 0u);
+    EXPECT_EQ(seen.count("user20"), 0u);
+    EXPECT_EQ(seen.count("user1"), 0u);
+
+    EXPECT_EQ(listing.page(listing.size(), 10, page), listing.size());
+    EXPECT_TRUE(page.empty());
+    EXPECT_EQ(userManager.onlineUsers().size(), 49u);
+    EXPECT_EQ(userManager.getActiveUsers().size(), 49u);
+}
+
+// -----------------------------------------------------------------------------
+// Test lock-free lookups against writers: readers always see an address
+// whole (its IP encodes its port) while logins replace it and registrations
+// grow the index under them
+// -----------------------------------------------------------------------------
+TEST(UserManagerTest, ReadsWhileWritersPublish) {
+    UserManager userManager(2);
+    userManager.registerUser("alice", "pw");
+    userManager.loginUser("alice", "pw", "10.0.0.0", 0);
+
+    std::atomic_bool stop{false};
+    std::atomic<size_t> lookups{0};
+    std::atomic<size_t> torn{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&]() {
+            std::string ipAddress;
+            uint16_t port;
+            while (!stop) {
+                if (userManager.getUserAddress("alice", ipAddress, port)) {
+                    torn += ipAddress != "10.0." + std::to_string(port / 256) + "." + std::to_string(port % 256);
+                }
+                lookups++;
+            }
+        });
+    }
+    std::thread registrar([&]() {
+        for (int i = 0; i < 2000; ++i) {
+            userManager.registerUser("user" + std::to_string(i), "pw");
+        }
+    });
+    while (lookups < readers.size()) {
+        std::this_thread::yield();
+    }
+    for (uint16_t port = 1; port < 5000; ++port) {
+        if (port % 64 == 0) {
+            std::this_thread::yield(); // Let readers in between writes even on one CPU
+        }
+        UserHandle session = userManager.openSession("alice", "pw",
+                                                     "10.0." + std::to_string(port / 256) + "." +
+                                                         std::to_string(port % 256),
+                                                     port);
+        if (port % 7 == 0) {
+            userManager.closeSession(session);
+        }
+    }
+    registrar.join();
+    stop = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_GT(lookups.load(), 0u);
+    EXPECT_EQ(torn.load(), 0u);
+    EXPECT_EQ(userManager.userCount(), 2001u);
+    std::string ipAddress;
+    uint16_t port;
+    ASSERT_TRUE(userManager.getUserAddress("alice", ipAddress, port));
+    EXPECT_EQ(port, 4999);
+    EXPECT_TRUE(userManager.getUserAddress("user1999", ipAddress, port) == false);
+    EXPECT_NE(userManager.findUser("user1999"), nullptr);
+}
+
 // -----------------------------------------------------------------------------
 // Main Function for Google Test
 // -----------------------------------------------------------------------------
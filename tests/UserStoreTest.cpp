@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+#include "UserManager.h"
+#include "UserStore.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <sys/resource.h> // For setrlimit
+#include <unistd.h> // For truncate
+
+namespace {
+// A fresh, empty data directory per test
+class UserStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        directory_ = std::filesystem::temp_directory_path() /
+                     ("chatserver-test-store-" + std::to_string(getpid()) + "-" +
+                      ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        std::filesystem::remove_all(directory_);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(directory_); }
+
+    std::string file(const std::string& name) const { return (directory_ / name).string(); }
+
+    // The names of the logs in the directory, oldest first
+    std::vector<std::string> logs() const
+    {
+        std::vector<std::string> names;
+        for (const auto& entry : std::filesystem::directory_iterator(directory_)) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("users.wal.", 0) == 0) {
+                names.push_back(name);
+            }
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    std::filesystem::path directory_;
+};
+
+// Caps the size of the files the process may write, so appending to a log
+// already that long fails as on a full disk
+class FileSizeLimit {
+public:
+    explicit FileSizeLimit(uintmax_t bytes)
+    {
+        signal(SIGXFSZ, SIG_IGN); // The write fails with EFBIG instead
+        getrlimit(RLIMIT_FSIZE, &saved_);
+        rlimit limit = {static_cast<rlim_t>(bytes), saved_.rlim_max};
+        setrlimit(RLIMIT_FSIZE, &limit);
+    }
+    ~FileSizeLimit() { setrlimit(RLIMIT_FSIZE, &saved_); }
+
+private:
+    rlimit saved_;
+};
+}
+
+// -----------------------------------------------------------------------------
+// Test the CRC against the standard check value of CRC-32C
+// -----------------------------------------------------------------------------
+TEST(Crc32cTest, MatchesCheckValue) {
+    EXPECT_EQ(crc32c("123456789", 9), 0xe3069283u);
+    EXPECT_EQ(crc32c("", 0), 0u);
+
+    // Continuing from a partial CRC gives the CRC of the whole
+    std::string text(1000, 'x');
+    for (size_t i = 0; i < text.size(); ++i) {
+        text[i] = static_cast<char>(i * 7);
+    }
+    EXPECT_EQ(crc32c(text.data() + 13, text.size() - 13, crc32c(text.data(), 13)), crc32c(text.data(), text.size()));
+}
+
+// -----------------------------------------------------------------------------
+// Test registrations and password changes survive a restart through the
+// log alone, and logins are not persisted
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, ReplaysTheLog) {
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        EXPECT_EQ(userManager.registerUser("alice", "password123"), UserUpdate::Ok);
+        EXPECT_EQ(userManager.registerUser("bob", "securepass"), UserUpdate::Ok);
+        EXPECT_EQ(userManager.changePassword("bob", "newpass"), UserUpdate::Ok);
+        EXPECT_EQ(userManager.changePassword("carol", "whatever"), UserUpdate::UserNotFound);
+        EXPECT_TRUE(userManager.loginUser("alice", "password123", "10.0.0.1", 6000));
+        EXPECT_GT(userManager.storeLogBytes(), 0u);
+    }
+
+    UserManager userManager;
+    ASSERT_TRUE(userManager.openStore(directory_.string()));
+    EXPECT_EQ(userManager.userCount(), 2u);
+    EXPECT_EQ(userManager.onlineCount(), 0u);
+    EXPECT_EQ(userManager.registerUser("alice", "again"), UserUpdate::UserExists);
+    EXPECT_TRUE(userManager.loginUser("alice", "password123", "10.0.0.2", 6001));
+    EXPECT_FALSE(userManager.loginUser("bob", "securepass", "10.0.0.3", 6002));
+    EXPECT_TRUE(userManager.loginUser("bob", "newpass", "10.0.0.3", 6002));
+}
+
+// -----------------------------------------------------------------------------
+// Test a snapshot replaces the log it covers and loads back whatever the
+// shard count of the loading table, with later changes replayed over it
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, LoadsSnapshotAndLaterLog) {
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        for (int i = 0; i < 1000; ++i) {
+            ASSERT_EQ(userManager.registerUser("user" + std::to_string(i), "pw" + std::to_string(i)), UserUpdate::Ok);
+        }
+        ASSERT_TRUE(userManager.writeSnapshot());
+        EXPECT_EQ(userManager.storeLogBytes(), 0u);
+        EXPECT_EQ(userManager.registerUser("late", "pw"), UserUpdate::Ok);
+        EXPECT_EQ(userManager.changePassword("user7", "changed"), UserUpdate::Ok);
+    }
+    EXPECT_TRUE(std::filesystem::exists(file("users.snapshot")));
+    EXPECT_EQ(logs(), std::vector<std::string>{"users.wal.2"});
+
+    for (size_t shards : {USER_SHARDS, size_t(1), size_t(7)}) {
+        UserManager userManager(shards);
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        EXPECT_EQ(userManager.userCount(), 1001u) << shards;
+        for (int i = 0; i < 1000; i += 97) {
+            std::string password = i == 7 ? "changed" : "pw" + std::to_string(i);
+            EXPECT_TRUE(userManager.loginUser("user" + std::to_string(i), password, "10.0.0.1", 6000)) << i;
+        }
+        EXPECT_FALSE(userManager.loginUser("user7", "pw7", "10.0.0.1", 6000));
+        EXPECT_TRUE(userManager.loginUser("late", "pw", "10.0.0.1", 6000));
+        EXPECT_EQ(userManager.registerUser("user999", "pw"), UserUpdate::UserExists);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Test a change the log refuses is reported as a storage error, not as a
+// taken name, and leaves the table alone
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, ReportsUnloggableChangeAsStorageError) {
+    UserManager userManager;
+    ASSERT_TRUE(userManager.openStore(directory_.string()));
+    std::string tooLong(MAX_STORED_FIELD + 1, 'x');
+    EXPECT_EQ(userManager.registerUser(tooLong, "pw"), UserUpdate::StorageError);
+    EXPECT_EQ(userManager.findUser(tooLong), nullptr);
+    EXPECT_EQ(userManager.userCount(), 0u);
+    EXPECT_EQ(userManager.registerUser("alice", "pw"), UserUpdate::Ok);
+}
+
+// -----------------------------------------------------------------------------
+// Test a batch that cannot be written fails its callers with a storage
+// error, leaves the table as it was, and makes the log refuse what follows
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, FailsCallersOfAFailedBatch) {
+    UserManager userManager;
+    ASSERT_TRUE(userManager.openStore(directory_.string()));
+    ASSERT_EQ(userManager.registerUser("alice", "pw"), UserUpdate::Ok);
+    {
+        FileSizeLimit limit(std::filesystem::file_size(file("users.wal.1")));
+        EXPECT_EQ(userManager.registerUser("bob", "pw"), UserUpdate::StorageError);
+    }
+    EXPECT_EQ(userManager.findUser("bob"), nullptr);
+    EXPECT_EQ(userManager.userCount(), 1u);
+    EXPECT_FALSE(userManager.loginUser("bob", "pw", "10.0.0.1", 6000));
+
+    EXPECT_EQ(userManager.registerUser("bob", "pw"), UserUpdate::StorageError);
+    EXPECT_EQ(userManager.registerUser("alice", "pw"), UserUpdate::UserExists);
+    EXPECT_EQ(userManager.changePassword("alice", "new"), UserUpdate::StorageError);
+    EXPECT_TRUE(userManager.loginUser("alice", "pw", "10.0.0.1", 6000));
+    EXPECT_FALSE(userManager.writeSnapshot());
+}
+
+// -----------------------------------------------------------------------------
+// Test a record cut short by a crash is dropped and cut off, so the next
+// registration is not lost behind it
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, TruncatesTornTail) {
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        EXPECT_EQ(userManager.registerUser("alice", "password123"), UserUpdate::Ok);
+        EXPECT_EQ(userManager.registerUser("bob", "securepass"), UserUpdate::Ok);
+    }
+    std::string log = file("users.wal.1");
+    uintmax_t size = std::filesystem::file_size(log);
+    ASSERT_EQ(truncate(log.c_str(), static_cast<off_t>(size - 3)), 0);
+
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        EXPECT_EQ(userManager.userCount(), 1u);
+        EXPECT_NE(userManager.findUser("alice"), nullptr);
+        EXPECT_EQ(userManager.findUser("bob"), nullptr);
+        EXPECT_EQ(userManager.registerUser("carol", "pw"), UserUpdate::Ok);
+    }
+
+    UserManager userManager;
+    ASSERT_TRUE(userManager.openStore(directory_.string()));
+    EXPECT_EQ(userManager.userCount(), 2u);
+    EXPECT_NE(userManager.findUser("carol"), nullptr);
+}
+
+// -----------------------------------------------------------------------------
+// Test a crash in the middle of a snapshot: the half-written file is
+// ignored and the sealed log still counts, then the next snapshot drops it
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, SurvivesCrashDuringSnapshot) {
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        EXPECT_EQ(userManager.registerUser("alice", "password123"), UserUpdate::Ok);
+    }
+    // As if a snapshot had sealed log 1, started log 2 and died writing
+    std::ofstream(file("users.snapshot.tmp")) << "partial";
+    std::ofstream(file("users.wal.2")).close();
+
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        EXPECT_FALSE(std::filesystem::exists(file("users.snapshot.tmp")));
+        EXPECT_NE(userManager.findUser("alice"), nullptr);
+        EXPECT_EQ(userManager.registerUser("bob", "securepass"), UserUpdate::Ok);
+        ASSERT_TRUE(userManager.writeSnapshot());
+        EXPECT_EQ(logs(), std::vector<std::string>{"users.wal.3"});
+    }
+
+    UserManager userManager;
+    ASSERT_TRUE(userManager.openStore(directory_.string()));
+    EXPECT_EQ(userManager.userCount(), 2u);
+}
+
+// -----------------------------------------------------------------------------
+// Test a damaged snapshot fails the open instead of starting without users
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, RefusesCorruptSnapshot) {
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string()));
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_EQ(userManager.registerUser("user" + std::to_string(i), "pw"), UserUpdate::Ok);
+        }
+        ASSERT_TRUE(userManager.writeSnapshot());
+    }
+    std::string snapshot = file("users.snapshot");
+    {
+        std::fstream stream(snapshot, std::ios::in | std::ios::out | std::ios::binary);
+        stream.seekp(static_cast<std::streamoff>(std::filesystem::file_size(snapshot) - 5));
+        stream.put('!');
+    }
+
+    UserManager userManager;
+    EXPECT_FALSE(userManager.openStore(directory_.string()));
+}
+
+// -----------------------------------------------------------------------------
+// Test concurrent registrations are group-committed: every caller returns
+// with its record on disk, also while a snapshot rotates the log and with
+// a batch delay holding batches open
+// -----------------------------------------------------------------------------
+TEST_F(UserStoreTest, GroupCommitsConcurrentRegistrations) {
+    constexpr int THREADS = 8;
+    constexpr int USERS_PER_THREAD = 200;
+    UserLogOptions options;
+    options.maxBatchDelayUs = 200;
+    {
+        UserManager userManager;
+        ASSERT_TRUE(userManager.openStore(directory_.string(), true, options));
+        std::vector<std::thread> threads;
+        std::vector<int> registered(THREADS, 0);
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < USERS_PER_THREAD; ++i) {
+                    std::string name = "user" + std::to_string(t) + "-" + std::to_string(i);
+                    if (userManager.registerUser(name, "pw") == UserUpdate::Ok) {
+                        ++registered[t];
+                    }
+                }
+            });
+        }
+        ASSERT_TRUE(userManager.writeSnapshot());
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (int t = 0; t < THREADS; ++t) {
+            EXPECT_EQ(registered[t], USERS_PER_THREAD) << t;
+        }
+        EXPECT_EQ(userManager.changePassword("user3-7", "changed"), UserUpdate::Ok);
+
+        // Returned means written: a second store reads it all back while
+        // the first still has the log open
+        UserManager reader;
+        ASSERT_TRUE(reader.openStore(directory_.string(), true, options));
+        EXPECT_EQ(reader.userCount(), static_cast<size_t>(THREADS * USERS_PER_THREAD));
+        EXPECT_TRUE(reader.loginUser("user3-7", "changed", "10.0.0.1", 6000));
+    }
+
+    UserManager userManager;
+    ASSERT_TRUE(userManager.openStore(directory_.string()));
+    EXPECT_EQ(userManager.userCount(), static_cast<size_t>(THREADS * USERS_PER_THREAD));
+}
+
+// -----------------------------------------------------------------------------
+// Main Function for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include "WebSocket.h"
+#include "DelimiterScan.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// Every level this CPU can run
+std::vector<ScanLevel> supportedLevels()
+{
+    std::vector<ScanLevel> levels = {ScanLevel::Scalar};
+    if (detectScanLevel() != ScanLevel::Scalar) {
+        levels.push_back(ScanLevel::Sse2);
+    }
+    if (detectScanLevel() == ScanLevel::Avx2) {
+        levels.push_back(ScanLevel::Avx2);
+    }
+    return levels;
+}
+
+// A client frame: masked with @p key, as browsers send them
+std::string clientFrame(uint8_t firstByte, const std::string& payload, const char key[4] = "\x11\x22\x33\x44")
+{
+    std::string frame(1, static_cast<char>(firstByte));
+    if (payload.size() < 126) {
+        frame.push_back(static_cast<char>(0x80 | payload.size()));
+    } else {
+        frame.push_back(static_cast<char>(0x80 | 126));
+        frame.push_back(static_cast<char>(payload.size() >> 8));
+        frame.push_back(static_cast<char>(payload.size()));
+    }
+    frame.append(key, 4);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        frame.push_back(static_cast<char>(payload[i] ^ key[i % 4]));
+    }
+    return frame;
+}
+
+const std::string UPGRADE_REQUEST =
+    "GET /chat HTTP/1.1\r\n"
+    "Host: server.example.com\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: keep-alive, Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test the accept value against the example in RFC 6455, section 1.3
+// -----------------------------------------------------------------------------
+TEST(WebSocketTest, ComputesAcceptKey) {
+    EXPECT_EQ(webSocketAccept("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+// -----------------------------------------------------------------------------
+// Test which upgrade requests are accepted; header names and tokens are
+// case-insensitive
+// -----------------------------------------------------------------------------
+TEST(WebSocketTest, ParsesUpgradeRequests) {
+    std::string_view key;
+    ASSERT_TRUE(parseUpgradeRequest(UPGRADE_REQUEST, key));
+    EXPECT_EQ(key, "dGhlIHNhbXBsZSBub25jZQ==");
+
+    std::string lowerCase = UPGRADE_REQUEST;
+    lowerCase.replace(lowerCase.find("Upgrade: websocket"), 18, "upgrade: WebSocket");
+    EXPECT_TRUE(parseUpgradeRequest(lowerCase, key));
+
+    auto without = [](const std::string& header) {
+        std::string request = UPGRADE_REQUEST;
+        size_t start = request.find(header);
+        return request.erase(start, request.find("\r\n", start) + 2 - start);
+    };
+    EXPECT_FALSE(parseUpgradeRequest(without("Upgrade:"), key));
+    EXPECT_FALSE(parseUpgradeRequest(without("Connection:"), key));
+    EXPECT_FALSE(parseUpgradeRequest(without("Sec-WebSocket-Key:"), key));
+    EXPECT_FALSE(parseUpgradeRequest(without("Sec-WebSocket-Version:"), key));
+
+    std::string post = UPGRADE_REQUEST;
+    post.replace(0, 3, "POST");
+    EXPECT_FALSE(parseUpgradeRequest(post, key));
+    EXPECT_FALSE(parseUpgradeRequest("GETINFO alice\r\n\r\n", key));
+}
+
+// -----------------------------------------------------------------------------
+// Test each level unmasks like the byte-at-a-time reference, at every
+// length around the 16/32-byte vector widths and every start alignment
+// -----------------------------------------------------------------------------
+TEST(WebSocketTest, UnmasksAtEveryLevel) {
+    std::mt19937 random(7);
+    const char key[4] = {'\x5a', '\xc3', '\x01', '\xff'};
+    std::string original(200, '\0');
+    for (char& c : original) {
+        c = static_cast<char>(random());
+    }
+
+    for (ScanLevel level : supportedLevels()) {
+        ASSERT_EQ(setScanLevel(level), level);
+        for (size_t offset = 0; offset < 8; ++offset) {
+            for (size_t size = 0; size + offset <= original.size(); size += 3) {
+                std::string data = original;
+                unmaskPayload(data.data() + offset, size, key);
+                for (size_t i = 0; i < data.size(); ++i) {
+                    char expected = original[i];
+                    if (i >= offset && i < offset + size) {
+                        expected = static_cast<char>(expected ^ key[(i - offset) % 4]);
+                    }
+                    ASSERT_EQ(data[i], expected) << "level " << static_cast<int>(level) << " offset " << offset
+                                                 << " size " << size << " byte " << i;
+                }
+            }
+        }
+    }
+    setScanLevel(detectScanLevel());
+}
+
+// -----------------------------------------------------------------------------
+// Test frames are decoded in place, one byte at a time as well as
+// coalesced, with 7- and 16-bit lengths
+// -----------------------------------------------------------------------------
+TEST(WebSocketTest, DecodesSplitAndCoalescedFrames) {
+    std::string longPayload(300, 'x');
+    std::string stream = clientFrame(0x81, "GETINFO alice") + clientFrame(0x01, "PI") +
+                         clientFrame(0x80, "NG") + clientFrame(0x89, "") + clientFrame(0x81, longPayload);
+
+    RingBuffer ring;
+    WsFrameParser parser;
+    WsFrame frame;
+    std::vector<std::pair<WsFrame, std::string>> frames;
+    for (char c : stream) {
+        ring.append(&c, 1);
+        while (parser.next(ring, frame) == WsFrameParser::Result::Frame) {
+            frames.emplace_back(frame, std::string(frame.payload));
+        }
+    }
+
+    ASSERT_EQ(frames.size(), 5u);
+    EXPECT_EQ(frames[0].first.opcode, WsOpcode::Text);
+    EXPECT_TRUE(frames[0].first.fin);
+    EXPECT_EQ(frames[0].second, "GETINFO alice");
+    EXPECT_FALSE(frames[1].first.fin);
+    EXPECT_EQ(frames[1].second, "PI");
+    EXPECT_EQ(frames[2].first.opcode, WsOpcode::Continuation);
+    EXPECT_EQ(frames[2].second, "NG");
+    EXPECT_EQ(frames[3].first.opcode, WsOpcode::Ping);
+    EXPECT_EQ(frames[4].second, longPayload);
+    EXPECT_TRUE(ring.empty());
+}
+
+// -----------------------------------------------------------------------------
+// Test frames the server must refuse
+// -----------------------------------------------------------------------------
+TEST(WebSocketTest, RejectsInvalidFrames) {
+    auto parse = [](const std::string& bytes) {
+        RingBuffer ring;
+        ring.append(bytes.data(), bytes.size());
+        WsFrame frame;
+        return WsFrameParser().next(ring, frame);
+    };
+
+    EXPECT_EQ(parse(std::string("\x81\x02hi", 4)), WsFrameParser::Result::Error);           // Unmasked
+    EXPECT_EQ(parse(clientFrame(0xC1, "hi")), WsFrameParser::Result::Error);               // RSV1 set
+    EXPECT_EQ(parse(clientFrame(0x83, "hi")), WsFrameParser::Result::Error);               // Reserved opcode
+    EXPECT_EQ(parse(clientFrame(0x09, "hi")), WsFrameParser::Result::Error);               // Fragmented ping
+    EXPECT_EQ(parse(clientFrame(0x89, std::string(126, 'p'))), WsFrameParser::Result::Error); // Long ping
+    EXPECT_EQ(parse(std::string("\x81\xff\x00\x00\x00\x00\x00\x20\x00\x00", 10)),         // 2 MiB
+              WsFrameParser::Result::TooLarge);
+    EXPECT_EQ(parse(clientFrame(0x81, "hi").substr(0, 5)), WsFrameParser::Result::NeedMore);
+}
+
+// -----------------------------------------------------------------------------
+// Test server frame headers pick the shortest length encoding
+// -----------------------------------------------------------------------------
+TEST(WebSocketTest, WritesServerHeaders) {
+    char header[MAX_WS_HEADER_SIZE];
+    ASSERT_EQ(writeWsHeader(header, WsOpcode::Text, 125), 2u);
+    EXPECT_EQ(std::string(header, 2), "\x81\x7d");
+    ASSERT_EQ(writeWsHeader(header, WsOpcode::Pong, 126), 4u);
+    EXPECT_EQ(std::string(header, 4), std::string("\x8a\x7e\x00\x7e", 4));
+    ASSERT_EQ(writeWsHeader(header, WsOpcode::Text, 65536), 10u);
+    EXPECT_EQ(std::string(header, 10), std::string("\x81\x7f\x00\x00\x00\x00\x00\x01\x00\x00", 10));
+}
+
+// -----------------------------------------------------------------------------
+// Main entry point for Google Test
+// -----------------------------------------------------------------------------
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}